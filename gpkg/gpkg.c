@@ -11,19 +11,62 @@
 ** 1.0.1 - 2021-03-18 - Corrected bug in isEmptyGPKGGeometry
 ** 1.0.2 - 2021-05-01 - Added support for version 1.3
 ** 1.0.3 - 2021-06-29 - Bug where removing an GPKG extension
+** 1.0.4 - 2026-10-17 - Added 3D spatial index and GPKG_SpatialWindow
+** 1.0.5 - 2026-10-17 - Added point index (GPKG_AddPointIndex, GPKG_PointWindow, GPKG_PointKNN), ST_X and ST_Y
+** 1.0.6 - 2026-10-17 - Added GPKG_SpatialJoin, ST_Intersects, ST_Contains and ST_Within
+** 1.0.7 - 2026-10-17 - Added GPKG_PointsInPolygons
+** 1.0.8 - 2026-10-17 - Added GPKG_NearestJoin and ST_Distance
+** 1.0.9 - 2026-10-17 - Added spatial histograms (GPKG_AnalyzeSpatial, GPKG_EstimateCount)
+** 1.0.10 - 2026-10-17 - Added GPKG_Layer virtual table
+** 1.0.11 - 2026-10-17 - Added ST_Subdivide
+** 1.0.12 - 2026-10-17 - Added segment index (GPKG_AddSegmentIndex, GPKG_DropSegmentIndex) used by ST_Intersects and ST_Contains
+** 1.0.13 - 2026-10-17 - Added ST_GeoHash, ST_QuadKey and GPKG_GridCount
+** 1.0.14 - 2026-10-17 - Added point overviews (GPKG_CreatePointOverview, GPKG_DropPointOverview)
+** 1.0.15 - 2026-10-17 - Added dirty-region tracking (GPKG_EnableDirtyTracking, GPKG_DisableDirtyTracking, GPKG_DirtyTiles)
+** 1.0.16 - 2026-10-17 - Added change logs (GPKG_EnableChangeLog, GPKG_DisableChangeLog, GPKG_ChangesSince)
+** 1.0.17 - 2026-10-17 - Added GPKG_DeleteInBox and GPKG_TranslateInBox
+** 1.0.18 - 2026-10-17 - Added GPKG_TransformInPlace
+** 1.0.19 - 2026-10-17 - Added ST_Transform
+** 1.0.20 - 2026-10-17 - Added EPSG catalogue (GPKG_AddSRS), used by GPKG_AddGeometryColumn
+** 1.0.21 - 2026-10-17 - Added GPKG_NormalizeByteOrder and ST_ByteOrder
+** 1.0.22 - 2026-10-17 - Added ST_GeometryHash and ST_EqualsExact
+** 1.0.23 - 2026-10-17 - Added ST_SnapToGrid, ST_ReducePrecision and GPKG_ReducePrecision
+** 1.0.24 - 2026-10-17 - Added ST_Triangulate
+** 1.0.25 - 2026-10-17 - Added ST_AsCoordArray
+** 1.0.26 - 2026-10-17 - Added GPKG_ExportArrow
+** 1.0.27 - 2026-10-17 - Added GPKG_ImportArrow
+** 1.0.28 - 2026-10-17 - Added GPKG_FlatGeobuf virtual table
 **
 ******************************************************************************/
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "sqlite3ext.h"
 SQLITE_EXTENSION_INIT1
 
+// Not defined by every math.h
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 // Uncomment this define to always use the GPKG Binary Header to get the Geometry envelope and check for the empty geometry
 // #define GPKG_ALLWAYS_USE_HEADER
 
 // Version of this extension
-#define VERSION "1.0.3"
+#define VERSION "1.0.28"
 
 // Application ID
 #define GPKG_APPLICATION_ID 1196444487
@@ -41,7 +84,9 @@ SQLITE_EXTENSION_INIT1
 #define GPKG_ENV_BITS (0x07 << 1) // 0x0E (00001110)
 #define GPKG_BYTEORDER_BIT 0x01 // (00000001)
 
-// Constans to check ENDIANESS
+// Constans to check ENDIANESS (glibc defines them as macros in <stdlib.h>)
+#undef LITTLE_ENDIAN
+#undef BIG_ENDIAN
 static const unsigned char LITTLE_ENDIAN = (unsigned char)1;
 static const unsigned char BIG_ENDIAN = (unsigned char)0;
 
@@ -68,6 +113,84 @@ static const char *wktGeomtryTypes[] = { "GEOMETRY", "POINT", "LINESTRING", "POL
 #define MIN 0
 #define MAX 1
 
+// Order of the Hilbert curve of the point index. The extent is divided in a grid of 2^16 x 2^16 cells
+#define HILBERT_ORDER 16
+
+// Number of cells of each side of the grid of the spatial histograms (GPKG_AnalyzeSpatial)
+#define SPATIAL_HISTOGRAM_SIZE 64
+
+// Segment index (GPKG_AddSegmentIndex): entries of each node of the packed R-tree, entries of each page stored, pages cached
+// while a predicate is evaluated, maximum number of levels of the tree and default minimum number of coordinates of the indexed features
+#define SEGMENT_INDEX_NODE_SIZE 16
+#define SEGMENT_INDEX_PAGE_SIZE 128
+#define SEGMENT_INDEX_CACHE_SIZE 16
+#define SEGMENT_INDEX_MAX_LEVELS 16
+#define SEGMENT_INDEX_MIN_VERTICES 1024
+
+// Maximum number of characters of ST_GeoHash, zoom level of ST_QuadKey and cells of GPKG_GridCount
+#define GEOHASH_MAX_PRECISION 12
+#define QUADKEY_MAX_ZOOM 23
+#define GRID_COUNT_MAX_CELLS (1 << 24)
+
+// Web Mercator (EPSG:3857): half of the side of the square of the world in meters and latitude of its border
+// Maximum number of tiles of GPKG_DirtyTiles
+#define WEB_MERCATOR_HALF_SIZE 20037508.342789244
+#define WEB_MERCATOR_MAX_LATITUDE 85.05112878
+#define DIRTY_TILES_MAX_TILES (1 << 24)
+
+// Number of features read by chunk by GPKG_TransformInPlace, GPKG_NormalizeByteOrder and GPKG_ReducePrecision
+#define TRANSFORM_CHUNK_SIZE 4096
+
+// Kinds of coordinate reference systems of ST_Transform and number of coordinates transformed by batch
+#define PROJECTION_GEOGRAPHIC 1
+#define PROJECTION_WEB_MERCATOR 2
+#define PROJECTION_TRANSVERSE_MERCATOR 3
+#define PROJECTION_BATCH_SIZE 256
+
+// Projections of the EPSG catalogue (GPKG_AddSRS)
+#define EPSG_GEOGRAPHIC 0
+#define EPSG_TRANSVERSE_MERCATOR 1
+#define EPSG_MERCATOR 2
+#define EPSG_PSEUDO_MERCATOR 3
+#define EPSG_LAMBERT_CONFORMAL_CONIC 4
+#define EPSG_LAMBERT_AZIMUTHAL_EQUAL_AREA 5
+
+// Minimum number of vertices of a Polygon for ST_Triangulate to index its vertices in z-order
+#define EARCUT_HASH_MIN_VERTICES 80
+
+// Number of rows of each record batch of GPKG_ExportArrow
+#define ARROW_BATCH_SIZE 65536
+
+// Kinds of columns of the Arrow IPC files (GPKG_ExportArrow, GPKG_ImportArrow)
+#define ARROW_INT64 1
+#define ARROW_FLOAT64 2
+#define ARROW_BOOL 3
+#define ARROW_UTF8 4
+#define ARROW_BINARY 5
+#define ARROW_WKB 6      // geoarrow.wkb
+#define ARROW_GEOMETRY 7 // geoarrow.point ... geoarrow.multipolygon
+
+// Values of the Arrow IPC metadata (Schema.fbs, Message.fbs)
+#define ARROW_METADATA_V5 4
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_RECORD_BATCH 3
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_BINARY 4
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_BOOL 6
+#define ARROW_TYPE_LIST 12
+#define ARROW_TYPE_STRUCT 13
+#define ARROW_TYPE_FIXED_SIZE_LIST 16
+#define ARROW_TYPE_LARGE_BINARY 19
+#define ARROW_TYPE_LARGE_UTF8 20
+#define ARROW_PRECISION_DOUBLE 2
+
+// Operations of the change logs (GPKG_EnableChangeLog)
+#define CHANGELOG_INSERT 1
+#define CHANGELOG_UPDATE 2
+#define CHANGELOG_DELETE 3
+
 // "fordward" declarations
 static int readWKBGeometryEnv(unsigned char *p_blob, int n_bytes, int *index, unsigned char byteOrder, int ordinate, int maxmin, int geometryTypeExpected, double *res);
 static int isEmptyWKBGeometry(unsigned char *p_blob, int n_bytes, int *index, unsigned char byteOrder, int geometryTypeExpected);
@@ -974,622 +1097,14781 @@ static int isEmptyGPKGGeometry(unsigned char *p_blob, int n_bytes, int *index, u
 
 }
 
-// SQL function: ST_MinX(GEOMETRY); 
-// Returns the minimum X of a geometry or NULL if there is an error
-static void fnct_STMinX(sqlite3_context *context, int argc, sqlite3_value **argv)
+// Reads the X and Y of a Point in GPKG format without walking the generic WKB readers
+// The coordinates are at a fixed offset after the GPKG header: 1 byte for the ENDIANESS and 4 bytes for the geometry type
+// p_blob -> BLOB with geometry in GPKG format
+// n_bytes -> Length in bytes of the blob
+// x <- X of the Point
+// y <- Y of the Point
+// Returns 1 if it's correct, 0 if the geometry is not a Point, is empty or there is an error
+static int readGPKGPointXY(unsigned char *p_blob, int n_bytes, double *x, double *y)
 {
-    unsigned char *p_blob;
-    int n_bytes;
     int index = 0;
-    double res;
+    int typeInt;
+    unsigned char byteOrder;
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    if (n_bytes < 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        return 0;
+    if (!skipGPKGHeader(p_blob, n_bytes, &index))
+        return 0;
+    if (index + 21 > n_bytes)
+        return 0;
+    byteOrder = p_blob[index++];
+    typeInt = getInt(p_blob, &index, byteOrder);
+    if ((typeInt & 0xffff) % 1000 != wkbPoint)
+        return 0;
+    if ((typeInt & 0x20000000) != 0) // Skip the SRID
     {
-        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
-        n_bytes = sqlite3_value_bytes(argv[0]);
-        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
-        {
-            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), X, MIN, wkbGeometry, &res))
-            {
-                sqlite3_result_double(context, res);
-                return;
-            }
-        }
+        index += 4;
+        if (index + 16 > n_bytes)
+            return 0;
     }
-    sqlite3_result_null(context);
+    *x = getDouble(p_blob, &index, byteOrder);
+    *y = getDouble(p_blob, &index, byteOrder);
+    if (isnan(*x) && isnan(*y))
+        return 0; // Empty Point
+    return 1;
 }
 
-// SQL function: ST_MinY(GEOMETRY); 
-// Returns the minimum Y of a geometry or NULL if there is an error
-static void fnct_STMinY(sqlite3_context *context, int argc, sqlite3_value **argv)
+// Returns the cell of a grid of 2^HILBERT_ORDER cells where a coordinate falls. Coordinates outside the grid fall in the border cells
+// value -> Coordinate
+// min, max -> Extent of the grid
+static unsigned int hilbertCell(double value, double min, double max)
 {
-    unsigned char *p_blob;
-    int n_bytes;
-    int index = 0;
-    double res;
+    double cell = (value - min) / (max - min) * (double)(1 << HILBERT_ORDER);
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    if (!(cell >= 0.0)) // Also catches NaN
+        return 0;
+    if (cell >= (double)(1 << HILBERT_ORDER))
+        return (1 << HILBERT_ORDER) - 1;
+    return (unsigned int)cell;
+}
+
+// Returns the distance along the Hilbert curve of the cell (x, y) of a grid of 2^order x 2^order cells
+// The key of a cell at a lower order is the prefix of the keys of all the cells it contains
+static sqlite3_int64 hilbertKey(unsigned int x, unsigned int y, int order)
+{
+    unsigned int n = 1u << order;
+    unsigned int rx, ry, t;
+    sqlite3_int64 d = 0;
+
+    for (unsigned int s = n >> 1; s > 0; s >>= 1)
     {
-        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
-        n_bytes = sqlite3_value_bytes(argv[0]);
-        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        rx = (x & s) > 0;
+        ry = (y & s) > 0;
+        d += (sqlite3_int64)s * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant
+        if (ry == 0)
         {
-            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), Y, MIN, wkbGeometry, &res))
+            if (rx == 1)
             {
-                sqlite3_result_double(context, res);
-                return;
+                x = n - 1 - x;
+                y = n - 1 - y;
             }
+            t = x;
+            x = y;
+            y = t;
         }
     }
-    sqlite3_result_null(context);
+    return d;
 }
 
-// SQL function: ST_MinZ(GEOMETRY); 
-// Returns the minimum Z of a geometry or NULL if there is an error
-static void fnct_STMinZ(sqlite3_context *context, int argc, sqlite3_value **argv)
+// Part of a geometry parsed in memory: a Point, a LineString or a Polygon
+typedef struct gpkgPart
 {
-    unsigned char *p_blob;
-    int n_bytes;
-    int index = 0;
-    double res;
+    int geometryType; // wkbPoint, wkbLineString or wkbPolygon
+    int firstRing;    // First ring of the part in gpkgGeometry.rings
+    int numRings;     // Number of rings. A Point or a LineString has one ring
+} gpkgPart;
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+// Ring of a part: the coordinate of a Point, the coordinates of a LineString or a ring of a Polygon
+typedef struct gpkgRing
+{
+    int firstPoint; // First coordinate of the ring in gpkgGeometry.coords
+    int numPoints;  // Number of coordinates
+} gpkgRing;
+
+// Geometry parsed in memory. Multi geometries and GeometryCollections are flattened in parts.
+// The buffers are reused each time a geometry is read, so the same gpkgGeometry can be used for many rows.
+typedef struct gpkgGeometry
+{
+    int geometryType; // Type of the geometry (wkbPoint ... wkbGeometryCollection)
+    int srsId;        // SRS ID of the GPKG header
+    int hasZ;         // 1 if the coordinates have Z
+    int hasM;         // 1 if the coordinates have M
+    int dimension;    // Number of ordinates of each coordinate
+    gpkgPart *parts;
+    int numParts, maxParts;
+    gpkgRing *rings;
+    int numRings, maxRings;
+    double *coords;   // numPoints * dimension ordinates
+    int numPoints, maxPoints;
+    double env[4];    // Envelope (minX, minY, maxX, maxY)
+} gpkgGeometry;
+
+// Releases the buffers of a geometry parsed in memory
+static void freeGPKGGeometry(gpkgGeometry *geom)
+{
+    sqlite3_free(geom->parts);
+    sqlite3_free(geom->rings);
+    sqlite3_free(geom->coords);
+    memset(geom, 0, sizeof(gpkgGeometry));
+}
+
+// Makes room in a geometry parsed in memory for more parts, rings and coordinates
+// geom -> Geometry
+// parts, rings, points -> Number of parts, rings and coordinates to add
+// Returns 0 if there is no memory or 1 if it's correct
+static int growGPKGGeometry(gpkgGeometry *geom, int parts, int rings, int points)
+{
+    if (geom->numParts + parts > geom->maxParts)
     {
-        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
-        n_bytes = sqlite3_value_bytes(argv[0]);
-        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
-        {
-            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), Z, MIN, wkbGeometry, &res))
-            {
-                sqlite3_result_double(context, res);
-                return;
-            }
-        }
+        int maxParts = (geom->numParts + parts) * 2;
+        gpkgPart *p = (gpkgPart *)sqlite3_realloc64(geom->parts, sizeof(gpkgPart) * maxParts);
+        if (p == NULL)
+            return 0;
+        geom->parts = p;
+        geom->maxParts = maxParts;
     }
-    sqlite3_result_null(context);
+    if (geom->numRings + rings > geom->maxRings)
+    {
+        int maxRings = (geom->numRings + rings) * 2;
+        gpkgRing *r = (gpkgRing *)sqlite3_realloc64(geom->rings, sizeof(gpkgRing) * maxRings);
+        if (r == NULL)
+            return 0;
+        geom->rings = r;
+        geom->maxRings = maxRings;
+    }
+    if (geom->numPoints + points > geom->maxPoints)
+    {
+        int maxPoints = (geom->numPoints + points) * 2;
+        double *c = (double *)sqlite3_realloc64(geom->coords, sizeof(double) * 4 * maxPoints);
+        if (c == NULL)
+            return 0;
+        geom->coords = c;
+        geom->maxPoints = maxPoints;
+    }
+    return 1;
 }
 
-// SQL function: ST_MinM(GEOMETRY); 
-// Returns the minimum M of a geometry or NULL if there is an error
-static void fnct_STMinM(sqlite3_context *context, int argc, sqlite3_value **argv)
+// Reads the coordinates of a ring into a geometry parsed in memory
+// p_blob -> BLOB with geometry in WKB format
+// n_bytes -> Length in bytes of the blob
+// index <-> Position where to start reading the BLOB and returns the position where to continue reading
+// byteOrder -> ENDIANESS in which the BLOB is stored
+// numPoints -> Number of coordinates to read
+// geom <-> Geometry where the ring is added
+// Returns 0 if there is an error or 1 if it's correct
+static int readWKBRing(unsigned char *p_blob, int n_bytes, int *index, unsigned char byteOrder, int numPoints, gpkgGeometry *geom)
 {
-    unsigned char *p_blob;
-    int n_bytes;
-    int index = 0;
-    double res;
+    double *coord;
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    if (numPoints < 0 || numPoints > (n_bytes - *index) / (geom->dimension * 8))
+        return 0;
+    if (!growGPKGGeometry(geom, 0, 1, numPoints))
+        return 0;
+    geom->rings[geom->numRings].firstPoint = geom->numPoints;
+    geom->rings[geom->numRings].numPoints = numPoints;
+    geom->numRings++;
+    coord = &geom->coords[geom->numPoints * geom->dimension];
+    for (int i = 0; i < numPoints * geom->dimension; i++)
+        coord[i] = getDouble(p_blob, index, byteOrder);
+    geom->numPoints += numPoints;
+    return 1;
+}
+
+// Reads a geometry in WKB format into a geometry parsed in memory
+// p_blob -> BLOB with geometry in WKB format
+// n_bytes -> Length in bytes of the blob
+// index <-> Position where to start reading the BLOB and returns the position where to continue reading
+// byteOrder -> ENDIANESS in which the BLOB is stored
+// geometryTypeExpected -> Type of geometry we expect to find. If we put wkbgGeometry it accepts all geometry type.
+// geom <-> Geometry where the parts are added. The empty parts are not added
+// Returns 0 if there is an error or 1 if it's correct
+static int readWKBGeometry(unsigned char *p_blob, int n_bytes, int *index, unsigned char byteOrder, int geometryTypeExpected, gpkgGeometry *geom)
+{
+    unsigned char newByteOrder;
+    int typeInt;
+    int geometryType;
+    int dimension;
+    int hasZ;
+    int hasM;
+    int num;
+    int firstRing;
+
+    if (*index + 5 > n_bytes)
+        return 0;
+
+    // Check the ByteOrder
+    newByteOrder = p_blob[(*index)++];
+    if (newByteOrder == LITTLE_ENDIAN || newByteOrder == BIG_ENDIAN) // If the byteOrder is correct we take it, else keep the value of the parameter
+        byteOrder = newByteOrder;
+
+    typeInt = getInt(p_blob, index, byteOrder);
+
+    // Check dimensions. All the parts must have the same dimensions
+    hasZ = ((typeInt & 0x80000000) != 0 || (typeInt & 0xffff) / 1000 == 1 || (typeInt & 0xffff) / 1000 == 3);
+    hasM = ((typeInt & 0x40000000) != 0 || (typeInt & 0xffff) / 1000 == 2 || (typeInt & 0xffff) / 1000 == 3);
+    dimension = 2 + (hasZ ? 1 : 0) + (hasM ? 1 : 0);
+    if (geom->dimension == 0)
     {
-        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
-        n_bytes = sqlite3_value_bytes(argv[0]);
-        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        geom->hasZ = hasZ;
+        geom->hasM = hasM;
+        geom->dimension = dimension;
+    }
+    else if (geom->dimension != dimension || geom->hasZ != hasZ)
+        return 0;
+
+    // Check if it has SRID and if it has we skip it
+    if ((typeInt & 0x20000000) != 0)
+        *index += 4;
+
+    // Check geometry type
+    geometryType = (typeInt & 0xffff) % 1000;
+    if (geometryTypeExpected != wkbGeometry && geometryTypeExpected != geometryType)
+        return 0;
+    if (geom->geometryType == wkbGeometry)
+        geom->geometryType = geometryType;
+    if (geometryType < wkbPoint || geometryType > wkbGeometryCollection)
+        return 0;
+    if (geometryType == wkbPoint)
+        num = 1;
+    else
+    {
+        if (*index + 4 > n_bytes)
+            return 0;
+        num = getInt(p_blob, index, byteOrder);
+        if (num < 0)
+            return 0;
+    }
+    switch (geometryType)
+    {
+    case wkbPoint:
+    case wkbLineString:
+        if (!growGPKGGeometry(geom, 1, 0, 0))
+            return 0;
+        firstRing = geom->numRings;
+        if (!readWKBRing(p_blob, n_bytes, index, byteOrder, num, geom))
+            return 0;
+        if (num == 0 || (geometryType == wkbPoint && isnan(geom->coords[(geom->numPoints - 1) * dimension]) && isnan(geom->coords[(geom->numPoints - 1) * dimension + 1])))
         {
-            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), M, MIN, wkbGeometry, &res))
-            {
-                sqlite3_result_double(context, res);
-                return;
-            }
+            // Empty Point or LineString
+            geom->numRings = firstRing;
+            geom->numPoints -= num;
+            return 1;
         }
+        geom->parts[geom->numParts].geometryType = geometryType;
+        geom->parts[geom->numParts].firstRing = firstRing;
+        geom->parts[geom->numParts].numRings = 1;
+        geom->numParts++;
+        return 1;
+
+    case wkbPolygon:
+        if (!growGPKGGeometry(geom, 1, 0, 0))
+            return 0;
+        firstRing = geom->numRings;
+        for (int i = 0; i < num; i++)
+        {
+            if (*index + 4 > n_bytes)
+                return 0;
+            if (!readWKBRing(p_blob, n_bytes, index, byteOrder, getInt(p_blob, index, byteOrder), geom))
+                return 0;
+            if (geom->rings[geom->numRings - 1].numPoints == 0)
+                geom->numRings--; // Empty ring
+        }
+        if (geom->numRings == firstRing)
+            return 1; // Empty Polygon
+        geom->parts[geom->numParts].geometryType = wkbPolygon;
+        geom->parts[geom->numParts].firstRing = firstRing;
+        geom->parts[geom->numParts].numRings = geom->numRings - firstRing;
+        geom->numParts++;
+        return 1;
+
+    default:
+        for (int i = 0; i < num; i++)
+        {
+            if (!readWKBGeometry(p_blob, n_bytes, index, byteOrder, geometryType == wkbGeometryCollection ? wkbGeometry : geometryType - 3, geom))
+                return 0;
+        }
+        return 1;
     }
-    sqlite3_result_null(context);
 }
 
-// SQL function: SQL function: ST_MaxX(GEOMETRY); 
-// Returns the maximum X of a geometry or NULL if there is an error
-static void fnct_STMaxX(sqlite3_context *context, int argc, sqlite3_value **argv)
+// Returns the WKB type of a geometry parsed in memory, with 1000 added for Z, 2000 for M and 3000 for ZM
+static int wkbTypeInt(const gpkgGeometry *geom, int geometryType)
 {
-    unsigned char *p_blob;
-    int n_bytes;
-    int index = 0;
-    double res;
+    return geometryType + (geom->hasZ ? 1000 : 0) + (geom->hasM ? 2000 : 0);
+}
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+// Returns the number of bytes of a part of a geometry parsed in memory written in WKB format
+static int wkbPartSize(const gpkgGeometry *geom, const gpkgPart *part)
+{
+    int size = 1 + 4; // ByteOrder and TypeInt
+
+    if (part->geometryType == wkbPoint)
+        return size + geom->dimension * 8;
+    if (part->geometryType == wkbLineString)
+        return size + 4 + geom->rings[part->firstRing].numPoints * geom->dimension * 8;
+    size += 4;
+    for (int r = part->firstRing; r < part->firstRing + part->numRings; r++)
+        size += 4 + geom->rings[r].numPoints * geom->dimension * 8;
+    return size;
+}
+
+// Writes a 4 byte int in the CPU ENDIANESS
+static void putInt(unsigned char *p_blob, int *index, int value)
+{
+    memcpy(&p_blob[*index], &value, 4);
+    *index += 4;
+}
+
+// Writes an 8 byte double in the CPU ENDIANESS
+static void putDouble(unsigned char *p_blob, int *index, double value)
+{
+    memcpy(&p_blob[*index], &value, 8);
+    *index += 8;
+}
+
+// Writes a part of a geometry parsed in memory in WKB format, in the CPU ENDIANESS
+static void writeWKBPart(const gpkgGeometry *geom, const gpkgPart *part, unsigned char *p_blob, int *index)
+{
+    p_blob[(*index)++] = endian();
+    putInt(p_blob, index, wkbTypeInt(geom, part->geometryType));
+    if (part->geometryType == wkbPolygon)
+        putInt(p_blob, index, part->numRings);
+    for (int r = part->firstRing; r < part->firstRing + part->numRings; r++)
     {
-        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
-        n_bytes = sqlite3_value_bytes(argv[0]);
-        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
-        {
-            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), X, MAX, wkbGeometry, &res))
-            {
-                sqlite3_result_double(context, res);
-                return;
-            }
-        }
+        const gpkgRing *ring = &geom->rings[r];
+        if (part->geometryType != wkbPoint)
+            putInt(p_blob, index, ring->numPoints);
+        for (int i = 0; i < ring->numPoints * geom->dimension; i++)
+            putDouble(p_blob, index, geom->coords[ring->firstPoint * geom->dimension + i]);
     }
-    sqlite3_result_null(context);
 }
 
-// SQL function: SQL function: ST_MaxY(GEOMETRY); 
-// Returns the maximum Y of a geometry or NULL if there is an error
-static void fnct_STMaxY(sqlite3_context *context, int argc, sqlite3_value **argv)
+// Writes a geometry parsed in memory in GPKG format, in the CPU ENDIANESS
+// The geometry keeps its type if its parts fit it. Otherwise a Point, LineString or Polygon with several parts
+// is written as a Multi geometry, and a Multi geometry with parts of other types as a GeometryCollection
+// geom -> Geometry. Its XY envelope must be computed
+// envelope -> Envelope contents indicator of the GPKG header: 0 none, 1 XY, 2 XYZ, 3 XYM, 4 XYZM. The Z and M ranges are only
+//             written if the geometry has them, and a Point or an empty geometry never has an envelope
+// p_blob <- BLOB allocated with sqlite3_malloc
+// n_bytes <- Length in bytes of the blob
+// Returns 0 if there is no memory or 1 if it's correct
+static int writeGPKGGeometry(const gpkgGeometry *geom, int envelope, unsigned char **p_blob, int *n_bytes)
 {
-    unsigned char *p_blob;
-    int n_bytes;
+    int geometryType = geom->geometryType;
+    int homogeneous = 1;
+    int size = 8;
     int index = 0;
-    double res;
+    int envZ, envM;
+    unsigned char *blob;
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    for (int i = 1; i < geom->numParts; i++)
     {
-        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
-        n_bytes = sqlite3_value_bytes(argv[0]);
-        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        if (geom->parts[i].geometryType != geom->parts[0].geometryType)
+            homogeneous = 0;
+    }
+    if (geometryType < wkbPoint || geometryType > wkbGeometryCollection)
+        geometryType = geom->numParts > 0 ? geom->parts[0].geometryType : wkbGeometryCollection;
+    if (geometryType <= wkbPolygon && geom->numParts > 1)
+        geometryType = homogeneous ? geometryType + 3 : wkbGeometryCollection;
+    else if (geometryType >= wkbMultiPoint && geometryType <= wkbMultiPolygon && geom->numParts > 0 && (!homogeneous || geom->parts[0].geometryType != geometryType - 3))
+        geometryType = wkbGeometryCollection;
+    envZ = geom->hasZ && (envelope == 2 || envelope == 4);
+    envM = geom->hasM && (envelope == 3 || envelope == 4);
+    if (geom->numParts == 0 || geometryType == wkbPoint || envelope < 1 || envelope > 4)
+        envelope = 0;
+    else
+        envelope = envZ && envM ? 4 : (envZ ? 2 : (envM ? 3 : 1));
+
+    // Size of the BLOB
+    if (envelope > 0)
+        size += 32 + (envZ ? 16 : 0) + (envM ? 16 : 0);
+    if (geometryType <= wkbPolygon)
+        size += geom->numParts > 0 ? wkbPartSize(geom, &geom->parts[0]) : 1 + 4 + (geometryType == wkbPoint ? geom->dimension * 8 : 4);
+    else
+    {
+        size += 1 + 4 + 4;
+        for (int i = 0; i < geom->numParts; i++)
+            size += wkbPartSize(geom, &geom->parts[i]);
+    }
+    blob = (unsigned char *)sqlite3_malloc(size);
+    if (blob == NULL)
+        return 0;
+
+    // GPKG header
+    blob[index++] = GPKG_MAGIC1;
+    blob[index++] = GPKG_MAGIC2;
+    blob[index++] = GPKG_VERSION;
+    blob[index++] = (envelope << 1) | (geom->numParts > 0 ? 0 : GPKG_EMPTY_BIT) | (endian() == LITTLE_ENDIAN ? GPKG_BYTEORDER_BIT : 0);
+    putInt(blob, &index, geom->srsId);
+    if (envelope > 0)
+    {
+        putDouble(blob, &index, geom->env[0]);
+        putDouble(blob, &index, geom->env[2]);
+        putDouble(blob, &index, geom->env[1]);
+        putDouble(blob, &index, geom->env[3]);
+        for (int o = 2; o < geom->dimension; o++)
         {
-            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), Y, MAX, wkbGeometry, &res))
+            // Z is the 3rd ordinate and M the last one
+            double min = HUGE_VAL, max = -HUGE_VAL;
+            if ((o == 2 && geom->hasZ) ? !envZ : !envM)
+                continue;
+            for (int i = 0; i < geom->numPoints; i++)
             {
-                sqlite3_result_double(context, res);
-                return;
+                double value = geom->coords[i * geom->dimension + o];
+                if (value < min) min = value;
+                if (value > max) max = value;
             }
+            putDouble(blob, &index, min);
+            putDouble(blob, &index, max);
         }
     }
-    sqlite3_result_null(context);
-}
-
-// SQL function: SQL function: ST_MaxZ(GEOMETRY); 
-// Returns the maximum Z of a geometry or NULL if there is an error
-static void fnct_STMaxZ(sqlite3_context *context, int argc, sqlite3_value **argv)
-{
-    unsigned char *p_blob;
-    int n_bytes;
-    int index = 0;
-    double res;
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    // WKB
+    if (geometryType <= wkbPolygon && geom->numParts > 0)
+        writeWKBPart(geom, &geom->parts[0], blob, &index);
+    else
     {
-        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
-        n_bytes = sqlite3_value_bytes(argv[0]);
-        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        blob[index++] = endian();
+        putInt(blob, &index, wkbTypeInt(geom, geometryType));
+        if (geometryType == wkbPoint)
         {
-            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), Z, MAX, wkbGeometry, &res))
-            {
-                sqlite3_result_double(context, res);
-                return;
-            }
+            // Empty Point
+            for (int i = 0; i < geom->dimension; i++)
+                putDouble(blob, &index, NAN);
+        }
+        else
+        {
+            putInt(blob, &index, geometryType <= wkbPolygon ? 0 : geom->numParts);
+            for (int i = 0; i < geom->numParts; i++)
+                writeWKBPart(geom, &geom->parts[i], blob, &index);
         }
     }
-    sqlite3_result_null(context);
+    *p_blob = blob;
+    *n_bytes = size;
+    return 1;
 }
 
-// SQL function: SQL function: ST_MaxM(GEOMETRY); 
+// Computes the envelope of a geometry parsed in memory
+static void computeGPKGEnvelope(gpkgGeometry *geom)
+{
+    geom->env[0] = geom->env[1] = HUGE_VAL;
+    geom->env[2] = geom->env[3] = -HUGE_VAL;
+    for (int i = 0; i < geom->numPoints; i++)
+    {
+        double x = geom->coords[i * geom->dimension];
+        double y = geom->coords[i * geom->dimension + 1];
+        if (x < geom->env[0]) geom->env[0] = x;
+        if (y < geom->env[1]) geom->env[1] = y;
+        if (x > geom->env[2]) geom->env[2] = x;
+        if (y > geom->env[3]) geom->env[3] = y;
+    }
+}
+
+// Returns the envelope contents indicator of the GPKG header of a BLOB (0 none, 1 XY, 2 XYZ, 3 XYM, 4 XYZM)
+static int readGPKGEnvelopeType(const unsigned char *p_blob, int n_bytes)
+{
+    return n_bytes > 3 ? (p_blob[3] & GPKG_ENV_BITS) >> 1 : 0;
+}
+
+// Reads a geometry in GPKG format into a geometry parsed in memory
+// p_blob -> BLOB with geometry in GPKG format
+// n_bytes -> Length in bytes of the blob
+// geom <- Geometry parsed in memory. Its buffers are reused
+// Returns 0 if there is an error or 1 if it's correct
+static int readGPKGGeometry(unsigned char *p_blob, int n_bytes, gpkgGeometry *geom)
+{
+    int index = 0;
+    int srsIndex = 4;
+
+    geom->geometryType = wkbGeometry;
+    geom->hasZ = geom->hasM = geom->dimension = 0;
+    geom->numParts = geom->numRings = geom->numPoints = 0;
+    if (n_bytes < 13) // Not enough bytes (at least 1 for Endianess and 4 for TypeInt + 8 minimum GPKG header)
+        return 0;
+    if (!skipGPKGHeader(p_blob, n_bytes, &index))
+        return 0;
+    geom->srsId = getInt(p_blob, &srsIndex, p_blob[3] & GPKG_BYTEORDER_BIT);
+    if (!readWKBGeometry(p_blob, n_bytes, &index, endian(), wkbGeometry, geom))
+        return 0;
+    computeGPKGEnvelope(geom);
+    return 1;
+}
+
+// Snaps the X and Y of a geometry parsed in memory to a grid, in place, and removes the consecutive repeated coordinates,
+// the LineStrings with less than 2 coordinates, the rings with less than 4 and the Polygons whose exterior ring collapses.
+// Z and M are not changed. The envelope must be computed again
+// geom <-> Geometry
+// size -> Size of the cells of the grid. If 1 / size is an integer (0.01, 0.001...) the coordinates are rounded multiplying by it,
+//         so they are the nearest doubles to the decimal values
+// Returns 1 if a coordinate moved or was removed, 0 if the geometry was already on the grid
+static int snapGPKGGeometry(gpkgGeometry *geom, double size)
+{
+    int dimension = geom->dimension;
+    double inverse = 1 / size;
+    int useInverse = fabs(inverse - round(inverse)) < 1e-9 * inverse;
+    int numParts = 0, numRings = 0, numPoints = 0;
+    int changed = 0;
+
+    for (int i = 0; i < geom->numPoints * dimension; i += dimension)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            double *value = &geom->coords[i + j];
+            double snapped = useInverse ? round(*value * round(inverse)) / round(inverse) : round(*value / size) * size;
+            if (snapped != *value)
+                changed = 1;
+            *value = snapped;
+        }
+    }
+
+    // Compact parts, rings and coordinates. The new positions are never after the old ones
+    for (int p = 0; p < geom->numParts; p++)
+    {
+        gpkgPart part = geom->parts[p];
+        int firstRing = numRings;
+        for (int r = part.firstRing; r < part.firstRing + part.numRings; r++)
+        {
+            gpkgRing ring = geom->rings[r];
+            int firstPoint = numPoints;
+            for (int i = ring.firstPoint; i < ring.firstPoint + ring.numPoints; i++)
+            {
+                const double *c = &geom->coords[i * dimension];
+                if (numPoints > firstPoint && c[0] == geom->coords[(numPoints - 1) * dimension] && c[1] == geom->coords[(numPoints - 1) * dimension + 1])
+                    continue;
+                memmove(&geom->coords[numPoints * dimension], c, sizeof(double) * dimension);
+                numPoints++;
+            }
+            if ((part.geometryType == wkbLineString && numPoints - firstPoint < 2) || (part.geometryType == wkbPolygon && numPoints - firstPoint < 4))
+            {
+                // Collapsed
+                numPoints = firstPoint;
+                if (part.geometryType == wkbPolygon && r == part.firstRing)
+                    break;
+                continue;
+            }
+            geom->rings[numRings].firstPoint = firstPoint;
+            geom->rings[numRings].numPoints = numPoints - firstPoint;
+            numRings++;
+        }
+        if (numRings == firstRing)
+            continue; // Collapsed
+        geom->parts[numParts].geometryType = part.geometryType;
+        geom->parts[numParts].firstRing = firstRing;
+        geom->parts[numParts].numRings = numRings - firstRing;
+        numParts++;
+    }
+    if (numPoints != geom->numPoints)
+        changed = 1;
+    geom->numParts = numParts;
+    geom->numRings = numRings;
+    geom->numPoints = numPoints;
+    return changed;
+}
+
+// Run of coordinates of a WKB geometry: the coordinate of a Point, the coordinates of a LineString or of a ring of a Polygon
+typedef struct wkbRun
+{
+    unsigned char *coords;   // First byte of the coordinates in the BLOB
+    int numPoints;           // Number of coordinates
+    int dimension;           // Number of ordinates of each coordinate
+    int hasZ;                // 1 if the coordinates have Z (the 3rd ordinate)
+    int hasM;                // 1 if the coordinates have M (the last ordinate)
+    unsigned char byteOrder; // ENDIANESS of the coordinates
+    int geometryType;        // wkbPoint, wkbLineString or wkbPolygon
+    int part;                // Number of the Point, LineString or Polygon in the whole geometry, from 0
+    int ring;                // Number of the ring in the Polygon (0 is the exterior ring). 0 for Points and LineStrings
+} wkbRun;
+
+// Visitor of the runs of coordinates of a WKB geometry (walkWKBRuns)
+// run -> Run of coordinates. The visitor can change the coordinates in place
+// ctx -> Context of the visitor
+// Returns 0 to stop walking or 1 to continue
+typedef int (*wkbRunVisitor)(const wkbRun *run, void *ctx);
+
+// Visits the runs of coordinates of a WKB geometry in the order they are stored, without copying them.
+// Multi geometries and GeometryCollections are walked recursively
+// p_blob -> BLOB with geometry in WKB format
+// n_bytes -> Length in bytes of the blob
+// index <-> Position where to start reading the BLOB and returns the position where to continue reading
+// byteOrder -> ENDIANESS of the parent geometry
+// part <-> Number of the next Point, LineString or Polygon
+// visit -> Function called for each run
+// ctx -> Context of the visitor
+// Returns 0 if there is an error or the visitor stopped, 1 if it's correct
+static int walkWKBRuns(unsigned char *p_blob, int n_bytes, int *index, unsigned char byteOrder, int *part, wkbRunVisitor visit, void *ctx)
+{
+    unsigned char newByteOrder;
+    int typeInt;
+    int num;
+    wkbRun run;
+
+    if (*index + 5 > n_bytes)
+        return 0;
+
+    // Check the ByteOrder
+    newByteOrder = p_blob[(*index)++];
+    if (newByteOrder == LITTLE_ENDIAN || newByteOrder == BIG_ENDIAN) // If the byteOrder is correct we take it, else keep the value of the parameter
+        byteOrder = newByteOrder;
+
+    typeInt = getInt(p_blob, index, byteOrder);
+    run.hasZ = ((typeInt & 0x80000000) != 0 || (typeInt & 0xffff) / 1000 == 1 || (typeInt & 0xffff) / 1000 == 3);
+    run.hasM = ((typeInt & 0x40000000) != 0 || (typeInt & 0xffff) / 1000 == 2 || (typeInt & 0xffff) / 1000 == 3);
+    run.dimension = 2 + run.hasZ + run.hasM;
+    run.byteOrder = byteOrder;
+    run.part = *part;
+    run.ring = 0;
+    if ((typeInt & 0x20000000) != 0) // Skip the SRID
+        *index += 4;
+
+    run.geometryType = (typeInt & 0xffff) % 1000;
+    switch (run.geometryType)
+    {
+    case wkbPoint:
+        if (*index + run.dimension * 8 > n_bytes)
+            return 0;
+        run.coords = p_blob + *index;
+        run.numPoints = 1;
+        if (!visit(&run, ctx))
+            return 0;
+        *index += run.dimension * 8;
+        (*part)++;
+        break;
+
+    case wkbLineString:
+    case wkbPolygon:
+        if (*index + 4 > n_bytes)
+            return 0;
+        num = run.geometryType == wkbPolygon ? getInt(p_blob, index, byteOrder) : 1;
+        if (num < 0)
+            return 0;
+        for (run.ring = 0; run.ring < num; run.ring++)
+        {
+            if (*index + 4 > n_bytes)
+                return 0;
+            run.numPoints = getInt(p_blob, index, byteOrder);
+            if (run.numPoints < 0 || (sqlite3_int64)run.numPoints * run.dimension * 8 > n_bytes - *index)
+                return 0;
+            run.coords = p_blob + *index;
+            if (!visit(&run, ctx))
+                return 0;
+            *index += run.numPoints * run.dimension * 8;
+        }
+        (*part)++;
+        break;
+
+    case wkbMultiPoint:
+    case wkbMultiLineString:
+    case wkbMultiPolygon:
+    case wkbGeometryCollection:
+        if (*index + 4 > n_bytes)
+            return 0;
+        num = getInt(p_blob, index, byteOrder);
+        if (num < 0)
+            return 0;
+        for (int i = 0; i < num; i++)
+            if (!walkWKBRuns(p_blob, n_bytes, index, byteOrder, part, visit, ctx))
+                return 0;
+        break;
+
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+// Visits the runs of coordinates of a geometry in GPKG format (see walkWKBRuns)
+// p_blob -> BLOB with geometry in GPKG format
+// n_bytes -> Length in bytes of the blob
+// visit -> Function called for each run
+// ctx -> Context of the visitor
+// Returns 0 if there is an error or the visitor stopped, 1 if it's correct
+static int walkGPKGRuns(unsigned char *p_blob, int n_bytes, wkbRunVisitor visit, void *ctx)
+{
+    int index = 0;
+    int part = 0;
+
+    if (n_bytes < 13) // Not enough bytes (at least 1 for Endianess and 4 for TypeInt + 8 minimum GPKG header)
+        return 0;
+    if (!skipGPKGHeader(p_blob, n_bytes, &index))
+        return 0;
+    return walkWKBRuns(p_blob, n_bytes, &index, endian(), &part, visit, ctx);
+}
+
+// Writes an 8 byte double into a byte array
+// p_blob -> byte array to write to
+// index -> start write position that gets atvanced 8 bytes
+// value -> double to write
+// byteOrder -> ENDIANESS
+static void putDoubleOrder(unsigned char *p_blob, int *index, double value, unsigned char byteOrder)
+{
+    if (byteOrder == endian())
+        memcpy(&p_blob[*index], &value, 8);
+    else
+    {
+        unsigned char *bytes = (unsigned char *)&value;
+        for (int i = 0; i < 8; i++)
+            p_blob[*index + i] = bytes[7 - i];
+    }
+    *index += 8;
+}
+
+// Writes the X and Y of the envelope of the GPKG header, if it has an envelope. Z and M are not changed
+// p_blob -> BLOB with geometry in GPKG format
+// n_bytes -> Length in bytes of the blob
+// env -> Envelope (minX, minY, maxX, maxY)
+static void putGPKGHeaderEnvelope(unsigned char *p_blob, int n_bytes, const double *env)
+{
+    int index = 8;
+    unsigned char byteOrder;
+
+    if (n_bytes < 40 || (p_blob[3] & GPKG_ENV_BITS) == 0)
+        return;
+    byteOrder = p_blob[3] & GPKG_BYTEORDER_BIT;
+    putDoubleOrder(p_blob, &index, env[0], byteOrder);
+    putDoubleOrder(p_blob, &index, env[2], byteOrder);
+    putDoubleOrder(p_blob, &index, env[1], byteOrder);
+    putDoubleOrder(p_blob, &index, env[3], byteOrder);
+}
+
+// Reverses the bytes of a value stored in a byte array
+// p -> First byte of the value
+// size -> Number of bytes (4 or 8)
+static void swapBytes(unsigned char *p, int size)
+{
+    for (int i = 0; i < size / 2; i++)
+    {
+        unsigned char b = p[i];
+        p[i] = p[size - 1 - i];
+        p[size - 1 - i] = b;
+    }
+}
+
+// Reads the byte orders of a WKB geometry and, optionally, converts it to the CPU ENDIANESS in place (the size doesn't change)
+// Multi geometries and GeometryCollections are read recursively, each part has its own byte order
+// p_blob -> BLOB with geometry in WKB format
+// n_bytes -> Length in bytes of the blob
+// index <-> Position where to start reading the BLOB and returns the position where to continue reading
+// normalize -> 1 to convert the geometry, 0 to only read the byte orders
+// orders <-> Adds the bits (1 << byteOrder) of the byte orders found
+// Returns 0 if there is an error (the geometry may be partially converted) or 1 if it's correct
+static int normalizeWKBByteOrder(unsigned char *p_blob, int n_bytes, int *index, int normalize, int *orders)
+{
+    unsigned char byteOrder;
+    int typeInt, dimension, num, numPoints, swap;
+
+    if (*index + 5 > n_bytes)
+        return 0;
+    byteOrder = p_blob[*index];
+    if (byteOrder != LITTLE_ENDIAN && byteOrder != BIG_ENDIAN)
+        return 0;
+    *orders |= 1 << byteOrder;
+    swap = normalize && byteOrder != endian();
+    if (swap)
+        p_blob[*index] = endian();
+    (*index)++;
+
+    typeInt = getInt(p_blob, index, byteOrder);
+    if (swap)
+        swapBytes(p_blob + *index - 4, 4);
+    dimension = 2 + ((typeInt & 0x80000000) != 0 || (typeInt & 0xffff) / 1000 == 1 || (typeInt & 0xffff) / 1000 == 3)
+        + ((typeInt & 0x40000000) != 0 || (typeInt & 0xffff) / 1000 == 2 || (typeInt & 0xffff) / 1000 == 3);
+    if ((typeInt & 0x20000000) != 0) // SRID
+    {
+        if (*index + 4 > n_bytes)
+            return 0;
+        if (swap)
+            swapBytes(p_blob + *index, 4);
+        *index += 4;
+    }
+
+    switch ((typeInt & 0xffff) % 1000)
+    {
+    case wkbPoint:
+        if (*index + dimension * 8 > n_bytes)
+            return 0;
+        for (int i = 0; swap && i < dimension; i++)
+            swapBytes(p_blob + *index + i * 8, 8);
+        *index += dimension * 8;
+        break;
+
+    case wkbLineString:
+    case wkbPolygon:
+        num = 1;
+        if ((typeInt & 0xffff) % 1000 == wkbPolygon)
+        {
+            if (*index + 4 > n_bytes)
+                return 0;
+            num = getInt(p_blob, index, byteOrder);
+            if (swap)
+                swapBytes(p_blob + *index - 4, 4);
+        }
+        for (int r = 0; r < num; r++)
+        {
+            if (*index + 4 > n_bytes)
+                return 0;
+            numPoints = getInt(p_blob, index, byteOrder);
+            if (swap)
+                swapBytes(p_blob + *index - 4, 4);
+            if (numPoints < 0 || (sqlite3_int64)numPoints * dimension * 8 > n_bytes - *index)
+                return 0;
+            for (int i = 0; swap && i < numPoints * dimension; i++)
+                swapBytes(p_blob + *index + i * 8, 8);
+            *index += numPoints * dimension * 8;
+        }
+        break;
+
+    case wkbMultiPoint:
+    case wkbMultiLineString:
+    case wkbMultiPolygon:
+    case wkbGeometryCollection:
+        if (*index + 4 > n_bytes)
+            return 0;
+        num = getInt(p_blob, index, byteOrder);
+        if (swap)
+            swapBytes(p_blob + *index - 4, 4);
+        for (int i = 0; i < num; i++)
+            if (!normalizeWKBByteOrder(p_blob, n_bytes, index, normalize, orders))
+                return 0;
+        break;
+
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+// Reads the byte orders of a geometry in GPKG format (header and WKB) and, optionally, converts it to the CPU ENDIANESS in place
+// p_blob -> BLOB with geometry in GPKG format
+// n_bytes -> Length in bytes of the blob
+// normalize -> 1 to convert the geometry, 0 to only read the byte orders
+// orders <- Bits (1 << byteOrder) of the byte orders found
+// Returns 0 if there is an error (the geometry may be partially converted) or 1 if it's correct
+static int normalizeGPKGByteOrder(unsigned char *p_blob, int n_bytes, int normalize, int *orders)
+{
+    int index = 0;
+    unsigned char byteOrder;
+
+    *orders = 0;
+    if (n_bytes < 13) // Not enough bytes (at least 1 for Endianess and 4 for TypeInt + 8 minimum GPKG header)
+        return 0;
+    if (!skipGPKGHeader(p_blob, n_bytes, &index) || index + 5 > n_bytes)
+        return 0;
+    byteOrder = p_blob[3] & GPKG_BYTEORDER_BIT;
+    *orders |= 1 << byteOrder;
+    if (normalize && byteOrder != endian())
+    {
+        // SRS ID and envelope
+        p_blob[3] = (p_blob[3] & ~GPKG_BYTEORDER_BIT) | endian();
+        swapBytes(p_blob + 4, 4);
+        for (int i = 8; i < index; i += 8)
+            swapBytes(p_blob + i, 8);
+    }
+    return normalizeWKBByteOrder(p_blob, n_bytes, &index, normalize, orders);
+}
+
+// Returns the orientation of the point c with respect to the segment a-b: > 0 to the left, < 0 to the right, 0 collinear
+static double orientation(const double *a, const double *b, const double *c)
+{
+    return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+// Returns 1 if the point c, collinear with the segment a-b, is inside the envelope of the segment
+static int onSegmentEnvelope(const double *a, const double *b, const double *c)
+{
+    return c[0] >= fmin(a[0], b[0]) && c[0] <= fmax(a[0], b[0]) && c[1] >= fmin(a[1], b[1]) && c[1] <= fmax(a[1], b[1]);
+}
+
+// Returns 1 if the segments a-b and c-d intersect (touching or overlapping included)
+static int segmentsIntersect(const double *a, const double *b, const double *c, const double *d)
+{
+    double o1 = orientation(a, b, c);
+    double o2 = orientation(a, b, d);
+    double o3 = orientation(c, d, a);
+    double o4 = orientation(c, d, b);
+
+    if (((o1 > 0 && o2 < 0) || (o1 < 0 && o2 > 0)) && ((o3 > 0 && o4 < 0) || (o3 < 0 && o4 > 0)))
+        return 1;
+    if (o1 == 0 && onSegmentEnvelope(a, b, c)) return 1;
+    if (o2 == 0 && onSegmentEnvelope(a, b, d)) return 1;
+    if (o3 == 0 && onSegmentEnvelope(c, d, a)) return 1;
+    if (o4 == 0 && onSegmentEnvelope(c, d, b)) return 1;
+    return 0;
+}
+
+// Returns 1 if the segments a-b and c-d cross at a point interior to both segments
+static int segmentsCross(const double *a, const double *b, const double *c, const double *d)
+{
+    double o1 = orientation(a, b, c);
+    double o2 = orientation(a, b, d);
+    double o3 = orientation(c, d, a);
+    double o4 = orientation(c, d, b);
+
+    return ((o1 > 0 && o2 < 0) || (o1 < 0 && o2 > 0)) && ((o3 > 0 && o4 < 0) || (o3 < 0 && o4 > 0));
+}
+
+// Locates a point with respect to a ring
+// geom -> Geometry
+// ring -> Ring of the geometry
+// p -> Point (x, y)
+// Returns 0 if the point is outside the ring, 1 if it is inside, 2 if it is on the ring
+static int pointInRing(const gpkgGeometry *geom, const gpkgRing *ring, const double *p)
+{
+    int inside = 0;
+    const double *a, *b;
+
+    for (int i = 0; i < ring->numPoints; i++)
+    {
+        a = &geom->coords[(ring->firstPoint + i) * geom->dimension];
+        b = &geom->coords[(ring->firstPoint + (i + 1) % ring->numPoints) * geom->dimension];
+        if ((a[1] > p[1]) != (b[1] > p[1]))
+        {
+            double x = a[0] + (p[1] - a[1]) * (b[0] - a[0]) / (b[1] - a[1]);
+            if (x == p[0])
+                return 2;
+            if (x > p[0])
+                inside = !inside;
+        }
+        else if (orientation(a, b, p) == 0 && onSegmentEnvelope(a, b, p))
+            return 2;
+    }
+    return inside;
+}
+
+// Locates a point with respect to a part of a geometry
+// geom -> Geometry
+// part -> Part of the geometry
+// p -> Point (x, y)
+// Returns 0 if the point doesn't touch the part, 1 if it is in the interior of a Polygon, 2 if it is on the boundary of a Polygon or on a Point or LineString
+static int pointInPart(const gpkgGeometry *geom, const gpkgPart *part, const double *p)
+{
+    const gpkgRing *ring = &geom->rings[part->firstRing];
+    int res;
+
+    if (part->geometryType == wkbPoint)
+    {
+        const double *c = &geom->coords[ring->firstPoint * geom->dimension];
+        return c[0] == p[0] && c[1] == p[1] ? 2 : 0;
+    }
+    if (part->geometryType == wkbLineString)
+    {
+        for (int i = 0; i < ring->numPoints - 1; i++)
+        {
+            const double *a = &geom->coords[(ring->firstPoint + i) * geom->dimension];
+            const double *b = a + geom->dimension;
+            if (orientation(a, b, p) == 0 && onSegmentEnvelope(a, b, p))
+                return 2;
+        }
+        return ring->numPoints == 1 && geom->coords[ring->firstPoint * geom->dimension] == p[0] && geom->coords[ring->firstPoint * geom->dimension + 1] == p[1] ? 2 : 0;
+    }
+    res = pointInRing(geom, ring, p);
+    if (res != 1)
+        return res;
+    for (int i = 1; i < part->numRings; i++)
+    {
+        res = pointInRing(geom, &geom->rings[part->firstRing + i], p);
+        if (res == 2)
+            return 2; // On the boundary of a hole
+        if (res == 1)
+            return 0; // Inside a hole
+    }
+    return 1;
+}
+
+// Locates a point with respect to a geometry
+// Returns 0 if the point doesn't touch the geometry, 1 if it is in the interior of a Polygon, 2 if it is on the boundary of a Polygon or on a Point or LineString
+static int pointInGeometry(const gpkgGeometry *geom, const double *p)
+{
+    int res = 0;
+
+    if (p[0] < geom->env[0] || p[0] > geom->env[2] || p[1] < geom->env[1] || p[1] > geom->env[3])
+        return 0;
+    for (int i = 0; i < geom->numParts; i++)
+    {
+        int res2 = pointInPart(geom, &geom->parts[i], p);
+        if (res2 == 1)
+            return 1;
+        if (res2 == 2)
+            res = 2;
+    }
+    return res;
+}
+
+// Returns 1 if any segment of the part pa of a intersects any segment of the part pb of b
+// proper -> If 1 only the segments that cross at a point interior to both segments are considered
+static int partSegmentsIntersect(const gpkgGeometry *a, const gpkgPart *pa, const gpkgGeometry *b, const gpkgPart *pb, int proper)
+{
+    for (int ra = pa->firstRing; ra < pa->firstRing + pa->numRings; ra++)
+    {
+        const gpkgRing *ringA = &a->rings[ra];
+        for (int i = 0; i < ringA->numPoints - 1; i++)
+        {
+            const double *a1 = &a->coords[(ringA->firstPoint + i) * a->dimension];
+            const double *a2 = a1 + a->dimension;
+            if (fmax(a1[0], a2[0]) < b->env[0] || fmin(a1[0], a2[0]) > b->env[2] || fmax(a1[1], a2[1]) < b->env[1] || fmin(a1[1], a2[1]) > b->env[3])
+                continue;
+            for (int rb = pb->firstRing; rb < pb->firstRing + pb->numRings; rb++)
+            {
+                const gpkgRing *ringB = &b->rings[rb];
+                for (int j = 0; j < ringB->numPoints - 1; j++)
+                {
+                    const double *b1 = &b->coords[(ringB->firstPoint + j) * b->dimension];
+                    const double *b2 = b1 + b->dimension;
+                    if (proper ? segmentsCross(a1, a2, b1, b2) : segmentsIntersect(a1, a2, b1, b2))
+                        return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Returns 1 if the part pa of a intersects the part pb of b
+static int partsIntersect(const gpkgGeometry *a, const gpkgPart *pa, const gpkgGeometry *b, const gpkgPart *pb)
+{
+    const double *firstA = &a->coords[a->rings[pa->firstRing].firstPoint * a->dimension];
+    const double *firstB = &b->coords[b->rings[pb->firstRing].firstPoint * b->dimension];
+
+    if (pa->geometryType == wkbPoint)
+        return pointInPart(b, pb, firstA) != 0;
+    if (pb->geometryType == wkbPoint)
+        return pointInPart(a, pa, firstB) != 0;
+    if (partSegmentsIntersect(a, pa, b, pb, 0))
+        return 1;
+    // Without crossing segments a part can only be inside a Polygon
+    if (pb->geometryType == wkbPolygon && pointInPart(b, pb, firstA) != 0)
+        return 1;
+    if (pa->geometryType == wkbPolygon && pointInPart(a, pa, firstB) != 0)
+        return 1;
+    return 0;
+}
+
+// Returns 1 if the geometry a intersects the geometry b
+static int geometryIntersects(const gpkgGeometry *a, const gpkgGeometry *b)
+{
+    if (a->numParts == 0 || b->numParts == 0)
+        return 0;
+    if (a->env[2] < b->env[0] || a->env[0] > b->env[2] || a->env[3] < b->env[1] || a->env[1] > b->env[3])
+        return 0;
+    for (int i = 0; i < a->numParts; i++)
+    {
+        for (int j = 0; j < b->numParts; j++)
+        {
+            if (partsIntersect(a, &a->parts[i], b, &b->parts[j]))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns 1 if the geometry a contains the geometry b
+// All the coordinates of b and the midpoints of its segments must touch a, no segment of b can cross a segment of a
+// and no coordinate of a can be in the interior of a Polygon of b (b would surround a hole or a concavity of a).
+// If b has no Polygons, a Polygon of a must have some of them in its interior (a Point on the boundary is not contained)
+static int geometryContains(const gpkgGeometry *a, const gpkgGeometry *b)
+{
+    int interior = 0;
+    int polygonA = 0;
+
+    if (a->numParts == 0 || b->numParts == 0)
+        return 0;
+    if (b->env[0] < a->env[0] || b->env[2] > a->env[2] || b->env[1] < a->env[1] || b->env[3] > a->env[3])
+        return 0;
+    for (int j = 0; j < b->numParts; j++)
+    {
+        const gpkgPart *pb = &b->parts[j];
+        for (int rb = pb->firstRing; rb < pb->firstRing + pb->numRings; rb++)
+        {
+            const gpkgRing *ring = &b->rings[rb];
+            for (int k = 0; k < ring->numPoints; k++)
+            {
+                const double *c = &b->coords[(ring->firstPoint + k) * b->dimension];
+                int res = pointInGeometry(a, c);
+                if (res == 0)
+                    return 0;
+                if (res == 1)
+                    interior = 1;
+                if (k > 0)
+                {
+                    double mid[2];
+                    mid[0] = (c[0] + c[-b->dimension]) / 2;
+                    mid[1] = (c[1] + c[1 - b->dimension]) / 2;
+                    res = pointInGeometry(a, mid);
+                    if (res == 0)
+                        return 0;
+                    if (res == 1)
+                        interior = 1;
+                }
+            }
+        }
+        if (pb->geometryType == wkbPolygon)
+            interior = 1;
+        for (int i = 0; i < a->numParts; i++)
+        {
+            const gpkgPart *pa = &a->parts[i];
+            if (pa->geometryType == wkbPolygon)
+                polygonA = 1;
+            if (pb->geometryType != wkbPoint && pa->geometryType != wkbPoint && partSegmentsIntersect(b, pb, a, pa, 1))
+                return 0;
+            if (pb->geometryType == wkbPolygon)
+            {
+                for (int ra = pa->firstRing; ra < pa->firstRing + pa->numRings; ra++)
+                {
+                    const gpkgRing *ring = &a->rings[ra];
+                    for (int k = 0; k < ring->numPoints; k++)
+                    {
+                        if (pointInPart(b, pb, &a->coords[(ring->firstPoint + k) * a->dimension]) == 1)
+                            return 0;
+                    }
+                }
+            }
+        }
+    }
+    return interior || !polygonA;
+}
+
+
+// Returns the distance from the point p to the segment a-b
+static double pointSegmentDistance(const double *p, const double *a, const double *b)
+{
+    double dx = b[0] - a[0];
+    double dy = b[1] - a[1];
+    double len2 = dx * dx + dy * dy;
+    double t = 0;
+
+    if (len2 > 0)
+    {
+        t = ((p[0] - a[0]) * dx + (p[1] - a[1]) * dy) / len2;
+        t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    }
+    return hypot(p[0] - (a[0] + t * dx), p[1] - (a[1] + t * dy));
+}
+
+// Returns the distance between the part pa of a and the part pb of b
+// The Points are handled as segments of length 0
+static double partsDistance(const gpkgGeometry *a, const gpkgPart *pa, const gpkgGeometry *b, const gpkgPart *pb)
+{
+    double dist = HUGE_VAL;
+
+    if (partsIntersect(a, pa, b, pb))
+        return 0;
+    for (int ra = pa->firstRing; ra < pa->firstRing + pa->numRings; ra++)
+    {
+        const gpkgRing *ringA = &a->rings[ra];
+        int segsA = ringA->numPoints > 1 ? ringA->numPoints - 1 : 1;
+        for (int i = 0; i < segsA; i++)
+        {
+            const double *a1 = &a->coords[(ringA->firstPoint + i) * a->dimension];
+            const double *a2 = ringA->numPoints > 1 ? a1 + a->dimension : a1;
+            for (int rb = pb->firstRing; rb < pb->firstRing + pb->numRings; rb++)
+            {
+                const gpkgRing *ringB = &b->rings[rb];
+                int segsB = ringB->numPoints > 1 ? ringB->numPoints - 1 : 1;
+                for (int j = 0; j < segsB; j++)
+                {
+                    const double *b1 = &b->coords[(ringB->firstPoint + j) * b->dimension];
+                    const double *b2 = ringB->numPoints > 1 ? b1 + b->dimension : b1;
+                    // The segments don't intersect, so the distance is reached at an end point
+                    dist = fmin(dist, pointSegmentDistance(a1, b1, b2));
+                    dist = fmin(dist, pointSegmentDistance(a2, b1, b2));
+                    dist = fmin(dist, pointSegmentDistance(b1, a1, a2));
+                    dist = fmin(dist, pointSegmentDistance(b2, a1, a2));
+                }
+            }
+        }
+    }
+    return dist;
+}
+
+// Returns the distance between the geometries a and b or -1 if any of them is empty
+static double geometryDistance(const gpkgGeometry *a, const gpkgGeometry *b)
+{
+    double dist = HUGE_VAL;
+
+    if (a->numParts == 0 || b->numParts == 0)
+        return -1;
+    for (int i = 0; i < a->numParts && dist > 0; i++)
+    {
+        for (int j = 0; j < b->numParts && dist > 0; j++)
+            dist = fmin(dist, partsDistance(a, &a->parts[i], b, &b->parts[j]));
+    }
+    return dist;
+}
+
+// Polygon prepared for many point-in-polygon tests: the segments of all its rings are grouped in horizontal bands,
+// so a test only checks the segments of the band of the point instead of all the segments of the polygon
+typedef struct preparedPolygon
+{
+    double env[4];   // Envelope (minX, minY, maxX, maxY)
+    int numBands;    // Number of bands
+    double bandSize; // Height of each band
+    int *bandStart;  // First segment of each band in segs. bandStart[numBands] is the end of the last band
+    int maxBands;
+    double *segs;    // Segments (x1, y1, x2, y2) of each band
+    int maxSegs;
+} preparedPolygon;
+
+// Releases the buffers of a prepared polygon
+static void freePreparedPolygon(preparedPolygon *prep)
+{
+    sqlite3_free(prep->bandStart);
+    sqlite3_free(prep->segs);
+    memset(prep, 0, sizeof(preparedPolygon));
+}
+
+// Returns the band of a prepared polygon that contains the Y
+static int preparedPolygonBand(const preparedPolygon *prep, double y)
+{
+    int band = (int)((y - prep->env[1]) / prep->bandSize);
+
+    return band < 0 ? 0 : (band >= prep->numBands ? prep->numBands - 1 : band);
+}
+
+// Prepares the Polygons of a geometry for point-in-polygon tests. The other parts of the geometry are ignored
+// geom -> Geometry
+// prep <- Prepared polygon. Its buffers are reused
+// Returns 0 if there is no memory or 1 if it's correct
+static int prepareGPKGPolygon(const gpkgGeometry *geom, preparedPolygon *prep)
+{
+    int numSegs = 0;
+    int numBands;
+
+    memcpy(prep->env, geom->env, sizeof(prep->env));
+    for (int i = 0; i < geom->numParts; i++)
+    {
+        const gpkgPart *part = &geom->parts[i];
+        if (part->geometryType != wkbPolygon)
+            continue;
+        for (int r = part->firstRing; r < part->firstRing + part->numRings; r++)
+            numSegs += geom->rings[r].numPoints;
+    }
+    // About 4 segments per band
+    numBands = numSegs / 4 + 1;
+    if (numBands > prep->maxBands)
+    {
+        int *bandStart = (int *)sqlite3_realloc64(prep->bandStart, sizeof(int) * (numBands + 1));
+        if (bandStart == NULL)
+            return 0;
+        prep->bandStart = bandStart;
+        prep->maxBands = numBands;
+    }
+    prep->numBands = numBands;
+    prep->bandSize = (prep->env[3] - prep->env[1]) / numBands;
+    if (!(prep->bandSize > 0))
+        prep->bandSize = 1;
+
+    // Two passes over the segments: count the segments of each band and fill the bands
+    memset(prep->bandStart, 0, sizeof(int) * (numBands + 1));
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < geom->numParts; i++)
+        {
+            const gpkgPart *part = &geom->parts[i];
+            if (part->geometryType != wkbPolygon)
+                continue;
+            for (int r = part->firstRing; r < part->firstRing + part->numRings; r++)
+            {
+                const gpkgRing *ring = &geom->rings[r];
+                for (int k = 0; k < ring->numPoints; k++)
+                {
+                    const double *a = &geom->coords[(ring->firstPoint + k) * geom->dimension];
+                    const double *b = &geom->coords[(ring->firstPoint + (k + 1) % ring->numPoints) * geom->dimension];
+                    int first = preparedPolygonBand(prep, fmin(a[1], b[1]));
+                    int last = preparedPolygonBand(prep, fmax(a[1], b[1]));
+                    for (int band = first; band <= last; band++)
+                    {
+                        if (pass == 0)
+                            prep->bandStart[band + 1]++;
+                        else
+                        {
+                            double *seg = &prep->segs[(prep->bandStart[band]++) * 4];
+                            seg[0] = a[0];
+                            seg[1] = a[1];
+                            seg[2] = b[0];
+                            seg[3] = b[1];
+                        }
+                    }
+                }
+            }
+        }
+        if (pass == 0)
+        {
+            for (int band = 0; band < numBands; band++)
+                prep->bandStart[band + 1] += prep->bandStart[band];
+            if (prep->bandStart[numBands] > prep->maxSegs)
+            {
+                double *segs = (double *)sqlite3_realloc64(prep->segs, sizeof(double) * 4 * prep->bandStart[numBands]);
+                if (segs == NULL)
+                    return 0;
+                prep->segs = segs;
+                prep->maxSegs = prep->bandStart[numBands];
+            }
+        }
+    }
+    // The second pass moved each bandStart to the start of the next band
+    for (int band = numBands; band > 0; band--)
+        prep->bandStart[band] = prep->bandStart[band - 1];
+    prep->bandStart[0] = 0;
+    return 1;
+}
+
+// Locates a point with respect to a prepared polygon
+// The rings are tested together with the even-odd rule, so the holes and the parts of a MultiPolygon are handled as in pointInGeometry
+// Returns 0 if the point is outside, 1 if it is in the interior, 2 if it is on the boundary
+static int pointInPreparedPolygon(const preparedPolygon *prep, double x, double y)
+{
+    const double p[2] = { x, y };
+    int inside = 0;
+    int band;
+
+    if (x < prep->env[0] || x > prep->env[2] || y < prep->env[1] || y > prep->env[3])
+        return 0;
+    band = preparedPolygonBand(prep, y);
+    for (int i = prep->bandStart[band]; i < prep->bandStart[band + 1]; i++)
+    {
+        const double *a = &prep->segs[i * 4];
+        const double *b = a + 2;
+        if ((a[1] > y) != (b[1] > y))
+        {
+            double xi = a[0] + (y - a[1]) * (b[0] - a[0]) / (b[1] - a[1]);
+            if (xi == x)
+                return 2;
+            if (xi > x)
+                inside = !inside;
+        }
+        else if (orientation(a, b, p) == 0 && onSegmentEnvelope(a, b, p))
+            return 2;
+    }
+    return inside;
+}
+
+// Adds to dest the coordinate of the segment a-b where the ordinate axis takes the value
+static void clipIntersection(gpkgGeometry *dest, const double *a, const double *b, int axis, double value)
+{
+    double t = (value - a[axis]) / (b[axis] - a[axis]);
+    double *c = &dest->coords[dest->numPoints * dest->dimension];
+
+    for (int i = 0; i < dest->dimension; i++)
+        c[i] = a[i] + t * (b[i] - a[i]);
+    c[axis] = value;
+    dest->numPoints++;
+}
+
+// Adds a coordinate to dest
+static void clipPoint(gpkgGeometry *dest, const double *a)
+{
+    memcpy(&dest->coords[dest->numPoints * dest->dimension], a, sizeof(double) * dest->dimension);
+    dest->numPoints++;
+}
+
+// Piece of a ring of a Polygon clipped with a half-plane: a chain of coordinates that enters the half-plane through the line
+// and leaves it through the line, or a whole ring inside the half-plane
+typedef struct clipChain
+{
+    int ring;      // Ring of the scratch geometry with the coordinates
+    int isChain;   // 1 if it is a chain, 0 if it is a whole ring
+    int isOuter;   // 1 if it comes from the exterior ring
+    double exit;   // Position on the line where the chain leaves the half-plane
+    int used;      // 1 when the chain has been added to a ring
+} clipChain;
+
+// Position on the line where a chain enters the half-plane, sorted in the direction the rings are closed
+typedef struct clipEntry
+{
+    double key;
+    int chain;
+} clipEntry;
+
+// Compares two entries by position for qsort
+static int compareClipEntries(const void *a, const void *b)
+{
+    double ka = ((const clipEntry *)a)->key;
+    double kb = ((const clipEntry *)b)->key;
+
+    return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+// Adds a ring of the scratch geometry to a geometry
+static void clipCopyRing(const gpkgGeometry *scratch, int ring, gpkgGeometry *dest)
+{
+    const gpkgRing *src = &scratch->rings[ring];
+
+    memcpy(&dest->coords[dest->numPoints * dest->dimension], &scratch->coords[src->firstPoint * scratch->dimension], sizeof(double) * src->numPoints * scratch->dimension);
+    dest->rings[dest->numRings].firstPoint = dest->numPoints;
+    dest->rings[dest->numRings++].numPoints = src->numPoints;
+    dest->numPoints += src->numPoints;
+}
+
+// Clips a Polygon with a half-plane (see clipGPKGGeometry)
+// The rings are cut in chains inside the half-plane that begin and end on the line. With the exterior ring counterclockwise
+// and the holes clockwise, the interior is at the left of the chains, so going along the line from the end of a chain
+// (with the half-plane at the left) the next start of a chain found is the one that follows it.
+// This way a Polygon cut in several pieces gives several Polygons, and not a ring with bridges along the line
+// src -> Geometry
+// part -> Polygon of the geometry
+// axis, value, upper -> Half-plane
+// dest <-> Geometry where the Polygons are added
+// scratch <-> Geometry for the chains. Its buffers are reused
+// Returns 0 if there is no memory or 1 if it's correct
+static int clipGPKGPolygon(const gpkgGeometry *src, const gpkgPart *part, int axis, double value, int upper, gpkgGeometry *dest, gpkgGeometry *scratch)
+{
+    int other = 1 - axis;
+    double dir = ((axis == X) == (upper != 0)) ? -1 : 1; // Direction along the line that leaves the half-plane at the left
+    int totalPoints = 0;
+    clipChain *chains;
+    clipEntry *entries;
+    int numChains = 0, numEntries = 0, numOuters;
+    int firstOuter;
+    int ok = 0;
+
+    for (int r = part->firstRing; r < part->firstRing + part->numRings; r++)
+        totalPoints += src->rings[r].numPoints;
+    chains = (clipChain *)sqlite3_malloc64(sizeof(clipChain) * (totalPoints + part->numRings));
+    entries = (clipEntry *)sqlite3_malloc64(sizeof(clipEntry) * (totalPoints + part->numRings));
+    if (chains == NULL || entries == NULL)
+        goto end;
+    scratch->dimension = src->dimension;
+    scratch->numParts = scratch->numRings = scratch->numPoints = 0;
+
+    for (int r = part->firstRing; r < part->firstRing + part->numRings; r++)
+    {
+        const gpkgRing *ring = &src->rings[r];
+        const double *coords = &src->coords[ring->firstPoint * src->dimension];
+        int n = ring->numPoints - 1; // Without the closing coordinate
+        double area = 0;
+        int forward, start = -1;
+        if (n < 3)
+            continue;
+        for (int k = 1; k < n - 1; k++)
+            area += orientation(coords, &coords[k * src->dimension], &coords[(k + 1) * src->dimension]);
+        if (area == 0)
+            continue;
+        forward = (area > 0) == (r == part->firstRing);
+        if (!growGPKGGeometry(scratch, 0, n + 1, n * 2 + 2))
+            goto end;
+#define CLIP_COORD(k) (&coords[(forward ? (k) % n : (n - (k) % n) % n) * src->dimension])
+#define CLIP_INSIDE(p) (upper ? (p)[axis] > value : (p)[axis] < value)
+        for (int k = 0; k < n && start < 0; k++)
+        {
+            if (!CLIP_INSIDE(CLIP_COORD(k)))
+                start = k;
+        }
+        if (start < 0)
+        {
+            // The whole ring is inside the half-plane
+            chains[numChains].ring = scratch->numRings;
+            chains[numChains].isChain = 0;
+            chains[numChains].isOuter = r == part->firstRing;
+            chains[numChains++].used = 0;
+            memcpy(&scratch->coords[scratch->numPoints * scratch->dimension], coords, sizeof(double) * ring->numPoints * src->dimension);
+            scratch->rings[scratch->numRings].firstPoint = scratch->numPoints;
+            scratch->rings[scratch->numRings++].numPoints = ring->numPoints;
+            scratch->numPoints += ring->numPoints;
+            continue;
+        }
+        for (int k = start; k < start + n; k++)
+        {
+            const double *a = CLIP_COORD(k);
+            const double *b = CLIP_COORD(k + 1);
+            int insideA = CLIP_INSIDE(a);
+            int insideB = CLIP_INSIDE(b);
+            if (!insideA && insideB)
+            {
+                // Enters the half-plane: start a chain
+                scratch->rings[scratch->numRings].firstPoint = scratch->numPoints;
+                clipIntersection(scratch, a, b, axis, value);
+                entries[numEntries].key = dir * scratch->coords[(scratch->numPoints - 1) * scratch->dimension + other];
+                entries[numEntries++].chain = numChains;
+            }
+            if (insideB)
+                clipPoint(scratch, b);
+            else if (insideA)
+            {
+                // Leaves the half-plane: end the chain
+                clipIntersection(scratch, a, b, axis, value);
+                scratch->rings[scratch->numRings].numPoints = scratch->numPoints - scratch->rings[scratch->numRings].firstPoint;
+                chains[numChains].ring = scratch->numRings++;
+                chains[numChains].isChain = 1;
+                chains[numChains].isOuter = r == part->firstRing;
+                chains[numChains].exit = dir * scratch->coords[(scratch->numPoints - 1) * scratch->dimension + other];
+                chains[numChains++].used = 0;
+            }
+        }
+#undef CLIP_COORD
+#undef CLIP_INSIDE
+    }
+    qsort(entries, numEntries, sizeof(clipEntry), compareClipEntries);
+
+    // Join the chains in exterior rings, added at the end of the scratch geometry
+    firstOuter = scratch->numRings;
+    for (int c = 0; c < numChains; c++)
+    {
+        int current = c;
+        int firstPoint = scratch->numPoints;
+        if (!chains[c].isChain || chains[c].used)
+            continue;
+        while (!chains[current].used)
+        {
+            const gpkgRing *ring;
+            int lo = 0, hi = numEntries;
+            chains[current].used = 1;
+            ring = &scratch->rings[chains[current].ring];
+            if (!growGPKGGeometry(scratch, 0, 1, ring->numPoints + 1))
+                goto end;
+            ring = &scratch->rings[chains[current].ring];
+            memcpy(&scratch->coords[scratch->numPoints * scratch->dimension], &scratch->coords[ring->firstPoint * scratch->dimension], sizeof(double) * ring->numPoints * scratch->dimension);
+            scratch->numPoints += ring->numPoints;
+            // Next start of a chain along the line
+            while (lo < hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (entries[mid].key < chains[current].exit)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo == numEntries)
+                break;
+            current = entries[lo].chain;
+        }
+        if (scratch->numPoints - firstPoint < 3)
+        {
+            scratch->numPoints = firstPoint;
+            continue;
+        }
+        clipPoint(scratch, &scratch->coords[firstPoint * scratch->dimension]); // Close the ring
+        scratch->rings[scratch->numRings].firstPoint = firstPoint;
+        scratch->rings[scratch->numRings++].numPoints = scratch->numPoints - firstPoint;
+    }
+    // A whole exterior ring is also an exterior ring of the result
+    for (int c = 0; c < numChains; c++)
+    {
+        if (!chains[c].isChain && chains[c].isOuter)
+        {
+            if (!growGPKGGeometry(scratch, 0, 1, 0))
+                goto end;
+            scratch->rings[scratch->numRings++] = scratch->rings[chains[c].ring];
+        }
+    }
+    numOuters = scratch->numRings - firstOuter;
+
+    // Each exterior ring is a Polygon with the whole holes inside it
+    for (int o = 0; o < numOuters; o++)
+    {
+        int firstRing = dest->numRings;
+        if (!growGPKGGeometry(dest, 1, 1, scratch->rings[firstOuter + o].numPoints))
+            goto end;
+        clipCopyRing(scratch, firstOuter + o, dest);
+        for (int c = 0; c < numChains; c++)
+        {
+            const gpkgRing *hole = &scratch->rings[chains[c].ring];
+            if (chains[c].isChain || chains[c].isOuter || chains[c].used)
+                continue;
+            if (!pointInRing(scratch, &scratch->rings[firstOuter + o], &scratch->coords[hole->firstPoint * scratch->dimension]))
+                continue;
+            chains[c].used = 1;
+            if (!growGPKGGeometry(dest, 0, 1, hole->numPoints))
+                goto end;
+            clipCopyRing(scratch, chains[c].ring, dest);
+        }
+        dest->parts[dest->numParts].geometryType = wkbPolygon;
+        dest->parts[dest->numParts].firstRing = firstRing;
+        dest->parts[dest->numParts++].numRings = dest->numRings - firstRing;
+    }
+    ok = 1;
+
+end:
+    sqlite3_free(chains);
+    sqlite3_free(entries);
+    return ok;
+}
+
+// Clips a geometry parsed in memory with a half-plane: the side of an axis-parallel line
+// A Polygon can be cut in several Polygons; a LineString is split where it leaves the half-plane;
+// a Point is kept if it is in the half-plane. The Points on the line only belong to the upper side, so no Point is returned twice
+// src -> Geometry to clip
+// axis -> X or Y
+// value -> Position of the line
+// upper -> 1 to keep the side where the ordinate is greater than value, 0 to keep the side where it is lower
+// dest <- Clipped geometry. Its buffers are reused
+// scratch <-> Geometry for the pieces of the Polygons. Its buffers are reused
+// Returns 0 if there is no memory or 1 if it's correct
+static int clipGPKGGeometry(const gpkgGeometry *src, int axis, double value, int upper, gpkgGeometry *dest, gpkgGeometry *scratch)
+{
+    dest->geometryType = src->geometryType;
+    dest->srsId = src->srsId;
+    dest->hasZ = src->hasZ;
+    dest->hasM = src->hasM;
+    dest->dimension = src->dimension;
+    dest->numParts = dest->numRings = dest->numPoints = 0;
+    for (int i = 0; i < src->numParts; i++)
+    {
+        const gpkgPart *part = &src->parts[i];
+        int firstRing = dest->numRings;
+        if (part->geometryType == wkbPolygon)
+        {
+            if (!clipGPKGPolygon(src, part, axis, value, upper, dest, scratch))
+                return 0;
+            continue;
+        }
+        for (int r = part->firstRing; r < part->firstRing + part->numRings; r++)
+        {
+            const gpkgRing *ring = &src->rings[r];
+            const double *coords = &src->coords[ring->firstPoint * src->dimension];
+            int firstPoint = dest->numPoints;
+            // A ring can get one more coordinate for each segment crossing the line, plus the closing one
+            if (!growGPKGGeometry(dest, 1, ring->numPoints, ring->numPoints * 2 + 1))
+                return 0;
+            if (part->geometryType == wkbPoint)
+            {
+                if (upper ? coords[axis] >= value : coords[axis] < value)
+                {
+                    clipPoint(dest, coords);
+                    dest->rings[dest->numRings].firstPoint = firstPoint;
+                    dest->rings[dest->numRings++].numPoints = 1;
+                }
+            }
+            else if (part->geometryType == wkbLineString)
+            {
+                for (int k = 0; k < ring->numPoints; k++)
+                {
+                    const double *b = &coords[k * src->dimension];
+                    int insideB = upper ? b[axis] >= value : b[axis] <= value;
+                    if (k > 0)
+                    {
+                        const double *a = b - src->dimension;
+                        int insideA = upper ? a[axis] >= value : a[axis] <= value;
+                        if (insideA && !insideB)
+                        {
+                            // Leaves the half-plane: end the current LineString
+                            if (a[axis] != value)
+                                clipIntersection(dest, a, b, axis, value);
+                            if (dest->numPoints - firstPoint >= 2)
+                            {
+                                dest->rings[dest->numRings].firstPoint = firstPoint;
+                                dest->rings[dest->numRings++].numPoints = dest->numPoints - firstPoint;
+                            }
+                            else
+                                dest->numPoints = firstPoint;
+                            firstPoint = dest->numPoints;
+                        }
+                        else if (!insideA && insideB && b[axis] != value)
+                            clipIntersection(dest, a, b, axis, value); // Enters the half-plane
+                    }
+                    if (insideB)
+                        clipPoint(dest, b);
+                }
+                if (dest->numPoints - firstPoint >= 2)
+                {
+                    dest->rings[dest->numRings].firstPoint = firstPoint;
+                    dest->rings[dest->numRings++].numPoints = dest->numPoints - firstPoint;
+                }
+                else
+                    dest->numPoints = firstPoint;
+            }
+        }
+        // Each LineString (or the Point) is a part
+        if (!growGPKGGeometry(dest, dest->numRings - firstRing, 0, 0))
+            return 0;
+        for (int r = firstRing; r < dest->numRings; r++)
+        {
+            dest->parts[dest->numParts].geometryType = part->geometryType;
+            dest->parts[dest->numParts].firstRing = r;
+            dest->parts[dest->numParts++].numRings = 1;
+        }
+    }
+    computeGPKGEnvelope(dest);
+    return 1;
+}
+
+// Spatial predicates
+#define PREDICATE_ENVELOPE 0
+#define PREDICATE_INTERSECTS 1
+#define PREDICATE_CONTAINS 2
+#define PREDICATE_WITHIN 3
+
+// SQL function: ST_MinX(GEOMETRY); 
+// Returns the minimum X of a geometry or NULL if there is an error
+static void fnct_STMinX(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int index = 0;
+    double res;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+        n_bytes = sqlite3_value_bytes(argv[0]);
+        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        {
+            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), X, MIN, wkbGeometry, &res))
+            {
+                sqlite3_result_double(context, res);
+                return;
+            }
+        }
+    }
+    sqlite3_result_null(context);
+}
+
+// SQL function: ST_MinY(GEOMETRY); 
+// Returns the minimum Y of a geometry or NULL if there is an error
+static void fnct_STMinY(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int index = 0;
+    double res;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+        n_bytes = sqlite3_value_bytes(argv[0]);
+        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        {
+            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), Y, MIN, wkbGeometry, &res))
+            {
+                sqlite3_result_double(context, res);
+                return;
+            }
+        }
+    }
+    sqlite3_result_null(context);
+}
+
+// SQL function: ST_MinZ(GEOMETRY); 
+// Returns the minimum Z of a geometry or NULL if there is an error
+static void fnct_STMinZ(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int index = 0;
+    double res;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+        n_bytes = sqlite3_value_bytes(argv[0]);
+        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        {
+            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), Z, MIN, wkbGeometry, &res))
+            {
+                sqlite3_result_double(context, res);
+                return;
+            }
+        }
+    }
+    sqlite3_result_null(context);
+}
+
+// SQL function: ST_MinM(GEOMETRY); 
+// Returns the minimum M of a geometry or NULL if there is an error
+static void fnct_STMinM(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int index = 0;
+    double res;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+        n_bytes = sqlite3_value_bytes(argv[0]);
+        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        {
+            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), M, MIN, wkbGeometry, &res))
+            {
+                sqlite3_result_double(context, res);
+                return;
+            }
+        }
+    }
+    sqlite3_result_null(context);
+}
+
+// SQL function: SQL function: ST_MaxX(GEOMETRY); 
+// Returns the maximum X of a geometry or NULL if there is an error
+static void fnct_STMaxX(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int index = 0;
+    double res;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+        n_bytes = sqlite3_value_bytes(argv[0]);
+        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        {
+            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), X, MAX, wkbGeometry, &res))
+            {
+                sqlite3_result_double(context, res);
+                return;
+            }
+        }
+    }
+    sqlite3_result_null(context);
+}
+
+// SQL function: SQL function: ST_MaxY(GEOMETRY); 
+// Returns the maximum Y of a geometry or NULL if there is an error
+static void fnct_STMaxY(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int index = 0;
+    double res;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+        n_bytes = sqlite3_value_bytes(argv[0]);
+        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        {
+            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), Y, MAX, wkbGeometry, &res))
+            {
+                sqlite3_result_double(context, res);
+                return;
+            }
+        }
+    }
+    sqlite3_result_null(context);
+}
+
+// SQL function: SQL function: ST_MaxZ(GEOMETRY); 
+// Returns the maximum Z of a geometry or NULL if there is an error
+static void fnct_STMaxZ(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int index = 0;
+    double res;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+        n_bytes = sqlite3_value_bytes(argv[0]);
+        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        {
+            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), Z, MAX, wkbGeometry, &res))
+            {
+                sqlite3_result_double(context, res);
+                return;
+            }
+        }
+    }
+    sqlite3_result_null(context);
+}
+
+// SQL function: SQL function: ST_MaxM(GEOMETRY); 
 // Returns the maximum M of a geometry or NULL if there is an error
 static void fnct_STMaxM(sqlite3_context *context, int argc, sqlite3_value **argv)
 {
-    unsigned char *p_blob;
-    int n_bytes;
-    int index = 0;
-    double res;
+    unsigned char *p_blob;
+    int n_bytes;
+    int index = 0;
+    double res;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+        n_bytes = sqlite3_value_bytes(argv[0]);
+        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
+        {
+            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), M, MAX, wkbGeometry, &res))
+            {
+                sqlite3_result_double(context, res);
+                return;
+            }
+        }
+    }
+    sqlite3_result_null(context);
+}
+
+// SQL function: ST_X(GEOMETRY); 
+// Returns the X of a Point or NULL if it is not a Point or there is an error
+static void fnct_STX(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    double x, y;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        if (readGPKGPointXY((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), &x, &y))
+        {
+            sqlite3_result_double(context, x);
+            return;
+        }
+    }
+    sqlite3_result_null(context);
+}
+
+// SQL function: ST_Y(GEOMETRY); 
+// Returns the Y of a Point or NULL if it is not a Point or there is an error
+static void fnct_STY(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    double x, y;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        if (readGPKGPointXY((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), &x, &y))
+        {
+            sqlite3_result_double(context, y);
+            return;
+        }
+    }
+    sqlite3_result_null(context);
+}
+
+// Gets the center of the envelope of a geometry in GPKG format. The coordinates of a Point are read directly
+// p_blob -> BLOB with geometry in GPKG format
+// n_bytes -> Length in bytes of the blob
+// env <- Envelope (minX, minY, maxX, maxY)
+// Returns 0 if the geometry is empty or there is an error, 1 if it's correct
+static int readGPKGEnvelope(unsigned char *p_blob, int n_bytes, double *env)
+{
+    gpkgGeometry geom;
+    int ok;
+
+    if (readGPKGPointXY(p_blob, n_bytes, &env[0], &env[1]))
+    {
+        env[2] = env[0];
+        env[3] = env[1];
+        return 1;
+    }
+    memset(&geom, 0, sizeof(gpkgGeometry));
+    ok = readGPKGGeometry(p_blob, n_bytes, &geom) && geom.numParts > 0;
+    if (ok)
+        memcpy(env, geom.env, sizeof(double) * 4);
+    freeGPKGGeometry(&geom);
+    return ok;
+}
+
+// Adds to a geohash the characters of the cells that contain a Point, each of 5 bits alternating longitude and latitude
+// x, y -> Longitude and latitude
+// hash <- Geohash, with room for precision characters and the terminator
+// precision -> Number of characters
+static void geoHash(double x, double y, char *hash, int precision)
+{
+    static const char base32[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+    double lon[2] = { -180, 180 };
+    double lat[2] = { -90, 90 };
+    int even = 1;
+
+    for (int i = 0; i < precision; i++)
+    {
+        int bits = 0;
+        for (int b = 0; b < 5; b++)
+        {
+            double *range = even ? lon : lat;
+            double value = even ? x : y;
+            double mid = (range[0] + range[1]) / 2;
+            bits <<= 1;
+            if (value >= mid)
+            {
+                bits |= 1;
+                range[0] = mid;
+            }
+            else
+                range[1] = mid;
+            even = !even;
+        }
+        hash[i] = base32[bits];
+    }
+    hash[precision] = '\0';
+}
+
+// SQL function: ST_GeoHash(GEOMETRY); ST_GeoHash(GEOMETRY, precision); 
+// Returns the geohash of a geometry with coordinates in longitude and latitude
+// precision -> optional parameter. Number of characters (1 to GEOHASH_MAX_PRECISION) of the geohash of the center of the envelope.
+//              If not specified returns the longest geohash (up to GEOHASH_MAX_PRECISION characters) whose cell contains the envelope
+// Returns NULL if the geometry is NULL, empty, out of the range of longitudes and latitudes or there is an error
+static void fnct_STGeoHash(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    char hash[GEOHASH_MAX_PRECISION + 1], hashMax[GEOHASH_MAX_PRECISION + 1];
+    double env[4];
+    int precision = GEOHASH_MAX_PRECISION;
+
+    if (argc == 2)
+    {
+        if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER || sqlite3_value_int(argv[1]) < 1 || sqlite3_value_int(argv[1]) > GEOHASH_MAX_PRECISION)
+        {
+            sqlite3_result_error(context, "ST_GeoHash() error: argument 2 [precision] must be an integer between 1 and 12", -1);
+            return;
+        }
+        precision = sqlite3_value_int(argv[1]);
+    }
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || !readGPKGEnvelope((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), env) ||
+        env[0] < -180 || env[2] > 180 || env[1] < -90 || env[3] > 90)
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    if (argc == 2)
+        geoHash((env[0] + env[2]) / 2, (env[1] + env[3]) / 2, hash, precision);
+    else
+    {
+        // The cells are nested: the cell of the envelope is the common prefix of the cells of its corners
+        geoHash(env[0], env[1], hash, precision);
+        geoHash(env[2], env[3], hashMax, precision);
+        for (int i = 0; i < precision; i++)
+        {
+            if (hash[i] != hashMax[i])
+            {
+                hash[i] = '\0';
+                break;
+            }
+        }
+    }
+    sqlite3_result_text(context, hash, -1, SQLITE_TRANSIENT);
+}
+
+// SQL function: ST_QuadKey(GEOMETRY, zoom); 
+// Returns the quadkey of the Web Mercator tile of a zoom level that contains the center of the envelope of a geometry
+// with coordinates in longitude and latitude. Latitudes are clipped to the range of Web Mercator
+// zoom -> Zoom level, from 1 to QUADKEY_MAX_ZOOM. The quadkey has one digit per level
+// Returns NULL if the geometry is NULL, empty or there is an error
+static void fnct_STQuadKey(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    char quadKey[QUADKEY_MAX_ZOOM + 1];
+    double env[4], x, y, sinLat;
+    unsigned int tileX, tileY, n;
+    int zoom;
+
+    if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER || sqlite3_value_int(argv[1]) < 1 || sqlite3_value_int(argv[1]) > QUADKEY_MAX_ZOOM)
+    {
+        sqlite3_result_error(context, "ST_QuadKey() error: argument 2 [zoom] must be an integer between 1 and 23", -1);
+        return;
+    }
+    zoom = sqlite3_value_int(argv[1]);
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || !readGPKGEnvelope((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), env))
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    x = ((env[0] + env[2]) / 2 + 180) / 360;
+    sinLat = sin(fmax(-85.05112878, fmin(85.05112878, (env[1] + env[3]) / 2)) * M_PI / 180);
+    y = 0.5 - log((1 + sinLat) / (1 - sinLat)) / (4 * M_PI);
+    n = 1u << zoom;
+    tileX = x <= 0 ? 0 : (x >= 1 ? n - 1 : (unsigned int)(x * n));
+    tileY = y <= 0 ? 0 : (y >= 1 ? n - 1 : (unsigned int)(y * n));
+    for (int i = 0; i < zoom; i++)
+    {
+        unsigned int mask = 1u << (zoom - 1 - i);
+        quadKey[i] = '0' + ((tileX & mask) ? 1 : 0) + ((tileY & mask) ? 2 : 0);
+    }
+    quadKey[zoom] = '\0';
+    sqlite3_result_text(context, quadKey, -1, SQLITE_TRANSIENT);
+}
+
+// SQL function: GPKG_HilbertKey(x, y, minX, minY, maxX, maxY); 
+// Returns the distance along the Hilbert curve of the cell where the coordinate (x, y) falls, or NULL if x or y are NULL
+// minX, minY, maxX, maxY -> Extent divided in a grid of 2^16 x 2^16 cells. Coordinates outside the extent fall in the border cells
+static void fnct_GPKGHilbertKey(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    double minx, miny, maxx, maxy;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL || sqlite3_value_type(argv[1]) == SQLITE_NULL)
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    minx = sqlite3_value_double(argv[2]);
+    miny = sqlite3_value_double(argv[3]);
+    maxx = sqlite3_value_double(argv[4]);
+    maxy = sqlite3_value_double(argv[5]);
+    if (!(maxx > minx) || !(maxy > miny))
+    {
+        sqlite3_result_error(context, "GPKG_HilbertKey() error: empty extent", -1);
+        return;
+    }
+    sqlite3_result_int64(context, hilbertKey(hilbertCell(sqlite3_value_double(argv[0]), minx, maxx),
+        hilbertCell(sqlite3_value_double(argv[1]), miny, maxy), HILBERT_ORDER));
+}
+
+// The canonical stream of a geometry is its geometry type followed, for each run of coordinates (see walkWKBRuns), by the type of the part,
+// the number of the ring, Z and M flags, the number of coordinates and the ordinates, with -0 read as 0 and every NaN as the same NaN.
+// It doesn't depend on the envelope of the GPKG header, the byte orders, the SRID of the WKB or the SRS ID.
+// Nested collections are compared by their parts: a GeometryCollection of a MultiPoint is equal to a GeometryCollection of its Points
+
+// Reads the geometry type of a geometry in GPKG format, without Z, M and SRID flags
+// Returns the geometry type or -1 if there is an error
+static int readGPKGGeometryType(unsigned char *p_blob, int n_bytes)
+{
+    int index = 0;
+    unsigned char byteOrder;
+
+    if (n_bytes < 13 || !skipGPKGHeader(p_blob, n_bytes, &index) || index + 5 > n_bytes)
+        return -1;
+    byteOrder = p_blob[index++];
+    if (byteOrder != LITTLE_ENDIAN && byteOrder != BIG_ENDIAN)
+        return -1;
+    return (getInt(p_blob, &index, byteOrder) & 0xffff) % 1000;
+}
+
+// Returns the bits of an ordinate of the canonical stream
+static sqlite3_uint64 canonicalOrdinate(double value)
+{
+    sqlite3_uint64 bits;
+
+    if (isnan(value))
+        value = NAN;
+    else if (value == 0)
+        value = 0; // -0
+    memcpy(&bits, &value, 8);
+    return bits;
+}
+
+// Returns the word of the canonical stream that describes a run of coordinates
+static sqlite3_uint64 canonicalRun(const wkbRun *run)
+{
+    return (sqlite3_uint64)run->geometryType | ((sqlite3_uint64)run->hasZ << 4) | ((sqlite3_uint64)run->hasM << 5) |
+        ((sqlite3_uint64)(unsigned int)run->ring << 8) | ((sqlite3_uint64)(unsigned int)run->numPoints << 32);
+}
+
+// 64 bit hash of a canonical stream, word by word (the mixing of MurmurHash3)
+typedef struct geometryHash
+{
+    sqlite3_uint64 h;
+    sqlite3_uint64 length;
+} geometryHash;
+
+// Rotates a 64 bit word to the left
+static sqlite3_uint64 rotl64(sqlite3_uint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// Adds a word to a hash
+static void hashWord(geometryHash *hash, sqlite3_uint64 k)
+{
+    k *= 0x87c37b91114253d5ULL;
+    k = rotl64(k, 31);
+    k *= 0x4cf5ad432745937fULL;
+    hash->h ^= k;
+    hash->h = rotl64(hash->h, 27) * 5 + 0x52dce729;
+    hash->length++;
+}
+
+// Adds a run of coordinates to a hash
+static int hashRun(const wkbRun *run, void *ctx)
+{
+    geometryHash *hash = (geometryHash *)ctx;
+    int index = 0;
+
+    hashWord(hash, canonicalRun(run));
+    for (int i = 0; i < run->numPoints * run->dimension; i++)
+        hashWord(hash, canonicalOrdinate(getDouble(run->coords, &index, run->byteOrder)));
+    return 1;
+}
+
+// SQL function: ST_GeometryHash(GEOMETRY); 
+// Returns a 64 bit hash of the canonical stream of a geometry: equal geometries written with or without envelope, in other byte orders
+// or with an SRID in the WKB have the same hash. The hash is the same in every platform
+// Returns NULL if the geometry is NULL or there is an error
+static void fnct_STGeometryHash(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int geometryType;
+    geometryHash hash = { 0, 0 };
+    sqlite3_uint64 h;
+
+    p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+    n_bytes = sqlite3_value_bytes(argv[0]);
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || (geometryType = readGPKGGeometryType(p_blob, n_bytes)) < 0)
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    hashWord(&hash, (sqlite3_uint64)geometryType);
+    if (!walkGPKGRuns(p_blob, n_bytes, hashRun, &hash))
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+
+    // Finalization of MurmurHash3
+    h = hash.h ^ hash.length;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    sqlite3_result_int64(context, (sqlite3_int64)h);
+}
+
+// Reader of the runs of coordinates of a WKB geometry one by one, in the order of walkWKBRuns.
+// The headers of the collections are skipped as they are found, so it doesn't need a stack
+typedef struct wkbRunCursor
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int index;     // Position of the next run or header
+    int numRings;  // Rings of the current Polygon
+    wkbRun run;    // Last run read
+} wkbRunCursor;
+
+// Reads the next run of coordinates of a cursor
+// Returns 0 if there are no more runs or there is an error, 1 if it's correct
+static int nextWKBRun(wkbRunCursor *cursor)
+{
+    wkbRun *run = &cursor->run;
+    unsigned char *p_blob = cursor->p_blob;
+    unsigned char byteOrder;
+    int typeInt;
+
+    if (run->geometryType == wkbPolygon && run->ring + 1 < cursor->numRings)
+        run->ring++;
+    else
+    {
+        for (;;)
+        {
+            // Header of a Point, LineString, Polygon or collection
+            if (cursor->index + 5 > cursor->n_bytes)
+                return 0;
+            byteOrder = p_blob[cursor->index++];
+            if (byteOrder == LITTLE_ENDIAN || byteOrder == BIG_ENDIAN)
+                run->byteOrder = byteOrder;
+            typeInt = getInt(p_blob, &cursor->index, run->byteOrder);
+            run->hasZ = ((typeInt & 0x80000000) != 0 || (typeInt & 0xffff) / 1000 == 1 || (typeInt & 0xffff) / 1000 == 3);
+            run->hasM = ((typeInt & 0x40000000) != 0 || (typeInt & 0xffff) / 1000 == 2 || (typeInt & 0xffff) / 1000 == 3);
+            run->dimension = 2 + run->hasZ + run->hasM;
+            run->geometryType = (typeInt & 0xffff) % 1000;
+            run->ring = 0;
+            if ((typeInt & 0x20000000) != 0) // Skip the SRID
+                cursor->index += 4;
+            if (run->geometryType < wkbPoint || run->geometryType > wkbGeometryCollection)
+                return 0;
+            if (run->geometryType == wkbPoint)
+                break;
+            if (cursor->index + 4 > cursor->n_bytes)
+                return 0;
+            if (run->geometryType == wkbLineString)
+            {
+                cursor->numRings = 1;
+                break;
+            }
+            // Number of rings of a Polygon or parts of a collection, whose headers follow
+            cursor->numRings = getInt(p_blob, &cursor->index, run->byteOrder);
+            if (run->geometryType == wkbPolygon && cursor->numRings > 0)
+                break;
+        }
+    }
+    if (run->geometryType == wkbPoint)
+        run->numPoints = 1;
+    else
+    {
+        if (cursor->index + 4 > cursor->n_bytes)
+            return 0;
+        run->numPoints = getInt(p_blob, &cursor->index, run->byteOrder);
+    }
+    if (run->numPoints < 0 || (sqlite3_int64)run->numPoints * run->dimension * 8 > cursor->n_bytes - cursor->index)
+        return 0;
+    run->coords = p_blob + cursor->index;
+    cursor->index += run->numPoints * run->dimension * 8;
+    return 1;
+}
+
+// Context of the visitor that compares the runs of a geometry with the runs of another one
+typedef struct equalContext
+{
+    wkbRunCursor other; // Runs of the other geometry
+    int differ;         // 1 if the runs are different
+} equalContext;
+
+// Compares a run of coordinates of the first geometry with the next run of the second one
+static int equalRun(const wkbRun *run, void *ctx)
+{
+    equalContext *equal = (equalContext *)ctx;
+    const wkbRun *other = &equal->other.run;
+    int index = 0, otherIndex = 0;
+
+    if (!nextWKBRun(&equal->other) || canonicalRun(run) != canonicalRun(other))
+    {
+        equal->differ = 1;
+        return 0;
+    }
+    for (int i = 0; i < run->numPoints * run->dimension; i++)
+    {
+        if (canonicalOrdinate(getDouble(run->coords, &index, run->byteOrder)) != canonicalOrdinate(getDouble(other->coords, &otherIndex, other->byteOrder)))
+        {
+            equal->differ = 1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// SQL function: ST_EqualsExact(GEOMETRY1, GEOMETRY2); 
+// Returns 1 if two geometries have the same canonical stream (same types, structure and coordinates, in the same order),
+// 0 if they don't, NULL if a geometry is NULL or there is an error. The streams are compared while they are read, without copying them
+static void fnct_STEqualsExact(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int geometryType;
+    equalContext equal;
+
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || sqlite3_value_type(argv[1]) != SQLITE_BLOB)
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+    n_bytes = sqlite3_value_bytes(argv[0]);
+    memset(&equal, 0, sizeof(equalContext));
+    equal.other.p_blob = (unsigned char *)sqlite3_value_blob(argv[1]);
+    equal.other.n_bytes = sqlite3_value_bytes(argv[1]);
+    equal.other.run.byteOrder = endian();
+    geometryType = readGPKGGeometryType(p_blob, n_bytes);
+    if (geometryType < 0 || readGPKGGeometryType(equal.other.p_blob, equal.other.n_bytes) < 0 ||
+        !skipGPKGHeader(equal.other.p_blob, equal.other.n_bytes, &equal.other.index))
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    if (geometryType != readGPKGGeometryType(equal.other.p_blob, equal.other.n_bytes))
+    {
+        sqlite3_result_int(context, 0);
+        return;
+    }
+    if (!walkGPKGRuns(p_blob, n_bytes, equalRun, &equal) && !equal.differ)
+    {
+        sqlite3_result_null(context); // The first geometry is not valid
+        return;
+    }
+    // The second geometry must not have more runs
+    sqlite3_result_int(context, !equal.differ && !nextWKBRun(&equal.other));
+}
+
+// Snaps a geometry to a grid (see snapGPKGGeometry) and returns it as the result of the context
+// Returns NULL if the geometry is NULL or there is an error. If everything collapses returns an empty geometry of the same type
+static void resultSnappedGeometry(sqlite3_context *context, sqlite3_value *value, double size)
+{
+    gpkgGeometry geom;
+    unsigned char *p_blob;
+    int n_bytes;
+
+    memset(&geom, 0, sizeof(gpkgGeometry));
+    if (sqlite3_value_type(value) != SQLITE_BLOB || !readGPKGGeometry((unsigned char *)sqlite3_value_blob(value), sqlite3_value_bytes(value), &geom))
+    {
+        freeGPKGGeometry(&geom);
+        sqlite3_result_null(context);
+        return;
+    }
+    snapGPKGGeometry(&geom, size);
+    computeGPKGEnvelope(&geom);
+    if (!writeGPKGGeometry(&geom, readGPKGEnvelopeType((unsigned char *)sqlite3_value_blob(value), sqlite3_value_bytes(value)), &p_blob, &n_bytes))
+        sqlite3_result_error_nomem(context);
+    else
+        sqlite3_result_blob(context, p_blob, n_bytes, sqlite3_free);
+    freeGPKGGeometry(&geom);
+}
+
+// SQL function: ST_SnapToGrid(GEOMETRY, size); 
+// Snaps the X and Y of a geometry to a grid and removes the consecutive repeated coordinates and the parts and rings that collapse
+// size -> Size of the cells of the grid
+// Returns NULL if the geometry is NULL or there is an error
+static void fnct_STSnapToGrid(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    if ((sqlite3_value_type(argv[1]) != SQLITE_INTEGER && sqlite3_value_type(argv[1]) != SQLITE_FLOAT) || !(sqlite3_value_double(argv[1]) > 0))
+    {
+        sqlite3_result_error(context, "ST_SnapToGrid() error: argument 2 [size] must be a number greater than 0", -1);
+        return;
+    }
+    resultSnappedGeometry(context, argv[0], sqlite3_value_double(argv[1]));
+}
+
+// SQL function: ST_ReducePrecision(GEOMETRY, decimals); 
+// Rounds the X and Y of a geometry to a number of decimals and removes the consecutive repeated coordinates and the parts and rings that collapse
+// decimals -> Number of decimals, from -9 to 15. Negative values round to tens, hundreds...
+// Returns NULL if the geometry is NULL or there is an error
+static void fnct_STReducePrecision(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER || sqlite3_value_int(argv[1]) < -9 || sqlite3_value_int(argv[1]) > 15)
+    {
+        sqlite3_result_error(context, "ST_ReducePrecision() error: argument 2 [decimals] must be an integer between -9 and 15", -1);
+        return;
+    }
+    resultSnappedGeometry(context, argv[0], pow(10, -sqlite3_value_int(argv[1])));
+}
+
+// Vertex of a ring being triangulated by ST_Triangulate (ear clipping). The vertices are linked by their position in earcut.nodes
+typedef struct earcutNode
+{
+    int i;            // Index of the vertex in the mesh
+    double x, y;
+    int prev, next;   // Previous and next vertices of the ring
+    int z;            // Position in the z-order curve
+    int prevZ, nextZ; // Previous and next vertices in z-order, -1 at the ends
+    int steiner;      // 1 if the vertex is a hole of only one point
+} earcutNode;
+
+// State of the triangulation of a Polygon
+typedef struct earcut
+{
+    earcutNode *nodes;
+    int numNodes, maxNodes;
+    unsigned int *indices; // 3 vertices by triangle
+    int numIndices, maxIndices;
+    double minX, minY, invSize; // Transformation of the coordinates to the z-order grid. invSize is 0 if it's not used
+    int failed;                 // 1 if there wasn't memory
+} earcut;
+
+#define EN(k) (e->nodes[k])
+
+// Signed area of a triangle: negative if the vertices are counter-clockwise (the y axis goes down in earcut)
+static double earcutArea(earcut *e, int p, int q, int r)
+{
+    return (EN(q).y - EN(p).y) * (EN(r).x - EN(q).x) - (EN(q).x - EN(p).x) * (EN(r).y - EN(q).y);
+}
+
+static int earcutEquals(earcut *e, int p, int q)
+{
+    return EN(p).x == EN(q).x && EN(p).y == EN(q).y;
+}
+
+static int earcutPointInTriangle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+{
+    return (cx - px) * (ay - py) >= (ax - px) * (cy - py) && (ax - px) * (by - py) >= (bx - px) * (ay - py) && (bx - px) * (cy - py) >= (cx - px) * (by - py);
+}
+
+// Position of (x, y) in the z-order curve of the grid of 32768 x 32768 cells over the Polygon
+static int earcutZOrder(earcut *e, double x, double y)
+{
+    unsigned int ix = (unsigned int)((x - e->minX) * e->invSize);
+    unsigned int iy = (unsigned int)((y - e->minY) * e->invSize);
+
+    ix = (ix | (ix << 8)) & 0x00FF00FF;
+    ix = (ix | (ix << 4)) & 0x0F0F0F0F;
+    ix = (ix | (ix << 2)) & 0x33333333;
+    ix = (ix | (ix << 1)) & 0x55555555;
+    iy = (iy | (iy << 8)) & 0x00FF00FF;
+    iy = (iy | (iy << 4)) & 0x0F0F0F0F;
+    iy = (iy | (iy << 2)) & 0x33333333;
+    iy = (iy | (iy << 1)) & 0x55555555;
+    return (int)(ix | (iy << 1));
+}
+
+// Creates a vertex and links it after last (-1 to start a ring)
+// Returns the vertex, or -1 if there isn't memory
+static int earcutInsertNode(earcut *e, int i, double x, double y, int last)
+{
+    int p;
+
+    if (e->numNodes == e->maxNodes)
+    {
+        int maxNodes = e->maxNodes * 2 + 64;
+        earcutNode *nodes = sqlite3_realloc64(e->nodes, sizeof(earcutNode) * maxNodes);
+        if (nodes == NULL)
+        {
+            e->failed = 1;
+            return -1;
+        }
+        e->nodes = nodes;
+        e->maxNodes = maxNodes;
+    }
+    p = e->numNodes++;
+    EN(p).i = i;
+    EN(p).x = x;
+    EN(p).y = y;
+    EN(p).z = -1;
+    EN(p).prevZ = EN(p).nextZ = -1;
+    EN(p).steiner = 0;
+    if (last < 0)
+    {
+        EN(p).prev = EN(p).next = p;
+    }
+    else
+    {
+        EN(p).next = EN(last).next;
+        EN(p).prev = last;
+        EN(EN(last).next).prev = p;
+        EN(last).next = p;
+    }
+    return p;
+}
+
+static void earcutRemoveNode(earcut *e, int p)
+{
+    EN(EN(p).next).prev = EN(p).prev;
+    EN(EN(p).prev).next = EN(p).next;
+    if (EN(p).prevZ >= 0)
+        EN(EN(p).prevZ).nextZ = EN(p).nextZ;
+    if (EN(p).nextZ >= 0)
+        EN(EN(p).nextZ).prevZ = EN(p).prevZ;
+}
+
+static void earcutAddTriangle(earcut *e, int a, int b, int c)
+{
+    if (e->numIndices + 3 > e->maxIndices)
+    {
+        int maxIndices = e->maxIndices * 2 + 48;
+        unsigned int *indices = sqlite3_realloc64(e->indices, sizeof(unsigned int) * maxIndices);
+        if (indices == NULL)
+        {
+            e->failed = 1;
+            return;
+        }
+        e->indices = indices;
+        e->maxIndices = maxIndices;
+    }
+    e->indices[e->numIndices++] = EN(a).i;
+    e->indices[e->numIndices++] = EN(b).i;
+    e->indices[e->numIndices++] = EN(c).i;
+}
+
+// Links the vertices of a ring (without the closing one) in the given orientation
+// Returns the last vertex, or -1 if the ring is empty or there isn't memory
+static int earcutLinkRing(earcut *e, const double *coords, int dimension, int numPoints, int firstVertex, int clockwise)
+{
+    double sum = 0;
+    int last = -1;
+
+    for (int i = 0, j = numPoints - 1; i < numPoints; j = i++)
+        sum += (coords[j * dimension] - coords[i * dimension]) * (coords[i * dimension + 1] + coords[j * dimension + 1]);
+    for (int k = 0; k < numPoints; k++)
+    {
+        int i = clockwise == (sum > 0) ? k : numPoints - 1 - k;
+        last = earcutInsertNode(e, firstVertex + i, coords[i * dimension], coords[i * dimension + 1], last);
+        if (last < 0)
+            return -1;
+    }
+    if (last >= 0 && earcutEquals(e, last, EN(last).next))
+    {
+        earcutRemoveNode(e, last);
+        last = EN(last).next;
+    }
+    return last;
+}
+
+// Removes the repeated and collinear vertices from start to end (-1 for the whole ring)
+static int earcutFilterPoints(earcut *e, int start, int end)
+{
+    int p, again;
+
+    if (start < 0)
+        return start;
+    if (end < 0)
+        end = start;
+    p = start;
+    do
+    {
+        again = 0;
+        if (!EN(p).steiner && (earcutEquals(e, p, EN(p).next) || earcutArea(e, EN(p).prev, p, EN(p).next) == 0))
+        {
+            earcutRemoveNode(e, p);
+            p = end = EN(p).prev;
+            if (p == EN(p).next)
+                break;
+            again = 1;
+        }
+        else
+            p = EN(p).next;
+    } while (again || p != end);
+    return end;
+}
+
+// Checks that no vertex of the ring is inside the triangle of an ear
+static int earcutIsEar(earcut *e, int ear)
+{
+    int a = EN(ear).prev, c = EN(ear).next;
+    double ax = EN(a).x, bx = EN(ear).x, cx = EN(c).x, ay = EN(a).y, by = EN(ear).y, cy = EN(c).y;
+    double x0 = fmin(ax, fmin(bx, cx)), y0 = fmin(ay, fmin(by, cy)), x1 = fmax(ax, fmax(bx, cx)), y1 = fmax(ay, fmax(by, cy));
+
+    if (earcutArea(e, a, ear, c) >= 0)
+        return 0; // Reflex
+    for (int p = EN(c).next; p != a; p = EN(p).next)
+    {
+        if (EN(p).x >= x0 && EN(p).x <= x1 && EN(p).y >= y0 && EN(p).y <= y1 &&
+            earcutPointInTriangle(ax, ay, bx, by, cx, cy, EN(p).x, EN(p).y) && earcutArea(e, EN(p).prev, p, EN(p).next) >= 0)
+            return 0;
+    }
+    return 1;
+}
+
+// Same as earcutIsEar, but only the vertices in the range of z-order of the envelope of the triangle are checked
+static int earcutIsEarHashed(earcut *e, int ear)
+{
+    int a = EN(ear).prev, c = EN(ear).next;
+    double ax = EN(a).x, bx = EN(ear).x, cx = EN(c).x, ay = EN(a).y, by = EN(ear).y, cy = EN(c).y;
+    double x0 = fmin(ax, fmin(bx, cx)), y0 = fmin(ay, fmin(by, cy)), x1 = fmax(ax, fmax(bx, cx)), y1 = fmax(ay, fmax(by, cy));
+    int minZ, maxZ, p, n;
+
+    if (earcutArea(e, a, ear, c) >= 0)
+        return 0; // Reflex
+    minZ = earcutZOrder(e, x0, y0);
+    maxZ = earcutZOrder(e, x1, y1);
+
+#define EARCUT_INSIDE(k) (EN(k).x >= x0 && EN(k).x <= x1 && EN(k).y >= y0 && EN(k).y <= y1 && (k) != a && (k) != c && \
+                          earcutPointInTriangle(ax, ay, bx, by, cx, cy, EN(k).x, EN(k).y) && earcutArea(e, EN(k).prev, (k), EN(k).next) >= 0)
+    // Look in both directions from the ear
+    p = EN(ear).prevZ;
+    n = EN(ear).nextZ;
+    while (p >= 0 && EN(p).z >= minZ && n >= 0 && EN(n).z <= maxZ)
+    {
+        if (EARCUT_INSIDE(p))
+            return 0;
+        p = EN(p).prevZ;
+        if (EARCUT_INSIDE(n))
+            return 0;
+        n = EN(n).nextZ;
+    }
+    for (; p >= 0 && EN(p).z >= minZ; p = EN(p).prevZ)
+        if (EARCUT_INSIDE(p))
+            return 0;
+    for (; n >= 0 && EN(n).z <= maxZ; n = EN(n).nextZ)
+        if (EARCUT_INSIDE(n))
+            return 0;
+#undef EARCUT_INSIDE
+    return 1;
+}
+
+static int earcutSign(double v)
+{
+    return v > 0 ? 1 : v < 0 ? -1 : 0;
+}
+
+// Checks if q is in the envelope of the segment p-r (they are collinear)
+static int earcutOnSegment(earcut *e, int p, int q, int r)
+{
+    return EN(q).x <= fmax(EN(p).x, EN(r).x) && EN(q).x >= fmin(EN(p).x, EN(r).x) && EN(q).y <= fmax(EN(p).y, EN(r).y) && EN(q).y >= fmin(EN(p).y, EN(r).y);
+}
+
+// Checks if the segments p1-q1 and p2-q2 intersect
+static int earcutIntersects(earcut *e, int p1, int q1, int p2, int q2)
+{
+    int o1 = earcutSign(earcutArea(e, p1, q1, p2));
+    int o2 = earcutSign(earcutArea(e, p1, q1, q2));
+    int o3 = earcutSign(earcutArea(e, p2, q2, p1));
+    int o4 = earcutSign(earcutArea(e, p2, q2, q1));
+
+    return (o1 != o2 && o3 != o4) || (o1 == 0 && earcutOnSegment(e, p1, p2, q1)) || (o2 == 0 && earcutOnSegment(e, p1, q2, q1)) ||
+           (o3 == 0 && earcutOnSegment(e, p2, p1, q2)) || (o4 == 0 && earcutOnSegment(e, p2, q1, q2));
+}
+
+// Checks if the segment a-b intersects an edge of the ring
+static int earcutIntersectsPolygon(earcut *e, int a, int b)
+{
+    int p = a;
+
+    do
+    {
+        if (EN(p).i != EN(a).i && EN(EN(p).next).i != EN(a).i && EN(p).i != EN(b).i && EN(EN(p).next).i != EN(b).i && earcutIntersects(e, p, EN(p).next, a, b))
+            return 1;
+        p = EN(p).next;
+    } while (p != a);
+    return 0;
+}
+
+// Checks if the diagonal a-b starts inside the ring at a
+static int earcutLocallyInside(earcut *e, int a, int b)
+{
+    return earcutArea(e, EN(a).prev, a, EN(a).next) < 0 ? earcutArea(e, a, b, EN(a).next) >= 0 && earcutArea(e, a, EN(a).prev, b) >= 0
+                                                         : earcutArea(e, a, b, EN(a).prev) < 0 || earcutArea(e, a, EN(a).next, b) < 0;
+}
+
+// Checks if the middle of the diagonal a-b is inside the ring
+static int earcutMiddleInside(earcut *e, int a, int b)
+{
+    int p = a, inside = 0;
+    double px = (EN(a).x + EN(b).x) / 2, py = (EN(a).y + EN(b).y) / 2;
+
+    do
+    {
+        int n = EN(p).next;
+        if ((EN(p).y > py) != (EN(n).y > py) && EN(n).y != EN(p).y && px < (EN(n).x - EN(p).x) * (py - EN(p).y) / (EN(n).y - EN(p).y) + EN(p).x)
+            inside = !inside;
+        p = n;
+    } while (p != a);
+    return inside;
+}
+
+// Checks if a diagonal a-b can split the ring in two
+static int earcutIsValidDiagonal(earcut *e, int a, int b)
+{
+    return EN(EN(a).next).i != EN(b).i && EN(EN(a).prev).i != EN(b).i && !earcutIntersectsPolygon(e, a, b) &&
+           ((earcutLocallyInside(e, a, b) && earcutLocallyInside(e, b, a) && earcutMiddleInside(e, a, b) &&
+             (earcutArea(e, EN(a).prev, a, EN(b).prev) != 0 || earcutArea(e, a, EN(b).prev, b) != 0)) ||
+            (earcutEquals(e, a, b) && earcutArea(e, EN(a).prev, a, EN(a).next) > 0 && earcutArea(e, EN(b).prev, b, EN(b).next) > 0));
+}
+
+// Splits the ring in two with the diagonal a-b, duplicating a and b
+// Returns the duplicate of b, that is in the new ring, or -1 if there isn't memory
+static int earcutSplitPolygon(earcut *e, int a, int b)
+{
+    int a2, b2, an, bp;
+
+    a2 = earcutInsertNode(e, EN(a).i, EN(a).x, EN(a).y, -1);
+    b2 = a2 < 0 ? -1 : earcutInsertNode(e, EN(b).i, EN(b).x, EN(b).y, -1);
+    if (b2 < 0)
+        return -1;
+    an = EN(a).next;
+    bp = EN(b).prev;
+    EN(a).next = b;
+    EN(b).prev = a;
+    EN(a2).next = an;
+    EN(an).prev = a2;
+    EN(b2).next = a2;
+    EN(a2).prev = b2;
+    EN(bp).next = b2;
+    EN(b2).prev = bp;
+    return b2;
+}
+
+// Finds a vertex of the outer ring that can be linked with the leftmost vertex of a hole
+// Returns -1 if there isn't any
+static int earcutFindHoleBridge(earcut *e, int hole, int outer)
+{
+    int p = outer, m = -1, stop;
+    double hx = EN(hole).x, hy = EN(hole).y, qx = -HUGE_VAL, mx, my, tanMin = HUGE_VAL;
+
+    // Find the segment of the outer ring to the left of the hole that is nearest to it in a horizontal ray
+    do
+    {
+        int n = EN(p).next;
+        if (hy <= EN(p).y && hy >= EN(n).y && EN(n).y != EN(p).y)
+        {
+            double x = EN(p).x + (hy - EN(p).y) * (EN(n).x - EN(p).x) / (EN(n).y - EN(p).y);
+            if (x <= hx && x > qx)
+            {
+                qx = x;
+                m = EN(p).x < EN(n).x ? p : n;
+                if (x == hx)
+                    return m; // The hole touches the outer ring
+            }
+        }
+        p = n;
+    } while (p != outer);
+    if (m < 0)
+        return -1;
+
+    // Look for the vertices inside the triangle of the hole, the intersection and m. If there is any, take the one with minimum angle with the ray
+    stop = m;
+    mx = EN(m).x;
+    my = EN(m).y;
+    p = m;
+    do
+    {
+        if (hx >= EN(p).x && EN(p).x >= mx && hx != EN(p).x &&
+            earcutPointInTriangle(hy < my ? hx : qx, hy, mx, my, hy < my ? qx : hx, hy, EN(p).x, EN(p).y))
+        {
+            double tan = fabs(hy - EN(p).y) / (hx - EN(p).x);
+            if (earcutLocallyInside(e, p, hole) &&
+                (tan < tanMin || (tan == tanMin && (EN(p).x > EN(m).x || (EN(p).x == EN(m).x && earcutArea(e, EN(m).prev, m, EN(p).prev) < 0 && earcutArea(e, EN(p).next, m, EN(m).next) < 0)))))
+            {
+                m = p;
+                tanMin = tan;
+            }
+        }
+        p = EN(p).next;
+    } while (p != stop);
+    return m;
+}
+
+// Hole of a Polygon to link with the outer ring
+typedef struct earcutHole
+{
+    double x;
+    int node; // Leftmost vertex
+} earcutHole;
+
+static int compareEarcutHoles(const void *a, const void *b)
+{
+    double d = ((const earcutHole *)a)->x - ((const earcutHole *)b)->x;
+    return d < 0 ? -1 : d > 0 ? 1 : 0;
+}
+
+// Links the holes with the outer ring, from left to right, so there is only one ring
+// Returns the outer ring
+static int earcutEliminateHoles(earcut *e, earcutHole *holes, int numHoles, int outer)
+{
+    qsort(holes, numHoles, sizeof(earcutHole), compareEarcutHoles);
+    for (int h = 0; h < numHoles && !e->failed; h++)
+    {
+        int bridge = earcutFindHoleBridge(e, holes[h].node, outer);
+        int bridgeReverse;
+        if (bridge < 0)
+            continue;
+        bridgeReverse = earcutSplitPolygon(e, bridge, holes[h].node);
+        if (bridgeReverse < 0)
+            break;
+        earcutFilterPoints(e, bridgeReverse, EN(bridgeReverse).next);
+        outer = earcutFilterPoints(e, bridge, EN(bridge).next);
+    }
+    return outer;
+}
+
+// Sorts the vertices of a ring in z-order (merge sort of the list linked by prevZ and nextZ)
+static void earcutIndexCurve(earcut *e, int start)
+{
+    int p = start, list, inSize = 1, numMerges;
+
+    do
+    {
+        if (EN(p).z < 0)
+            EN(p).z = earcutZOrder(e, EN(p).x, EN(p).y);
+        EN(p).prevZ = EN(p).prev;
+        EN(p).nextZ = EN(p).next;
+        p = EN(p).next;
+    } while (p != start);
+    EN(EN(p).prevZ).nextZ = -1;
+    EN(p).prevZ = -1;
+
+    list = p;
+    do
+    {
+        int tail = -1;
+        p = list;
+        list = -1;
+        numMerges = 0;
+        while (p >= 0)
+        {
+            int q = p, pSize = 0, qSize = inSize;
+            numMerges++;
+            for (int i = 0; i < inSize && q >= 0; i++)
+            {
+                pSize++;
+                q = EN(q).nextZ;
+            }
+            while (pSize > 0 || (qSize > 0 && q >= 0))
+            {
+                int n;
+                if (pSize != 0 && (qSize == 0 || q < 0 || EN(p).z <= EN(q).z))
+                {
+                    n = p;
+                    p = EN(p).nextZ;
+                    pSize--;
+                }
+                else
+                {
+                    n = q;
+                    q = EN(q).nextZ;
+                    qSize--;
+                }
+                if (tail >= 0)
+                    EN(tail).nextZ = n;
+                else
+                    list = n;
+                EN(n).prevZ = tail;
+                tail = n;
+            }
+            p = q;
+        }
+        EN(tail).nextZ = -1;
+        inSize *= 2;
+    } while (numMerges > 1);
+}
+
+static void earcutLinked(earcut *e, int ear, int pass);
+
+// Clips the triangles of the local self-intersections (a-p-p.next-b with a-p and p.next-b crossing)
+static int earcutCureLocalIntersections(earcut *e, int start)
+{
+    int p = start;
+
+    do
+    {
+        int a = EN(p).prev, b = EN(EN(p).next).next;
+        if (!earcutEquals(e, a, b) && earcutIntersects(e, a, p, EN(p).next, b) && earcutLocallyInside(e, a, b) && earcutLocallyInside(e, b, a))
+        {
+            earcutAddTriangle(e, a, p, b);
+            earcutRemoveNode(e, p);
+            earcutRemoveNode(e, EN(p).next);
+            p = start = b;
+        }
+        p = EN(p).next;
+    } while (p != start);
+    return earcutFilterPoints(e, p, -1);
+}
+
+// Splits the ring by a valid diagonal and triangulates both rings
+static void earcutSplit(earcut *e, int start)
+{
+    int a = start;
+
+    do
+    {
+        for (int b = EN(EN(a).next).next; b != EN(a).prev; b = EN(b).next)
+        {
+            if (EN(a).i != EN(b).i && earcutIsValidDiagonal(e, a, b))
+            {
+                int c = earcutSplitPolygon(e, a, b);
+                if (c < 0)
+                    return;
+                a = earcutFilterPoints(e, a, EN(a).next);
+                c = earcutFilterPoints(e, c, EN(c).next);
+                earcutLinked(e, a, 0);
+                earcutLinked(e, c, 0);
+                return;
+            }
+        }
+        a = EN(a).next;
+    } while (a != start);
+}
+
+// Clips the ears of a ring. If none is found, tries again without the repeated vertices (pass 1),
+// curing the local self-intersections (pass 2) and splitting the ring in two
+static void earcutLinked(earcut *e, int ear, int pass)
+{
+    int stop;
+
+    if (ear < 0 || e->failed)
+        return;
+    if (!pass && e->invSize > 0)
+        earcutIndexCurve(e, ear);
+    stop = ear;
+    while (EN(ear).prev != EN(ear).next)
+    {
+        int prev = EN(ear).prev, next = EN(ear).next;
+        if (e->invSize > 0 ? earcutIsEarHashed(e, ear) : earcutIsEar(e, ear))
+        {
+            earcutAddTriangle(e, prev, ear, next);
+            earcutRemoveNode(e, ear);
+            ear = stop = EN(next).next;
+            continue;
+        }
+        ear = next;
+        if (ear == stop)
+        {
+            if (pass == 0)
+                earcutLinked(e, earcutFilterPoints(e, ear, -1), 1);
+            else if (pass == 1)
+                earcutLinked(e, earcutCureLocalIntersections(e, earcutFilterPoints(e, ear, -1)), 2);
+            else
+                earcutSplit(e, ear);
+            break;
+        }
+    }
+}
+
+// Triangulates a Polygon parsed in memory adding the triangles to the state
+// geom -> Geometry
+// part -> Polygon
+// firstVertex -> Index in the mesh of the first coordinate of the Polygon
+// holes -> Buffer for the holes, with room for the rings of the Polygon
+static void earcutPolygon(earcut *e, gpkgGeometry *geom, gpkgPart *part, int firstVertex, earcutHole *holes)
+{
+    gpkgRing *rings = &geom->rings[part->firstRing];
+    int dimension = geom->dimension;
+    int numHoles = 0, numVertices = 0;
+    int outer;
+
+    e->numNodes = 0;
+    outer = earcutLinkRing(e, &geom->coords[rings[0].firstPoint * dimension], dimension, rings[0].numPoints, firstVertex, 1);
+    if (outer < 0 || EN(outer).next == EN(outer).prev)
+        return;
+    for (int r = 0; r < part->numRings; r++)
+        numVertices += rings[r].numPoints;
+
+    if (part->numRings > 1)
+    {
+        int vertex = firstVertex + rings[0].numPoints;
+        for (int r = 1; r < part->numRings; r++)
+        {
+            int list = earcutLinkRing(e, &geom->coords[rings[r].firstPoint * dimension], dimension, rings[r].numPoints, vertex, 0);
+            vertex += rings[r].numPoints;
+            if (list < 0)
+                continue;
+            if (list == EN(list).next)
+                EN(list).steiner = 1;
+            // Leftmost vertex
+            holes[numHoles].node = list;
+            for (int p = EN(list).next; p != list; p = EN(p).next)
+                if (EN(p).x < EN(holes[numHoles].node).x || (EN(p).x == EN(holes[numHoles].node).x && EN(p).y < EN(holes[numHoles].node).y))
+                    holes[numHoles].node = p;
+            holes[numHoles].x = EN(holes[numHoles].node).x;
+            numHoles++;
+        }
+        if (e->failed)
+            return;
+        outer = earcutEliminateHoles(e, holes, numHoles, outer);
+    }
+
+    // Index the vertices in z-order if the Polygon isn't too simple
+    e->invSize = 0;
+    if (numVertices > EARCUT_HASH_MIN_VERTICES)
+    {
+        double maxX, maxY;
+        const double *c = &geom->coords[rings[0].firstPoint * dimension];
+        e->minX = maxX = c[0];
+        e->minY = maxY = c[1];
+        for (int i = 1; i < rings[0].numPoints; i++)
+        {
+            c += dimension;
+            e->minX = fmin(e->minX, c[0]);
+            e->minY = fmin(e->minY, c[1]);
+            maxX = fmax(maxX, c[0]);
+            maxY = fmax(maxY, c[1]);
+        }
+        e->invSize = fmax(maxX - e->minX, maxY - e->minY);
+        e->invSize = e->invSize != 0 ? 32767 / e->invSize : 0;
+    }
+    earcutLinked(e, outer, 0);
+}
+
+#undef EN
+
+// SQL function: ST_Triangulate(GEOMETRY [, originX, originY]); 
+// Triangulates the Polygons of a geometry by ear clipping (holes are linked with the exterior ring, and the vertices of big Polygons are indexed in z-order)
+// originX, originY -> Optional origin subtracted from the coordinates, to keep their precision in float32 (i.e. the corner of a tile)
+// Returns a BLOB with the mesh, in the byte order of the CPU, that is NULL if the geometry is NULL or there is an error:
+//   uint32 numVertices, uint32 numIndices, numVertices * (float32 x, float32 y), numIndices * uint32 (3 vertices by triangle, counter-clockwise)
+// The vertices are the coordinates of the rings of the Polygons in order, without the closing one. Z and M are ignored.
+// Geometries without Polygons return an empty mesh
+static void fnct_STTriangulate(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    gpkgGeometry geom;
+    earcut e;
+    earcutHole *holes = NULL;
+    double originX = 0, originY = 0;
+    int numVertices = 0, maxRings = 0;
+    unsigned char *p_blob;
+    float *vertices;
+    int n_bytes;
+    int vertex;
+
+    if (argc == 3)
+    {
+        if ((sqlite3_value_type(argv[1]) != SQLITE_INTEGER && sqlite3_value_type(argv[1]) != SQLITE_FLOAT) ||
+            (sqlite3_value_type(argv[2]) != SQLITE_INTEGER && sqlite3_value_type(argv[2]) != SQLITE_FLOAT))
+        {
+            sqlite3_result_error(context, "ST_Triangulate() error: arguments 2 and 3 [originX, originY] must be numbers", -1);
+            return;
+        }
+        originX = sqlite3_value_double(argv[1]);
+        originY = sqlite3_value_double(argv[2]);
+    }
+    memset(&geom, 0, sizeof(gpkgGeometry));
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || !readGPKGGeometry((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), &geom))
+    {
+        freeGPKGGeometry(&geom);
+        sqlite3_result_null(context);
+        return;
+    }
+
+    // Rings of the Polygons without the closing coordinate, that are the vertices of the mesh
+    for (int p = 0; p < geom.numParts; p++)
+    {
+        if (geom.parts[p].geometryType != wkbPolygon)
+            continue;
+        for (int r = geom.parts[p].firstRing; r < geom.parts[p].firstRing + geom.parts[p].numRings; r++)
+        {
+            gpkgRing *ring = &geom.rings[r];
+            const double *first = &geom.coords[ring->firstPoint * geom.dimension];
+            const double *last = &geom.coords[(ring->firstPoint + ring->numPoints - 1) * geom.dimension];
+            if (ring->numPoints > 1 && first[0] == last[0] && first[1] == last[1])
+                ring->numPoints--;
+            numVertices += ring->numPoints;
+        }
+        if (geom.parts[p].numRings > maxRings)
+            maxRings = geom.parts[p].numRings;
+    }
+
+    memset(&e, 0, sizeof(earcut));
+    holes = sqlite3_malloc64(sizeof(earcutHole) * (maxRings + 1));
+    e.failed = holes == NULL;
+    vertex = 0;
+    for (int p = 0; p < geom.numParts && !e.failed; p++)
+    {
+        if (geom.parts[p].geometryType != wkbPolygon)
+            continue;
+        if (geom.parts[p].numRings > 0)
+            earcutPolygon(&e, &geom, &geom.parts[p], vertex, holes);
+        for (int r = geom.parts[p].firstRing; r < geom.parts[p].firstRing + geom.parts[p].numRings; r++)
+            vertex += geom.rings[r].numPoints;
+    }
+
+    n_bytes = 8 + 8 * numVertices + 4 * e.numIndices;
+    p_blob = e.failed ? NULL : sqlite3_malloc(n_bytes);
+    if (p_blob == NULL)
+    {
+        sqlite3_result_error_nomem(context);
+    }
+    else
+    {
+        ((unsigned int *)p_blob)[0] = numVertices;
+        ((unsigned int *)p_blob)[1] = e.numIndices;
+        vertices = (float *)(p_blob + 8);
+        for (int p = 0; p < geom.numParts; p++)
+        {
+            if (geom.parts[p].geometryType != wkbPolygon)
+                continue;
+            for (int r = geom.parts[p].firstRing; r < geom.parts[p].firstRing + geom.parts[p].numRings; r++)
+            {
+                const double *c = &geom.coords[geom.rings[r].firstPoint * geom.dimension];
+                for (int i = 0; i < geom.rings[r].numPoints; i++, c += geom.dimension)
+                {
+                    *vertices++ = (float)(c[0] - originX);
+                    *vertices++ = (float)(c[1] - originY);
+                }
+            }
+        }
+        if (e.numIndices > 0)
+            memcpy(vertices, e.indices, 4 * e.numIndices);
+        sqlite3_result_blob(context, p_blob, n_bytes, sqlite3_free);
+    }
+    sqlite3_free(e.nodes);
+    sqlite3_free(e.indices);
+    sqlite3_free(holes);
+    freeGPKGGeometry(&geom);
+}
+
+// Context of the visitors of ST_AsCoordArray
+typedef struct coordArrayContext
+{
+    int numPoints, numRings;    // Counted in the first walk
+    unsigned char *coords;      // Next coordinate of the array
+    int dimension;              // 2 (XY) or 3 (XYZ)
+    int size;                   // Bytes of each ordinate: 4 (float32) or 8 (float64)
+    unsigned int *ringOffsets;  // First coordinate of each run
+    unsigned int *partOffsets;  // First run of each part
+    int point, ring, part;      // Next coordinate, run and part
+} coordArrayContext;
+
+// Visitor of ST_AsCoordArray that counts the coordinates and the runs
+static int coordArrayCount(const wkbRun *run, void *ctx)
+{
+    coordArrayContext *c = (coordArrayContext *)ctx;
+
+    c->numPoints += run->numPoints;
+    c->numRings++;
+    return 1;
+}
+
+// Visitor of ST_AsCoordArray that copies the coordinates of a run to the array. They are copied as they are if they
+// already have the format, else they are converted one by one
+static int coordArrayCopy(const wkbRun *run, void *ctx)
+{
+    coordArrayContext *c = (coordArrayContext *)ctx;
+    int swap = run->byteOrder != endian();
+
+    while (c->part <= run->part) // Parts without runs (empty Polygons) have no rings
+        c->partOffsets[c->part++] = c->ring;
+    c->ringOffsets[c->ring++] = c->point;
+    c->point += run->numPoints;
+
+    if (!swap && c->size == 8 && run->dimension == c->dimension && (c->dimension == 2 || run->hasZ))
+    {
+        memcpy(c->coords, run->coords, (size_t)run->numPoints * run->dimension * 8);
+        c->coords += (size_t)run->numPoints * run->dimension * 8;
+        return 1;
+    }
+    for (int i = 0; i < run->numPoints; i++)
+    {
+        const unsigned char *p = run->coords + (size_t)i * run->dimension * 8;
+        for (int j = 0; j < c->dimension; j++)
+        {
+            double value = NAN;
+            if (j < 2 || run->hasZ)
+            {
+                memcpy(&value, p + j * 8, 8);
+                if (swap)
+                    swapBytes((unsigned char *)&value, 8);
+            }
+            if (c->size == 4)
+            {
+                float f = (float)value;
+                memcpy(c->coords, &f, 4);
+            }
+            else
+                memcpy(c->coords, &value, 8);
+            c->coords += c->size;
+        }
+    }
+    return 1;
+}
+
+// SQL function: ST_AsCoordArray(GEOMETRY, format); 
+// Returns the coordinates of a geometry as a flat array that can be wrapped without parsing
+// format -> Type and ordinates of the coordinates: 'XY32', 'XYZ32' (float32) or 'XY64', 'XYZ64' (float64). A missing Z is NaN
+// Returns a BLOB, in the byte order of the CPU, that is NULL if the geometry is NULL or there is an error:
+//   uint32 numPoints, uint32 numRings, uint32 numParts, uint32 dimension (2 or 3),
+//   numPoints * dimension ordinates (interleaved), (numRings + 1) * uint32 first coordinate of each ring and the end,
+//   (numParts + 1) * uint32 first ring of each part and the end.
+// The parts are the Points, LineStrings and Polygons of the geometry, and the rings of Points and LineStrings are their coordinates
+static void fnct_STAsCoordArray(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    const char *format;
+    coordArrayContext c;
+    unsigned char *result;
+    sqlite3_int64 size;
+    int index = 0;
+    int numParts = 0;
+
+    format = (const char *)sqlite3_value_text(argv[1]);
+    memset(&c, 0, sizeof(coordArrayContext));
+    if (format != NULL && (sqlite3_stricmp(format, "XY32") == 0 || sqlite3_stricmp(format, "XYZ32") == 0 || sqlite3_stricmp(format, "XY64") == 0 || sqlite3_stricmp(format, "XYZ64") == 0))
+    {
+        c.dimension = (format[2] == 'Z' || format[2] == 'z') ? 3 : 2;
+        c.size = format[c.dimension] == '3' ? 4 : 8;
+    }
+    else
+    {
+        sqlite3_result_error(context, "ST_AsCoordArray() error: argument 2 [format] must be 'XY32', 'XYZ32', 'XY64' or 'XYZ64'", -1);
+        return;
+    }
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB)
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+    n_bytes = sqlite3_value_bytes(argv[0]);
+
+    // First walk: count the structure, without reading the coordinates
+    if (n_bytes < 13 || !skipGPKGHeader(p_blob, n_bytes, &index) || !walkWKBRuns(p_blob, n_bytes, &index, endian(), &numParts, coordArrayCount, &c))
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+
+    size = 16 + (sqlite3_int64)c.numPoints * c.dimension * c.size + 4 * ((sqlite3_int64)c.numRings + 1) + 4 * ((sqlite3_int64)numParts + 1);
+    if (size > 0x7fffffff || (result = sqlite3_malloc64(size)) == NULL)
+    {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    ((unsigned int *)result)[0] = c.numPoints;
+    ((unsigned int *)result)[1] = c.numRings;
+    ((unsigned int *)result)[2] = numParts;
+    ((unsigned int *)result)[3] = c.dimension;
+    c.coords = result + 16;
+    c.ringOffsets = (unsigned int *)(c.coords + (size_t)c.numPoints * c.dimension * c.size);
+    c.partOffsets = c.ringOffsets + c.numRings + 1;
+
+    // Second walk: copy the coordinates
+    walkGPKGRuns(p_blob, n_bytes, coordArrayCopy, &c);
+    c.ringOffsets[c.numRings] = c.numPoints;
+    while (c.part <= numParts)
+        c.partOffsets[c.part++] = c.numRings;
+    sqlite3_result_blob(context, result, (int)size, sqlite3_free);
+}
+
+// SQL function: ST_ByteOrder(GEOMETRY); 
+// Returns the byte order of a geometry: 1 if the GPKG header and all the WKB are little endian (NDR), 0 if they are big endian (XDR),
+// -1 if they are mixed. Returns NULL if the geometry is NULL or there is an error
+static void fnct_STByteOrder(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    int orders;
+
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB ||
+        !normalizeGPKGByteOrder((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), 0, &orders))
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    sqlite3_result_int(context, orders == (1 << LITTLE_ENDIAN) ? LITTLE_ENDIAN : (orders == (1 << BIG_ENDIAN) ? BIG_ENDIAN : -1));
+}
+
+// Coordinate reference system of ST_Transform, read from gpkg_spatial_ref_sys
+// The ellipsoid is only used by the Transverse Mercator: datum shifts (TOWGS84) are not applied
+typedef struct projection
+{
+    int srsId;            // srs_id of gpkg_spatial_ref_sys
+    int kind;             // PROJECTION_GEOGRAPHIC, PROJECTION_WEB_MERCATOR or PROJECTION_TRANSVERSE_MERCATOR
+    double unit;          // Radians of the angular unit (geographic) or meters of the linear unit (projected)
+    double a;             // Semi-major axis of the ellipsoid
+    double e;             // Eccentricity of the ellipsoid
+    double lon0;          // Central meridian in radians
+    double k0;            // Scale factor on the central meridian
+    double falseEasting;  // False easting in the linear unit
+    double falseNorthing; // False northing in the linear unit
+    double A;             // Rectifying radius times the scale factor
+    double xi0;           // Rectifying latitude of the latitude of origin
+    double alpha[4];      // Coefficients of the Krueger series from the conformal to the rectifying latitude
+    double beta[4];       // Coefficients of the Krueger series from the rectifying to the conformal latitude
+    double delta[4];      // Coefficients of the series from the conformal to the geodetic latitude
+} projection;
+
+// Finds a keyword of a WKT definition followed by its opening bracket, case insensitive
+// Returns the position after the bracket or NULL if it's not found
+static const char *wktFind(const char *wkt, const char *keyword)
+{
+    int n = (int)strlen(keyword);
+
+    for (const char *p = wkt; p != NULL && *p != '\0'; p++)
+    {
+        if (sqlite3_strnicmp(p, keyword, n) == 0 && (p[n] == '[' || p[n] == '('))
+            return p + n + 1;
+    }
+    return NULL;
+}
+
+// Reads a value of a WKT node. The values are separated by commas, skipping quoted texts and nested nodes
+// node -> Position after the opening bracket of the node
+// n -> Number of the value, from 0
+// value <- Value, if it's a number
+// Returns 0 if the node has not n + 1 values or the value is not a number, 1 if it's correct
+static int wktNumber(const char *node, int n, double *value)
+{
+    int depth = 0;
+    char *end;
+
+    for (const char *p = node; *p != '\0'; p++)
+    {
+        if (*p == '"')
+        {
+            p = strchr(p + 1, '"');
+            if (p == NULL)
+                return 0;
+        }
+        else if (*p == '[' || *p == '(')
+            depth++;
+        else if (*p == ']' || *p == ')')
+        {
+            if (--depth < 0)
+                return 0;
+        }
+        else if (*p == ',' && depth == 0 && --n == 0)
+        {
+            *value = strtod(p + 1, &end);
+            return end != p + 1;
+        }
+    }
+    return 0;
+}
+
+// Reads a PARAMETER["name",value] of a WKT definition, case insensitive
+// Returns 0 if it's not found or 1 if it's correct
+static int wktParameter(const char *wkt, const char *name, double *value)
+{
+    int n = (int)strlen(name);
+
+    for (const char *p = wktFind(wkt, "PARAMETER"); p != NULL; p = wktFind(p, "PARAMETER"))
+    {
+        if (*p == '"' && sqlite3_strnicmp(p + 1, name, n) == 0 && p[n + 1] == '"')
+            return wktNumber(p, 1, value);
+    }
+    return 0;
+}
+
+// Computes the constants of a Transverse Mercator projection (Krueger series to n^4, as in Karney 2011)
+// proj <-> Projection with a, e, lon0, k0 set
+// lat0 -> Latitude of origin in radians
+static void initTransverseMercator(projection *proj, double lat0)
+{
+    double f = 1 - sqrt(1 - proj->e * proj->e);
+    double n = f / (2 - f), n2 = n * n, n3 = n2 * n, n4 = n3 * n;
+    double t;
+
+    proj->A = proj->k0 * proj->a / (1 + n) * (1 + n2 / 4 + n4 / 64);
+    proj->alpha[0] = n / 2 - 2 * n2 / 3 + 5 * n3 / 16 + 41 * n4 / 180;
+    proj->alpha[1] = 13 * n2 / 48 - 3 * n3 / 5 + 557 * n4 / 1440;
+    proj->alpha[2] = 61 * n3 / 240 - 103 * n4 / 140;
+    proj->alpha[3] = 49561 * n4 / 161280;
+    proj->beta[0] = n / 2 - 2 * n2 / 3 + 37 * n3 / 96 - n4 / 360;
+    proj->beta[1] = n2 / 48 + n3 / 15 - 437 * n4 / 1440;
+    proj->beta[2] = 17 * n3 / 480 - 37 * n4 / 840;
+    proj->beta[3] = 4397 * n4 / 161280;
+    proj->delta[0] = 2 * n - 2 * n2 / 3 - 2 * n3 + 116 * n4 / 45;
+    proj->delta[1] = 7 * n2 / 3 - 8 * n3 / 5 - 227 * n4 / 45;
+    proj->delta[2] = 56 * n3 / 15 - 136 * n4 / 35;
+    proj->delta[3] = 4279 * n4 / 630;
+
+    // On the central meridian the rectifying latitude is the distance along the meridian divided by A
+    t = sinh(atanh(sin(lat0)) - proj->e * atanh(proj->e * sin(lat0)));
+    proj->xi0 = atan(t);
+    for (int j = 1; j <= 4; j++)
+        proj->xi0 += proj->alpha[j - 1] * sin(2 * j * atan(t));
+}
+
+// Reads a coordinate reference system of gpkg_spatial_ref_sys. The EPSG codes 4326, 3857 and the WGS 84 UTM zones (326zz, 327zz)
+// are recognized by its code. Other SRS are read from the WKT definition: GEOGCS, PROJCS with PROJECTION["Transverse_Mercator"]
+// or a spherical Mercator (Popular_Visualisation_Pseudo_Mercator or Mercator_Auxiliary_Sphere)
+// db -> Database
+// srsId -> srs_id of the SRS
+// proj <- Projection
+// Returns SQLITE_OK, SQLITE_NOTFOUND if the SRS doesn't exist or is not supported or the error code
+static int readProjection(sqlite3 *db, int srsId, projection *proj)
+{
+    sqlite3_stmt *stmt;
+    const char *organization;
+    const char *wkt;
+    const char *node;
+    int code;
+    double invFlattening = 0, lat0 = 0;
+    int rc;
+
+    memset(proj, 0, sizeof(projection));
+    proj->srsId = srsId;
+    proj->a = 6378137;
+    proj->e = sqrt(1 / 298.257223563 * (2 - 1 / 298.257223563));
+    proj->unit = 1;
+    proj->k0 = 1;
+    rc = sqlite3_prepare_v2(db, "SELECT organization, organization_coordsys_id, definition FROM gpkg_spatial_ref_sys WHERE srs_id = ?", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+        return rc;
+    sqlite3_bind_int(stmt, 1, srsId);
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_ROW)
+    {
+        sqlite3_finalize(stmt);
+        return rc == SQLITE_DONE ? SQLITE_NOTFOUND : rc;
+    }
+    organization = (const char *)sqlite3_column_text(stmt, 0);
+    code = sqlite3_column_int(stmt, 1);
+    wkt = (const char *)sqlite3_column_text(stmt, 2);
+    rc = SQLITE_OK;
+    if (organization != NULL && sqlite3_stricmp(organization, "EPSG") == 0 && (code == 4326 || code == 3857 ||
+        (code >= 32601 && code <= 32660) || (code >= 32701 && code <= 32760)))
+    {
+        if (code == 4326)
+        {
+            proj->kind = PROJECTION_GEOGRAPHIC;
+            proj->unit = M_PI / 180;
+        }
+        else if (code == 3857)
+            proj->kind = PROJECTION_WEB_MERCATOR;
+        else
+        {
+            proj->kind = PROJECTION_TRANSVERSE_MERCATOR;
+            proj->lon0 = ((code % 100) * 6 - 183) * M_PI / 180;
+            proj->k0 = 0.9996;
+            proj->falseEasting = 500000;
+            proj->falseNorthing = code > 32700 ? 10000000 : 0;
+            initTransverseMercator(proj, 0);
+        }
+    }
+    else if (wkt != NULL)
+    {
+        // Ellipsoid and angular unit of the geographic SRS
+        node = wktFind(wkt, "SPHEROID");
+        if (node != NULL && wktNumber(node, 1, &proj->a) && wktNumber(node, 2, &invFlattening) && proj->a > 0)
+            proj->e = invFlattening > 0 ? sqrt(1 / invFlattening * (2 - 1 / invFlattening)) : 0;
+        node = wktFind(wkt, "GEOGCS");
+        if (node != NULL)
+            node = wktFind(node, "UNIT");
+        if (node == NULL || !wktNumber(node, 1, &proj->unit) || proj->unit <= 0)
+            proj->unit = M_PI / 180;
+        if (sqlite3_strnicmp(wkt, "GEOGCS", 6) == 0)
+            proj->kind = PROJECTION_GEOGRAPHIC;
+        else if (sqlite3_strnicmp(wkt, "PROJCS", 6) == 0 && (node = wktFind(wkt, "PROJECTION")) != NULL)
+        {
+            // The parameters are in the angular unit of the geographic SRS, the linear unit follows the projection
+            double angular = proj->unit;
+            if (sqlite3_strnicmp(node, "\"Transverse_Mercator\"", 21) == 0)
+            {
+                proj->kind = PROJECTION_TRANSVERSE_MERCATOR;
+                wktParameter(wkt, "latitude_of_origin", &lat0);
+                wktParameter(wkt, "central_meridian", &proj->lon0);
+                wktParameter(wkt, "scale_factor", &proj->k0);
+                wktParameter(wkt, "false_easting", &proj->falseEasting);
+                wktParameter(wkt, "false_northing", &proj->falseNorthing);
+                proj->lon0 *= angular;
+            }
+            else if (sqlite3_strnicmp(node, "\"Popular_Visualisation_Pseudo_Mercator\"", 39) == 0 || sqlite3_strnicmp(node, "\"Mercator_Auxiliary_Sphere\"", 27) == 0)
+                proj->kind = PROJECTION_WEB_MERCATOR;
+            node = wktFind(node, "UNIT");
+            if (node == NULL || !wktNumber(node, 1, &proj->unit) || proj->unit <= 0)
+                proj->unit = 1;
+            if (proj->kind == PROJECTION_TRANSVERSE_MERCATOR)
+                initTransverseMercator(proj, lat0 * angular);
+        }
+    }
+    if (proj->kind == 0)
+        rc = SQLITE_NOTFOUND;
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Converts a batch of coordinates of a projection to longitude and latitude in radians, in place
+// Every kind of projection has its own loop over the arrays of X and Y, so the compiler can vectorize them
+static void projectionToGeographic(const projection *proj, double *x, double *y, int n)
+{
+    double r = WEB_MERCATOR_HALF_SIZE / M_PI;
+
+    switch (proj->kind)
+    {
+    case PROJECTION_GEOGRAPHIC:
+        for (int i = 0; i < n; i++)
+        {
+            x[i] *= proj->unit;
+            y[i] *= proj->unit;
+        }
+        break;
+
+    case PROJECTION_WEB_MERCATOR:
+        for (int i = 0; i < n; i++)
+        {
+            x[i] = x[i] * proj->unit / r;
+            y[i] = 2 * atan(exp(y[i] * proj->unit / r)) - M_PI / 2;
+        }
+        break;
+
+    case PROJECTION_TRANSVERSE_MERCATOR:
+        for (int i = 0; i < n; i++)
+        {
+            double eta = (x[i] - proj->falseEasting) * proj->unit / proj->A;
+            double xi = (y[i] - proj->falseNorthing) * proj->unit / proj->A + proj->xi0;
+            double xi1 = xi, eta1 = eta, chi;
+            for (int j = 1; j <= 4; j++)
+            {
+                xi1 -= proj->beta[j - 1] * sin(2 * j * xi) * cosh(2 * j * eta);
+                eta1 -= proj->beta[j - 1] * cos(2 * j * xi) * sinh(2 * j * eta);
+            }
+            chi = asin(sin(xi1) / cosh(eta1));
+            x[i] = proj->lon0 + atan2(sinh(eta1), cos(xi1));
+            y[i] = chi;
+            for (int j = 1; j <= 4; j++)
+                y[i] += proj->delta[j - 1] * sin(2 * j * chi);
+        }
+        break;
+    }
+}
+
+// Converts a batch of coordinates in longitude and latitude in radians to a projection, in place
+static void projectionFromGeographic(const projection *proj, double *x, double *y, int n)
+{
+    double r = WEB_MERCATOR_HALF_SIZE / M_PI;
+    double maxLat = WEB_MERCATOR_MAX_LATITUDE * M_PI / 180;
+
+    switch (proj->kind)
+    {
+    case PROJECTION_GEOGRAPHIC:
+        for (int i = 0; i < n; i++)
+        {
+            x[i] /= proj->unit;
+            y[i] /= proj->unit;
+        }
+        break;
+
+    case PROJECTION_WEB_MERCATOR:
+        for (int i = 0; i < n; i++)
+        {
+            x[i] = x[i] * r / proj->unit;
+            y[i] = log(tan(M_PI / 4 + fmax(-maxLat, fmin(maxLat, y[i])) / 2)) * r / proj->unit;
+        }
+        break;
+
+    case PROJECTION_TRANSVERSE_MERCATOR:
+        for (int i = 0; i < n; i++)
+        {
+            double lambda = x[i] - proj->lon0;
+            double sinPhi = sin(y[i]);
+            double t = sinh(atanh(sinPhi) - proj->e * atanh(proj->e * sinPhi));
+            double xi1 = atan2(t, cos(lambda));
+            double eta1 = atanh(sin(lambda) / sqrt(1 + t * t));
+            double xi = xi1, eta = eta1;
+            for (int j = 1; j <= 4; j++)
+            {
+                xi += proj->alpha[j - 1] * sin(2 * j * xi1) * cosh(2 * j * eta1);
+                eta += proj->alpha[j - 1] * cos(2 * j * xi1) * sinh(2 * j * eta1);
+            }
+            x[i] = proj->falseEasting + proj->A * eta / proj->unit;
+            y[i] = proj->falseNorthing + proj->A * (xi - proj->xi0) / proj->unit;
+        }
+        break;
+    }
+}
+
+// Context of the visitor that transforms the coordinates of a geometry from a projection to another
+typedef struct projectContext
+{
+    const projection *source;
+    const projection *target;
+    double env[4]; // Envelope of the transformed coordinates
+    int valid;     // 0 if a coordinate is out of the domain of the projections
+} projectContext;
+
+// Transforms a run of coordinates in place by batches and extends the envelope
+static int projectRun(const wkbRun *run, void *ctx)
+{
+    projectContext *project = (projectContext *)ctx;
+    double x[PROJECTION_BATCH_SIZE], y[PROJECTION_BATCH_SIZE];
+    int index, n;
+
+    for (int first = 0; first < run->numPoints; first += PROJECTION_BATCH_SIZE)
+    {
+        n = run->numPoints - first < PROJECTION_BATCH_SIZE ? run->numPoints - first : PROJECTION_BATCH_SIZE;
+        for (int i = 0; i < n; i++)
+        {
+            index = (first + i) * run->dimension * 8;
+            x[i] = getDouble(run->coords, &index, run->byteOrder);
+            y[i] = getDouble(run->coords, &index, run->byteOrder);
+        }
+        if (run->geometryType == wkbPoint && isnan(x[0]) && isnan(y[0]))
+            return 1; // Empty Point
+        projectionToGeographic(project->source, x, y, n);
+        projectionFromGeographic(project->target, x, y, n);
+        for (int i = 0; i < n; i++)
+        {
+            if (!isfinite(x[i]) || !isfinite(y[i]))
+            {
+                project->valid = 0;
+                return 0;
+            }
+            index = (first + i) * run->dimension * 8;
+            putDoubleOrder(run->coords, &index, x[i], run->byteOrder);
+            putDoubleOrder(run->coords, &index, y[i], run->byteOrder);
+            project->env[0] = fmin(project->env[0], x[i]);
+            project->env[1] = fmin(project->env[1], y[i]);
+            project->env[2] = fmax(project->env[2], x[i]);
+            project->env[3] = fmax(project->env[3], y[i]);
+        }
+    }
+    return 1;
+}
+
+// SQL function: ST_Transform(GEOMETRY, srsId); 
+// Transforms a geometry from its SRS to another SRS of gpkg_spatial_ref_sys, without an external projection library
+// srsId -> srs_id of the target SRS
+// The SRS must be geographic, Web Mercator or Transverse Mercator (UTM zones and other Transverse Mercator of WKT definitions)
+// and the datum is not changed. The projections are cached while the statement runs if srsId is a constant.
+// The result has the same size as the geometry: it's copied once and transformed in place by batches of coordinates.
+// Returns NULL if the geometry is NULL, not valid or a coordinate is out of the domain of the projections. If an SRS is not supported throw an exception
+static void fnct_STTransform(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    projection *cache;
+    projectContext project;
+    unsigned char *p_blob;
+    int n_bytes;
+    int srsId, geomSrsId;
+    int index = 0;
+    char *err;
+    int rc;
+
+    if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER)
+    {
+        sqlite3_result_error(context, "ST_Transform() error: argument 2 [srsId] must be an integer", -1);
+        return;
+    }
+    srsId = sqlite3_value_int(argv[1]);
+    n_bytes = sqlite3_value_bytes(argv[0]);
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || n_bytes < 13 || !skipGPKGHeader((unsigned char *)sqlite3_value_blob(argv[0]), n_bytes, &index))
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    index = 4;
+    geomSrsId = getInt((unsigned char *)sqlite3_value_blob(argv[0]), &index, ((unsigned char *)sqlite3_value_blob(argv[0]))[3] & GPKG_BYTEORDER_BIT);
+    if (geomSrsId == srsId)
+    {
+        sqlite3_result_value(context, argv[0]);
+        return;
+    }
+
+    // Projections of the target SRS and of the last geometry: SQLite keeps them while the statement runs if srsId is a constant
+    cache = (projection *)sqlite3_get_auxdata(context, 1);
+    if (cache == NULL || cache[1].srsId != srsId)
+    {
+        cache = (projection *)sqlite3_malloc(sizeof(projection) * 2);
+        if (cache == NULL)
+        {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        rc = readProjection(sqlite3_context_db_handle(context), srsId, &cache[1]);
+        memset(&cache[0], 0, sizeof(projection)); // Not read yet
+        if (rc != SQLITE_OK)
+        {
+            sqlite3_free(cache);
+            if (rc == SQLITE_NOTFOUND)
+                sqlite3_result_error(context, "ST_Transform() error: argument 2 [srsId] unknown or unsupported SRS", -1);
+            else
+                sqlite3_result_error_code(context, rc);
+            return;
+        }
+        sqlite3_set_auxdata(context, 1, cache, sqlite3_free);
+        cache = (projection *)sqlite3_get_auxdata(context, 1);
+        if (cache == NULL)
+        {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+    }
+    if (cache[0].srsId != geomSrsId || cache[0].kind == 0)
+    {
+        rc = readProjection(sqlite3_context_db_handle(context), geomSrsId, &cache[0]);
+        if (rc != SQLITE_OK)
+        {
+            cache[0].kind = 0;
+            if (rc == SQLITE_NOTFOUND)
+            {
+                err = sqlite3_mprintf("ST_Transform() error: unknown or unsupported SRS %d of the geometry", geomSrsId);
+                sqlite3_result_error(context, err, -1);
+                sqlite3_free(err);
+            }
+            else
+                sqlite3_result_error_code(context, rc);
+            return;
+        }
+    }
+
+    // Copy the geometry and transform it in place
+    p_blob = (unsigned char *)sqlite3_malloc(n_bytes);
+    if (p_blob == NULL)
+    {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    memcpy(p_blob, sqlite3_value_blob(argv[0]), n_bytes);
+    project.source = &cache[0];
+    project.target = &cache[1];
+    project.env[0] = project.env[1] = INFINITY;
+    project.env[2] = project.env[3] = -INFINITY;
+    project.valid = 1;
+    if (!walkGPKGRuns(p_blob, n_bytes, projectRun, &project))
+    {
+        sqlite3_free(p_blob);
+        sqlite3_result_null(context);
+        return;
+    }
+    if (project.env[0] <= project.env[2])
+        putGPKGHeaderEnvelope(p_blob, n_bytes, project.env);
+
+    // SRS ID of the GPKG header, in its ENDIANESS
+    index = 4;
+    putInt(p_blob, &index, srsId);
+    if ((p_blob[3] & GPKG_BYTEORDER_BIT) != endian())
+        swapBytes(p_blob + 4, 4);
+    sqlite3_result_blob(context, p_blob, n_bytes, sqlite3_free);
+}
+
+// Segment index of a feature (GPKG_AddSegmentIndex): packed Hilbert R-tree of the segments of the rings of a Polygon or MultiPolygon
+// The tree is an array of entries of 4 doubles sorted by levels from the root to the leaves. The leaves are the segments (x1, y1, x2, y2)
+// sorted by the Hilbert key of their centers and each entry of the other levels is the envelope (minX, minY, maxX, maxY)
+// of SEGMENT_INDEX_NODE_SIZE consecutive entries of the next level.
+// It's stored by pages in segidx_tableName_geometryColumn: page 0 has the byte order and the number of segments, page k (k > 0)
+// has SEGMENT_INDEX_PAGE_SIZE entries from the entry (k - 1) * SEGMENT_INDEX_PAGE_SIZE, so a search only reads the pages it needs
+typedef struct segmentIndex
+{
+    char *table;                // Name of the table (to check the cached index)
+    char *gcolumn;              // Column that contains the geometry
+    sqlite3_stmt *pageStmt;     // Reads a page of the tree of a feature
+    sqlite3_stmt *geometryStmt; // Reads the geometry of a feature
+    sqlite3_int64 id;           // Feature whose tree is searched
+    sqlite3_int64 numSegments;  // Number of segments of the tree
+    int numLevels;              // Number of levels of the tree
+    sqlite3_int64 levelStart[SEGMENT_INDEX_MAX_LEVELS + 1]; // First entry of each level from the root. The last one is the number of entries
+    sqlite3_int64 cachedPages[SEGMENT_INDEX_CACHE_SIZE];     // Page read in each slot of the cache, 0 if the slot is empty
+    int cachedEntries[SEGMENT_INDEX_CACHE_SIZE];             // Number of entries of the page of each slot
+    double *cache;              // SEGMENT_INDEX_CACHE_SIZE pages of SEGMENT_INDEX_PAGE_SIZE entries
+} segmentIndex;
+
+// Segment of a feature and Hilbert key of its center, to sort the leaves of the segment index
+typedef struct segmentKey
+{
+    sqlite3_int64 key;
+    int point; // Index of the first coordinate of the segment
+} segmentKey;
+
+// Compares two segments by Hilbert key for qsort
+static int compareSegmentKeys(const void *a, const void *b)
+{
+    sqlite3_int64 ka = ((const segmentKey *)a)->key;
+    sqlite3_int64 kb = ((const segmentKey *)b)->key;
+
+    return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+// Releases a segment index
+static void freeSegmentIndex(void *p)
+{
+    segmentIndex *index = (segmentIndex *)p;
+
+    sqlite3_finalize(index->pageStmt);
+    sqlite3_finalize(index->geometryStmt);
+    sqlite3_free(index->table);
+    sqlite3_free(index->gcolumn);
+    sqlite3_free(index->cache);
+    sqlite3_free(index);
+}
+
+// Computes the levels of a packed R-tree
+// numSegments -> Number of leaves
+// levelStart <- First entry of each level from the root and, after the last level, the number of entries
+// Returns the number of levels
+static int segmentIndexLevels(sqlite3_int64 numSegments, sqlite3_int64 *levelStart)
+{
+    sqlite3_int64 sizes[SEGMENT_INDEX_MAX_LEVELS];
+    sqlite3_int64 n = numSegments;
+    int numLevels = 0;
+
+    do
+    {
+        sizes[numLevels++] = n;
+        n = (n + SEGMENT_INDEX_NODE_SIZE - 1) / SEGMENT_INDEX_NODE_SIZE;
+    } while (sizes[numLevels - 1] > 1 && numLevels < SEGMENT_INDEX_MAX_LEVELS);
+    levelStart[0] = 0;
+    for (int l = 0; l < numLevels; l++)
+        levelStart[l + 1] = levelStart[l] + sizes[numLevels - 1 - l];
+    return numLevels;
+}
+
+// Returns the envelope of an entry of a segment index. A leaf is converted from segment to envelope
+static void segmentIndexEnvelope(const double *entry, int leaf, double *env)
+{
+    if (leaf)
+    {
+        env[0] = fmin(entry[0], entry[2]);
+        env[1] = fmin(entry[1], entry[3]);
+        env[2] = fmax(entry[0], entry[2]);
+        env[3] = fmax(entry[1], entry[3]);
+    }
+    else
+        memcpy(env, entry, sizeof(double) * 4);
+}
+
+// Builds the segment index of a Polygon or MultiPolygon parsed in memory
+// geom -> Geometry
+// tree <- Entries of the tree. Must be released with sqlite3_free
+// numSegments <- Number of segments
+// Returns 0 if there is no memory or 1 if it's correct
+static int buildSegmentIndex(const gpkgGeometry *geom, double **tree, sqlite3_int64 *numSegments)
+{
+    sqlite3_int64 levelStart[SEGMENT_INDEX_MAX_LEVELS + 1];
+    segmentKey *keys;
+    double ext[4];
+    int numLevels, n = 0;
+
+    for (int r = 0; r < geom->numRings; r++)
+        n += geom->rings[r].numPoints > 1 ? geom->rings[r].numPoints - 1 : 0;
+    keys = (segmentKey *)sqlite3_malloc64(sizeof(segmentKey) * (n > 0 ? n : 1));
+    if (keys == NULL)
+        return 0;
+
+    // Sort the segments by the Hilbert key of their centers in a grid over the envelope of the geometry
+    memcpy(ext, geom->env, sizeof(ext));
+    if (ext[2] == ext[0])
+    {
+        ext[0] -= 0.5;
+        ext[2] += 0.5;
+    }
+    if (ext[3] == ext[1])
+    {
+        ext[1] -= 0.5;
+        ext[3] += 0.5;
+    }
+    n = 0;
+    for (int r = 0; r < geom->numRings; r++)
+    {
+        const gpkgRing *ring = &geom->rings[r];
+        for (int k = 0; k < ring->numPoints - 1; k++)
+        {
+            const double *a = &geom->coords[(ring->firstPoint + k) * geom->dimension];
+            const double *b = a + geom->dimension;
+            keys[n].key = hilbertKey(hilbertCell((a[0] + b[0]) / 2, ext[0], ext[2]), hilbertCell((a[1] + b[1]) / 2, ext[1], ext[3]), HILBERT_ORDER);
+            keys[n++].point = ring->firstPoint + k;
+        }
+    }
+    qsort(keys, n, sizeof(segmentKey), compareSegmentKeys);
+
+    numLevels = segmentIndexLevels(n, levelStart);
+    *tree = (double *)sqlite3_malloc64(sizeof(double) * 4 * (levelStart[numLevels] > 0 ? levelStart[numLevels] : 1));
+    if (*tree == NULL)
+    {
+        sqlite3_free(keys);
+        return 0;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        double *leaf = &(*tree)[(levelStart[numLevels - 1] + i) * 4];
+        const double *a = &geom->coords[keys[i].point * geom->dimension];
+        leaf[0] = a[0];
+        leaf[1] = a[1];
+        leaf[2] = a[geom->dimension];
+        leaf[3] = a[geom->dimension + 1];
+    }
+    sqlite3_free(keys);
+
+    // Each entry is the envelope of the entries of its node in the next level
+    for (int l = numLevels - 2; l >= 0; l--)
+    {
+        for (sqlite3_int64 e = levelStart[l]; e < levelStart[l + 1]; e++)
+        {
+            sqlite3_int64 first = levelStart[l + 1] + (e - levelStart[l]) * SEGMENT_INDEX_NODE_SIZE;
+            sqlite3_int64 last = first + SEGMENT_INDEX_NODE_SIZE < levelStart[l + 2] ? first + SEGMENT_INDEX_NODE_SIZE : levelStart[l + 2];
+            double *env = &(*tree)[e * 4];
+            segmentIndexEnvelope(&(*tree)[first * 4], l + 1 == numLevels - 1, env);
+            for (sqlite3_int64 c = first + 1; c < last; c++)
+            {
+                double child[4];
+                segmentIndexEnvelope(&(*tree)[c * 4], l + 1 == numLevels - 1, child);
+                env[0] = fmin(env[0], child[0]);
+                env[1] = fmin(env[1], child[1]);
+                env[2] = fmax(env[2], child[2]);
+                env[3] = fmax(env[3], child[3]);
+            }
+        }
+    }
+    *numSegments = n;
+    return 1;
+}
+
+// Reads the header of the tree of a feature and empties the cache of pages
+// index -> Segment index
+// id -> Feature
+// Returns SQLITE_OK, SQLITE_NOTFOUND if the feature has no tree (or it was written with other byte order) or an error code
+static int openSegmentIndex(segmentIndex *index, sqlite3_int64 id)
+{
+    int rc;
+
+    memset(index->cachedPages, 0, sizeof(index->cachedPages));
+    index->id = id;
+    sqlite3_bind_int64(index->pageStmt, 1, id);
+    sqlite3_bind_int(index->pageStmt, 2, 0);
+    rc = sqlite3_step(index->pageStmt);
+    if (rc == SQLITE_ROW)
+    {
+        const unsigned char *header = (const unsigned char *)sqlite3_column_blob(index->pageStmt, 0);
+        if (sqlite3_column_bytes(index->pageStmt, 0) == 1 + (int)sizeof(sqlite3_int64) && header[0] == endian())
+        {
+            memcpy(&index->numSegments, header + 1, sizeof(sqlite3_int64));
+            index->numLevels = segmentIndexLevels(index->numSegments, index->levelStart);
+            rc = index->numSegments > 0 ? SQLITE_OK : SQLITE_NOTFOUND;
+        }
+        else
+            rc = SQLITE_NOTFOUND;
+    }
+    else if (rc == SQLITE_DONE)
+        rc = SQLITE_NOTFOUND;
+    sqlite3_reset(index->pageStmt);
+    return rc;
+}
+
+// Reads an entry of the tree of the current feature through the cache of pages
+// index -> Segment index
+// entry -> Number of the entry
+// value <- Its 4 doubles
+// Returns 0 if there is an error or 1 if it's correct
+static int readSegmentIndexEntry(segmentIndex *index, sqlite3_int64 entry, double *value)
+{
+    sqlite3_int64 page = entry / SEGMENT_INDEX_PAGE_SIZE + 1;
+    int slot = (int)(page % SEGMENT_INDEX_CACHE_SIZE);
+    int offset = (int)(entry % SEGMENT_INDEX_PAGE_SIZE);
+    double *data = &index->cache[slot * SEGMENT_INDEX_PAGE_SIZE * 4];
+
+    if (index->cachedPages[slot] != page)
+    {
+        int bytes;
+        sqlite3_bind_int64(index->pageStmt, 1, index->id);
+        sqlite3_bind_int64(index->pageStmt, 2, page);
+        if (sqlite3_step(index->pageStmt) != SQLITE_ROW)
+        {
+            sqlite3_reset(index->pageStmt);
+            return 0;
+        }
+        bytes = sqlite3_column_bytes(index->pageStmt, 0);
+        if (bytes > (int)sizeof(double) * 4 * SEGMENT_INDEX_PAGE_SIZE)
+            bytes = (int)sizeof(double) * 4 * SEGMENT_INDEX_PAGE_SIZE;
+        memcpy(data, sqlite3_column_blob(index->pageStmt, 0), bytes);
+        sqlite3_reset(index->pageStmt);
+        index->cachedPages[slot] = page;
+        index->cachedEntries[slot] = bytes / ((int)sizeof(double) * 4);
+    }
+    if (offset >= index->cachedEntries[slot])
+        return 0;
+    memcpy(value, &data[offset * 4], sizeof(double) * 4);
+    return 1;
+}
+
+// Visits the segments of the tree of the current feature whose envelope intersects a box
+// index -> Segment index
+// box -> minX, minY, maxX, maxY
+// visit -> Function called with each segment (x1, y1, x2, y2). The search stops when it returns a value != 0
+// ctx -> Parameter of visit
+// Returns the value != 0 returned by visit, 0 if all the segments were visited or -1 if there is an error
+static int searchSegmentIndex(segmentIndex *index, const double *box, int (*visit)(void *, const double *), void *ctx)
+{
+    sqlite3_int64 stack[SEGMENT_INDEX_MAX_LEVELS * SEGMENT_INDEX_NODE_SIZE];
+    int levels[SEGMENT_INDEX_MAX_LEVELS * SEGMENT_INDEX_NODE_SIZE];
+    int top = 0;
+
+    stack[top] = 0;
+    levels[top++] = 0;
+    while (top > 0)
+    {
+        sqlite3_int64 e = stack[--top];
+        int l = levels[top];
+        int leaf = l == index->numLevels - 1;
+        double entry[4], env[4];
+        if (!readSegmentIndexEntry(index, e, entry))
+            return -1;
+        segmentIndexEnvelope(entry, leaf, env);
+        if (env[0] > box[2] || env[2] < box[0] || env[1] > box[3] || env[3] < box[1])
+            continue;
+        if (leaf)
+        {
+            int res = visit(ctx, entry);
+            if (res != 0)
+                return res;
+        }
+        else
+        {
+            sqlite3_int64 first = index->levelStart[l + 1] + (e - index->levelStart[l]) * SEGMENT_INDEX_NODE_SIZE;
+            sqlite3_int64 last = first + SEGMENT_INDEX_NODE_SIZE < index->levelStart[l + 2] ? first + SEGMENT_INDEX_NODE_SIZE : index->levelStart[l + 2];
+            for (sqlite3_int64 c = last - 1; c >= first; c--)
+            {
+                stack[top] = c;
+                levels[top++] = l + 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Parameters of the visits of a search in a segment index
+typedef struct segmentVisit
+{
+    const double *p, *q;          // Point, or segment p-q
+    const gpkgGeometry *geom;     // Geometry and part where the first coordinate of the segments is located
+    const gpkgPart *part;
+    int res;                      // Result of the location of the point
+} segmentVisit;
+
+// Counts the crossings of a segment with the ray from the point to +X, as pointInRing. Stops if the point is on the segment
+static int visitPointLocation(void *ctx, const double *s)
+{
+    segmentVisit *v = (segmentVisit *)ctx;
+    const double *a = s, *b = s + 2, *p = v->p;
+
+    if ((a[1] > p[1]) != (b[1] > p[1]))
+    {
+        double x = a[0] + (p[1] - a[1]) * (b[0] - a[0]) / (b[1] - a[1]);
+        if (x == p[0])
+            return 1;
+        if (x > p[0])
+            v->res = !v->res;
+    }
+    else if (orientation(a, b, p) == 0 && onSegmentEnvelope(a, b, p))
+        return 1;
+    return 0;
+}
+
+// Stops if the segment intersects p-q
+static int visitSegmentIntersects(void *ctx, const double *s)
+{
+    segmentVisit *v = (segmentVisit *)ctx;
+
+    return segmentsIntersect(s, s + 2, v->p, v->q);
+}
+
+// Stops if the segment crosses p-q in a point interior to both
+static int visitSegmentCrosses(void *ctx, const double *s)
+{
+    segmentVisit *v = (segmentVisit *)ctx;
+
+    return segmentsCross(s, s + 2, v->p, v->q);
+}
+
+// Stops if the first coordinate of the segment is in the interior (res == 1) or in the part (res == 0)
+static int visitVertexInPart(void *ctx, const double *s)
+{
+    segmentVisit *v = (segmentVisit *)ctx;
+    int res = pointInPart(v->geom, v->part, s);
+
+    return v->res ? res == 1 : res != 0;
+}
+
+// Returns 0 if a point is outside the feature of the segment index, 1 if it is in the interior, 2 if it is on the boundary or -1 if there is an error
+// The crossings of all the rings are counted together, as the Polygons of a MultiPolygon don't overlap
+static int pointInSegmentIndex(segmentIndex *index, const double *p)
+{
+    segmentVisit v;
+    double box[4];
+    int res;
+
+    v.p = p;
+    v.res = 0;
+    box[0] = p[0];
+    box[1] = p[1];
+    box[2] = HUGE_VAL;
+    box[3] = p[1];
+    res = searchSegmentIndex(index, box, visitPointLocation, &v);
+    return res < 0 ? -1 : (res > 0 ? 2 : v.res);
+}
+
+// Searches the segments of the feature of the segment index that intersect (or cross) a segment
+// Returns 1 if there is one, 0 if there isn't or -1 if there is an error
+static int segmentInSegmentIndex(segmentIndex *index, const double *p, const double *q, int proper)
+{
+    segmentVisit v;
+    double box[4];
+
+    v.p = p;
+    v.q = q;
+    box[0] = fmin(p[0], q[0]);
+    box[1] = fmin(p[1], q[1]);
+    box[2] = fmax(p[0], q[0]);
+    box[3] = fmax(p[1], q[1]);
+    return searchSegmentIndex(index, box, proper ? visitSegmentCrosses : visitSegmentIntersects, &v);
+}
+
+// Searches the vertices of the feature of the segment index inside the envelope of a part that are in the part (or in its interior)
+// Returns 1 if there is one, 0 if there isn't or -1 if there is an error
+static int vertexInPart(segmentIndex *index, const gpkgGeometry *geom, const gpkgPart *part, int interior)
+{
+    const gpkgRing *ring = &geom->rings[part->firstRing];
+    segmentVisit v;
+    double box[4] = { HUGE_VAL, HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+
+    for (int k = 0; k < ring->numPoints; k++)
+    {
+        const double *c = &geom->coords[(ring->firstPoint + k) * geom->dimension];
+        box[0] = fmin(box[0], c[0]);
+        box[1] = fmin(box[1], c[1]);
+        box[2] = fmax(box[2], c[0]);
+        box[3] = fmax(box[3], c[1]);
+    }
+    v.geom = geom;
+    v.part = part;
+    v.res = interior;
+    return searchSegmentIndex(index, box, visitVertexInPart, &v);
+}
+
+// Evaluates a predicate between the feature of the segment index and a geometry, as geometryIntersects and geometryContains
+// but searching the segments of the feature in its tree instead of reading all of them
+// index -> Segment index opened on the feature
+// b -> Geometry
+// predicate -> PREDICATE_INTERSECTS or PREDICATE_CONTAINS (the feature contains b)
+// Returns 1 if the predicate is satisfied, 0 if it isn't or -1 if there is an error
+static int segmentIndexPredicate(segmentIndex *index, const gpkgGeometry *b, int predicate)
+{
+    double root[4], env[4];
+    int interior = 0;
+    int res;
+
+    if (b->numParts == 0)
+        return 0;
+    if (!readSegmentIndexEntry(index, 0, root))
+        return -1;
+    segmentIndexEnvelope(root, index->numLevels == 1, env);
+    if (predicate == PREDICATE_INTERSECTS && (env[2] < b->env[0] || env[0] > b->env[2] || env[3] < b->env[1] || env[1] > b->env[3]))
+        return 0;
+    if (predicate == PREDICATE_CONTAINS && (b->env[0] < env[0] || b->env[2] > env[2] || b->env[1] < env[1] || b->env[3] > env[3]))
+        return 0;
+    for (int j = 0; j < b->numParts; j++)
+    {
+        const gpkgPart *pb = &b->parts[j];
+        for (int rb = pb->firstRing; rb < pb->firstRing + pb->numRings; rb++)
+        {
+            const gpkgRing *ring = &b->rings[rb];
+            for (int k = 0; k < ring->numPoints; k++)
+            {
+                const double *c = &b->coords[(ring->firstPoint + k) * b->dimension];
+                if (predicate == PREDICATE_INTERSECTS)
+                {
+                    // A vertex of b in the feature, or a segment of b that intersects a segment of the feature
+                    if (k == 0 || pb->geometryType == wkbPoint)
+                        res = pointInSegmentIndex(index, c);
+                    else
+                        res = segmentInSegmentIndex(index, c - b->dimension, c, 0);
+                    if (res != 0)
+                        return res < 0 ? -1 : 1;
+                    continue;
+                }
+                // All the vertices and the midpoints of the segments of b in the feature
+                res = pointInSegmentIndex(index, c);
+                if (res <= 0)
+                    return res;
+                if (res == 1)
+                    interior = 1;
+                if (k > 0)
+                {
+                    double mid[2];
+                    mid[0] = (c[0] + c[-b->dimension]) / 2;
+                    mid[1] = (c[1] + c[1 - b->dimension]) / 2;
+                    res = pointInSegmentIndex(index, mid);
+                    if (res <= 0)
+                        return res;
+                    if (res == 1)
+                        interior = 1;
+                    // No segment of b crosses the boundary of the feature
+                    res = segmentInSegmentIndex(index, c - b->dimension, c, 1);
+                    if (res != 0)
+                        return res < 0 ? -1 : 0;
+                }
+            }
+        }
+        if (pb->geometryType == wkbPolygon)
+        {
+            // For intersects, the feature can be inside b. For contains, no vertex of the feature can be in the interior of b
+            res = vertexInPart(index, b, pb, predicate == PREDICATE_CONTAINS);
+            if (res != 0)
+                return predicate == PREDICATE_INTERSECTS || res < 0 ? res : 0;
+            interior = 1;
+        }
+    }
+    return predicate == PREDICATE_INTERSECTS ? 0 : interior;
+}
+
+// Gets the segment index of a table for a spatial predicate. It's cached while tableName and geometryColumn are constants
+// context -> sqlite3_context of the function
+// table -> Name of the table
+// gcolumn -> Column that contains the geometry
+// name -> Name of the function for the error messages
+// Returns the segment index or NULL if the table has no segment index or there is an error, that is returned in context
+static segmentIndex *getSegmentIndex(sqlite3_context *context, const char *table, const char *gcolumn, const char *name)
+{
+    sqlite3 *db = sqlite3_context_db_handle(context);
+    segmentIndex *index = (segmentIndex *)sqlite3_get_auxdata(context, 0);
+    sqlite3_stmt *stmt;
+    char *sql;
+    int rc;
+
+    if (index != NULL && strcmp(index->table, table) == 0 && strcmp(index->gcolumn, gcolumn) == 0)
+        return index;
+
+    // Get the id column of the segment index
+    rc = sqlite3_prepare_v2(db, "SELECT id_column FROM gpkgext_segment_index WHERE LOWER(table_name) = LOWER(?) AND LOWER(column_name) = LOWER(?)", -1, &stmt, NULL);
+    if (rc == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, gcolumn, -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+    }
+    if (rc != SQLITE_ROW)
+    {
+        sqlite3_finalize(stmt);
+        sql = sqlite3_mprintf("%s() error: argument 1 [tableName] has no segment index in the geometry column", name);
+        sqlite3_result_error(context, sql, -1);
+        sqlite3_free(sql);
+        return NULL;
+    }
+    index = (segmentIndex *)sqlite3_malloc(sizeof(segmentIndex));
+    if (index == NULL)
+    {
+        sqlite3_finalize(stmt);
+        sqlite3_result_error_nomem(context);
+        return NULL;
+    }
+    memset(index, 0, sizeof(segmentIndex));
+    index->table = sqlite3_mprintf("%s", table);
+    index->gcolumn = sqlite3_mprintf("%s", gcolumn);
+    index->cache = (double *)sqlite3_malloc64(sizeof(double) * 4 * SEGMENT_INDEX_PAGE_SIZE * SEGMENT_INDEX_CACHE_SIZE);
+    sql = sqlite3_mprintf("SELECT \"%w\" FROM \"%w\" WHERE \"%w\" = ?", gcolumn, table, (const char *)sqlite3_column_text(stmt, 0));
+    sqlite3_finalize(stmt);
+    rc = index->table == NULL || index->gcolumn == NULL || index->cache == NULL || sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &index->geometryStmt, NULL);
+    sqlite3_free(sql);
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("SELECT data FROM \"segidx_%w_%w\" WHERE id = ? AND page = ?", table, gcolumn);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &index->pageStmt, NULL);
+        sqlite3_free(sql);
+    }
+    if (rc != SQLITE_OK)
+    {
+        freeSegmentIndex(index);
+        if (rc == SQLITE_NOMEM)
+            sqlite3_result_error_nomem(context);
+        else
+            sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return NULL;
+    }
+    // SQLite releases the index when the statement ends or, if the parameters are not constants, when this call ends
+    sqlite3_set_auxdata(context, 0, index, freeSegmentIndex);
+    index = (segmentIndex *)sqlite3_get_auxdata(context, 0);
+    if (index == NULL)
+        sqlite3_result_error_nomem(context);
+    return index;
+}
+
+// Evaluates an exact spatial predicate between a feature of a table with segment index and a geometry in GPKG format
+// The feature is evaluated with its tree if it has one, else with its geometry
+// context -> sqlite3_context where the result is returned: 1 if the predicate is satisfied, 0 if it is not, NULL if the feature doesn't exist, a geometry is NULL or there is an error
+// argv -> tableName, geometryColumn, id of the feature and geometry
+// predicate -> PREDICATE_INTERSECTS or PREDICATE_CONTAINS
+static void evaluateIndexedPredicate(sqlite3_context *context, sqlite3_value **argv, int predicate)
+{
+    const char *table = (const char *)sqlite3_value_text(argv[0]);
+    const char *gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    segmentIndex *index;
+    gpkgGeometry a, b;
+    int res = -1;
+    int rc;
+
+    if (table == NULL || gcolumn == NULL || sqlite3_value_type(argv[2]) == SQLITE_NULL || sqlite3_value_type(argv[3]) != SQLITE_BLOB)
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    index = getSegmentIndex(context, table, gcolumn, predicate == PREDICATE_INTERSECTS ? "ST_Intersects" : "ST_Contains");
+    if (index == NULL)
+        return;
+
+    memset(&a, 0, sizeof(gpkgGeometry));
+    memset(&b, 0, sizeof(gpkgGeometry));
+    if (readGPKGGeometry((unsigned char *)sqlite3_value_blob(argv[3]), sqlite3_value_bytes(argv[3]), &b))
+    {
+        rc = openSegmentIndex(index, sqlite3_value_int64(argv[2]));
+        if (rc == SQLITE_OK)
+            res = segmentIndexPredicate(index, &b, predicate);
+        else if (rc == SQLITE_NOTFOUND)
+        {
+            // Without tree, read the geometry of the feature
+            sqlite3_bind_value(index->geometryStmt, 1, argv[2]);
+            if (sqlite3_step(index->geometryStmt) == SQLITE_ROW && sqlite3_column_type(index->geometryStmt, 0) == SQLITE_BLOB &&
+                readGPKGGeometry((unsigned char *)sqlite3_column_blob(index->geometryStmt, 0), sqlite3_column_bytes(index->geometryStmt, 0), &a))
+                res = predicate == PREDICATE_INTERSECTS ? geometryIntersects(&a, &b) : geometryContains(&a, &b);
+            sqlite3_reset(index->geometryStmt);
+        }
+    }
+    freeGPKGGeometry(&a);
+    freeGPKGGeometry(&b);
+    if (res < 0)
+        sqlite3_result_null(context);
+    else
+        sqlite3_result_int(context, res);
+}
+
+// Evaluates an exact spatial predicate between two geometries in GPKG format
+// context -> sqlite3_context where the result is returned: 1 if the predicate is satisfied, 0 if it is not, NULL if a geometry is NULL or there is an error
+// argv -> The two geometries
+// predicate -> PREDICATE_INTERSECTS, PREDICATE_CONTAINS or PREDICATE_WITHIN
+static void evaluatePredicate(sqlite3_context *context, sqlite3_value **argv, int predicate)
+{
+    gpkgGeometry a, b;
+    int res = -1;
+
+    memset(&a, 0, sizeof(gpkgGeometry));
+    memset(&b, 0, sizeof(gpkgGeometry));
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB && sqlite3_value_type(argv[1]) == SQLITE_BLOB) // Must be BLOBs
+    {
+        if (readGPKGGeometry((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), &a) &&
+            readGPKGGeometry((unsigned char *)sqlite3_value_blob(argv[1]), sqlite3_value_bytes(argv[1]), &b))
+        {
+            if (predicate == PREDICATE_INTERSECTS)
+                res = geometryIntersects(&a, &b);
+            else if (predicate == PREDICATE_CONTAINS)
+                res = geometryContains(&a, &b);
+            else
+                res = geometryContains(&b, &a);
+        }
+    }
+    freeGPKGGeometry(&a);
+    freeGPKGGeometry(&b);
+    if (res < 0)
+        sqlite3_result_null(context);
+    else
+        sqlite3_result_int(context, res);
+}
+
+// SQL function: ST_Intersects(GEOMETRY, GEOMETRY); ST_Intersects(tableName, geometryColumn, id, GEOMETRY); 
+// With 4 arguments the first geometry is the feature id of a table with segment index (GPKG_AddSegmentIndex)
+// Returns 1 if the geometries intersect, 0 if they don't, NULL if a geometry is NULL or there is an error
+static void fnct_STIntersects(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    if (argc == 4)
+        evaluateIndexedPredicate(context, argv, PREDICATE_INTERSECTS);
+    else
+        evaluatePredicate(context, argv, PREDICATE_INTERSECTS);
+}
+
+// SQL function: ST_Contains(GEOMETRY, GEOMETRY); ST_Contains(tableName, geometryColumn, id, GEOMETRY); 
+// With 4 arguments the first geometry is the feature id of a table with segment index (GPKG_AddSegmentIndex)
+// Returns 1 if the first geometry contains the second one, 0 if it doesn't, NULL if a geometry is NULL or there is an error
+static void fnct_STContains(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    if (argc == 4)
+        evaluateIndexedPredicate(context, argv, PREDICATE_CONTAINS);
+    else
+        evaluatePredicate(context, argv, PREDICATE_CONTAINS);
+}
+
+// SQL function: ST_Within(GEOMETRY, GEOMETRY); 
+// Returns 1 if the first geometry is within the second one, 0 if it isn't, NULL if a geometry is NULL or there is an error
+static void fnct_STWithin(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    evaluatePredicate(context, argv, PREDICATE_WITHIN);
+}
+
+// SQL function: ST_Distance(GEOMETRY, GEOMETRY); 
+// Returns the minimum distance between the geometries, NULL if a geometry is NULL, empty or there is an error
+static void fnct_STDistance(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    gpkgGeometry a, b;
+    double dist = -1;
+
+    memset(&a, 0, sizeof(gpkgGeometry));
+    memset(&b, 0, sizeof(gpkgGeometry));
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB && sqlite3_value_type(argv[1]) == SQLITE_BLOB) // Must be BLOBs
+    {
+        if (readGPKGGeometry((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), &a) &&
+            readGPKGGeometry((unsigned char *)sqlite3_value_blob(argv[1]), sqlite3_value_bytes(argv[1]), &b))
+            dist = geometryDistance(&a, &b);
+    }
+    freeGPKGGeometry(&a);
+    freeGPKGGeometry(&b);
+    if (dist < 0)
+        sqlite3_result_null(context);
+    else
+        sqlite3_result_double(context, dist);
+}
+
+// SQL function: SQL function: ST_IsEmpty(GEOMETRY); 
+// Returns 1 if the geometry is empty, 0 if it is not empty, -1 if there is an error (therefore ISEMPTY (GEOM) is evaluated to TRUE)
+static void fnct_STIsEmpty(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    unsigned char *p_blob;
+    int n_bytes;
+    int index = 0;
+    int res = -1;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
+    {
+        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
+        n_bytes = sqlite3_value_bytes(argv[0]);
+        if (n_bytes >= 13) // Not enough bytes (at least 1 for Endianess and 4 for TypeInt + 8 minimum GPKG header)
+            res = isEmptyGPKGGeometry(p_blob, n_bytes, &index, endian(), wkbGeometry);
+    }
+    sqlite3_result_int(context, res);
+}
+
+// Ellipsoid of the EPSG catalogue
+typedef struct epsgEllipsoid
+{
+    const char *name;
+    int code;
+    double a;             // Semi-major axis
+    double invFlattening; // Inverse flattening
+} epsgEllipsoid;
+
+// Geographic SRS of the EPSG catalogue
+typedef struct epsgGeographic
+{
+    int code;
+    const char *name;
+    const char *datum;   // Name of the datum
+    int datumCode;       // EPSG code of the datum
+    int ellipsoid;       // Index in epsgEllipsoids
+    const char *toWGS84; // Parameters of TOWGS84 or NULL
+} epsgGeographic;
+
+// Entry of the EPSG catalogue: a geographic SRS, a projected SRS or a range of projected SRS by zones (UTM)
+// The definitions are built from the parameters, so the catalogue is much smaller than the WKT it produces
+typedef struct epsgEntry
+{
+    int first, last;      // EPSG codes of the entry. first = last if it's not by zones
+    int zoneOffset;       // Zone of a code of an entry by zones: code - zoneOffset. Its central meridian is zone * 6 - 183
+    const char *name;     // Name. Entries by zones have %d for the zone
+    int geographic;       // Index in epsgGeographics of the geographic SRS
+    int projection;       // EPSG_GEOGRAPHIC ... EPSG_LAMBERT_AZIMUTHAL_EQUAL_AREA
+    double parameters[6]; // Parameters in the order of epsgProjections
+} epsgEntry;
+
+static const epsgEllipsoid epsgEllipsoids[] = {
+    { "WGS 84", 7030, 6378137, 298.257223563 },
+    { "GRS 1980", 7019, 6378137, 298.257222101 },
+    { "Clarke 1866", 7008, 6378206.4, 294.978698213898 },
+    { "Airy 1830", 7001, 6377563.396, 299.3249646 },
+    { "International 1924", 7022, 6378388, 297 },
+    { "WGS 72", 7043, 6378135, 298.26 }
+};
+
+static const epsgGeographic epsgGeographics[] = {
+    { 4326, "WGS 84", "WGS_1984", 6326, 0, NULL },
+    { 4258, "ETRS89", "European_Terrestrial_Reference_System_1989", 6258, 1, "0,0,0,0,0,0,0" },
+    { 4269, "NAD83", "North_American_Datum_1983", 6269, 1, "0,0,0,0,0,0,0" },
+    { 4267, "NAD27", "North_American_Datum_1927", 6267, 2, NULL },
+    { 4277, "OSGB 1936", "OSGB_1936", 6277, 3, "446.448,-125.157,542.06,0.15,0.247,0.842,-20.489" },
+    { 4230, "ED50", "European_Datum_1950", 6230, 4, "-87,-98,-121,0,0,0,0" },
+    { 4283, "GDA94", "Geocentric_Datum_of_Australia_1994", 6283, 1, "0,0,0,0,0,0,0" },
+    { 4167, "NZGD2000", "New_Zealand_Geodetic_Datum_2000", 6167, 1, "0,0,0,0,0,0,0" },
+    { 4171, "RGF93", "Reseau_Geodesique_Francais_1993", 6171, 1, "0,0,0,0,0,0,0" },
+    { 4674, "SIRGAS 2000", "Sistema_de_Referencia_Geocentrico_para_las_AmericaS_2000", 6674, 1, "0,0,0,0,0,0,0" },
+    { 4612, "JGD2000", "Japanese_Geodetic_Datum_2000", 6612, 1, "0,0,0,0,0,0,0" },
+    { 4322, "WGS 72", "WGS_1972", 6322, 5, "0,0,4.5,0,0,0.554,0.2263" },
+    { 4148, "Hartebeesthoek94", "Hartebeesthoek94", 6148, 0, "0,0,0,0,0,0,0" }
+};
+
+// WKT names of the projections and of their parameters, indexed by EPSG_TRANSVERSE_MERCATOR ... EPSG_LAMBERT_AZIMUTHAL_EQUAL_AREA
+static const char *epsgProjections[][7] = {
+    { NULL },
+    { "Transverse_Mercator", "latitude_of_origin", "central_meridian", "scale_factor", "false_easting", "false_northing", NULL },
+    { "Mercator_1SP", "central_meridian", "scale_factor", "false_easting", "false_northing", NULL },
+    { "Mercator_1SP", "central_meridian", "scale_factor", "false_easting", "false_northing", NULL },
+    { "Lambert_Conformal_Conic_2SP", "standard_parallel_1", "standard_parallel_2", "latitude_of_origin", "central_meridian", "false_easting", "false_northing" },
+    { "Lambert_Azimuthal_Equal_Area", "latitude_of_center", "longitude_of_center", "false_easting", "false_northing", NULL }
+};
+
+// Sorted by code, for a binary search
+static const epsgEntry epsgEntries[] = {
+    { 2154, 2154, 0, "RGF93 / Lambert-93", 8, EPSG_LAMBERT_CONFORMAL_CONIC, { 49, 44, 46.5, 3, 700000, 6600000 } },
+    { 2193, 2193, 0, "NZGD2000 / New Zealand Transverse Mercator 2000", 7, EPSG_TRANSVERSE_MERCATOR, { 0, 173, 0.9996, 1600000, 10000000 } },
+    { 3035, 3035, 0, "ETRS89 / LAEA Europe", 1, EPSG_LAMBERT_AZIMUTHAL_EQUAL_AREA, { 52, 10, 4321000, 3210000 } },
+    { 3395, 3395, 0, "WGS 84 / World Mercator", 0, EPSG_MERCATOR, { 0, 1, 0, 0 } },
+    { 3857, 3857, 0, "WGS 84 / Pseudo-Mercator", 0, EPSG_PSEUDO_MERCATOR, { 0, 1, 0, 0 } },
+    { 4148, 4148, 0, "Hartebeesthoek94", 12, EPSG_GEOGRAPHIC, { 0 } },
+    { 4167, 4167, 0, "NZGD2000", 7, EPSG_GEOGRAPHIC, { 0 } },
+    { 4171, 4171, 0, "RGF93", 8, EPSG_GEOGRAPHIC, { 0 } },
+    { 4230, 4230, 0, "ED50", 5, EPSG_GEOGRAPHIC, { 0 } },
+    { 4258, 4258, 0, "ETRS89", 1, EPSG_GEOGRAPHIC, { 0 } },
+    { 4267, 4267, 0, "NAD27", 3, EPSG_GEOGRAPHIC, { 0 } },
+    { 4269, 4269, 0, "NAD83", 2, EPSG_GEOGRAPHIC, { 0 } },
+    { 4277, 4277, 0, "OSGB 1936", 4, EPSG_GEOGRAPHIC, { 0 } },
+    { 4283, 4283, 0, "GDA94", 6, EPSG_GEOGRAPHIC, { 0 } },
+    { 4322, 4322, 0, "WGS 72", 11, EPSG_GEOGRAPHIC, { 0 } },
+    { 4326, 4326, 0, "WGS 84", 0, EPSG_GEOGRAPHIC, { 0 } },
+    { 4612, 4612, 0, "JGD2000", 10, EPSG_GEOGRAPHIC, { 0 } },
+    { 4674, 4674, 0, "SIRGAS 2000", 9, EPSG_GEOGRAPHIC, { 0 } },
+    { 23028, 23038, 23000, "ED50 / UTM zone %dN", 5, EPSG_TRANSVERSE_MERCATOR, { 0, 0, 0.9996, 500000, 0 } },
+    { 25828, 25838, 25800, "ETRS89 / UTM zone %dN", 1, EPSG_TRANSVERSE_MERCATOR, { 0, 0, 0.9996, 500000, 0 } },
+    { 26703, 26722, 26700, "NAD27 / UTM zone %dN", 3, EPSG_TRANSVERSE_MERCATOR, { 0, 0, 0.9996, 500000, 0 } },
+    { 26901, 26923, 26900, "NAD83 / UTM zone %dN", 2, EPSG_TRANSVERSE_MERCATOR, { 0, 0, 0.9996, 500000, 0 } },
+    { 27700, 27700, 0, "OSGB 1936 / British National Grid", 4, EPSG_TRANSVERSE_MERCATOR, { 49, -2, 0.9996012717, 400000, -100000 } },
+    { 28348, 28358, 28300, "GDA94 / MGA zone %d", 6, EPSG_TRANSVERSE_MERCATOR, { 0, 0, 0.9996, 500000, 10000000 } },
+    { 32601, 32660, 32600, "WGS 84 / UTM zone %dN", 0, EPSG_TRANSVERSE_MERCATOR, { 0, 0, 0.9996, 500000, 0 } },
+    { 32701, 32760, 32700, "WGS 84 / UTM zone %dS", 0, EPSG_TRANSVERSE_MERCATOR, { 0, 0, 0.9996, 500000, 10000000 } }
+};
+
+// Finds an EPSG code in the catalogue by binary search
+// Returns the entry or NULL if the code is not in the catalogue
+static const epsgEntry *findEPSG(int code)
+{
+    int low = 0, high = (int)(sizeof(epsgEntries) / sizeof(epsgEntries[0])) - 1;
+
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        if (code < epsgEntries[mid].first)
+            high = mid - 1;
+        else if (code > epsgEntries[mid].last)
+            low = mid + 1;
+        else
+            return &epsgEntries[mid];
+    }
+    return NULL;
+}
+
+// Builds the WKT definition of an SRS of the EPSG catalogue
+// entry -> Entry of the catalogue
+// code -> EPSG code, inside the range of the entry
+// Returns the definition allocated with sqlite3_mprintf or NULL if there is no memory
+static char *epsgDefinition(const epsgEntry *entry, int code)
+{
+    const epsgGeographic *geo = &epsgGeographics[entry->geographic];
+    const epsgEllipsoid *ellipsoid = &epsgEllipsoids[geo->ellipsoid];
+    const char *const *names = epsgProjections[entry->projection];
+    double parameters[6];
+    char *geogcs, *name, *wkt;
+
+    geogcs = sqlite3_mprintf("GEOGCS[\"%s\",DATUM[\"%s\",SPHEROID[\"%s\",%.15g,%.15g,AUTHORITY[\"EPSG\",\"%d\"]]%s%s%s,AUTHORITY[\"EPSG\",\"%d\"]],"
+        "PRIMEM[\"Greenwich\",0,AUTHORITY[\"EPSG\",\"8901\"]],UNIT[\"degree\",0.0174532925199433,AUTHORITY[\"EPSG\",\"9122\"]],AUTHORITY[\"EPSG\",\"%d\"]]",
+        geo->name, geo->datum, ellipsoid->name, ellipsoid->a, ellipsoid->invFlattening, ellipsoid->code,
+        geo->toWGS84 != NULL ? ",TOWGS84[" : "", geo->toWGS84 != NULL ? geo->toWGS84 : "", geo->toWGS84 != NULL ? "]" : "", geo->datumCode, geo->code);
+    if (entry->projection == EPSG_GEOGRAPHIC || geogcs == NULL)
+        return geogcs;
+
+    memcpy(parameters, entry->parameters, sizeof(parameters));
+    if (entry->zoneOffset != 0)
+        parameters[1] = (code - entry->zoneOffset) * 6 - 183;
+    name = entry->zoneOffset != 0 ? sqlite3_mprintf(entry->name, code - entry->zoneOffset) : sqlite3_mprintf("%s", entry->name);
+    wkt = name == NULL ? NULL : sqlite3_mprintf("PROJCS[\"%s\",%s,PROJECTION[\"%s\"]", name, geogcs, names[0]);
+    for (int i = 1; i < 7 && names[i] != NULL && wkt != NULL; i++)
+        wkt = sqlite3_mprintf("%z,PARAMETER[\"%s\",%.15g]", wkt, names[i], parameters[i - 1]);
+    if (wkt != NULL)
+        wkt = sqlite3_mprintf("%z,UNIT[\"metre\",1,AUTHORITY[\"EPSG\",\"9001\"]],AXIS[\"Easting\",EAST],AXIS[\"Northing\",NORTH]%s,AUTHORITY[\"EPSG\",\"%d\"]]", wkt,
+            entry->projection == EPSG_PSEUDO_MERCATOR ? ",EXTENSION[\"PROJ4\",\"+proj=merc +a=6378137 +b=6378137 +lat_ts=0 +lon_0=0 +x_0=0 +y_0=0 +k=1 +units=m +nadgrids=@null +wktext +no_defs\"]" : "",
+            code);
+    sqlite3_free(name);
+    sqlite3_free(geogcs);
+    return wkt;
+}
+
+// Inserts an SRS of the EPSG catalogue into gpkg_spatial_ref_sys with srs_id = code, if there is no SRS with that srs_id
+// db -> Database
+// code -> EPSG code
+// Returns SQLITE_OK, SQLITE_NOTFOUND if the SRS doesn't exist and the code is not in the catalogue or the error code
+static int registerEPSG(sqlite3 *db, int code)
+{
+    const epsgEntry *entry;
+    sqlite3_stmt *stmt;
+    char *name, *wkt;
+    int rc;
+
+    rc = sqlite3_prepare_v2(db, "SELECT 1 FROM gpkg_spatial_ref_sys WHERE srs_id = ?", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+        return rc;
+    sqlite3_bind_int(stmt, 1, code);
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE)
+        return rc == SQLITE_ROW ? SQLITE_OK : rc;
+
+    entry = findEPSG(code);
+    if (entry == NULL)
+        return SQLITE_NOTFOUND;
+    name = entry->zoneOffset != 0 ? sqlite3_mprintf(entry->name, code - entry->zoneOffset) : sqlite3_mprintf("%s", entry->name);
+    wkt = epsgDefinition(entry, code);
+    rc = name == NULL || wkt == NULL ? SQLITE_NOMEM :
+        sqlite3_prepare_v2(db, "INSERT INTO gpkg_spatial_ref_sys(srs_name, srs_id, organization, organization_coordsys_id, definition) VALUES(?, ?, 'EPSG', ?, ?)", -1, &stmt, NULL);
+    if (rc == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, code);
+        sqlite3_bind_int(stmt, 3, code);
+        sqlite3_bind_text(stmt, 4, wkt, -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+        rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_free(name);
+    sqlite3_free(wkt);
+    return rc;
+}
+
+// SQL function: GPKG_AddSRS(epsg); 
+// Registers an SRS of the embedded EPSG catalogue in gpkg_spatial_ref_sys, with srs_id = epsg and organization = 'EPSG'
+// epsg -> EPSG code. The catalogue has the most common geographic SRS (WGS 84, ETRS89, NAD83, NAD27, ED50, OSGB 1936, GDA94...),
+//         Web Mercator, World Mercator, the UTM zones of WGS 84, ETRS89, NAD83, NAD27, ED50 and GDA94 and some national grids
+// If there is already an SRS with that srs_id nothing is done.
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGAddSRS(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    int rc;
+
+    if (sqlite3_value_type(argv[0]) != SQLITE_INTEGER)
+    {
+        sqlite3_result_error(context, "GPKG_AddSRS() error: argument 1 [epsg] must be an integer", -1);
+        return;
+    }
+    rc = registerEPSG(sqlite3_context_db_handle(context), sqlite3_value_int(argv[0]));
+    if (rc == SQLITE_NOTFOUND)
+        sqlite3_result_error(context, "GPKG_AddSRS() error: argument 1 [epsg] is not in the EPSG catalogue", -1);
+    else if (rc != SQLITE_OK)
+        sqlite3_result_error(context, sqlite3_errmsg(sqlite3_context_db_handle(context)), -1);
+}
+
+// SQL function: GPKG_AddGeometryColumn(identifier, tableName, geometryColumn, geometryType, srsId, zFlag, mFlag); 
+// identifier -> Identifier of the geometry (gpkg_contents)
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// geometryType -> WKT geometry name : "GEOMETRY", "POINT", "LINESTRING", "POLYGON", "MULTIPOINT", "MULTILINESTRING", "MULTIPOLYGON", "GEOMCOLLECTION"
+// srsId -> SRS ID of the geometries
+// zFlag -> 0: z values prohibited; 1: z values mandatory; 2: z values optional
+// mflag -> 0: m values prohibited; 1: m values mandatory; 2: m values optional
+// Populates the gpkg_spatial_ref_sys table with the SRS of the EPSG catalogue whose code is srsId (if not already present)
+// Populates the gpkg_contents table (if not already present)
+// Populates the gpkg_geometry_columns table
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGAddGeometryColumn(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *identifier;
+    const char *table;
+    const char *gcolumn;
+    const char *gtype;
+    int igtype;
+    int srsid;
+    int zflag;
+    int mflag;
+    sqlite3 *db;
+    char *sql;
+    int rc;
+
+    // Get the parameters
+    identifier = (const char *)sqlite3_value_text(argv[0]);
+    table = (const char *)sqlite3_value_text(argv[1]);
+    gcolumn = (const char *)sqlite3_value_text(argv[2]);
+    gtype = (const char *)sqlite3_value_text(argv[3]);
+    srsid = sqlite3_value_int(argv[4]);
+    zflag = sqlite3_value_int(argv[5]);
+    mflag = sqlite3_value_int(argv[6]);
+
+    // Check parmeters
+    for (igtype = 0; wktGeomtryTypes[igtype] != NULL; igtype++)
+    {
+        if (_stricmp(gtype, wktGeomtryTypes[igtype]) == 0)
+            break;
+    }
+    if (wktGeomtryTypes[igtype] == NULL)
+    {
+        sqlite3_result_error(context, "GPKG_AddGeometryColumn() error: argument 3 [geometryType] unrecognised geometry type", -1);
+        return;
+    }
+    // HACK! Convert "GEOMETRYCOLLECTION" to "GEOMCOLLECTION"
+    if (igtype == 8)
+        igtype = 7;
+    if (zflag != 0 && zflag != 1 && zflag != 2)
+    {
+        sqlite3_result_error(context, "GPKG_AddGeometryColumn() error: argument 5 [zFlag] must be 0, 1 or 2", -1);
+        return;
+    }
+    if (mflag != 0 && mflag != 1 && mflag != 2)
+    {
+        sqlite3_result_error(context, "GPKG_AddGeometryColumn() error: argument 6 [mFlag] must be 0, 1 or 2", -1);
+        return;
+    }
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Populate gpkg_spatial_ref_sys. An SRS that is not in the EPSG catalogue must be inserted before
+    rc = registerEPSG(db, srsid);
+    if (rc != SQLITE_OK && rc != SQLITE_NOTFOUND)
+    {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+
+    // Populate gpkg_contents
+    sql = sqlite3_mprintf("INSERT OR IGNORE INTO gpkg_contents(table_name, data_type, identifier, srs_id) VALUES(%Q, 'features', %Q, %i)",
+        table, identifier, srsid);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Populate gpkg_geometry_column
+    sql = sqlite3_mprintf("INSERT INTO gpkg_geometry_columns(table_name, column_name, geometry_type_name, srs_id, z, m) VALUES(%Q, %Q, '%s', %i, %i, %i)",
+        table, gcolumn, wktGeomtryTypes[igtype], srsid, zflag, mflag);
+    sqlite3_exec_free(context, db, sql, NULL);
+}
+
+// Returns the SQL fragment with the Z bounds of a 3D spatial index, to be appended to the VALUES of the rtree
+// It's allocated with sqlite3_mprintf so it can be consumed with the %z format
+// zIndex -> 1 if the spatial index is 3D, 0 if it is 2D (returns an empty string)
+// prefix -> Prefix of the geometry column ("NEW." inside the triggers, "" when populating the spatial index)
+// gcolumn -> Column that contains the geometry
+// Geometries without Z are indexed with minz = maxz = 0
+static char *rtreeZValues(int zIndex, const char *prefix, const char *gcolumn)
+{
+    if (!zIndex)
+        return sqlite3_mprintf("");
+    return sqlite3_mprintf(", IFNULL(ST_MinZ(%s\"%w\"), 0), IFNULL(ST_MaxZ(%s\"%w\"), 0)",
+        prefix, gcolumn, prefix, gcolumn);
+}
+
+// SQL function: GPKG_AddSpatialIndex(tableName, geometryColumn, idColumn, zIndex);
+// Creates a spatial index of a table and the corresponding triggers to maintain the integrity between the spatial index and the table
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// idColumn -> Column that is the PrimaryKey of the table
+// zIndex -> optional parameter. If 1 creates a 3D spatial index with the columns minz and maxz. If not specified assumes 0 (2D spatial index).
+//           The geometry column must not be registered with z = 0 in gpkg_geometry_columns.
+// The spatial index created is called rtree_tableName_geometryColumn
+// The triggers are called rtree_tableName_geometryColumn_insert, rtree_tableName_geometryColumn_update1, rtree_tableName_geometryColumn_update2,
+//                         rtree_tableName_geometryColumn_update3, rtree_tableName_geometryColumn_update4, rtree_tableName_geometryColumn_delete
+// Registers the gpkg extension gpkg_rtree_index. A 3D spatial index is registered as the vendor extension xnaval_rtree_index_3d instead,
+// because its rtree has the extra columns minz and maxz that readers of gpkg_rtree_index don't expect
+// Populates the spatial index
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGAddSpatialIndex(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    const char *icolumn;
+    int zIndex = 0;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    char *sql, *errsql;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    icolumn = (const char *)sqlite3_value_text(argv[2]);
+    if (argc == 4)
+    {
+        zIndex = sqlite3_value_int(argv[3]);
+        if (zIndex != 0 && zIndex != 1)
+        {
+            sqlite3_result_error(context, "GPKG_AddSpatialIndex() error: argument 4 [zIndex] must be 0 or 1", -1);
+            return;
+        }
+    }
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // A 3D spatial index needs a geometry column that can have Z values
+    if (zIndex)
+    {
+        sql = sqlite3_mprintf("SELECT z FROM gpkg_geometry_columns WHERE LOWER(table_name) = LOWER(%Q) AND LOWER(column_name) = LOWER(%Q)",
+            table, gcolumn);
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+        {
+            if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 0)
+            {
+                sqlite3_finalize(stmt);
+                sqlite3_free(sql);
+                sqlite3_result_error(context, "GPKG_AddSpatialIndex() error: argument 4 [zIndex] the geometry column is registered without z values", -1);
+                return;
+            }
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_free(sql);
+    }
+
+    // Create rtree
+    sql = sqlite3_mprintf("CREATE VIRTUAL TABLE \"rtree_%w_%w\" USING rtree(id, minx, maxx, miny, maxy%s)",
+        table, gcolumn, zIndex ? ", minz, maxz" : "");
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Conditions: Insertion of non-empty geometry
+    //    Actions: Insert record into rtree
+    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_insert\" AFTER INSERT ON \"%w\" WHEN (NEW.\"%w\" NOT NULL AND NOT ST_IsEmpty(NEW.\"%w\"))\nBEGIN\n   INSERT OR REPLACE INTO \"rtree_%w_%w\" VALUES (NEW.\"%w\", ST_MinX(NEW.\"%w\"), ST_MaxX(NEW.\"%w\"), ST_MinY(NEW.\"%w\"), ST_MaxY(NEW.\"%w\")%z);\nEND;",
+        table, gcolumn, table, gcolumn, gcolumn, table, gcolumn, icolumn, gcolumn, gcolumn, gcolumn, gcolumn, rtreeZValues(zIndex, "NEW.", gcolumn));
+    errsql = sqlite3_mprintf("DROP TABLE \"rtree_%w_%w\"",
+        table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Update of geometry column to non-empty geometry
+    //             No row ID change
+    //    Actions: Update record in rtree
+    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_update1\" AFTER UPDATE OF \"%w\" ON \"%w\" WHEN OLD.\"%w\" = NEW.\"%w\" AND (NEW.\"%w\" NOT NULL AND NOT ST_IsEmpty(NEW.\"%w\"))\nBEGIN\n   INSERT OR REPLACE INTO \"rtree_%w_%w\" VALUES (NEW.\"%w\", ST_MinX(NEW.\"%w\"), ST_MaxX(NEW.\"%w\"), ST_MinY(NEW.\"%w\"), ST_MaxY(NEW.\"%w\")%z);\nEND;",
+        table, gcolumn, gcolumn, table, icolumn, icolumn, gcolumn, gcolumn, table, gcolumn, icolumn, gcolumn, gcolumn, gcolumn, gcolumn, rtreeZValues(zIndex, "NEW.", gcolumn));
+    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
+        table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Update of geometry column to empty geometry
+    //             No row ID change
+    //    Actions: Remove record from rtree
+    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_update2\" AFTER UPDATE OF \"%w\" ON \"%w\" WHEN OLD.\"%w\" = NEW.\"%w\" AND (NEW.\"%w\" IS NULL OR ST_IsEmpty(NEW.\"%w\"))\nBEGIN\n   DELETE FROM \"rtree_%w_%w\" WHERE id = OLD.\"%w\";\nEND;",
+        table, gcolumn, gcolumn, table, icolumn, icolumn, gcolumn, gcolumn, table, gcolumn, icolumn);
+    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Update of any column
+    //             Row ID change
+    //             Non-empty geometry
+    //    Actions: Remove record from rtree for old <i>
+    //             Insert record into rtree for new <i>
+    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_update3\" AFTER UPDATE ON \"%w\" WHEN OLD.\"%w\" != NEW.\"%w\" AND (NEW.\"%w\" NOT NULL AND NOT ST_IsEmpty(NEW.\"%w\"))\nBEGIN\n   DELETE FROM \"rtree_%w_%w\" WHERE id = OLD.\"%w\";\n   INSERT OR REPLACE INTO \"rtree_%w_%w\" VALUES (NEW.\"%w\", ST_MinX(NEW.\"%w\"), ST_MaxX(NEW.\"%w\"), ST_MinY(NEW.\"%w\"), ST_MaxY(NEW.\"%w\")%z);\nEND;",
+        table, gcolumn, table, icolumn, icolumn, gcolumn, gcolumn, table, gcolumn, icolumn, table, gcolumn, icolumn, gcolumn, gcolumn, gcolumn, gcolumn, rtreeZValues(zIndex, "NEW.", gcolumn));
+    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Update of any column
+    //             Row ID change
+    //             Empty geometry
+    //    Actions: Remove record from rtree for old and new <i>
+    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_update4\" AFTER UPDATE ON \"%w\" WHEN OLD.\"%w\" != NEW.\"%w\" AND (NEW.\"%w\" IS NULL OR ST_IsEmpty(NEW.\"%w\"))\nBEGIN\n   DELETE FROM \"rtree_%w_%w\" WHERE id IN (OLD.\"%w\", NEW.\"%w\");\nEND;\n",
+        table, gcolumn, table, icolumn, icolumn, gcolumn, gcolumn, table, gcolumn, icolumn, icolumn);
+    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_update3\"; DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Row deleted
+    //    Actions: Remove record from rtree for old <i>
+    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_delete\" AFTER DELETE ON \"%w\" WHEN old.\"%w\" NOT NULL\nBEGIN\n   DELETE FROM \"rtree_%w_%w\" WHERE id = OLD.\"%w\";\nEND;",
+        table, gcolumn, table, gcolumn, table, gcolumn, icolumn);
+    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_update4\"; DROP TRIGGER \"rtree_%w_%w_update3\"; DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Register GPKG Extension
+    sql = sqlite3_mprintf("INSERT INTO gpkg_extensions(table_name, column_name, extension_name, definition, scope)  VALUES(%Q, %Q, %Q, %Q, 'write-only')",
+        table, gcolumn, zIndex ? "xnaval_rtree_index_3d" : "gpkg_rtree_index", zIndex ? "https://github.com/xnaval/SQLiteExtensions" : "F.3 RTree Spatial Index");
+    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_delete\"; DROP TRIGGER \"rtree_%w_%w_update4\"; DROP TRIGGER \"rtree_%w_%w_update3\"; DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Populate rtree
+    sql = sqlite3_mprintf("INSERT OR REPLACE INTO \"rtree_%w_%w\" SELECT \"%w\", ST_MinX(\"%w\"), ST_MaxX(\"%w\"), ST_MinY(\"%w\"), ST_MaxY(\"%w\")%z FROM \"%w\"",
+        table, gcolumn, icolumn, gcolumn, gcolumn, gcolumn, gcolumn, rtreeZValues(zIndex, "", gcolumn), table);
+    errsql = sqlite3_mprintf("DELETE FROM gpkg_extensions where table_name = %Q AND column_name = %Q AND extension_name IN ('gpkg_rtree_index', 'xnaval_rtree_index_3d'); DROP TRIGGER \"rtree_%w_%w_delete\"; DROP TRIGGER \"rtree_%w_%w_update4\"; DROP TRIGGER \"rtree_%w_%w_update3\"; DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+}
+
+// SQL function: GPKG_DropSpatialIndex(table, geometryColumn, idColumn); 
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// idColumn -> Column that is the PrimaryKey of the table
+// Drops a spatial index of a table and the corresponding triggers to maintain the integrity between the spatial index and the table
+// Unregisters the gpkg extension gpkg_rtree_index (or xnaval_rtree_index_3d for a 3D spatial index)
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGDropSpatialIndex(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    sqlite3 *db;
+    char *sql;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Drop triggers and RTree
+    sql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_delete\"; DROP TRIGGER \"rtree_%w_%w_update4\"; DROP TRIGGER \"rtree_%w_%w_update3\"; DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Remove GPKG Extension
+    sql = sqlite3_mprintf("DELETE FROM gpkg_extensions WHERE LOWER(table_name) = LOWER(%Q) AND LOWER(column_name) = LOWER(%Q) AND extension_name IN ('gpkg_rtree_index', 'xnaval_rtree_index_3d')",
+        table, gcolumn);
+    sqlite3_exec_free(context, db, sql, NULL);
+}
+
+// Drops the triggers of the spatial index of a table so that changes made in bulk don't update the spatial index row by row
+// Only the six triggers of the spatial index are dropped, not the ones of another geometry column whose name starts with gcolumn
+// db -> sqlite3
+// table -> Name of the table
+// gcolumn -> Column that contains the geometry
+// triggers <- SQL that creates the triggers again, allocated with sqlite3_mprintf
+// Returns SQLITE_OK if it's correct or an SQLite error code
+static int dropSpatialIndexTriggers(sqlite3 *db, const char *table, const char *gcolumn, char **triggers)
+{
+    sqlite3_stmt *stmt;
+    char *prefix, *drop;
+    int rc;
+
+    *triggers = sqlite3_mprintf("");
+    drop = sqlite3_mprintf("");
+    prefix = sqlite3_mprintf("rtree_%s_%s_", table, gcolumn);
+    if (*triggers == NULL || drop == NULL || prefix == NULL)
+        rc = SQLITE_NOMEM;
+    else
+        rc = sqlite3_prepare_v2(db, "SELECT name, sql FROM sqlite_master WHERE type = 'trigger' AND lower(name) IN (lower(?1 || 'insert'), "
+            "lower(?1 || 'update1'), lower(?1 || 'update2'), lower(?1 || 'update3'), lower(?1 || 'update4'), lower(?1 || 'delete'))", -1, &stmt, NULL);
+    if (rc == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC);
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW && *triggers != NULL && drop != NULL)
+        {
+            *triggers = sqlite3_mprintf("%z%s;\n", *triggers, (const char *)sqlite3_column_text(stmt, 1));
+            drop = sqlite3_mprintf("%zDROP TRIGGER \"%w\";\n", drop, (const char *)sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+        if (rc == SQLITE_DONE)
+            rc = *triggers == NULL || drop == NULL ? SQLITE_NOMEM : sqlite3_exec(db, drop, NULL, NULL, NULL);
+    }
+    sqlite3_free(prefix);
+    sqlite3_free(drop);
+    return rc;
+}
+
+// Gets the features whose envelope is inside a box, looking at the spatial index and checking the envelope of the geometry
+// db -> sqlite3
+// table -> Name of the table
+// gcolumn -> Column that contains the geometry
+// box -> Box (minX, minY, maxX, maxY)
+// ids <- Row IDs of the features sorted, allocated with sqlite3_malloc64
+// numIds <- Number of features
+// Returns SQLITE_OK if it's correct or an SQLite error code
+static int featuresInBox(sqlite3 *db, const char *table, const char *gcolumn, const double *box, sqlite3_int64 **ids, int *numIds)
+{
+    sqlite3_stmt *stmt;
+    char *sql;
+    double env[4];
+    int maxIds = 0;
+    int rc;
+
+    *ids = NULL;
+    *numIds = 0;
+    sql = sqlite3_mprintf("SELECT r.id, t.\"%w\" FROM \"rtree_%w_%w\" r JOIN \"%w\" t ON t.rowid = r.id WHERE r.maxx >= ?1 AND r.minx <= ?3 AND r.maxy >= ?2 AND r.miny <= ?4 ORDER BY r.id",
+        gcolumn, table, gcolumn, table);
+    rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+        return rc;
+    for (int i = 0; i < 4; i++)
+        sqlite3_bind_double(stmt, 1 + i, box[i]);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        if (sqlite3_column_type(stmt, 1) != SQLITE_BLOB ||
+            !readGPKGEnvelope((unsigned char *)sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1), env) ||
+            env[0] < box[0] || env[1] < box[1] || env[2] > box[2] || env[3] > box[3])
+            continue;
+        if (*numIds == maxIds)
+        {
+            sqlite3_int64 *grown = (sqlite3_int64 *)sqlite3_realloc64(*ids, sizeof(sqlite3_int64) * (maxIds * 2 + 256));
+            if (grown == NULL)
+            {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            *ids = grown;
+            maxIds = maxIds * 2 + 256;
+        }
+        (*ids)[(*numIds)++] = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE)
+    {
+        sqlite3_free(*ids);
+        *ids = NULL;
+        *numIds = 0;
+        return rc;
+    }
+    return SQLITE_OK;
+}
+
+// Reads the box of the arguments of GPKG_DeleteInBox and GPKG_TranslateInBox
+// Returns 0 if it isn't valid (the error is the result of the context) or 1 if it's correct
+static int readBoxArguments(sqlite3_context *context, sqlite3_value **argv, const char *name, double *box)
+{
+    char *err;
+
+    for (int i = 0; i < 4; i++)
+        box[i] = sqlite3_value_double(argv[2 + i]);
+    if (sqlite3_value_type(argv[2]) == SQLITE_NULL || sqlite3_value_type(argv[3]) == SQLITE_NULL || sqlite3_value_type(argv[4]) == SQLITE_NULL ||
+        sqlite3_value_type(argv[5]) == SQLITE_NULL || !(box[2] >= box[0]) || !(box[3] >= box[1]))
+    {
+        err = sqlite3_mprintf("%s() error: arguments 3 to 6 [minX, minY, maxX, maxY] are not a valid box", name);
+        sqlite3_result_error(context, err, -1);
+        sqlite3_free(err);
+        return 0;
+    }
+    return 1;
+}
+
+// Ends the savepoint gpkg_bulk of the functions that change many features (GPKG_DeleteInBox, GPKG_TranslateInBox, GPKG_TransformInPlace):
+// releases it, or rolls it back if there is an error (the error is the result of the context)
+static void endBulkSavepoint(sqlite3_context *context, sqlite3 *db, int rc, const char *name)
+{
+    char *err;
+
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, "RELEASE gpkg_bulk", NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        return;
+    err = sqlite3_mprintf("%s() error: %s", name, rc == SQLITE_NOMEM ? "out of memory" : sqlite3_errmsg(db));
+    sqlite3_exec(db, "ROLLBACK TO gpkg_bulk; RELEASE gpkg_bulk", NULL, NULL, NULL);
+    sqlite3_result_error(context, err, -1);
+    sqlite3_free(err);
+}
+
+// SQL function: GPKG_DeleteInBox(tableName, geometryColumn, minX, minY, maxX, maxY); 
+// Deletes the features of a table whose envelope is inside a box
+// tableName -> Name of the table. It must have a spatial index (see GPKG_AddSpatialIndex)
+// geometryColumn -> Column that contains the geometry
+// minX, minY, maxX, maxY -> Box
+// The features are found through the spatial index. The triggers of the spatial index are dropped while the features are deleted
+// and the spatial index is patched in one pass sorted by id, so each feature is deleted with two reused statements. The other triggers
+// of the table are fired. Everything is done in a savepoint: if there is an error nothing changes
+// On success returns the number of features deleted. If there is an error throw an exception
+static void fnct_GPKGDeleteInBox(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    double box[4];
+    sqlite3 *db;
+    sqlite3_stmt *deleteFeature = NULL, *deleteEntry = NULL;
+    sqlite3_int64 *ids = NULL;
+    int numIds = 0;
+    char *triggers = NULL;
+    char *sql;
+    int rc;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    if (!readBoxArguments(context, argv, "GPKG_DeleteInBox", box))
+        return;
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    if (sqlite3_exec(db, "SAVEPOINT gpkg_bulk", NULL, NULL, NULL) != SQLITE_OK)
+    {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+    rc = featuresInBox(db, table, gcolumn, box, &ids, &numIds);
+    if (rc == SQLITE_OK)
+        rc = dropSpatialIndexTriggers(db, table, gcolumn, &triggers);
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("DELETE FROM \"%w\" WHERE rowid = ?", table);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &deleteFeature, NULL);
+        sqlite3_free(sql);
+    }
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("DELETE FROM \"rtree_%w_%w\" WHERE id = ?", table, gcolumn);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &deleteEntry, NULL);
+        sqlite3_free(sql);
+    }
+    for (int i = 0; i < numIds && rc == SQLITE_OK; i++)
+    {
+        sqlite3_bind_int64(deleteFeature, 1, ids[i]);
+        rc = sqlite3_step(deleteFeature);
+        sqlite3_reset(deleteFeature);
+        if (rc == SQLITE_DONE)
+        {
+            sqlite3_bind_int64(deleteEntry, 1, ids[i]);
+            rc = sqlite3_step(deleteEntry);
+            sqlite3_reset(deleteEntry);
+        }
+        rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+    }
+    sqlite3_finalize(deleteFeature);
+    sqlite3_finalize(deleteEntry);
+    sqlite3_free(ids);
+
+    // Create the triggers of the spatial index again
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, triggers, NULL, NULL, NULL);
+    sqlite3_free(triggers);
+    endBulkSavepoint(context, db, rc, "GPKG_DeleteInBox");
+    if (rc == SQLITE_OK)
+        sqlite3_result_int(context, numIds);
+}
+
+// Context of the visitor that translates the coordinates of a geometry
+typedef struct translateContext
+{
+    double dx, dy;
+    double env[4]; // Envelope of the translated coordinates
+} translateContext;
+
+// Translates a run of coordinates in place and extends the envelope
+static int translateRun(const wkbRun *run, void *ctx)
+{
+    translateContext *translate = (translateContext *)ctx;
+    double x, y;
+    int index;
+
+    for (int i = 0; i < run->numPoints; i++)
+    {
+        index = i * run->dimension * 8;
+        x = getDouble(run->coords, &index, run->byteOrder);
+        y = getDouble(run->coords, &index, run->byteOrder);
+        if (isnan(x) && isnan(y))
+            continue; // Empty Point
+        x += translate->dx;
+        y += translate->dy;
+        index = i * run->dimension * 8;
+        putDoubleOrder(run->coords, &index, x, run->byteOrder);
+        putDoubleOrder(run->coords, &index, y, run->byteOrder);
+        translate->env[0] = fmin(translate->env[0], x);
+        translate->env[1] = fmin(translate->env[1], y);
+        translate->env[2] = fmax(translate->env[2], x);
+        translate->env[3] = fmax(translate->env[3], y);
+    }
+    return 1;
+}
+
+// SQL function: GPKG_TranslateInBox(tableName, geometryColumn, minX, minY, maxX, maxY, dx, dy); 
+// Moves the features of a table whose envelope is inside a box
+// tableName -> Name of the table. It must have a spatial index (see GPKG_AddSpatialIndex)
+// geometryColumn -> Column that contains the geometry
+// minX, minY, maxX, maxY -> Box
+// dx, dy -> Translation
+// The features are found through the spatial index. Each geometry is translated on a copy of its BLOB, coordinates and envelope
+// of the GPKG header, without parsing it in memory. The triggers of the spatial index are dropped while the features are updated
+// and the spatial index is patched in one pass sorted by id. The other triggers of the table are fired. Everything is done in
+// a savepoint: if there is an error nothing changes
+// On success returns the number of features moved. If there is an error throw an exception
+static void fnct_GPKGTranslateInBox(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    double box[4];
+    translateContext translate;
+    sqlite3 *db;
+    sqlite3_stmt *readFeature = NULL, *updateFeature = NULL, *updateEntry = NULL;
+    sqlite3_int64 *ids = NULL;
+    int numIds = 0;
+    unsigned char *p_blob = NULL;
+    int n_bytes, maxBytes = 0;
+    char *triggers = NULL;
+    char *sql;
+    int rc;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    if (!readBoxArguments(context, argv, "GPKG_TranslateInBox", box))
+        return;
+    translate.dx = sqlite3_value_double(argv[6]);
+    translate.dy = sqlite3_value_double(argv[7]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    if (sqlite3_exec(db, "SAVEPOINT gpkg_bulk", NULL, NULL, NULL) != SQLITE_OK)
+    {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+    rc = featuresInBox(db, table, gcolumn, box, &ids, &numIds);
+    if (rc == SQLITE_OK)
+        rc = dropSpatialIndexTriggers(db, table, gcolumn, &triggers);
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("SELECT \"%w\" FROM \"%w\" WHERE rowid = ?", gcolumn, table);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &readFeature, NULL);
+        sqlite3_free(sql);
+    }
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("UPDATE \"%w\" SET \"%w\" = ? WHERE rowid = ?", table, gcolumn);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &updateFeature, NULL);
+        sqlite3_free(sql);
+    }
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("UPDATE \"rtree_%w_%w\" SET minx = ?, maxx = ?, miny = ?, maxy = ? WHERE id = ?", table, gcolumn);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &updateEntry, NULL);
+        sqlite3_free(sql);
+    }
+    for (int i = 0; i < numIds && rc == SQLITE_OK; i++)
+    {
+        // Translate a copy of the geometry
+        sqlite3_bind_int64(readFeature, 1, ids[i]);
+        if (sqlite3_step(readFeature) != SQLITE_ROW)
+        {
+            rc = sqlite3_reset(readFeature);
+            continue;
+        }
+        n_bytes = sqlite3_column_bytes(readFeature, 0);
+        if (n_bytes > maxBytes)
+        {
+            unsigned char *grown = (unsigned char *)sqlite3_realloc(p_blob, n_bytes);
+            if (grown == NULL)
+            {
+                sqlite3_reset(readFeature);
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            p_blob = grown;
+            maxBytes = n_bytes;
+        }
+        memcpy(p_blob, sqlite3_column_blob(readFeature, 0), n_bytes);
+        sqlite3_reset(readFeature);
+        translate.env[0] = translate.env[1] = INFINITY;
+        translate.env[2] = translate.env[3] = -INFINITY;
+        if (!walkGPKGRuns(p_blob, n_bytes, translateRun, &translate) || translate.env[0] > translate.env[2])
+            continue; // Not a valid geometry, it can't be in the box
+        putGPKGHeaderEnvelope(p_blob, n_bytes, translate.env);
+
+        // Update the feature and the spatial index
+        sqlite3_bind_blob(updateFeature, 1, p_blob, n_bytes, SQLITE_STATIC);
+        sqlite3_bind_int64(updateFeature, 2, ids[i]);
+        rc = sqlite3_step(updateFeature);
+        sqlite3_reset(updateFeature);
+        if (rc == SQLITE_DONE)
+        {
+            sqlite3_bind_double(updateEntry, 1, translate.env[0]);
+            sqlite3_bind_double(updateEntry, 2, translate.env[2]);
+            sqlite3_bind_double(updateEntry, 3, translate.env[1]);
+            sqlite3_bind_double(updateEntry, 4, translate.env[3]);
+            sqlite3_bind_int64(updateEntry, 5, ids[i]);
+            rc = sqlite3_step(updateEntry);
+            sqlite3_reset(updateEntry);
+        }
+        rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+    }
+    sqlite3_finalize(readFeature);
+    sqlite3_finalize(updateFeature);
+    sqlite3_finalize(updateEntry);
+    sqlite3_free(p_blob);
+    sqlite3_free(ids);
+
+    // Create the triggers of the spatial index again
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, triggers, NULL, NULL, NULL);
+    sqlite3_free(triggers);
+    endBulkSavepoint(context, db, rc, "GPKG_TranslateInBox");
+    if (rc == SQLITE_OK)
+        sqlite3_result_int(context, numIds);
+}
+
+// Context of the visitor that applies an affine transformation to the coordinates of a geometry
+typedef struct affineContext
+{
+    double m[6];   // x' = m[0] * x + m[1] * y + m[4], y' = m[2] * x + m[3] * y + m[5]
+    double env[4]; // Envelope of the transformed coordinates
+} affineContext;
+
+// Transforms a run of coordinates in place and extends the envelope
+static int affineRun(const wkbRun *run, void *ctx)
+{
+    affineContext *affine = (affineContext *)ctx;
+    const double *m = affine->m;
+    double x, y, tx, ty;
+    int index;
+
+    for (int i = 0; i < run->numPoints; i++)
+    {
+        index = i * run->dimension * 8;
+        x = getDouble(run->coords, &index, run->byteOrder);
+        y = getDouble(run->coords, &index, run->byteOrder);
+        if (isnan(x) && isnan(y))
+            continue; // Empty Point
+        tx = m[0] * x + m[1] * y + m[4];
+        ty = m[2] * x + m[3] * y + m[5];
+        index = i * run->dimension * 8;
+        putDoubleOrder(run->coords, &index, tx, run->byteOrder);
+        putDoubleOrder(run->coords, &index, ty, run->byteOrder);
+        affine->env[0] = fmin(affine->env[0], tx);
+        affine->env[1] = fmin(affine->env[1], ty);
+        affine->env[2] = fmax(affine->env[2], tx);
+        affine->env[3] = fmax(affine->env[3], ty);
+    }
+    return 1;
+}
+
+// Looks for a trigger of a table other than the triggers of the spatial indexes of its columns
+// db -> sqlite3
+// table -> Name of the table
+// name <- Name of the trigger allocated with sqlite3_mprintf or NULL if there isn't any
+// Returns SQLITE_OK if it's correct or an SQLite error code
+static int findOtherTrigger(sqlite3 *db, const char *table, char **name)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    *name = NULL;
+    rc = sqlite3_prepare_v2(db, "SELECT name FROM (SELECT name, tbl_name FROM sqlite_master WHERE type = 'trigger' "
+        "UNION ALL SELECT name, tbl_name FROM sqlite_temp_master WHERE type = 'trigger') WHERE lower(tbl_name) = lower(?1) AND lower(name) NOT IN "
+        "(SELECT lower('rtree_' || ?1 || '_' || c.name || s.column1) FROM pragma_table_info(?1) c, "
+        "(VALUES ('_insert'), ('_update1'), ('_update2'), ('_update3'), ('_update4'), ('_delete')) s) LIMIT 1", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+        return rc;
+    sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW)
+        rc = (*name = sqlite3_mprintf("%s", (const char *)sqlite3_column_text(stmt, 0))) == NULL ? SQLITE_NOMEM : SQLITE_DONE;
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+// SQL function: GPKG_TransformInPlace(tableName, geometryColumn, a, b, c, d, xoff, yoff); 
+// Applies an affine transformation to all the geometries of a table: x' = a * x + b * y + xoff, y' = c * x + d * y + yoff
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// a, b, c, d, xoff, yoff -> Coefficients of the transformation
+// An affine transformation doesn't change the size of a geometry, so each BLOB is read and rewritten in place, coordinates and envelope
+// of the GPKG header, with sqlite3_blob_read and sqlite3_blob_write: the rows are not rewritten and the triggers are not fired.
+// The features are processed by chunks of TRANSFORM_CHUNK_SIZE rows. The new envelopes are saved in a temporary table and at the end
+// the spatial index, if any, is emptied and loaded again in one pass: loading an empty rtree is much faster than updating every entry.
+// No table is dropped (the temporary tables are emptied), so the function can be called for several tables in one statement
+// The table can't have other triggers than the ones of its spatial indexes: the structures they maintain (point index, point overview,
+// change log, dirty regions, segment index...) would not be updated. In that case the function fails and the geometries must be updated with UPDATE.
+// Everything is done in a savepoint: if there is an error nothing changes
+// On success returns the number of geometries transformed. If there is an error throw an exception
+static void fnct_GPKGTransformInPlace(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    affineContext affine;
+    sqlite3 *db;
+    sqlite3_stmt *chunkStmt = NULL, *insertEnvelope = NULL, *stmt;
+    sqlite3_blob *blob = NULL;
+    sqlite3_int64 ids[TRANSFORM_CHUNK_SIZE];
+    char *trigger;
+    int hasRtree = 0;
+    int rtreeColumns = 0;
+    int numIds;
+    sqlite3_int64 lastId = 0;
+    unsigned char *p_blob = NULL;
+    int n_bytes, maxBytes = 0;
+    int count = 0;
+    char *sql;
+    int rc;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    for (int i = 0; i < 6; i++)
+    {
+        if (sqlite3_value_type(argv[2 + i]) != SQLITE_INTEGER && sqlite3_value_type(argv[2 + i]) != SQLITE_FLOAT)
+        {
+            sqlite3_result_error(context, "GPKG_TransformInPlace() error: arguments 3 to 8 [a, b, c, d, xoff, yoff] must be numbers", -1);
+            return;
+        }
+        affine.m[i] = sqlite3_value_double(argv[2 + i]);
+    }
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // The changes in place don't fire the triggers
+    rc = findOtherTrigger(db, table, &trigger);
+    if (rc != SQLITE_OK || trigger != NULL)
+    {
+        sql = rc != SQLITE_OK ? sqlite3_mprintf("GPKG_TransformInPlace() error: %s", sqlite3_errmsg(db))
+            : sqlite3_mprintf("GPKG_TransformInPlace() error: the trigger %s of the table would not be fired. Update the geometries with UPDATE", trigger);
+        sqlite3_result_error(context, sql, -1);
+        sqlite3_free(sql);
+        sqlite3_free(trigger);
+        return;
+    }
+
+    if (sqlite3_exec(db, "SAVEPOINT gpkg_bulk", NULL, NULL, NULL) != SQLITE_OK)
+    {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+    sql = sqlite3_mprintf("SELECT rowid FROM \"%w\" WHERE rowid > ? AND \"%w\" IS NOT NULL ORDER BY rowid LIMIT %d", table, gcolumn, TRANSFORM_CHUNK_SIZE);
+    rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &chunkStmt, NULL);
+    sqlite3_free(sql);
+
+    // The spatial index is optional
+    sql = sqlite3_mprintf("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'rtree_%q_%q'", table, gcolumn);
+    if (rc == SQLITE_OK)
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+    if (rc == SQLITE_OK)
+    {
+        hasRtree = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+    }
+    if (rc == SQLITE_OK && hasRtree)
+    {
+        // 2D or 3D spatial index
+        sql = sqlite3_mprintf("SELECT * FROM \"rtree_%w_%w\"", table, gcolumn);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+        sqlite3_free(sql);
+        if (rc == SQLITE_OK)
+        {
+            rtreeColumns = sqlite3_column_count(stmt);
+            sqlite3_finalize(stmt);
+            rc = sqlite3_exec(db, "CREATE TEMP TABLE IF NOT EXISTS gpkg_bulk_envelope(id INTEGER PRIMARY KEY, minx, maxx, miny, maxy);"
+                "DELETE FROM temp.gpkg_bulk_envelope", NULL, NULL, NULL);
+        }
+        if (rc == SQLITE_OK)
+            rc = sqlite3_prepare_v2(db, "INSERT INTO temp.gpkg_bulk_envelope VALUES(?, ?, ?, ?, ?)", -1, &insertEnvelope, NULL);
+    }
+
+    while (rc == SQLITE_OK)
+    {
+        // Read a chunk of row IDs. The BLOBs aren't written while the table is read
+        numIds = 0;
+        sqlite3_bind_int64(chunkStmt, 1, lastId);
+        while ((rc = sqlite3_step(chunkStmt)) == SQLITE_ROW)
+            ids[numIds++] = sqlite3_column_int64(chunkStmt, 0);
+        sqlite3_reset(chunkStmt);
+        if (rc != SQLITE_DONE)
+            break;
+        rc = SQLITE_OK;
+        if (numIds == 0)
+            break;
+        lastId = ids[numIds - 1];
+
+        // Transform the geometries in place
+        for (int i = 0; i < numIds && rc == SQLITE_OK; i++)
+        {
+            rc = blob == NULL ? sqlite3_blob_open(db, "main", table, gcolumn, ids[i], 1, &blob) : sqlite3_blob_reopen(blob, ids[i]);
+            if (rc != SQLITE_OK)
+                break;
+            n_bytes = sqlite3_blob_bytes(blob);
+            if (n_bytes > maxBytes)
+            {
+                unsigned char *grown = (unsigned char *)sqlite3_realloc(p_blob, n_bytes);
+                if (grown == NULL)
+                {
+                    rc = SQLITE_NOMEM;
+                    break;
+                }
+                p_blob = grown;
+                maxBytes = n_bytes;
+            }
+            rc = sqlite3_blob_read(blob, p_blob, n_bytes, 0);
+            if (rc != SQLITE_OK)
+                break;
+            affine.env[0] = affine.env[1] = INFINITY;
+            affine.env[2] = affine.env[3] = -INFINITY;
+            if (!walkGPKGRuns(p_blob, n_bytes, affineRun, &affine))
+                continue; // Not a valid geometry, it's not changed
+            if (affine.env[0] <= affine.env[2])
+            {
+                putGPKGHeaderEnvelope(p_blob, n_bytes, affine.env);
+                if (insertEnvelope != NULL)
+                {
+                    // Appended in order of id
+                    sqlite3_bind_int64(insertEnvelope, 1, ids[i]);
+                    sqlite3_bind_double(insertEnvelope, 2, affine.env[0]);
+                    sqlite3_bind_double(insertEnvelope, 3, affine.env[2]);
+                    sqlite3_bind_double(insertEnvelope, 4, affine.env[1]);
+                    sqlite3_bind_double(insertEnvelope, 5, affine.env[3]);
+                    rc = sqlite3_step(insertEnvelope);
+                    sqlite3_reset(insertEnvelope);
+                    if (rc != SQLITE_DONE)
+                        break;
+                }
+            }
+            rc = sqlite3_blob_write(blob, p_blob, n_bytes, 0);
+            count++;
+        }
+    }
+    sqlite3_blob_close(blob);
+    sqlite3_finalize(chunkStmt);
+    sqlite3_finalize(insertEnvelope);
+    sqlite3_free(p_blob);
+
+    // Rebuild the spatial index in place with the new envelopes, keeping the Z bounds of a 3D index and the entries of invalid geometries.
+    // The rtree is emptied and loaded again instead of dropped: a table can't be dropped while another statement of the connection runs
+    if (rc == SQLITE_OK && hasRtree)
+    {
+        sql = sqlite3_mprintf("CREATE TEMP TABLE IF NOT EXISTS gpkg_bulk_rtree(id INTEGER PRIMARY KEY, minx, maxx, miny, maxy, minz, maxz);"
+            "DELETE FROM temp.gpkg_bulk_rtree;"
+            "INSERT INTO temp.gpkg_bulk_rtree SELECT r.id, IFNULL(e.minx, r.minx), IFNULL(e.maxx, r.maxx), IFNULL(e.miny, r.miny), IFNULL(e.maxy, r.maxy), %s "
+            "FROM \"rtree_%w_%w\" r LEFT JOIN temp.gpkg_bulk_envelope e ON e.id = r.id;"
+            "DELETE FROM \"rtree_%w_%w\";"
+            "INSERT INTO \"rtree_%w_%w\" SELECT id, minx, maxx, miny, maxy%s FROM temp.gpkg_bulk_rtree ORDER BY id;"
+            "DELETE FROM temp.gpkg_bulk_rtree",
+            rtreeColumns > 5 ? "r.minz, r.maxz" : "NULL, NULL", table, gcolumn, table, gcolumn, table, gcolumn, rtreeColumns > 5 ? ", minz, maxz" : "");
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_exec(db, sql, NULL, NULL, NULL);
+        sqlite3_free(sql);
+    }
+    if (hasRtree)
+        sqlite3_exec(db, "DELETE FROM temp.gpkg_bulk_envelope", NULL, NULL, NULL);
+    endBulkSavepoint(context, db, rc, "GPKG_TransformInPlace");
+    if (rc == SQLITE_OK)
+        sqlite3_result_int(context, count);
+}
+
+// SQL function: GPKG_NormalizeByteOrder(tableName, geometryColumn); 
+// Converts the geometries of a table that are not in the CPU ENDIANESS (GPKG header and WKB), so they are read without swapping bytes
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// The conversion doesn't change the size of a geometry, so each BLOB is read and rewritten in place with sqlite3_blob_read
+// and sqlite3_blob_write: the rows are not rewritten and the triggers are not fired. The geometries already in the CPU ENDIANESS
+// and the ones that are not valid are not written. The features are processed by chunks of TRANSFORM_CHUNK_SIZE rows
+// and everything is done in a savepoint: if there is an error nothing changes
+// On success returns the number of geometries converted. If there is an error throw an exception
+static void fnct_GPKGNormalizeByteOrder(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    sqlite3 *db;
+    sqlite3_stmt *chunkStmt = NULL;
+    sqlite3_blob *blob = NULL;
+    sqlite3_int64 ids[TRANSFORM_CHUNK_SIZE];
+    sqlite3_int64 lastId = 0;
+    unsigned char *p_blob = NULL;
+    int n_bytes, maxBytes = 0;
+    int numIds, orders;
+    int count = 0;
+    char *sql;
+    int rc;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    if (sqlite3_exec(db, "SAVEPOINT gpkg_bulk", NULL, NULL, NULL) != SQLITE_OK)
+    {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+    sql = sqlite3_mprintf("SELECT rowid FROM \"%w\" WHERE rowid > ? AND \"%w\" IS NOT NULL ORDER BY rowid LIMIT %d", table, gcolumn, TRANSFORM_CHUNK_SIZE);
+    rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &chunkStmt, NULL);
+    sqlite3_free(sql);
+
+    while (rc == SQLITE_OK)
+    {
+        // Read a chunk of row IDs. The BLOBs aren't written while the table is read
+        numIds = 0;
+        sqlite3_bind_int64(chunkStmt, 1, lastId);
+        while ((rc = sqlite3_step(chunkStmt)) == SQLITE_ROW)
+            ids[numIds++] = sqlite3_column_int64(chunkStmt, 0);
+        sqlite3_reset(chunkStmt);
+        if (rc != SQLITE_DONE)
+            break;
+        rc = SQLITE_OK;
+        if (numIds == 0)
+            break;
+        lastId = ids[numIds - 1];
+
+        // Convert the geometries in place
+        for (int i = 0; i < numIds && rc == SQLITE_OK; i++)
+        {
+            rc = blob == NULL ? sqlite3_blob_open(db, "main", table, gcolumn, ids[i], 1, &blob) : sqlite3_blob_reopen(blob, ids[i]);
+            if (rc != SQLITE_OK)
+                break;
+            n_bytes = sqlite3_blob_bytes(blob);
+            if (n_bytes > maxBytes)
+            {
+                unsigned char *grown = (unsigned char *)sqlite3_realloc(p_blob, n_bytes);
+                if (grown == NULL)
+                {
+                    rc = SQLITE_NOMEM;
+                    break;
+                }
+                p_blob = grown;
+                maxBytes = n_bytes;
+            }
+            rc = sqlite3_blob_read(blob, p_blob, n_bytes, 0);
+            if (rc != SQLITE_OK)
+                break;
+
+            // Check before converting, a geometry that is not valid must not be partially converted
+            if (!normalizeGPKGByteOrder(p_blob, n_bytes, 0, &orders) || orders == (1 << endian()))
+                continue;
+            normalizeGPKGByteOrder(p_blob, n_bytes, 1, &orders);
+            rc = sqlite3_blob_write(blob, p_blob, n_bytes, 0);
+            count++;
+        }
+    }
+    sqlite3_blob_close(blob);
+    sqlite3_finalize(chunkStmt);
+    sqlite3_free(p_blob);
+    endBulkSavepoint(context, db, rc, "GPKG_NormalizeByteOrder");
+    if (rc == SQLITE_OK)
+        sqlite3_result_int(context, count);
+}
+
+// SQL function: GPKG_ReducePrecision(tableName, geometryColumn, size); 
+// Snaps the geometries of a table to a grid (see ST_SnapToGrid) to remove the noise of their coordinates and make them smaller
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// size -> Size of the cells of the grid
+// The features are processed by chunks of TRANSFORM_CHUNK_SIZE rows with reused statements and only the geometries that change
+// are updated (the ones with a coordinate that moves), so the triggers of the table (spatial index...) are fired for them. Everything is done in a savepoint:
+// if there is an error nothing changes
+// On success returns the number of geometries updated. If there is an error throw an exception
+static void fnct_GPKGReducePrecision(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    double size;
+    sqlite3 *db;
+    sqlite3_stmt *chunkStmt = NULL, *selectStmt = NULL, *updateStmt = NULL;
+    sqlite3_int64 ids[TRANSFORM_CHUNK_SIZE];
+    sqlite3_int64 lastId = 0;
+    gpkgGeometry geom;
+    unsigned char *p_blob;
+    int n_bytes;
+    int numIds;
+    int count = 0;
+    char *sql;
+    int rc;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    if ((sqlite3_value_type(argv[2]) != SQLITE_INTEGER && sqlite3_value_type(argv[2]) != SQLITE_FLOAT) || !(sqlite3_value_double(argv[2]) > 0))
+    {
+        sqlite3_result_error(context, "GPKG_ReducePrecision() error: argument 3 [size] must be a number greater than 0", -1);
+        return;
+    }
+    size = sqlite3_value_double(argv[2]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    if (sqlite3_exec(db, "SAVEPOINT gpkg_bulk", NULL, NULL, NULL) != SQLITE_OK)
+    {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+    sql = sqlite3_mprintf("SELECT rowid FROM \"%w\" WHERE rowid > ? AND \"%w\" IS NOT NULL ORDER BY rowid LIMIT %d", table, gcolumn, TRANSFORM_CHUNK_SIZE);
+    rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &chunkStmt, NULL);
+    sqlite3_free(sql);
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("SELECT \"%w\" FROM \"%w\" WHERE rowid = ?", gcolumn, table);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &selectStmt, NULL);
+        sqlite3_free(sql);
+    }
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("UPDATE \"%w\" SET \"%w\" = ? WHERE rowid = ?", table, gcolumn);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &updateStmt, NULL);
+        sqlite3_free(sql);
+    }
+
+    memset(&geom, 0, sizeof(gpkgGeometry));
+    while (rc == SQLITE_OK)
+    {
+        // Read a chunk of row IDs. The rows aren't updated while the table is read
+        numIds = 0;
+        sqlite3_bind_int64(chunkStmt, 1, lastId);
+        while ((rc = sqlite3_step(chunkStmt)) == SQLITE_ROW)
+            ids[numIds++] = sqlite3_column_int64(chunkStmt, 0);
+        sqlite3_reset(chunkStmt);
+        if (rc != SQLITE_DONE)
+            break;
+        rc = SQLITE_OK;
+        if (numIds == 0)
+            break;
+        lastId = ids[numIds - 1];
+
+        for (int i = 0; i < numIds && rc == SQLITE_OK; i++)
+        {
+            sqlite3_bind_int64(selectStmt, 1, ids[i]);
+            if (sqlite3_step(selectStmt) != SQLITE_ROW || sqlite3_column_type(selectStmt, 0) != SQLITE_BLOB ||
+                !readGPKGGeometry((unsigned char *)sqlite3_column_blob(selectStmt, 0), sqlite3_column_bytes(selectStmt, 0), &geom))
+            {
+                sqlite3_reset(selectStmt);
+                continue; // Not a valid geometry, it's not changed
+            }
+            if (!snapGPKGGeometry(&geom, size))
+            {
+                sqlite3_reset(selectStmt);
+                continue; // Already on the grid
+            }
+            computeGPKGEnvelope(&geom);
+            if (!writeGPKGGeometry(&geom, readGPKGEnvelopeType((unsigned char *)sqlite3_column_blob(selectStmt, 0), sqlite3_column_bytes(selectStmt, 0)), &p_blob, &n_bytes))
+            {
+                sqlite3_reset(selectStmt);
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            sqlite3_reset(selectStmt);
+            sqlite3_bind_blob(updateStmt, 1, p_blob, n_bytes, sqlite3_free);
+            sqlite3_bind_int64(updateStmt, 2, ids[i]);
+            rc = sqlite3_step(updateStmt);
+            sqlite3_reset(updateStmt);
+            rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+            count++;
+        }
+    }
+    freeGPKGGeometry(&geom);
+    sqlite3_finalize(chunkStmt);
+    sqlite3_finalize(selectStmt);
+    sqlite3_finalize(updateStmt);
+    endBulkSavepoint(context, db, rc, "GPKG_ReducePrecision");
+    if (rc == SQLITE_OK)
+        sqlite3_result_int(context, count);
+}
+
+// Builder of a FlatBuffer (the metadata of the Arrow IPC files). As the official builders, it writes from the end of the buffer
+// to the start, so the objects are written before the ones that reference them. The offsets of the objects are their distance
+// to the end of the buffer
+typedef struct flatBuilder
+{
+    unsigned char *buf;
+    int capacity, size; // The data is buf[capacity - size] to buf[capacity - 1]
+    int minAlign;       // Maximum alignment of the written scalars
+    int tableStart;     // Size when the table being built was started
+    int fields[8];      // Offsets of the fields of the table being built, 0 if absent
+    int numFields;      // 1 + the highest field of the table being built
+    int failed;         // 1 if there wasn't memory
+} flatBuilder;
+
+static void flatReset(flatBuilder *b)
+{
+    b->size = 0;
+    b->minAlign = 1;
+}
+
+// Makes room for n more bytes
+static int flatReserve(flatBuilder *b, int n)
+{
+    if (b->failed)
+        return 0;
+    if (b->size + n > b->capacity)
+    {
+        int capacity = (b->size + n) * 2 + 256;
+        unsigned char *buf = sqlite3_malloc(capacity);
+        if (buf == NULL)
+        {
+            b->failed = 1;
+            return 0;
+        }
+        if (b->size > 0)
+            memcpy(buf + capacity - b->size, b->buf + b->capacity - b->size, b->size);
+        sqlite3_free(b->buf);
+        b->buf = buf;
+        b->capacity = capacity;
+    }
+    return 1;
+}
+
+// Writes a little-endian scalar of n bytes without aligning it
+static void flatPush(flatBuilder *b, sqlite3_uint64 value, int n)
+{
+    if (!flatReserve(b, n))
+        return;
+    b->size += n;
+    for (int i = 0; i < n; i++)
+        b->buf[b->capacity - b->size + i] = (unsigned char)(value >> (8 * i));
+}
+
+// Pads so that after writing n bytes the size is a multiple of align
+static void flatPrep(flatBuilder *b, int align, int n)
+{
+    int padding = (align - (b->size + n) % align) % align;
+
+    if (align > b->minAlign)
+        b->minAlign = align;
+    if (padding > 0 && flatReserve(b, padding))
+    {
+        b->size += padding;
+        memset(b->buf + b->capacity - b->size, 0, padding);
+    }
+}
+
+static void flatScalar(flatBuilder *b, sqlite3_uint64 value, int n)
+{
+    flatPrep(b, n, n);
+    flatPush(b, value, n);
+}
+
+// Writes the offset of an object from the current position
+static void flatOffset(flatBuilder *b, int offset)
+{
+    flatPrep(b, 4, 0);
+    flatPush(b, b->size + 4 - offset, 4);
+}
+
+static void flatStartTable(flatBuilder *b)
+{
+    memset(b->fields, 0, sizeof(b->fields));
+    b->numFields = 0;
+    b->tableStart = b->size;
+}
+
+// Adds a scalar field of n bytes to the table being built
+static void flatField(flatBuilder *b, int id, sqlite3_uint64 value, int n)
+{
+    flatScalar(b, value, n);
+    b->fields[id] = b->size;
+    if (id >= b->numFields)
+        b->numFields = id + 1;
+}
+
+// Adds a field that references an object to the table being built
+static void flatFieldOffset(flatBuilder *b, int id, int offset)
+{
+    flatOffset(b, offset);
+    b->fields[id] = b->size;
+    if (id >= b->numFields)
+        b->numFields = id + 1;
+}
+
+// Ends the table being built writing its vtable before it
+// Returns the offset of the table
+static int flatEndTable(flatBuilder *b)
+{
+    int object, vtable;
+
+    flatScalar(b, 0, 4); // Offset of the vtable, written at the end
+    object = b->size;
+    for (int i = b->numFields - 1; i >= 0; i--)
+        flatScalar(b, b->fields[i] != 0 ? object - b->fields[i] : 0, 2);
+    flatScalar(b, object - b->tableStart, 2);
+    flatScalar(b, 4 + 2 * b->numFields, 2);
+    vtable = b->size;
+    if (!b->failed)
+    {
+        unsigned char *p = b->buf + b->capacity - object;
+        for (int i = 0; i < 4; i++)
+            p[i] = (unsigned char)((unsigned int)(vtable - object) >> (8 * i));
+    }
+    return object;
+}
+
+// Returns the offset of a string
+static int flatString(flatBuilder *b, const char *value)
+{
+    int n = (int)strlen(value);
+
+    flatPrep(b, 4, n + 1);
+    flatPush(b, 0, 1);
+    if (flatReserve(b, n))
+    {
+        b->size += n;
+        memcpy(b->buf + b->capacity - b->size, value, n);
+    }
+    flatPush(b, n, 4);
+    return b->size;
+}
+
+// Returns the offset of a vector of objects
+static int flatOffsetVector(flatBuilder *b, const int *offsets, int num)
+{
+    flatPrep(b, 4, 4 * num);
+    for (int i = num - 1; i >= 0; i--)
+        flatOffset(b, offsets[i]);
+    flatPush(b, num, 4);
+    return b->size;
+}
+
+// Returns the offset of a vector of structs of 64 bit words (FieldNode, Buffer, Block)
+static int flatStructVector(flatBuilder *b, const sqlite3_int64 *words, int numStructs, int wordsByStruct)
+{
+    int n = numStructs * wordsByStruct;
+
+    flatPrep(b, 4, 8 * n);
+    flatPrep(b, 8, 8 * n);
+    for (int i = n - 1; i >= 0; i--)
+        flatPush(b, (sqlite3_uint64)words[i], 8);
+    flatPush(b, numStructs, 4);
+    return b->size;
+}
+
+// Writes the offset of the root table. The buffer is buf + capacity - size
+static void flatFinish(flatBuilder *b, int root)
+{
+    flatPrep(b, b->minAlign, 4);
+    flatOffset(b, root);
+}
+
+// Growable buffer of a column of an Arrow record batch
+typedef struct arrowBuffer
+{
+    unsigned char *data;
+    sqlite3_int64 size, capacity;
+} arrowBuffer;
+
+// Appends bytes to a buffer (zeros if data is NULL)
+// Returns 0 if there isn't memory
+static int arrowAppend(arrowBuffer *buffer, const void *data, sqlite3_int64 size)
+{
+    if (buffer->size + size > buffer->capacity)
+    {
+        sqlite3_int64 capacity = (buffer->size + size) * 2 + 1024;
+        unsigned char *p = sqlite3_realloc64(buffer->data, capacity);
+        if (p == NULL)
+            return 0;
+        buffer->data = p;
+        buffer->capacity = capacity;
+    }
+    if (data != NULL)
+        memcpy(buffer->data + buffer->size, data, size);
+    else
+        memset(buffer->data + buffer->size, 0, size);
+    buffer->size += size;
+    return 1;
+}
+
+// Appends an offset of a list or a string, that is 32 bits in Arrow
+// Returns 0 if there isn't memory or the offset doesn't fit. A batch is written before its offsets overflow (see arrowValueFits)
+static int arrowAppendOffset(arrowBuffer *buffer, sqlite3_int64 value)
+{
+    int v = (int)value;
+
+    return value <= 0x7fffffff && arrowAppend(buffer, &v, 4);
+}
+
+// Sets the bit of a row in a bitmap (validity or BOOL)
+static int arrowAppendBit(arrowBuffer *bitmap, sqlite3_int64 row, int bit)
+{
+    if (row % 8 == 0 && !arrowAppend(bitmap, NULL, 1))
+        return 0;
+    if (bit)
+        bitmap->data[row / 8] |= (unsigned char)(1 << (row % 8));
+    return 1;
+}
+
+// Column of GPKG_ExportArrow
+typedef struct arrowColumn
+{
+    char *name;
+    int kind;                   // ARROW_INT64 ... ARROW_GEOMETRY
+    int geometryType;           // wkbPoint ... wkbMultiPolygon for ARROW_GEOMETRY
+    int dimension;              // 2 (XY) or 3 (XYZ) for ARROW_GEOMETRY
+    char *metadata;             // GeoArrow metadata (JSON) for ARROW_WKB and ARROW_GEOMETRY
+    char zm[3];                 // Flags z and m of gpkg_geometry_columns ("00" ... "22") for ARROW_WKB and ARROW_GEOMETRY, or ""
+    sqlite3_int64 nullCount;
+    arrowBuffer validity;
+    arrowBuffer offsets;        // Offsets of the strings, BLOBs or lists of the rows
+    arrowBuffer data;           // Values or coordinates
+    arrowBuffer partOffsets;    // Offsets of the Polygons of ARROW_GEOMETRY (multipolygon)
+    arrowBuffer ringOffsets;    // Offsets of the rings or LineStrings of ARROW_GEOMETRY (polygon, multilinestring, multipolygon)
+    int numParts, numRings, numPoints;
+} arrowColumn;
+
+// Levels of lists of the GeoArrow types by WKB geometry type: point, linestring, polygon, multipoint, multilinestring, multipolygon
+static const int arrowDepths[] = { 0, 0, 1, 2, 1, 2, 3 };
+static const char *arrowExtensions[] = { "geoarrow.wkb", "geoarrow.point", "geoarrow.linestring", "geoarrow.polygon", "geoarrow.multipoint", "geoarrow.multilinestring", "geoarrow.multipolygon" };
+static const char *arrowChildNames[][3] = { { NULL }, { NULL }, { "vertices" }, { "rings", "vertices" }, { "points" }, { "linestrings", "vertices" }, { "polygons", "rings", "vertices" } };
+
+// Context of the visitor that converts the runs of coordinates of a geometry to GeoArrow
+typedef struct arrowRunContext
+{
+    arrowColumn *column;
+    int depth;     // Levels of lists of the type
+    int part;      // Next part of the geometry
+    int numPoints; // Coordinates of the geometry converted
+    int nomem;     // 1 if there wasn't memory
+} arrowRunContext;
+
+// Appends the coordinates of a run, with the lists of the type of the column
+static int arrowGeometryRun(const wkbRun *run, void *ctx)
+{
+    arrowRunContext *a = (arrowRunContext *)ctx;
+    arrowColumn *column = a->column;
+    int swap = run->byteOrder != endian();
+    int numPoints = run->numPoints;
+
+    if (a->depth == 0)
+    {
+        if (a->numPoints > 0 || numPoints == 0)
+            return 1; // Only the first coordinate of a point column
+        numPoints = 1;
+    }
+    if (a->depth == 3)
+    {
+        while (a->part <= run->part)
+        {
+            if (!arrowAppendOffset(&column->partOffsets, column->numRings))
+                return a->nomem = 1, 0;
+            column->numParts++;
+            a->part++;
+        }
+    }
+    if (a->depth >= 2)
+    {
+        if (!arrowAppendOffset(&column->ringOffsets, column->numPoints))
+            return a->nomem = 1, 0;
+        column->numRings++;
+    }
+    if (!arrowAppend(&column->data, NULL, (sqlite3_int64)numPoints * column->dimension * 8))
+        return a->nomem = 1, 0;
+    if (!swap && run->dimension == column->dimension && (column->dimension == 2 || run->hasZ))
+    {
+        memcpy(column->data.data + column->data.size - (sqlite3_int64)numPoints * column->dimension * 8, run->coords, (size_t)numPoints * column->dimension * 8);
+    }
+    else
+    {
+        double *out = (double *)(column->data.data + column->data.size - (sqlite3_int64)numPoints * column->dimension * 8);
+        for (int i = 0; i < numPoints; i++)
+        {
+            const unsigned char *p = run->coords + (size_t)i * run->dimension * 8;
+            for (int j = 0; j < column->dimension; j++)
+            {
+                double value = NAN;
+                if (j < 2 || run->hasZ)
+                {
+                    memcpy(&value, p + j * 8, 8);
+                    if (swap)
+                        swapBytes((unsigned char *)&value, 8);
+                }
+                *out++ = value;
+            }
+        }
+    }
+    column->numPoints += numPoints;
+    a->numPoints += numPoints;
+    return 1;
+}
+
+// Appends a geometry in GPKG format to a GeoArrow column. Not valid geometries are appended as NULL
+// Returns 0 if there isn't memory, 1 if the geometry was appended or -1 if it was appended as NULL
+static int arrowAppendGeometry(arrowColumn *column, unsigned char *p_blob, int n_bytes)
+{
+    arrowRunContext a;
+    sqlite3_int64 dataSize = column->data.size, partSize = column->partOffsets.size, ringSize = column->ringOffsets.size;
+    int numParts = column->numParts, numRings = column->numRings, numPoints = column->numPoints;
+    int index = 0, part = 0;
+    int valid;
+
+    memset(&a, 0, sizeof(arrowRunContext));
+    a.column = column;
+    a.depth = arrowDepths[column->geometryType];
+    if (a.depth >= 1 && !arrowAppendOffset(&column->offsets, a.depth == 1 ? column->numPoints : a.depth == 2 ? column->numRings : column->numParts))
+        return 0;
+    valid = p_blob != NULL && n_bytes >= 13 && skipGPKGHeader(p_blob, n_bytes, &index) &&
+            walkWKBRuns(p_blob, n_bytes, &index, endian(), &part, arrowGeometryRun, &a);
+    if (a.nomem)
+        return 0;
+    if (!valid)
+    {
+        // Undo the runs converted
+        column->data.size = dataSize;
+        column->partOffsets.size = partSize;
+        column->ringOffsets.size = ringSize;
+        column->numParts = numParts;
+        column->numRings = numRings;
+        column->numPoints = numPoints;
+        a.numPoints = 0;
+        a.part = part = 0;
+    }
+    while (a.depth == 3 && a.part < part)
+    {
+        if (!arrowAppendOffset(&column->partOffsets, column->numRings))
+            return 0;
+        column->numParts++;
+        a.part++;
+    }
+    if (a.depth == 0 && a.numPoints == 0)
+    {
+        // Empty or NULL point
+        double nan[3] = { NAN, NAN, NAN };
+        if (!arrowAppend(&column->data, nan, column->dimension * 8))
+            return 0;
+        column->numPoints++;
+    }
+    return valid ? 1 : -1;
+}
+
+// Appends the value of a column of a row
+// Returns 0 if there isn't memory
+static int arrowAppendValue(arrowColumn *column, sqlite3_stmt *stmt, int i, sqlite3_int64 row)
+{
+    int isNull = sqlite3_column_type(stmt, i) == SQLITE_NULL;
+    int ok = 1;
+
+    switch (column->kind)
+    {
+    case ARROW_INT64:
+    {
+        sqlite3_int64 value = sqlite3_column_int64(stmt, i);
+        ok = arrowAppend(&column->data, &value, 8);
+        break;
+    }
+    case ARROW_FLOAT64:
+    {
+        double value = isNull ? 0 : sqlite3_column_double(stmt, i);
+        ok = arrowAppend(&column->data, &value, 8);
+        break;
+    }
+    case ARROW_BOOL:
+        ok = arrowAppendBit(&column->data, row, sqlite3_column_int64(stmt, i) != 0);
+        break;
+    case ARROW_UTF8:
+        ok = arrowAppendOffset(&column->offsets, column->data.size) &&
+             (isNull || arrowAppend(&column->data, sqlite3_column_text(stmt, i), sqlite3_column_bytes(stmt, i)));
+        break;
+    case ARROW_BINARY:
+        ok = arrowAppendOffset(&column->offsets, column->data.size) &&
+             (isNull || arrowAppend(&column->data, sqlite3_column_blob(stmt, i), sqlite3_column_bytes(stmt, i)));
+        break;
+    case ARROW_WKB:
+    {
+        // The WKB of the geometry, without the GPKG header
+        unsigned char *p_blob = (unsigned char *)sqlite3_column_blob(stmt, i);
+        int n_bytes = sqlite3_column_bytes(stmt, i);
+        int index = 0;
+        ok = arrowAppendOffset(&column->offsets, column->data.size);
+        if (ok && !isNull)
+        {
+            if (sqlite3_column_type(stmt, i) == SQLITE_BLOB && n_bytes >= 13 && skipGPKGHeader(p_blob, n_bytes, &index))
+                ok = arrowAppend(&column->data, p_blob + index, n_bytes - index);
+            else
+                isNull = 1;
+        }
+        break;
+    }
+    case ARROW_GEOMETRY:
+        if (sqlite3_column_type(stmt, i) != SQLITE_BLOB)
+            isNull = 1;
+        ok = arrowAppendGeometry(column, isNull ? NULL : (unsigned char *)sqlite3_column_blob(stmt, i), isNull ? 0 : sqlite3_column_bytes(stmt, i));
+        if (ok < 0)
+            isNull = 1;
+        break;
+    }
+    if (isNull)
+        column->nullCount++;
+    return ok != 0 && arrowAppendBit(&column->validity, row, !isNull);
+}
+
+// Returns 1 if the value of a column of a row can be appended to the batch without overflowing the 32 bit offsets of the column
+static int arrowValueFits(const arrowColumn *column, sqlite3_stmt *stmt, int i)
+{
+    sqlite3_int64 n_bytes;
+
+    switch (column->kind)
+    {
+    case ARROW_UTF8:
+    case ARROW_BINARY:
+    case ARROW_WKB:
+        return column->data.size + sqlite3_column_bytes(stmt, i) <= 0x7fffffff;
+    case ARROW_GEOMETRY:
+        // A WKB has at most a point every 16 bytes and a ring or a part every 4 bytes
+        n_bytes = sqlite3_column_type(stmt, i) == SQLITE_BLOB ? sqlite3_column_bytes(stmt, i) : 0;
+        return column->numPoints + n_bytes / 16 + 1 <= 0x7fffffff && column->numRings + n_bytes / 4 + 1 <= 0x7fffffff &&
+               column->numParts + n_bytes / 4 + 1 <= 0x7fffffff;
+    }
+    return 1;
+}
+
+// Appends the last offsets of the lists of a column at the end of a batch
+// Returns 0 if there isn't memory
+static int arrowEndColumn(arrowColumn *column)
+{
+    int depth;
+
+    switch (column->kind)
+    {
+    case ARROW_UTF8:
+    case ARROW_BINARY:
+    case ARROW_WKB:
+        return arrowAppendOffset(&column->offsets, column->data.size);
+    case ARROW_GEOMETRY:
+        depth = arrowDepths[column->geometryType];
+        return (depth < 1 || arrowAppendOffset(&column->offsets, depth == 1 ? column->numPoints : depth == 2 ? column->numRings : column->numParts)) &&
+               (depth < 2 || arrowAppendOffset(&column->ringOffsets, column->numPoints)) &&
+               (depth < 3 || arrowAppendOffset(&column->partOffsets, column->numRings));
+    }
+    return 1;
+}
+
+static void arrowResetColumn(arrowColumn *column)
+{
+    column->nullCount = 0;
+    column->validity.size = column->offsets.size = column->data.size = column->partOffsets.size = column->ringOffsets.size = 0;
+    column->numParts = column->numRings = column->numPoints = 0;
+}
+
+// Field nodes and buffers of a record batch
+typedef struct arrowBatch
+{
+    sqlite3_int64 *nodes;         // length and null_count of each node
+    int numNodes;
+    sqlite3_int64 *buffers;       // offset and length of each buffer in the body
+    const unsigned char **data;   // Data of each buffer
+    int numBuffers;
+    sqlite3_int64 bodyLength;
+} arrowBatch;
+
+static void arrowAddNode(arrowBatch *batch, sqlite3_int64 length, sqlite3_int64 nullCount)
+{
+    batch->nodes[2 * batch->numNodes] = length;
+    batch->nodes[2 * batch->numNodes + 1] = nullCount;
+    batch->numNodes++;
+}
+
+// Adds a buffer to the body. Each buffer is padded to 8 bytes
+static void arrowAddBuffer(arrowBatch *batch, const unsigned char *data, sqlite3_int64 length)
+{
+    batch->buffers[2 * batch->numBuffers] = batch->bodyLength;
+    batch->buffers[2 * batch->numBuffers + 1] = length;
+    batch->data[batch->numBuffers] = data;
+    batch->numBuffers++;
+    batch->bodyLength += (length + 7) & ~7;
+}
+
+// Adds the field nodes and buffers of a column (at most 5 nodes and 9 buffers) in the order of the fields of the schema
+static void arrowAddColumn(arrowBatch *batch, arrowColumn *column, sqlite3_int64 numRows)
+{
+    int depth;
+
+    arrowAddNode(batch, numRows, column->nullCount);
+    arrowAddBuffer(batch, column->validity.data, column->nullCount > 0 ? column->validity.size : 0);
+    switch (column->kind)
+    {
+    case ARROW_INT64:
+    case ARROW_FLOAT64:
+    case ARROW_BOOL:
+        arrowAddBuffer(batch, column->data.data, column->data.size);
+        break;
+    case ARROW_UTF8:
+    case ARROW_BINARY:
+    case ARROW_WKB:
+        arrowAddBuffer(batch, column->offsets.data, column->offsets.size);
+        arrowAddBuffer(batch, column->data.data, column->data.size);
+        break;
+    case ARROW_GEOMETRY:
+        depth = arrowDepths[column->geometryType];
+        if (depth >= 1)
+            arrowAddBuffer(batch, column->offsets.data, column->offsets.size);
+        if (depth >= 3)
+        {
+            arrowAddNode(batch, column->numParts, 0);
+            arrowAddBuffer(batch, NULL, 0);
+            arrowAddBuffer(batch, column->partOffsets.data, column->partOffsets.size);
+        }
+        if (depth >= 2)
+        {
+            arrowAddNode(batch, column->numRings, 0);
+            arrowAddBuffer(batch, NULL, 0);
+            arrowAddBuffer(batch, column->ringOffsets.data, column->ringOffsets.size);
+        }
+        if (depth >= 1)
+        {
+            arrowAddNode(batch, column->numPoints, 0);
+            arrowAddBuffer(batch, NULL, 0);
+        }
+        arrowAddNode(batch, (sqlite3_int64)column->numPoints * column->dimension, 0);
+        arrowAddBuffer(batch, NULL, 0);
+        arrowAddBuffer(batch, column->data.data, column->data.size);
+        break;
+    }
+}
+
+// Returns the offset of a type table with up to two scalar fields (Int, FloatingPoint, FixedSizeList, or empty)
+static int arrowType(flatBuilder *b, int numFields, int value0, int size0, int value1, int size1)
+{
+    flatStartTable(b);
+    if (numFields > 0)
+        flatField(b, 0, value0, size0);
+    if (numFields > 1)
+        flatField(b, 1, value1, size1);
+    return flatEndTable(b);
+}
+
+// Returns the offset of a Field. If extension isn't NULL the field has the metadata of an Arrow extension type,
+// and the flags z and m of gpkg_geometry_columns (gpkg:zm) if zm isn't empty
+static int arrowField(flatBuilder *b, const char *name, int nullable, int typeType, int type, int *children, int numChildren, const char *extension, const char *metadata, const char *zm)
+{
+    int nameOffset = flatString(b, name);
+    int childrenOffset = flatOffsetVector(b, children, numChildren);
+    int metadataOffset = 0;
+
+    if (extension != NULL)
+    {
+        int keyValues[3];
+        int key, value;
+        key = flatString(b, "ARROW:extension:name");
+        value = flatString(b, extension);
+        flatStartTable(b);
+        flatFieldOffset(b, 0, key);
+        flatFieldOffset(b, 1, value);
+        keyValues[0] = flatEndTable(b);
+        key = flatString(b, "ARROW:extension:metadata");
+        value = flatString(b, metadata);
+        flatStartTable(b);
+        flatFieldOffset(b, 0, key);
+        flatFieldOffset(b, 1, value);
+        keyValues[1] = flatEndTable(b);
+        if (zm != NULL && zm[0] != '\0')
+        {
+            key = flatString(b, "gpkg:zm");
+            value = flatString(b, zm);
+            flatStartTable(b);
+            flatFieldOffset(b, 0, key);
+            flatFieldOffset(b, 1, value);
+            keyValues[2] = flatEndTable(b);
+        }
+        metadataOffset = flatOffsetVector(b, keyValues, zm != NULL && zm[0] != '\0' ? 3 : 2);
+    }
+    flatStartTable(b);
+    flatFieldOffset(b, 0, nameOffset);
+    flatField(b, 1, nullable, 1);
+    flatField(b, 2, typeType, 1);
+    flatFieldOffset(b, 3, type);
+    flatFieldOffset(b, 5, childrenOffset);
+    if (metadataOffset != 0)
+        flatFieldOffset(b, 6, metadataOffset);
+    return flatEndTable(b);
+}
+
+// Returns the offset of the Field of a column
+static int arrowColumnField(flatBuilder *b, arrowColumn *column)
+{
+    int field, type, depth;
+
+    switch (column->kind)
+    {
+    case ARROW_INT64:
+        return arrowField(b, column->name, 1, ARROW_TYPE_INT, arrowType(b, 2, 64, 4, 1, 1), NULL, 0, NULL, NULL, NULL);
+    case ARROW_FLOAT64:
+        return arrowField(b, column->name, 1, ARROW_TYPE_FLOATING_POINT, arrowType(b, 1, ARROW_PRECISION_DOUBLE, 2, 0, 0), NULL, 0, NULL, NULL, NULL);
+    case ARROW_BOOL:
+        return arrowField(b, column->name, 1, ARROW_TYPE_BOOL, arrowType(b, 0, 0, 0, 0, 0), NULL, 0, NULL, NULL, NULL);
+    case ARROW_UTF8:
+        return arrowField(b, column->name, 1, ARROW_TYPE_UTF8, arrowType(b, 0, 0, 0, 0, 0), NULL, 0, NULL, NULL, NULL);
+    case ARROW_BINARY:
+        return arrowField(b, column->name, 1, ARROW_TYPE_BINARY, arrowType(b, 0, 0, 0, 0, 0), NULL, 0, NULL, NULL, NULL);
+    case ARROW_WKB:
+        return arrowField(b, column->name, 1, ARROW_TYPE_BINARY, arrowType(b, 0, 0, 0, 0, 0), NULL, 0, arrowExtensions[0], column->metadata, column->zm);
+    }
+
+    // GeoArrow: lists of FixedSizeList<double>[dimension], from the coordinates to the column
+    depth = arrowDepths[column->geometryType];
+    type = arrowType(b, 1, ARROW_PRECISION_DOUBLE, 2, 0, 0);
+    field = arrowField(b, column->dimension == 3 ? "xyz" : "xy", 0, ARROW_TYPE_FLOATING_POINT, type, NULL, 0, NULL, NULL, NULL);
+    type = arrowType(b, 1, column->dimension, 4, 0, 0);
+    if (depth == 0)
+        return arrowField(b, column->name, 1, ARROW_TYPE_FIXED_SIZE_LIST, type, &field, 1, arrowExtensions[column->geometryType], column->metadata, column->zm);
+    field = arrowField(b, arrowChildNames[column->geometryType][depth - 1], 0, ARROW_TYPE_FIXED_SIZE_LIST, type, &field, 1, NULL, NULL, NULL);
+    for (int level = depth - 1; level > 0; level--)
+        field = arrowField(b, arrowChildNames[column->geometryType][level - 1], 0, ARROW_TYPE_LIST, arrowType(b, 0, 0, 0, 0, 0), &field, 1, NULL, NULL, NULL);
+    return arrowField(b, column->name, 1, ARROW_TYPE_LIST, arrowType(b, 0, 0, 0, 0, 0), &field, 1, arrowExtensions[column->geometryType], column->metadata, column->zm);
+}
+
+// Returns the offset of the Schema of the columns
+static int arrowSchema(flatBuilder *b, arrowColumn *columns, int numColumns)
+{
+    int *fields = sqlite3_malloc64(sizeof(int) * (numColumns + 1));
+    int vector;
+
+    if (fields == NULL)
+    {
+        b->failed = 1;
+        return 0;
+    }
+    for (int i = 0; i < numColumns; i++)
+        fields[i] = arrowColumnField(b, &columns[i]);
+    vector = flatOffsetVector(b, fields, numColumns);
+    sqlite3_free(fields);
+    flatStartTable(b);
+    flatField(b, 0, endian() == LITTLE_ENDIAN ? 0 : 1, 2);
+    flatFieldOffset(b, 1, vector);
+    return flatEndTable(b);
+}
+
+// Returns the offset of a Message
+static int arrowMessage(flatBuilder *b, int headerType, int header, sqlite3_int64 bodyLength)
+{
+    flatStartTable(b);
+    flatField(b, 3, bodyLength, 8);
+    flatFieldOffset(b, 2, header);
+    flatField(b, 0, ARROW_METADATA_V5, 2);
+    flatField(b, 1, headerType, 1);
+    return flatEndTable(b);
+}
+
+// Writes the metadata of an encapsulated message (continuation, length and FlatBuffer padded to 8 bytes)
+// position <-> Position in the file
+// block <- Offset and metadata length of the Block of the message in the footer
+// Returns 0 if there is an error
+static int arrowWriteMessage(FILE *file, flatBuilder *b, sqlite3_int64 *position, sqlite3_int64 *block)
+{
+    static const unsigned char zeros[8] = { 0 };
+    unsigned char prefix[8];
+    int padding = (8 - b->size % 8) % 8;
+    int length = b->size + padding;
+
+    for (int i = 0; i < 4; i++)
+    {
+        prefix[i] = 0xff;
+        prefix[4 + i] = (unsigned char)(length >> (8 * i));
+    }
+    if (b->failed || fwrite(prefix, 1, 8, file) != 8 || fwrite(b->buf + b->capacity - b->size, 1, b->size, file) != (size_t)b->size ||
+        fwrite(zeros, 1, padding, file) != (size_t)padding)
+        return 0;
+    block[0] = *position;
+    block[1] = 8 + length;
+    *position += 8 + length;
+    return 1;
+}
+
+// Writes a record batch of the columns
+// blocks <-> Blocks of the record batches of the file (3 words each), with room for this one
+// Returns 0 if there is an error
+static int arrowWriteBatch(FILE *file, flatBuilder *b, arrowColumn *columns, int numColumns, sqlite3_int64 numRows, arrowBatch *batch,
+                           sqlite3_int64 *position, sqlite3_int64 *block)
+{
+    static const unsigned char zeros[8] = { 0 };
+    int nodes, buffers, recordBatch;
+
+    batch->numNodes = batch->numBuffers = 0;
+    batch->bodyLength = 0;
+    for (int i = 0; i < numColumns; i++)
+        arrowAddColumn(batch, &columns[i], numRows);
+
+    flatReset(b);
+    nodes = flatStructVector(b, batch->nodes, batch->numNodes, 2);
+    buffers = flatStructVector(b, batch->buffers, batch->numBuffers, 2);
+    flatStartTable(b);
+    flatField(b, 0, numRows, 8);
+    flatFieldOffset(b, 1, nodes);
+    flatFieldOffset(b, 2, buffers);
+    recordBatch = flatEndTable(b);
+    flatFinish(b, arrowMessage(b, ARROW_HEADER_RECORD_BATCH, recordBatch, batch->bodyLength));
+    if (!arrowWriteMessage(file, b, position, block))
+        return 0;
+
+    // Body
+    for (int i = 0; i < batch->numBuffers; i++)
+    {
+        sqlite3_int64 length = batch->buffers[2 * i + 1];
+        if (length > 0 && (fwrite(batch->data[i], 1, length, file) != (size_t)length || fwrite(zeros, 1, (8 - length % 8) % 8, file) != (size_t)((8 - length % 8) % 8)))
+            return 0;
+    }
+    block[2] = batch->bodyLength;
+    *position += batch->bodyLength;
+    return 1;
+}
+
+// Returns the kind of an Arrow column for the declared type of a column, following the rules of the affinity of SQLite
+static int arrowKind(const char *type)
+{
+    if (type == NULL || *type == '\0' || sqlite3_strlike("%BLOB%", type, 0) == 0)
+        return ARROW_BINARY;
+    if (sqlite3_strlike("%INT%", type, 0) == 0)
+        return ARROW_INT64;
+    if (sqlite3_strlike("%BOOL%", type, 0) == 0)
+        return ARROW_BOOL;
+    if (sqlite3_strlike("%CHAR%", type, 0) == 0 || sqlite3_strlike("%CLOB%", type, 0) == 0 || sqlite3_strlike("%TEXT%", type, 0) == 0 ||
+        sqlite3_strlike("%DATE%", type, 0) == 0 || sqlite3_strlike("%TIME%", type, 0) == 0)
+        return ARROW_UTF8; // The dates of a GeoPackage are text
+    return ARROW_FLOAT64;
+}
+
+// SQL function: GPKG_ExportArrow(tableName, path [, columns]); 
+// Writes a table to an Arrow IPC file, with its geometry columns in GeoArrow encoding
+// tableName -> Name of the table
+// path -> Path of the file. It's overwritten
+// columns -> Optional comma separated list of the columns to export. By default all the columns
+// The columns INTEGER are int64, REAL float64, BOOLEAN bool, TEXT, DATE and DATETIME utf8 and BLOB binary. The geometry columns
+// of gpkg_geometry_columns with a type from POINT to MULTIPOLYGON are GeoArrow native with interleaved coordinates (xy or xyz if
+// their z is not 0); the others (GEOMETRY, GEOMCOLLECTION) are geoarrow.wkb. The CRS is in the metadata of the extension type,
+// and the flags z and m of gpkg_geometry_columns in the metadata gpkg:zm of the field ("00" ... "22"), read by GPKG_ImportArrow
+// The rows are converted and written by record batches of ARROW_BATCH_SIZE, with the buffers of the columns reused between them.
+// A batch is written before it's full if the next row would overflow the 32 bit offsets of its strings, BLOBs or lists
+// On success returns the number of rows exported. If there is an error throw an exception
+static void fnct_GPKGExportArrow(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *path;
+    const char *list = NULL;
+    sqlite3 *db;
+    sqlite3_stmt *stmt = NULL;
+    arrowColumn *columns = NULL;
+    int numColumns = 0;
+    arrowBatch batch;
+    flatBuilder b;
+    FILE *file = NULL;
+    sqlite3_int64 *blocks = NULL;
+    int numBlocks = 0, maxBlocks = 0;
+    sqlite3_int64 position = 8;
+    sqlite3_int64 numRows = 0, batchRows = 0;
+    sqlite3_int64 schemaBlock[3];
+    const char *error = NULL;
+    char *sql = NULL;
+    int rc;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    path = (const char *)sqlite3_value_text(argv[1]);
+    if (argc == 3)
+        list = (const char *)sqlite3_value_text(argv[2]);
+    if (table == NULL || path == NULL)
+    {
+        sqlite3_result_error(context, "GPKG_ExportArrow() error: arguments 1 and 2 [tableName, path] must be text", -1);
+        return;
+    }
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+    memset(&batch, 0, sizeof(arrowBatch));
+    memset(&b, 0, sizeof(flatBuilder));
+
+    // Columns of the table, in the order of the list if there is one
+    rc = sqlite3_prepare_v2(db, "SELECT t.name, t.type, g.geometry_type_name, g.z, s.organization, s.organization_coordsys_id, g.m FROM pragma_table_info(?1) t "
+                                "LEFT JOIN gpkg_geometry_columns g ON g.table_name = ?1 AND g.column_name = t.name COLLATE NOCASE "
+                                "LEFT JOIN gpkg_spatial_ref_sys s ON s.srs_id = g.srs_id ORDER BY t.cid",
+                            -1, &stmt, NULL);
+    if (rc != SQLITE_OK) // Not a GeoPackage
+        rc = sqlite3_prepare_v2(db, "SELECT name, type, NULL, NULL, NULL, NULL, NULL FROM pragma_table_info(?1) ORDER BY cid", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+        goto end;
+    sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        const char *gtype = (const char *)sqlite3_column_text(stmt, 2);
+        const char *organization = (const char *)sqlite3_column_text(stmt, 4);
+        arrowColumn *column;
+        if (list != NULL)
+        {
+            // Is it in the list?
+            const char *p = list;
+            int n = (int)strlen(name);
+            while (*p != '\0')
+            {
+                while (*p == ' ' || *p == ',' || *p == '"')
+                    p++;
+                if (sqlite3_strnicmp(p, name, n) == 0 && (p[n] == '\0' || p[n] == ',' || p[n] == ' ' || p[n] == '"'))
+                    break;
+                while (*p != '\0' && *p != ',')
+                    p++;
+            }
+            if (*p == '\0')
+                continue;
+        }
+        if ((numColumns & 15) == 0)
+        {
+            arrowColumn *p = sqlite3_realloc64(columns, sizeof(arrowColumn) * (numColumns + 16));
+            if (p == NULL)
+            {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            columns = p;
+        }
+        column = &columns[numColumns++];
+        memset(column, 0, sizeof(arrowColumn));
+        column->name = sqlite3_mprintf("%s", name);
+        column->kind = arrowKind((const char *)sqlite3_column_text(stmt, 1));
+        if (gtype != NULL)
+        {
+            column->kind = ARROW_WKB;
+            for (int t = wkbPoint; t <= wkbMultiPolygon; t++)
+                if (sqlite3_stricmp(gtype, wktGeomtryTypes[t]) == 0)
+                {
+                    column->kind = ARROW_GEOMETRY;
+                    column->geometryType = t;
+                }
+            column->dimension = sqlite3_column_int(stmt, 3) != 0 ? 3 : 2;
+            if (sqlite3_column_int(stmt, 3) >= 0 && sqlite3_column_int(stmt, 3) <= 2 && sqlite3_column_int(stmt, 6) >= 0 && sqlite3_column_int(stmt, 6) <= 2)
+            {
+                column->zm[0] = (char)('0' + sqlite3_column_int(stmt, 3));
+                column->zm[1] = (char)('0' + sqlite3_column_int(stmt, 6));
+            }
+            if (organization != NULL && sqlite3_column_int(stmt, 5) > 0 && strchr(organization, '"') == NULL && strchr(organization, '\\') == NULL)
+            {
+                // Authorities are upper case in PROJ ("EPSG:4326")
+                column->metadata = sqlite3_mprintf("{\"crs\":\"%s:%d\",\"crs_type\":\"authority_code\"}", organization, sqlite3_column_int(stmt, 5));
+                for (char *c = column->metadata != NULL ? column->metadata + 8 : NULL; c != NULL && *c != ':'; c++)
+                    if (*c >= 'a' && *c <= 'z')
+                        *c -= 'a' - 'A';
+            }
+            else
+                column->metadata = sqlite3_mprintf("{}");
+            if (column->metadata == NULL)
+                rc = SQLITE_NOMEM;
+        }
+        if (column->name == NULL)
+            rc = SQLITE_NOMEM;
+        if (rc == SQLITE_NOMEM)
+            break;
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (rc != SQLITE_DONE)
+        goto end;
+    if (numColumns == 0)
+    {
+        error = "GPKG_ExportArrow() error: the table doesn't exist or it has none of the columns";
+        goto end;
+    }
+
+    // Query
+    sql = sqlite3_mprintf("SELECT \"%w\"", columns[0].name);
+    for (int i = 1; i < numColumns && sql != NULL; i++)
+    {
+        char *s = sqlite3_mprintf("%s, \"%w\"", sql, columns[i].name);
+        sqlite3_free(sql);
+        sql = s;
+    }
+    if (sql != NULL)
+    {
+        char *s = sqlite3_mprintf("%s FROM \"%w\"", sql, table);
+        sqlite3_free(sql);
+        sql = s;
+    }
+    if (sql == NULL)
+    {
+        rc = SQLITE_NOMEM;
+        goto end;
+    }
+    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+        goto end;
+
+    batch.nodes = sqlite3_malloc64(sizeof(sqlite3_int64) * 2 * 5 * numColumns);
+    batch.buffers = sqlite3_malloc64(sizeof(sqlite3_int64) * 2 * 9 * numColumns);
+    batch.data = sqlite3_malloc64(sizeof(unsigned char *) * 9 * numColumns);
+    if (batch.nodes == NULL || batch.buffers == NULL || batch.data == NULL)
+    {
+        rc = SQLITE_NOMEM;
+        goto end;
+    }
+
+    // Magic and schema
+    file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        error = "GPKG_ExportArrow() error: argument 2 [path] can't be opened for writing";
+        goto end;
+    }
+    flatReset(&b);
+    flatFinish(&b, arrowMessage(&b, ARROW_HEADER_SCHEMA, arrowSchema(&b, columns, numColumns), 0));
+    if (fwrite("ARROW1\0\0", 1, 8, file) != 8 || !arrowWriteMessage(file, &b, &position, schemaBlock))
+    {
+        rc = b.failed ? SQLITE_NOMEM : SQLITE_IOERR;
+        goto end;
+    }
+
+    // Record batches
+    while (1)
+    {
+        int fits = 1;
+        rc = sqlite3_step(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+            break;
+        for (int i = 0; i < numColumns && rc == SQLITE_ROW && fits; i++)
+            fits = arrowValueFits(&columns[i], stmt, i);
+        if (batchRows == ARROW_BATCH_SIZE || (batchRows > 0 && (rc == SQLITE_DONE || !fits)))
+        {
+            if (numBlocks == maxBlocks)
+            {
+                sqlite3_int64 *p = sqlite3_realloc64(blocks, sizeof(sqlite3_int64) * 3 * (maxBlocks * 2 + 16));
+                if (p == NULL)
+                {
+                    rc = SQLITE_NOMEM;
+                    break;
+                }
+                blocks = p;
+                maxBlocks = maxBlocks * 2 + 16;
+            }
+            for (int i = 0; i < numColumns; i++)
+            {
+                if (!arrowEndColumn(&columns[i]))
+                {
+                    rc = SQLITE_NOMEM;
+                    break;
+                }
+            }
+            if (rc == SQLITE_NOMEM)
+                break;
+            if (!arrowWriteBatch(file, &b, columns, numColumns, batchRows, &batch, &position, &blocks[3 * numBlocks]))
+            {
+                rc = b.failed ? SQLITE_NOMEM : SQLITE_IOERR;
+                break;
+            }
+            numBlocks++;
+            batchRows = 0;
+            for (int i = 0; i < numColumns; i++)
+                arrowResetColumn(&columns[i]);
+        }
+        if (rc == SQLITE_DONE)
+            break;
+        for (int i = 0; i < numColumns; i++)
+        {
+            if (!arrowAppendValue(&columns[i], stmt, i, batchRows))
+            {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+        }
+        if (rc != SQLITE_ROW)
+            break;
+        batchRows++;
+        numRows++;
+    }
+    if (rc != SQLITE_DONE)
+        goto end;
+
+    // End of stream and footer
+    {
+        static const unsigned char eos[8] = { 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0 };
+        unsigned char trailer[10];
+        int schema, dictionaries, recordBatches, footer;
+        flatReset(&b);
+        schema = arrowSchema(&b, columns, numColumns);
+        dictionaries = flatStructVector(&b, NULL, 0, 3);
+        recordBatches = flatStructVector(&b, blocks, numBlocks, 3);
+        flatStartTable(&b);
+        flatField(&b, 0, ARROW_METADATA_V5, 2);
+        flatFieldOffset(&b, 1, schema);
+        flatFieldOffset(&b, 2, dictionaries);
+        flatFieldOffset(&b, 3, recordBatches);
+        footer = flatEndTable(&b);
+        flatFinish(&b, footer);
+        for (int i = 0; i < 4; i++)
+            trailer[i] = (unsigned char)(b.size >> (8 * i));
+        memcpy(trailer + 4, "ARROW1", 6);
+        if (b.failed)
+            rc = SQLITE_NOMEM;
+        else if (fwrite(eos, 1, 8, file) != 8 || fwrite(b.buf + b.capacity - b.size, 1, b.size, file) != (size_t)b.size || fwrite(trailer, 1, 10, file) != 10)
+            rc = SQLITE_IOERR;
+    }
+
+end:
+    if (file != NULL && fclose(file) != 0 && rc == SQLITE_DONE)
+        rc = SQLITE_IOERR;
+    sqlite3_finalize(stmt);
+    sqlite3_free(sql);
+    for (int i = 0; i < numColumns; i++)
+    {
+        sqlite3_free(columns[i].name);
+        sqlite3_free(columns[i].metadata);
+        sqlite3_free(columns[i].validity.data);
+        sqlite3_free(columns[i].offsets.data);
+        sqlite3_free(columns[i].data.data);
+        sqlite3_free(columns[i].partOffsets.data);
+        sqlite3_free(columns[i].ringOffsets.data);
+    }
+    sqlite3_free(columns);
+    sqlite3_free(blocks);
+    sqlite3_free(batch.nodes);
+    sqlite3_free(batch.buffers);
+    sqlite3_free(batch.data);
+    sqlite3_free(b.buf);
+    if (error != NULL)
+        sqlite3_result_error(context, error, -1);
+    else if (rc == SQLITE_NOMEM)
+        sqlite3_result_error_nomem(context);
+    else if (rc == SQLITE_IOERR)
+        sqlite3_result_error(context, "GPKG_ExportArrow() error: can't write the file", -1);
+    else if (rc != SQLITE_DONE)
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+    else
+        sqlite3_result_int64(context, numRows);
+}
+
+// File mapped in memory, read only
+typedef struct mappedFile
+{
+    const unsigned char *data;
+    sqlite3_int64 size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} mappedFile;
+
+// Maps a file in memory, read only
+// path -> Path of the file (UTF-8)
+// m <- Mapped file. It must be released with unmapFile
+// Returns 0 if the file can't be opened or it's empty
+static int mapFile(const char *path, mappedFile *m)
+{
+#ifdef _WIN32
+    WCHAR wpath[MAX_PATH];
+    LARGE_INTEGER size;
+
+    memset(m, 0, sizeof(mappedFile));
+    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH) == 0)
+        return 0;
+    m->file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m->file == INVALID_HANDLE_VALUE)
+    {
+        m->file = NULL;
+        return 0;
+    }
+    if (!GetFileSizeEx(m->file, &size) || size.QuadPart == 0 ||
+        (m->mapping = CreateFileMappingW(m->file, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL ||
+        (m->data = (const unsigned char *)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0)) == NULL)
+    {
+        if (m->mapping != NULL)
+            CloseHandle(m->mapping);
+        CloseHandle(m->file);
+        memset(m, 0, sizeof(mappedFile));
+        return 0;
+    }
+    m->size = size.QuadPart;
+    return 1;
+#else
+    struct stat st;
+    void *data;
+    int fd;
+
+    memset(m, 0, sizeof(mappedFile));
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || (data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return 0;
+    }
+    close(fd); // The mapping keeps the file open
+    m->data = (const unsigned char *)data;
+    m->size = st.st_size;
+    return 1;
+#endif
+}
+
+// Releases a file mapped in memory
+static void unmapFile(mappedFile *m)
+{
+    if (m->data == NULL)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(m->data);
+    CloseHandle(m->mapping);
+    CloseHandle(m->file);
+#else
+    munmap((void *)m->data, (size_t)m->size);
+#endif
+    memset(m, 0, sizeof(mappedFile));
+}
+
+// Table of a FlatBuffer being read. All the reads are checked against the size of the buffer
+typedef struct flatTable
+{
+    const unsigned char *buf;
+    sqlite3_int64 size;
+    sqlite3_int64 pos;    // Position of the table
+    sqlite3_int64 vtable; // Position of its vtable
+    int vtableSize;
+} flatTable;
+
+// Reads a little endian unsigned integer of n bytes
+static sqlite3_uint64 flatRead(const unsigned char *p, int n)
+{
+    sqlite3_uint64 value = 0;
+
+    for (int i = n - 1; i >= 0; i--)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+// Reads the table at a position of a buffer
+// Returns 0 if it's not inside the buffer
+static int flatTableAt(const unsigned char *buf, sqlite3_int64 size, sqlite3_int64 pos, flatTable *t)
+{
+    if (pos < 0 || pos + 4 > size)
+        return 0;
+    t->vtable = pos - (int)flatRead(buf + pos, 4);
+    if (t->vtable < 0 || t->vtable + 4 > size)
+        return 0;
+    t->vtableSize = (int)flatRead(buf + t->vtable, 2);
+    if (t->vtableSize < 4 || t->vtable + t->vtableSize > size)
+        return 0;
+    t->buf = buf;
+    t->size = size;
+    t->pos = pos;
+    return 1;
+}
+
+// Position of a field of n bytes of a table, or 0 if the field is not present
+static sqlite3_int64 flatFieldPos(const flatTable *t, int id, int n)
+{
+    sqlite3_int64 offset;
+
+    if (4 + 2 * id + 2 > t->vtableSize)
+        return 0;
+    offset = (sqlite3_int64)flatRead(t->buf + t->vtable + 4 + 2 * id, 2);
+    if (offset == 0 || t->pos + offset + n > t->size)
+        return 0;
+    return t->pos + offset;
+}
+
+// Reads a scalar field of n bytes (signed), or returns the default value if it's not present
+static sqlite3_int64 flatGetInt(const flatTable *t, int id, int n, sqlite3_int64 value)
+{
+    sqlite3_int64 pos = flatFieldPos(t, id, n);
+
+    if (pos == 0)
+        return value;
+    value = (sqlite3_int64)flatRead(t->buf + pos, n);
+    if (n < 8 && (value & ((sqlite3_int64)1 << (8 * n - 1))) != 0)
+        value -= (sqlite3_int64)1 << (8 * n);
+    return value;
+}
+
+// Follows the offset of a field (table, vector or string)
+// Returns 0 if the field is not present or not valid
+static int flatGetRef(const flatTable *t, int id, sqlite3_int64 *pos)
+{
+    sqlite3_int64 p = flatFieldPos(t, id, 4);
+
+    if (p == 0)
+        return 0;
+    *pos = p + (sqlite3_int64)flatRead(t->buf + p, 4);
+    return *pos + 4 <= t->size;
+}
+
+// Reads a field that is a table
+static int flatGetTable(const flatTable *t, int id, flatTable *child)
+{
+    sqlite3_int64 pos;
+
+    return flatGetRef(t, id, &pos) && flatTableAt(t->buf, t->size, pos, child);
+}
+
+// Reads a field that is a vector of elements of elementSize bytes (4 for tables and strings)
+// start <- Position of the first element
+// num <- Number of elements
+static int flatGetVector(const flatTable *t, int id, int elementSize, sqlite3_int64 *start, sqlite3_int64 *num)
+{
+    sqlite3_int64 pos;
+
+    if (!flatGetRef(t, id, &pos))
+        return 0;
+    *num = (sqlite3_int64)flatRead(t->buf + pos, 4);
+    *start = pos + 4;
+    return *num <= (t->size - *start) / elementSize;
+}
+
+// Reads the table i of a vector of tables
+static int flatVectorTable(const flatTable *t, sqlite3_int64 start, sqlite3_int64 i, flatTable *child)
+{
+    sqlite3_int64 pos = start + 4 * i;
+
+    return flatTableAt(t->buf, t->size, pos + (sqlite3_int64)flatRead(t->buf + pos, 4), child);
+}
+
+// Reads a field that is a string. It's not terminated by zero in the buffer
+static int flatGetString(const flatTable *t, int id, const char **s, int *n)
+{
+    sqlite3_int64 start, num;
+
+    if (!flatGetVector(t, id, 1, &start, &num) || num > 0x7fffffff)
+        return 0;
+    *s = (const char *)t->buf + start;
+    *n = (int)num;
+    return 1;
+}
+
+// Compares a string field with a zero terminated string
+static int flatStringEquals(const flatTable *t, int id, const char *value)
+{
+    const char *s;
+    int n;
+
+    return flatGetString(t, id, &s, &n) && n == (int)strlen(value) && memcmp(s, value, n) == 0;
+}
+
+// Reads the next encapsulated message of an Arrow IPC stream, with or without continuation marker
+// buf, size -> Stream
+// position <-> Position of the message, and returns the position of the next one
+// message <- Message table
+// body <- Position of the body of the message
+// Returns 1 if there is a message, 0 at the end of the stream or -1 if it's not valid
+static int arrowNextMessage(const unsigned char *buf, sqlite3_int64 size, sqlite3_int64 *position, flatTable *message, sqlite3_int64 *body)
+{
+    sqlite3_int64 pos = *position;
+    sqlite3_int64 length, bodyLength;
+
+    if (pos + 4 > size)
+        return 0;
+    length = (sqlite3_int64)flatRead(buf + pos, 4);
+    pos += 4;
+    if (length == 0xffffffff)
+    {
+        if (pos + 4 > size)
+            return 0;
+        length = (sqlite3_int64)flatRead(buf + pos, 4);
+        pos += 4;
+    }
+    if (length == 0)
+        return 0; // End of stream
+    if (length > size - pos || length < 4 || !flatTableAt(buf + pos, length, (sqlite3_int64)flatRead(buf + pos, 4), message))
+        return -1;
+    bodyLength = flatGetInt(message, 3, 8, 0);
+    *body = pos + length;
+    if (bodyLength < 0 || bodyLength > size - *body)
+        return -1;
+    *position = *body + bodyLength;
+    return 1;
+}
+
+// Column of an Arrow IPC file read by GPKG_ImportArrow
+typedef struct arrowSource
+{
+    char *name;
+    int kind;           // ARROW_INT64 ... ARROW_GEOMETRY, or 0 if the column is not imported
+    int bitWidth;       // Bits of the integers and floating points
+    int isSigned;       // 1 if the integers are signed
+    int large;          // 1 if the offsets of utf8 and binary have 64 bits (large_utf8, large_binary)
+    int geometryType;   // wkbPoint ... wkbMultiPolygon for ARROW_GEOMETRY
+    int hasZ, hasM;     // Ordinates of the coordinates of ARROW_GEOMETRY
+    int interleaved;    // 1 if the coordinates are a fixed size list (interleaved), 0 if they are a struct (separated)
+    int stride;         // Ordinates of each interleaved coordinate
+    int ordinates[4];   // Position (interleaved) or child (separated) of X, Y, Z and M, in the order of gpkgGeometry.coords
+    int sameLayout;     // 1 if the interleaved coordinates are like gpkgGeometry.coords, so they are copied with memcpy
+    int srsId;
+    int z, m;           // Flags z and m of gpkg_geometry_columns from the metadata gpkg:zm (see GPKG_ExportArrow), or -1
+    int firstNode;      // First field node of the column in the record batches
+    int firstBuffer;    // First buffer of the column in the record batches
+    int parameter;      // Parameter of the INSERT, or 0 if the column is not in the table
+    // Buffers of the current record batch
+    const unsigned char *validity;  // NULL if there are no NULL values
+    const unsigned char *offsets[3]; // Offsets of the utf8 and binary values, or of the lists of each level of ARROW_GEOMETRY
+    sqlite3_int64 lengths[4];        // Number of rows and elements of each level of lists of ARROW_GEOMETRY
+    const unsigned char *values[4];  // Values, or X, Y, Z and M of the separated coordinates
+    sqlite3_int64 valuesSize;        // Bytes of the utf8 and binary values
+} arrowSource;
+
+// Counts the field nodes and buffers of a field of an Arrow schema in the record batches, with its children
+// Returns 0 if the layout of the type is not supported (unions, views, run-end encoded)
+static int arrowFieldLayout(const flatTable *field, int *numNodes, int *numBuffers)
+{
+    flatTable dictionary, child;
+    sqlite3_int64 start, num = 0;
+
+    (*numNodes)++;
+    if (flatGetTable(field, 4, &dictionary))
+    {
+        // The values are the indices of a dictionary
+        *numBuffers += 2;
+        return 1;
+    }
+    switch (flatGetInt(field, 2, 1, 0))
+    {
+    case 1: // Null
+        return 1;
+    case ARROW_TYPE_INT: case ARROW_TYPE_FLOATING_POINT: case ARROW_TYPE_BOOL: case 7: case 8: case 9: case 10: case 11: case 15: case 18:
+        *numBuffers += 2;
+        return 1;
+    case ARROW_TYPE_BINARY: case ARROW_TYPE_UTF8: case ARROW_TYPE_LARGE_BINARY: case ARROW_TYPE_LARGE_UTF8:
+        *numBuffers += 3;
+        return 1;
+    case ARROW_TYPE_LIST: case 17: case 21: // List, Map, LargeList
+        *numBuffers += 2;
+        break;
+    case ARROW_TYPE_STRUCT: case ARROW_TYPE_FIXED_SIZE_LIST:
+        *numBuffers += 1;
+        break;
+    default:
+        return 0;
+    }
+    if (flatGetVector(field, 5, 4, &start, &num))
+    {
+        for (sqlite3_int64 i = 0; i < num; i++)
+        {
+            if (!flatVectorTable(field, start, i, &child) || !arrowFieldLayout(&child, numNodes, numBuffers))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+// Returns the value of a key of the custom metadata of a field, or NULL
+static const char *arrowFieldMetadata(const flatTable *field, const char *key, int *n)
+{
+    flatTable keyValue;
+    sqlite3_int64 start, num;
+    const char *value;
+
+    if (!flatGetVector(field, 6, 4, &start, &num))
+        return NULL;
+    for (sqlite3_int64 i = 0; i < num; i++)
+    {
+        if (flatVectorTable(field, start, i, &keyValue) && flatStringEquals(&keyValue, 0, key) && flatGetString(&keyValue, 1, &value, n))
+            return value;
+    }
+    return NULL;
+}
+
+// Reads the child i of a field
+static int arrowFieldChild(const flatTable *field, int i, flatTable *child)
+{
+    sqlite3_int64 start, num;
+
+    return flatGetVector(field, 5, 4, &start, &num) && i < num && flatVectorTable(field, start, i, child);
+}
+
+// Checks that a field is float64
+static int arrowIsDouble(const flatTable *field)
+{
+    flatTable type;
+
+    return flatGetInt(field, 2, 1, 0) == ARROW_TYPE_FLOATING_POINT && flatGetTable(field, 3, &type) &&
+           flatGetInt(&type, 0, 2, 0) == ARROW_PRECISION_DOUBLE && !flatGetTable(field, 4, &type);
+}
+
+// Reads the coordinates of a GeoArrow native type: a fixed size list of float64 (interleaved) or a struct of float64 (separated),
+// with the dimensions in the name of the list child ("xy", "xyz", "xym", "xyzm") or in the names of the struct children
+// Returns 0 if the coordinates are not valid
+static int arrowSourceCoordinates(const flatTable *field, arrowSource *column)
+{
+    flatTable type, child;
+    int position[4] = { -1, -1, -1, -1 };
+    char names[4];
+    const char *name;
+    int n, numOrdinates;
+
+    if (flatGetInt(field, 2, 1, 0) == ARROW_TYPE_FIXED_SIZE_LIST)
+    {
+        if (!flatGetTable(field, 3, &type) || !arrowFieldChild(field, 0, &child) || !arrowIsDouble(&child))
+            return 0;
+        numOrdinates = (int)flatGetInt(&type, 0, 4, 0);
+        if (!flatGetString(&child, 0, &name, &n) || n != numOrdinates)
+            name = numOrdinates == 3 ? "xyz" : "xyzm", n = numOrdinates; // Unnamed: XYZ or XYZM
+        column->interleaved = 1;
+        column->stride = numOrdinates;
+    }
+    else if (flatGetInt(field, 2, 1, 0) == ARROW_TYPE_STRUCT)
+    {
+        const char *s;
+        int len;
+        for (numOrdinates = 0; numOrdinates < 5 && arrowFieldChild(field, numOrdinates, &child); numOrdinates++)
+        {
+            if (numOrdinates == 4 || !arrowIsDouble(&child) || !flatGetString(&child, 0, &s, &len) || len != 1)
+                return 0;
+            names[numOrdinates] = s[0];
+        }
+        name = names;
+        n = numOrdinates;
+    }
+    else
+        return 0;
+    if (numOrdinates < 2 || numOrdinates > 4)
+        return 0;
+    for (int i = 0; i < n; i++)
+    {
+        const char *p = strchr("xyzm", name[i] | 0x20);
+        if (p == NULL || name[i] == '\0' || position[p - "xyzm"] >= 0)
+            return 0;
+        position[p - "xyzm"] = i;
+    }
+    if (position[0] < 0 || position[1] < 0)
+        return 0;
+    column->hasZ = position[2] >= 0;
+    column->hasM = position[3] >= 0;
+    n = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (position[i] >= 0)
+            column->ordinates[n++] = position[i];
+    }
+    column->sameLayout = column->interleaved;
+    for (int i = 0; i < n; i++)
+    {
+        if (column->ordinates[i] != i)
+            column->sameLayout = 0;
+    }
+    return n == numOrdinates;
+}
+
+// Reads the SRS ID of the GeoArrow metadata: the code of an EPSG CRS ("EPSG:4326" or PROJJSON), else 0
+static int arrowSourceSrsId(const char *metadata, int n)
+{
+    for (int i = 0; i + 5 < n; i++)
+    {
+        if (sqlite3_strnicmp(metadata + i, "EPSG:", 5) == 0 && metadata[i + 5] >= '0' && metadata[i + 5] <= '9')
+            return atoi(metadata + i + 5);
+        if (sqlite3_strnicmp(metadata + i, "\"EPSG\"", 6) == 0)
+        {
+            // PROJJSON: "id": {"authority": "EPSG", "code": 4326}
+            for (int j = i + 6; j + 7 < n && metadata[j] != '}'; j++)
+                if (memcmp(metadata + j, "\"code\"", 6) == 0)
+                {
+                    j += 6;
+                    while (j < n && (metadata[j] == ' ' || metadata[j] == ':'))
+                        j++;
+                    return j < n && metadata[j] >= '0' && metadata[j] <= '9' ? atoi(metadata + j) : 0;
+                }
+        }
+    }
+    return 0;
+}
+
+// Reads a field of the schema of an Arrow IPC file into a column
+// The columns whose type is not supported are not imported (kind 0)
+// Returns SQLITE_OK, SQLITE_NOMEM or SQLITE_ERROR if the layout of the field is not supported
+static int arrowSourceColumn(const flatTable *field, arrowSource *column, int *numNodes, int *numBuffers)
+{
+    flatTable type, level;
+    const char *s, *metadata;
+    int n, metadataLength;
+
+    memset(column, 0, sizeof(arrowSource));
+    column->firstNode = *numNodes;
+    column->firstBuffer = *numBuffers;
+    if (!arrowFieldLayout(field, numNodes, numBuffers))
+        return SQLITE_ERROR;
+    if (!flatGetString(field, 0, &s, &n))
+        s = "", n = 0;
+    if ((column->name = sqlite3_mprintf("%.*s", n, s)) == NULL)
+        return SQLITE_NOMEM;
+    if (flatGetTable(field, 4, &type))
+        return SQLITE_OK; // Dictionary encoded
+
+    // GeoArrow
+    s = arrowFieldMetadata(field, "ARROW:extension:name", &n);
+    if (s != NULL && n > 9 && memcmp(s, "geoarrow.", 9) == 0)
+    {
+        int typeType = (int)flatGetInt(field, 2, 1, 0);
+        metadata = arrowFieldMetadata(field, "ARROW:extension:metadata", &metadataLength);
+        column->srsId = metadata != NULL ? arrowSourceSrsId(metadata, metadataLength) : 0;
+        metadata = arrowFieldMetadata(field, "gpkg:zm", &metadataLength);
+        column->z = column->m = -1;
+        if (metadata != NULL && metadataLength == 2 && metadata[0] >= '0' && metadata[0] <= '2' && metadata[1] >= '0' && metadata[1] <= '2')
+        {
+            column->z = metadata[0] - '0';
+            column->m = metadata[1] - '0';
+        }
+        if (n == (int)strlen(arrowExtensions[0]) && memcmp(s, arrowExtensions[0], n) == 0)
+        {
+            if (typeType == ARROW_TYPE_BINARY || typeType == ARROW_TYPE_LARGE_BINARY)
+            {
+                column->kind = ARROW_WKB;
+                column->large = typeType == ARROW_TYPE_LARGE_BINARY;
+            }
+            return SQLITE_OK;
+        }
+        for (int t = wkbPoint; t <= wkbMultiPolygon; t++)
+        {
+            if (n != (int)strlen(arrowExtensions[t]) || memcmp(s, arrowExtensions[t], n) != 0)
+                continue;
+            level = *field;
+            for (int i = 0; i < arrowDepths[t]; i++)
+            {
+                if (flatGetInt(&level, 2, 1, 0) != ARROW_TYPE_LIST || !arrowFieldChild(&level, 0, &level))
+                    return SQLITE_OK;
+            }
+            if (arrowSourceCoordinates(&level, column))
+            {
+                column->kind = ARROW_GEOMETRY;
+                column->geometryType = t;
+            }
+        }
+        return SQLITE_OK;
+    }
+
+    switch (flatGetInt(field, 2, 1, 0))
+    {
+    case ARROW_TYPE_INT:
+        if (flatGetTable(field, 3, &type))
+        {
+            column->bitWidth = (int)flatGetInt(&type, 0, 4, 0);
+            column->isSigned = (int)flatGetInt(&type, 1, 1, 0);
+            if (column->bitWidth == 8 || column->bitWidth == 16 || column->bitWidth == 32 || column->bitWidth == 64)
+                column->kind = ARROW_INT64;
+        }
+        break;
+    case ARROW_TYPE_FLOATING_POINT:
+        if (flatGetTable(field, 3, &type))
+        {
+            column->bitWidth = flatGetInt(&type, 0, 2, 0) == ARROW_PRECISION_DOUBLE ? 64 : 32;
+            if (flatGetInt(&type, 0, 2, 0) != 0) // Half precision is not supported
+                column->kind = ARROW_FLOAT64;
+        }
+        break;
+    case ARROW_TYPE_BOOL:
+        column->kind = ARROW_BOOL;
+        break;
+    case ARROW_TYPE_UTF8: case ARROW_TYPE_LARGE_UTF8:
+        column->kind = ARROW_UTF8;
+        column->large = flatGetInt(field, 2, 1, 0) == ARROW_TYPE_LARGE_UTF8;
+        break;
+    case ARROW_TYPE_BINARY: case ARROW_TYPE_LARGE_BINARY:
+        column->kind = ARROW_BINARY;
+        column->large = flatGetInt(field, 2, 1, 0) == ARROW_TYPE_LARGE_BINARY;
+        break;
+    }
+    return SQLITE_OK;
+}
+
+// Record batch of an Arrow IPC file
+typedef struct arrowSourceBatch
+{
+    const unsigned char *body;
+    sqlite3_int64 bodyLength;
+    const unsigned char *nodes;   // FieldNode structs (length, null_count)
+    const unsigned char *buffers; // Buffer structs (offset, length)
+    sqlite3_int64 length;         // Number of rows
+} arrowSourceBatch;
+
+// Returns a buffer of a record batch, or NULL if it's empty
+static const unsigned char *arrowSourceBuffer(const arrowSourceBatch *batch, int i, sqlite3_int64 *length)
+{
+    sqlite3_int64 offset = (sqlite3_int64)flatRead(batch->buffers + 16 * i, 8);
+
+    *length = (sqlite3_int64)flatRead(batch->buffers + 16 * i + 8, 8);
+    return *length > 0 ? batch->body + offset : NULL;
+}
+
+// Sets the buffers of a column for a record batch, checking their sizes
+// Returns 0 if they are not valid
+static int arrowSourceLoad(arrowSource *column, const arrowSourceBatch *batch)
+{
+    sqlite3_int64 length = (sqlite3_int64)flatRead(batch->nodes + 16 * column->firstNode, 8);
+    sqlite3_int64 nullCount = (sqlite3_int64)flatRead(batch->nodes + 16 * column->firstNode + 8, 8);
+    sqlite3_int64 size;
+    int depth;
+
+    if (length < batch->length)
+        return 0;
+    column->lengths[0] = length;
+    column->validity = arrowSourceBuffer(batch, column->firstBuffer, &size);
+    if (nullCount == 0)
+        column->validity = NULL;
+    else if (size < (length + 7) / 8)
+        return 0;
+    switch (column->kind)
+    {
+    case ARROW_INT64: case ARROW_FLOAT64:
+        column->values[0] = arrowSourceBuffer(batch, column->firstBuffer + 1, &size);
+        return size / (column->bitWidth / 8) >= length;
+    case ARROW_BOOL:
+        column->values[0] = arrowSourceBuffer(batch, column->firstBuffer + 1, &size);
+        return size >= (length + 7) / 8;
+    case ARROW_UTF8: case ARROW_BINARY: case ARROW_WKB:
+        column->offsets[0] = arrowSourceBuffer(batch, column->firstBuffer + 1, &size);
+        if (size / (column->large ? 8 : 4) < length + 1)
+            return 0;
+        column->values[0] = arrowSourceBuffer(batch, column->firstBuffer + 2, &column->valuesSize);
+        return 1;
+    case ARROW_GEOMETRY:
+        depth = arrowDepths[column->geometryType];
+        for (int i = 0; i < depth; i++)
+        {
+            column->offsets[i] = arrowSourceBuffer(batch, column->firstBuffer + 2 * i + 1, &size);
+            column->lengths[i + 1] = (sqlite3_int64)flatRead(batch->nodes + 16 * (column->firstNode + i + 1), 8);
+            if (size / 4 < column->lengths[i] + 1 || column->lengths[i + 1] < 0)
+                return 0;
+        }
+        length = column->lengths[depth];
+        if (column->interleaved)
+        {
+            column->values[0] = arrowSourceBuffer(batch, column->firstBuffer + 2 * depth + 2, &size);
+            return size / 8 / column->stride >= length;
+        }
+        for (int i = 0; i < 2 + column->hasZ + column->hasM; i++)
+        {
+            column->values[i] = arrowSourceBuffer(batch, column->firstBuffer + 2 * depth + 2 + 2 * i, &size);
+            if (size / 8 < length)
+                return 0;
+        }
+        return 1;
+    }
+    return 1;
+}
+
+// Reads the range of elements of the next level of the list i of a level of a GeoArrow column
+// Returns 0 if the offsets are not valid
+static int arrowSourceRange(const arrowSource *column, int level, sqlite3_int64 i, sqlite3_int64 *start, sqlite3_int64 *end)
+{
+    int offsets[2];
+
+    memcpy(offsets, column->offsets[level] + 4 * i, 8);
+    *start = offsets[0];
+    *end = offsets[1];
+    return *start >= 0 && *start <= *end && *end <= column->lengths[level + 1];
+}
+
+// Adds a part to a geometry parsed in memory
+static int arrowSourcePart(gpkgGeometry *geom, int geometryType)
+{
+    if (!growGPKGGeometry(geom, 1, 0, 0))
+        return 0;
+    geom->parts[geom->numParts].geometryType = geometryType;
+    geom->parts[geom->numParts].firstRing = geom->numRings;
+    geom->parts[geom->numParts].numRings = 0;
+    geom->numParts++;
+    return 1;
+}
+
+// Adds the coordinates [start, end) of a GeoArrow column as a ring of the last part of a geometry parsed in memory
+static int arrowSourceRing(const arrowSource *column, sqlite3_int64 start, sqlite3_int64 end, gpkgGeometry *geom)
+{
+    int numPoints = (int)(end - start);
+    int dimension = geom->dimension;
+    double *coord;
+
+    if (end - start > 0x7fffffff / 4 || !growGPKGGeometry(geom, 0, 1, numPoints))
+        return 0;
+    geom->rings[geom->numRings].firstPoint = geom->numPoints;
+    geom->rings[geom->numRings].numPoints = numPoints;
+    geom->numRings++;
+    geom->parts[geom->numParts - 1].numRings++;
+    coord = &geom->coords[geom->numPoints * dimension];
+    if (column->sameLayout)
+        memcpy(coord, column->values[0] + start * dimension * 8, (size_t)numPoints * dimension * 8); // Same layout
+    else
+    {
+        for (sqlite3_int64 i = start; i < end; i++)
+        {
+            for (int j = 0; j < dimension; j++)
+            {
+                if (column->interleaved)
+                    memcpy(coord++, column->values[0] + (i * column->stride + column->ordinates[j]) * 8, 8);
+                else
+                    memcpy(coord++, column->values[column->ordinates[j]] + i * 8, 8);
+            }
+        }
+    }
+    geom->numPoints += numPoints;
+    return 1;
+}
+
+// Reads the geometry of a row of a GeoArrow native column into a geometry parsed in memory
+// The empty parts are not added: a Point with NaN coordinates, a LineString without coordinates, a Polygon without rings
+// Returns SQLITE_OK, SQLITE_NOMEM or SQLITE_CORRUPT if the offsets are not valid
+static int arrowSourceGeometry(const arrowSource *column, sqlite3_int64 row, gpkgGeometry *geom)
+{
+    sqlite3_int64 start, end, start1, end1, start2, end2;
+    double xy[2];
+
+    geom->geometryType = column->geometryType;
+    geom->srsId = column->srsId;
+    geom->hasZ = column->hasZ;
+    geom->hasM = column->hasM;
+    geom->dimension = 2 + column->hasZ + column->hasM;
+    geom->numParts = geom->numRings = geom->numPoints = 0;
+    if (column->geometryType == wkbPoint)
+    {
+        for (int j = 0; j < 2; j++)
+            memcpy(&xy[j], column->interleaved ? column->values[0] + (row * column->stride + column->ordinates[j]) * 8 :
+                                                 column->values[column->ordinates[j]] + row * 8, 8);
+        if (isnan(xy[0]) && isnan(xy[1]))
+            return SQLITE_OK;
+        return arrowSourcePart(geom, wkbPoint) && arrowSourceRing(column, row, row + 1, geom) ? SQLITE_OK : SQLITE_NOMEM;
+    }
+    if (!arrowSourceRange(column, 0, row, &start, &end))
+        return SQLITE_CORRUPT;
+    for (sqlite3_int64 i = start; i < end; i++)
+    {
+        switch (column->geometryType)
+        {
+        case wkbLineString:
+            // A single list of coordinates
+            if (!arrowSourcePart(geom, wkbLineString) || !arrowSourceRing(column, start, end, geom))
+                return SQLITE_NOMEM;
+            return SQLITE_OK;
+        case wkbMultiPoint:
+            if (!arrowSourcePart(geom, wkbPoint) || !arrowSourceRing(column, i, i + 1, geom))
+                return SQLITE_NOMEM;
+            break;
+        case wkbPolygon:
+            if (i == start && !arrowSourcePart(geom, wkbPolygon))
+                return SQLITE_NOMEM;
+            if (!arrowSourceRange(column, 1, i, &start1, &end1))
+                return SQLITE_CORRUPT;
+            if (!arrowSourceRing(column, start1, end1, geom))
+                return SQLITE_NOMEM;
+            break;
+        case wkbMultiLineString:
+            if (!arrowSourceRange(column, 1, i, &start1, &end1))
+                return SQLITE_CORRUPT;
+            if (start1 < end1 && (!arrowSourcePart(geom, wkbLineString) || !arrowSourceRing(column, start1, end1, geom)))
+                return SQLITE_NOMEM;
+            break;
+        case wkbMultiPolygon:
+            if (!arrowSourceRange(column, 1, i, &start1, &end1))
+                return SQLITE_CORRUPT;
+            if (start1 < end1 && !arrowSourcePart(geom, wkbPolygon))
+                return SQLITE_NOMEM;
+            for (sqlite3_int64 j = start1; j < end1; j++)
+            {
+                if (!arrowSourceRange(column, 2, j, &start2, &end2))
+                    return SQLITE_CORRUPT;
+                if (!arrowSourceRing(column, start2, end2, geom))
+                    return SQLITE_NOMEM;
+            }
+            break;
+        }
+    }
+    return SQLITE_OK;
+}
+
+// Encodes a geometry in WKB format in GPKG format, with the WKB unchanged after a header with its envelope
+// p_blob <-> Buffer of the GPKG geometry, reused between rows (allocated with sqlite3_realloc)
+// maxBytes <-> Size of the buffer
+// geom <- Geometry parsed, for its envelope
+// Returns the size of the GPKG geometry, 0 if the WKB is not valid or -1 if there is no memory
+static int arrowSourceWKB(const unsigned char *wkb, int n, int srsId, unsigned char **p_blob, int *maxBytes, gpkgGeometry *geom)
+{
+    int index = 0;
+    int size;
+
+    geom->geometryType = wkbGeometry;
+    geom->hasZ = geom->hasM = geom->dimension = 0;
+    geom->numParts = geom->numRings = geom->numPoints = 0;
+    if (!readWKBGeometry((unsigned char *)wkb, n, &index, endian(), wkbGeometry, geom))
+        return 0;
+    computeGPKGEnvelope(geom);
+    size = 8 + (geom->numParts > 0 ? 32 : 0) + n;
+    if (size > *maxBytes)
+    {
+        unsigned char *p = (unsigned char *)sqlite3_realloc(*p_blob, size);
+        if (p == NULL)
+            return -1;
+        *p_blob = p;
+        *maxBytes = size;
+    }
+    index = 0;
+    (*p_blob)[index++] = GPKG_MAGIC1;
+    (*p_blob)[index++] = GPKG_MAGIC2;
+    (*p_blob)[index++] = GPKG_VERSION;
+    (*p_blob)[index++] = (geom->numParts > 0 ? 0x01 << 1 : GPKG_EMPTY_BIT) | (endian() == LITTLE_ENDIAN ? GPKG_BYTEORDER_BIT : 0);
+    putInt(*p_blob, &index, srsId);
+    if (geom->numParts > 0)
+    {
+        putDouble(*p_blob, &index, geom->env[0]);
+        putDouble(*p_blob, &index, geom->env[2]);
+        putDouble(*p_blob, &index, geom->env[1]);
+        putDouble(*p_blob, &index, geom->env[3]);
+    }
+    memcpy(*p_blob + index, wkb, n);
+    return size;
+}
+
+// Binds the value of a row of a column to its parameter of the INSERT
+// geom <-> Geometry reused to encode the geometries
+// p_blob, maxBytes <-> Buffer reused to encode the geometries in WKB format
+// Returns SQLITE_OK, SQLITE_NOMEM or SQLITE_CORRUPT if the buffers are not valid
+static int arrowSourceBind(const arrowSource *column, sqlite3_int64 row, sqlite3_stmt *stmt, gpkgGeometry *geom, unsigned char **p_blob, int *maxBytes)
+{
+    int parameter = column->parameter;
+    sqlite3_int64 start = 0, end = 0;
+    unsigned char *blob;
+    int n;
+
+    if (column->validity != NULL && (column->validity[row >> 3] & (1 << (row & 7))) == 0)
+        return sqlite3_bind_null(stmt, parameter);
+    if (column->kind == ARROW_UTF8 || column->kind == ARROW_BINARY || column->kind == ARROW_WKB)
+    {
+        if (column->large)
+        {
+            memcpy(&start, column->offsets[0] + 8 * row, 8);
+            memcpy(&end, column->offsets[0] + 8 * row + 8, 8);
+        }
+        else
+        {
+            int offsets[2];
+            memcpy(offsets, column->offsets[0] + 4 * row, 8);
+            start = offsets[0];
+            end = offsets[1];
+        }
+        if (start < 0 || start > end || end > column->valuesSize || end - start > 0x7fffffff - 40)
+            return SQLITE_CORRUPT;
+    }
+    switch (column->kind)
+    {
+    case ARROW_INT64:
+        switch (column->bitWidth)
+        {
+        case 8:
+            return sqlite3_bind_int64(stmt, parameter, column->isSigned ? (sqlite3_int64)((const signed char *)column->values[0])[row] : column->values[0][row]);
+        case 16:
+        {
+            unsigned short value;
+            memcpy(&value, column->values[0] + 2 * row, 2);
+            return sqlite3_bind_int64(stmt, parameter, column->isSigned ? (sqlite3_int64)(short)value : value);
+        }
+        case 32:
+        {
+            unsigned int value;
+            memcpy(&value, column->values[0] + 4 * row, 4);
+            return sqlite3_bind_int64(stmt, parameter, column->isSigned ? (sqlite3_int64)(int)value : value);
+        }
+        default:
+        {
+            sqlite3_uint64 value;
+            memcpy(&value, column->values[0] + 8 * row, 8);
+            if (!column->isSigned && value > 0x7fffffffffffffffULL)
+                return sqlite3_bind_double(stmt, parameter, (double)value);
+            return sqlite3_bind_int64(stmt, parameter, (sqlite3_int64)value);
+        }
+        }
+    case ARROW_FLOAT64:
+        if (column->bitWidth == 32)
+        {
+            float value;
+            memcpy(&value, column->values[0] + 4 * row, 4);
+            return sqlite3_bind_double(stmt, parameter, value);
+        }
+        else
+        {
+            double value;
+            memcpy(&value, column->values[0] + 8 * row, 8);
+            return sqlite3_bind_double(stmt, parameter, value);
+        }
+    case ARROW_BOOL:
+        return sqlite3_bind_int(stmt, parameter, (column->values[0][row >> 3] >> (row & 7)) & 1);
+    case ARROW_UTF8:
+        return sqlite3_bind_text(stmt, parameter, end > start ? (const char *)column->values[0] + start : "", (int)(end - start), SQLITE_STATIC);
+    case ARROW_BINARY:
+        if (end == start)
+            return sqlite3_bind_zeroblob(stmt, parameter, 0);
+        return sqlite3_bind_blob(stmt, parameter, column->values[0] + start, (int)(end - start), SQLITE_STATIC);
+    case ARROW_WKB:
+        n = end > start ? arrowSourceWKB(column->values[0] + start, (int)(end - start), column->srsId, p_blob, maxBytes, geom) : 0;
+        if (n < 0)
+            return SQLITE_NOMEM;
+        if (n == 0)
+        {
+            geom->numParts = 0;
+            return sqlite3_bind_null(stmt, parameter); // Not valid WKB
+        }
+        return sqlite3_bind_blob(stmt, parameter, *p_blob, n, SQLITE_STATIC);
+    case ARROW_GEOMETRY:
+        n = arrowSourceGeometry(column, row, geom);
+        if (n != SQLITE_OK)
+            return n;
+        computeGPKGEnvelope(geom);
+        if (!writeGPKGGeometry(geom, 1, &blob, &n))
+            return SQLITE_NOMEM;
+        return sqlite3_bind_blob(stmt, parameter, blob, n, sqlite3_free);
+    }
+    return sqlite3_bind_null(stmt, parameter);
+}
+
+// Returns the SQL type of the column of a new table for an Arrow column
+static const char *arrowSourceType(const arrowSource *column)
+{
+    switch (column->kind)
+    {
+    case ARROW_INT64: return "INTEGER";
+    case ARROW_FLOAT64: return "DOUBLE";
+    case ARROW_BOOL: return "BOOLEAN";
+    case ARROW_UTF8: return "TEXT";
+    case ARROW_WKB: return "GEOMETRY";
+    case ARROW_GEOMETRY: return wktGeomtryTypes[column->geometryType];
+    }
+    return "BLOB";
+}
+
+// Cell of a node of a spatial index: rowid of the feature (or number of the child node) and its box rounded to float like the rtree module
+typedef struct rtreeCell
+{
+    sqlite3_int64 id;
+    sqlite3_int64 key; // Hilbert key of the center of the box, to sort the leaves
+    float box[6];      // minx, maxx, miny, maxy, minz, maxz
+} rtreeCell;
+
+// Compares two cells by their Hilbert key (qsort)
+static int compareRtreeCells(const void *a, const void *b)
+{
+    sqlite3_int64 ka = ((const rtreeCell *)a)->key, kb = ((const rtreeCell *)b)->key;
+    return ka < kb ? -1 : ka > kb;
+}
+
+// Compares two pairs (rowid, nodeno) by rowid (qsort)
+static int compareRtreeRowids(const void *a, const void *b)
+{
+    sqlite3_int64 ka = *(const sqlite3_int64 *)a, kb = *(const sqlite3_int64 *)b;
+    return ka < kb ? -1 : ka > kb;
+}
+
+// Rounds a double to the float not greater (down) or not less (up), like the rtree module
+static float rtreeValueDown(double d)
+{
+    float f = (float)d;
+    if (f > d)
+        f = (float)(d * (d < 0 ? 1.0 + 1.0 / 8388608.0 : 1.0 - 1.0 / 8388608.0));
+    return f;
+}
+static float rtreeValueUp(double d)
+{
+    float f = (float)d;
+    if (f < d)
+        f = (float)(d * (d < 0 ? 1.0 - 1.0 / 8388608.0 : 1.0 + 1.0 / 8388608.0));
+    return f;
+}
+
+// Writes the nodes of a level of a packed spatial index and returns the cells of the level above in the same array
+// cells <-> Cells of the level, and the cells that point to its nodes
+// numCells <-> Number of cells
+// firstNode -> Number of the first node of the level
+// insertChild -> Statement that inserts the parent of each child node (%_parent), or NULL for the leaves
+// rowids <- Pairs (rowid, nodeno) of the leaves, to be inserted into %_rowid sorted by rowid
+// Returns SQLITE_OK or an SQLite error code
+static int rtreeWriteLevel(rtreeCell *cells, sqlite3_int64 *numCells, sqlite3_int64 firstNode, int depth, int isRoot, int numCoords, int nodeSize,
+                           unsigned char *node, sqlite3_stmt *insertNode, sqlite3_stmt *insertChild, sqlite3_int64 *rowids)
+{
+    int maxCells = (nodeSize - 4) / (8 + 4 * numCoords);
+    sqlite3_int64 numNodes = 0;
+    int rc = SQLITE_OK;
+
+    for (sqlite3_int64 first = 0; first < *numCells && rc == SQLITE_OK; first += maxCells, numNodes++)
+    {
+        int n = *numCells - first < maxCells ? (int)(*numCells - first) : maxCells;
+        rtreeCell parent;
+        unsigned char *p = node + 4;
+
+        memset(node, 0, nodeSize);
+        node[0] = (unsigned char)(isRoot ? depth >> 8 : 0);
+        node[1] = (unsigned char)(isRoot ? depth : 0);
+        node[2] = (unsigned char)(n >> 8);
+        node[3] = (unsigned char)n;
+        parent.id = firstNode + numNodes;
+        memcpy(parent.box, cells[first].box, sizeof(parent.box));
+        for (int i = 0; i < n; i++)
+        {
+            rtreeCell *cell = &cells[first + i];
+            for (int j = 0; j < 8; j++)
+                *p++ = (unsigned char)(cell->id >> (56 - 8 * j));
+            for (int j = 0; j < numCoords; j++)
+            {
+                unsigned int bits;
+                memcpy(&bits, &cell->box[j], 4);
+                for (int k = 0; k < 4; k++)
+                    *p++ = (unsigned char)(bits >> (24 - 8 * k));
+                if ((j & 1) == 0 ? cell->box[j] < parent.box[j] : cell->box[j] > parent.box[j])
+                    parent.box[j] = cell->box[j];
+            }
+            if (insertChild == NULL)
+            {
+                rowids[2 * (first + i)] = cell->id;
+                rowids[2 * (first + i) + 1] = parent.id;
+                continue;
+            }
+            sqlite3_bind_int64(insertChild, 1, cell->id);
+            sqlite3_bind_int64(insertChild, 2, parent.id);
+            rc = sqlite3_step(insertChild);
+            sqlite3_reset(insertChild);
+            if (rc != SQLITE_DONE)
+                return rc;
+            rc = SQLITE_OK;
+        }
+        sqlite3_bind_int64(insertNode, 1, parent.id);
+        sqlite3_bind_blob(insertNode, 2, node, nodeSize, SQLITE_STATIC);
+        rc = sqlite3_step(insertNode);
+        sqlite3_reset(insertNode);
+        rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+        cells[numNodes] = parent; // The cells of the nodes written are not read again
+    }
+    *numCells = numNodes;
+    return rc;
+}
+
+// Populates the spatial index of a table with the boxes of new features, sorted by the Hilbert key of their center.
+// If the spatial index is empty, it's packed bottom-up with full nodes (a packed Hilbert R-tree) and its nodes are written
+// directly to the shadow tables of the rtree (%_node, %_rowid and %_parent). Else the boxes are inserted through the rtree in that order
+// table -> Name of the table
+// gcolumn -> Column that contains the geometry
+// zIndex -> 1 if the spatial index is 3D
+// cells -> Boxes of the features. They are sorted and overwritten
+// numCells -> Number of boxes
+// Returns SQLITE_OK or an SQLite error code
+static int rtreeBulkLoad(sqlite3 *db, const char *table, const char *gcolumn, int zIndex, rtreeCell *cells, sqlite3_int64 numCells)
+{
+    sqlite3_stmt *stmt = NULL, *insertNode = NULL, *insertChild = NULL;
+    sqlite3_int64 levelNodes[64];
+    sqlite3_int64 *rowids = NULL;
+    sqlite3_int64 numRowids = numCells;
+    unsigned char *node = NULL;
+    double ext[4] = { HUGE_VAL, HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+    int numCoords = zIndex ? 6 : 4;
+    int nodeSize = 0, numLevels;
+    char *sql;
+    int rc;
+
+    if (numCells == 0)
+        return SQLITE_OK;
+
+    // Sort the boxes by the Hilbert key of their centers in a grid over their extent
+    for (sqlite3_int64 i = 0; i < numCells; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            if (cells[i].box[2 * j] < ext[j]) ext[j] = cells[i].box[2 * j];
+            if (cells[i].box[2 * j + 1] > ext[j + 2]) ext[j + 2] = cells[i].box[2 * j + 1];
+        }
+    }
+    for (sqlite3_int64 i = 0; i < numCells; i++)
+        cells[i].key = hilbertKey(hilbertCell(((double)cells[i].box[0] + cells[i].box[1]) / 2, ext[0], ext[2]),
+                                  hilbertCell(((double)cells[i].box[2] + cells[i].box[3]) / 2, ext[1], ext[3]), HILBERT_ORDER);
+    qsort(cells, (size_t)numCells, sizeof(rtreeCell), compareRtreeCells);
+
+    // Is the spatial index empty? The size of its nodes is the size of the root
+    sql = sqlite3_mprintf("SELECT length(data), (SELECT count(*) FROM \"rtree_%w_%w_rowid\") FROM \"rtree_%w_%w_node\" WHERE nodeno = 1",
+        table, gcolumn, table, gcolumn);
+    rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+    if (rc == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int64(stmt, 1) == 0)
+            nodeSize = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (rc == SQLITE_OK && nodeSize < 4 + 2 * (8 + 4 * numCoords))
+    {
+        sql = sqlite3_mprintf("INSERT INTO \"rtree_%w_%w\" VALUES(?, ?, ?, ?, ?%s)", table, gcolumn, zIndex ? ", ?, ?" : "");
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+        sqlite3_free(sql);
+        for (sqlite3_int64 i = 0; i < numCells && rc == SQLITE_OK; i++)
+        {
+            sqlite3_bind_int64(stmt, 1, cells[i].id);
+            for (int j = 0; j < numCoords; j++)
+                sqlite3_bind_double(stmt, 2 + j, cells[i].box[j]);
+            rc = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+        }
+        sqlite3_finalize(stmt);
+        return rc;
+    }
+
+    // Nodes of each level. The root is the node 1 and the others are numbered from the top
+    levelNodes[0] = numCells;
+    for (numLevels = 1; numLevels == 1 || levelNodes[numLevels - 1] > 1; numLevels++)
+        levelNodes[numLevels] = (levelNodes[numLevels - 1] + (nodeSize - 4) / (8 + 4 * numCoords) - 1) / ((nodeSize - 4) / (8 + 4 * numCoords));
+    node = (unsigned char *)sqlite3_malloc(nodeSize);
+    rowids = (sqlite3_int64 *)sqlite3_malloc64(sizeof(sqlite3_int64) * 2 * numRowids);
+    sql = sqlite3_mprintf("INSERT OR REPLACE INTO \"rtree_%w_%w_node\"(nodeno, data) VALUES(?, ?)", table, gcolumn);
+    rc = sql == NULL || node == NULL || rowids == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &insertNode, NULL);
+    sqlite3_free(sql);
+    for (int level = 1; level < numLevels && rc == SQLITE_OK; level++)
+    {
+        sqlite3_int64 firstNode = 1;
+        for (int above = level + 1; above < numLevels; above++)
+            firstNode += levelNodes[above];
+        if (level > 1)
+        {
+            sql = sqlite3_mprintf("INSERT INTO \"rtree_%w_%w_parent\"(nodeno, parentnode) VALUES(?, ?)", table, gcolumn);
+            rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &insertChild, NULL);
+            sqlite3_free(sql);
+        }
+        if (rc == SQLITE_OK)
+            rc = rtreeWriteLevel(cells, &numCells, firstNode, numLevels - 2, level == numLevels - 1, numCoords, nodeSize, node, insertNode, insertChild, rowids);
+        sqlite3_finalize(insertChild);
+        insertChild = NULL;
+    }
+
+    // Leaf of each feature, inserted in order of rowid
+    sql = sqlite3_mprintf("INSERT INTO \"rtree_%w_%w_rowid\"(rowid, nodeno) VALUES(?, ?)", table, gcolumn);
+    if (rc == SQLITE_OK)
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &insertChild, NULL);
+    sqlite3_free(sql);
+    if (rc == SQLITE_OK)
+        qsort(rowids, (size_t)numRowids, sizeof(sqlite3_int64) * 2, compareRtreeRowids);
+    for (sqlite3_int64 i = 0; i < numRowids && rc == SQLITE_OK; i++)
+    {
+        sqlite3_bind_int64(insertChild, 1, rowids[2 * i]);
+        sqlite3_bind_int64(insertChild, 2, rowids[2 * i + 1]);
+        rc = sqlite3_step(insertChild);
+        sqlite3_reset(insertChild);
+        rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+    }
+    sqlite3_finalize(insertChild);
+    sqlite3_finalize(insertNode);
+    sqlite3_free(rowids);
+    sqlite3_free(node);
+    return rc;
+}
+
+// SQL function: GPKG_ImportArrow(path, tableName);
+// Inserts the rows of an Arrow IPC file (or stream) into a table, converting the GeoArrow geometry columns to GPKG format
+// path -> Path of the file. It's mapped in memory and the values are bound to the INSERT from the buffers of the record batches
+// tableName -> Name of the table. If it doesn't exist it's created with a column fid INTEGER PRIMARY KEY (an int column "fid" of the
+//              file is used as it) and a column by column of the file, and in a GeoPackage its first geometry column is registered
+//              (with the SRS of the EPSG code of the GeoArrow CRS, and the flags z and m of gpkg:zm, else the ones of its
+//              coordinates) with a spatial index. If it exists, the columns of the file are
+//              inserted into the columns with the same name, and its geometry column takes the first geometry column of the file
+//              if none has its name
+// The int, float, bool, utf8, binary (and large) columns are imported; the geometry columns are geoarrow.wkb or GeoArrow native
+// (point ... multipolygon) with interleaved or separated coordinates. The columns of other types are not imported.
+// The rows are inserted with one prepared statement in a savepoint: if there is an error nothing changes. The triggers of the
+// spatial index are dropped meanwhile and the envelopes of the geometries are loaded at the end (see rtreeBulkLoad)
+// On success returns the number of rows imported. If there is an error throw an exception
+static void fnct_GPKGImportArrow(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *path;
+    const char *table;
+    sqlite3 *db;
+    sqlite3_stmt *stmt = NULL;
+    mappedFile file;
+    flatTable message, schema, field;
+    arrowSource *columns = NULL;
+    sqlite3_int64 numColumns = 0, start;
+    int numNodes = 0, numBuffers = 0;
+    sqlite3_int64 position, body;
+    gpkgGeometry geom, other;
+    unsigned char *p_blob = NULL;
+    int maxBytes = 0;
+    char *gcolumn = NULL;
+    int geometrySource = -1;
+    int bound = 0;
+    int isGeoPackage = 0, exists = 0;
+    int rtreeColumns = 0;
+    char *triggers = NULL;
+    rtreeCell *cells = NULL;
+    sqlite3_int64 numCells = 0, maxCells = 0;
+    sqlite3_int64 numRows = 0;
+    const char *error = NULL;
+    char *sql = NULL;
+    int rc = SQLITE_OK, next;
+
+    // Get the parameters
+    path = (const char *)sqlite3_value_text(argv[0]);
+    table = (const char *)sqlite3_value_text(argv[1]);
+    if (path == NULL || table == NULL)
+    {
+        sqlite3_result_error(context, "GPKG_ImportArrow() error: arguments 1 and 2 [path, tableName] must be text", -1);
+        return;
+    }
+    if (!mapFile(path, &file))
+    {
+        sqlite3_result_error(context, "GPKG_ImportArrow() error: argument 1 [path] can't be opened", -1);
+        return;
+    }
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+    memset(&geom, 0, sizeof(gpkgGeometry));
+    memset(&other, 0, sizeof(gpkgGeometry));
+
+    // Schema: the first message of the stream, after the magic of a file
+    position = file.size >= 8 && memcmp(file.data, "ARROW1", 6) == 0 ? 8 : 0;
+    if (arrowNextMessage(file.data, file.size, &position, &message, &body) != 1 || flatGetInt(&message, 1, 1, 0) != ARROW_HEADER_SCHEMA ||
+        !flatGetTable(&message, 2, &schema) || !flatGetVector(&schema, 1, 4, &start, &numColumns))
+    {
+        error = "GPKG_ImportArrow() error: argument 1 [path] is not an Arrow IPC file";
+        goto end;
+    }
+    if (flatGetInt(&schema, 0, 2, 0) != (endian() == LITTLE_ENDIAN ? 0 : 1))
+    {
+        error = "GPKG_ImportArrow() error: the ENDIANESS of the file is not the one of the CPU";
+        goto end;
+    }
+    columns = (arrowSource *)sqlite3_malloc64(sizeof(arrowSource) * (numColumns + 1));
+    if (columns == NULL)
+    {
+        rc = SQLITE_NOMEM;
+        goto end;
+    }
+    memset(columns, 0, sizeof(arrowSource) * (numColumns + 1));
+    for (sqlite3_int64 i = 0; i < numColumns; i++)
+    {
+        if (!flatVectorTable(&schema, start, i, &field))
+            rc = SQLITE_ERROR;
+        else
+            rc = arrowSourceColumn(&field, &columns[i], &numNodes, &numBuffers);
+        if (rc != SQLITE_OK)
+        {
+            numColumns = i + 1;
+            if (rc == SQLITE_ERROR)
+                error = "GPKG_ImportArrow() error: the file has a column with a type whose layout is not supported";
+            goto end;
+        }
+        if (geometrySource < 0 && (columns[i].kind == ARROW_WKB || columns[i].kind == ARROW_GEOMETRY))
+            geometrySource = (int)i;
+    }
+
+    if (sqlite3_exec(db, "SAVEPOINT gpkg_bulk", NULL, NULL, NULL) != SQLITE_OK)
+    {
+        rc = SQLITE_ERROR;
+        goto end;
+    }
+    rc = sqlite3_prepare_v2(db, "SELECT (SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = 'gpkg_geometry_columns'), "
+                                "(SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = ?)", -1, &stmt, NULL);
+    if (rc == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt) == SQLITE_ROW ? SQLITE_OK : sqlite3_errcode(db);
+        isGeoPackage = sqlite3_column_int(stmt, 0);
+        exists = sqlite3_column_int(stmt, 1);
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+    }
+
+    // Create the table
+    if (rc == SQLITE_OK && !exists)
+    {
+        int first = 0; // 1 while no column has been added
+        for (sqlite3_int64 i = 0; i < numColumns; i++)
+        {
+            if (columns[i].kind == ARROW_INT64 && sqlite3_stricmp(columns[i].name, "fid") == 0)
+                first = 1;
+        }
+        sql = sqlite3_mprintf("CREATE TABLE \"%w\"(%s", table, first ? "" : "fid INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL");
+        for (sqlite3_int64 i = 0; i < numColumns && sql != NULL; i++)
+        {
+            if (columns[i].kind != 0)
+            {
+                int isFid = columns[i].kind == ARROW_INT64 && sqlite3_stricmp(columns[i].name, "fid") == 0;
+                sql = sqlite3_mprintf("%z%s\"%w\" %s", sql, first ? "" : ", ", columns[i].name, isFid ? "INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL" : arrowSourceType(&columns[i]));
+                first = 0;
+            }
+        }
+        sql = sqlite3_mprintf("%z)", sql);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_exec(db, sql, NULL, NULL, NULL);
+        sqlite3_free(sql);
+        if (rc == SQLITE_OK && isGeoPackage && geometrySource >= 0)
+        {
+            arrowSource *column = &columns[geometrySource];
+            sql = sqlite3_mprintf("SELECT GPKG_AddGeometryColumn(%Q, %Q, %Q, '%s', %d, %d, %d); SELECT GPKG_AddSpatialIndex(%Q, %Q, 'fid')",
+                table, table, column->name, column->kind == ARROW_GEOMETRY ? wktGeomtryTypes[column->geometryType] : "GEOMETRY",
+                column->srsId, column->z >= 0 ? column->z : column->hasZ, column->m >= 0 ? column->m : column->hasM, table, column->name);
+            rc = sql == NULL ? SQLITE_NOMEM : sqlite3_exec(db, sql, NULL, NULL, NULL);
+            sqlite3_free(sql);
+        }
+    }
+
+    // Geometry column of the table and its SRS
+    if (rc == SQLITE_OK && isGeoPackage)
+    {
+        rc = sqlite3_prepare_v2(db, "SELECT column_name, srs_id FROM gpkg_geometry_columns WHERE table_name = ?", -1, &stmt, NULL);
+        if (rc == SQLITE_OK)
+        {
+            sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+            if (sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                gcolumn = sqlite3_mprintf("%s", sqlite3_column_text(stmt, 0));
+                if (gcolumn == NULL)
+                    rc = SQLITE_NOMEM;
+                for (sqlite3_int64 i = 0; i < numColumns; i++)
+                {
+                    if (columns[i].kind == ARROW_WKB || columns[i].kind == ARROW_GEOMETRY)
+                        columns[i].srsId = sqlite3_column_int(stmt, 1);
+                }
+            }
+            sqlite3_finalize(stmt);
+            stmt = NULL;
+        }
+    }
+
+    // Columns of the table
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, "SELECT name FROM pragma_table_info(?)", -1, &stmt, NULL);
+    if (rc == SQLITE_OK)
+    {
+        int numParameters = 0;
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            const char *name = (const char *)sqlite3_column_text(stmt, 0);
+            for (sqlite3_int64 i = 0; i < numColumns; i++)
+            {
+                if (columns[i].kind != 0 && columns[i].parameter == 0 && sqlite3_stricmp(columns[i].name, name) == 0)
+                {
+                    columns[i].parameter = ++numParameters;
+                    if (gcolumn != NULL && sqlite3_stricmp(name, gcolumn) == 0)
+                    {
+                        bound = 1;
+                        if (columns[i].kind == ARROW_WKB || columns[i].kind == ARROW_GEOMETRY)
+                            geometrySource = (int)i;
+                        else
+                            geometrySource = -1;
+                    }
+                    break;
+                }
+            }
+        }
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+        rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+        if (rc == SQLITE_OK && gcolumn != NULL && !bound && geometrySource >= 0 && columns[geometrySource].parameter == 0)
+        {
+            // None of the geometry columns of the file has the name of the geometry column of the table
+            columns[geometrySource].parameter = ++numParameters;
+            sqlite3_free(columns[geometrySource].name);
+            columns[geometrySource].name = sqlite3_mprintf("%s", gcolumn);
+            if (columns[geometrySource].name == NULL)
+                rc = SQLITE_NOMEM;
+        }
+        if (rc == SQLITE_OK && numParameters == 0)
+        {
+            error = "GPKG_ImportArrow() error: the table doesn't exist or it has none of the columns";
+            rc = SQLITE_ERROR;
+        }
+    }
+    if (gcolumn == NULL || (geometrySource >= 0 && columns[geometrySource].parameter == 0))
+        geometrySource = -1; // The geometries are not indexed
+
+    // INSERT
+    if (rc == SQLITE_OK)
+    {
+        char *values = sqlite3_mprintf("");
+        sql = sqlite3_mprintf("INSERT INTO \"%w\"(", table);
+        for (sqlite3_int64 i = 0, n = 0; i < numColumns && sql != NULL && values != NULL; i++)
+        {
+            if (columns[i].parameter == 0)
+                continue;
+            sql = sqlite3_mprintf("%z%s\"%w\"", sql, n > 0 ? ", " : "", columns[i].name);
+            values = sqlite3_mprintf("%z%s?%d", values, n > 0 ? ", " : "", columns[i].parameter);
+            n++;
+        }
+        sql = sql == NULL || values == NULL ? NULL : sqlite3_mprintf("%z) VALUES(%s)", sql, values);
+        sqlite3_free(values);
+        rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+        sqlite3_free(sql);
+    }
+
+    // The spatial index is populated at the end
+    if (rc == SQLITE_OK && geometrySource >= 0)
+    {
+        sqlite3_stmt *rtree;
+        sql = sqlite3_mprintf("SELECT * FROM \"rtree_%w_%w\"", table, gcolumn);
+        if (sql == NULL)
+            rc = SQLITE_NOMEM;
+        else if (sqlite3_prepare_v2(db, sql, -1, &rtree, NULL) == SQLITE_OK)
+        {
+            rtreeColumns = sqlite3_column_count(rtree);
+            sqlite3_finalize(rtree);
+            rc = dropSpatialIndexTriggers(db, table, gcolumn, &triggers);
+        }
+        sqlite3_free(sql);
+    }
+
+    // Record batches
+    while (rc == SQLITE_OK && (next = arrowNextMessage(file.data, file.size, &position, &message, &body)) != 0)
+    {
+        flatTable recordBatch, compression;
+        arrowSourceBatch batch;
+        sqlite3_int64 nodesStart, nodesNum, buffersStart, buffersNum;
+        int valid;
+
+        if (next < 0)
+        {
+            error = "GPKG_ImportArrow() error: the file is not valid";
+            rc = SQLITE_ERROR;
+            break;
+        }
+        if (flatGetInt(&message, 1, 1, 0) != ARROW_HEADER_RECORD_BATCH)
+            continue; // Dictionaries of the columns not imported
+        valid = flatGetTable(&message, 2, &recordBatch) && flatGetVector(&recordBatch, 1, 16, &nodesStart, &nodesNum) &&
+                flatGetVector(&recordBatch, 2, 16, &buffersStart, &buffersNum) && nodesNum == numNodes && buffersNum == numBuffers;
+        if (!valid)
+        {
+            error = "GPKG_ImportArrow() error: the file has a record batch that is not valid";
+            rc = SQLITE_ERROR;
+            break;
+        }
+        if (flatGetTable(&recordBatch, 3, &compression))
+        {
+            error = "GPKG_ImportArrow() error: the compressed record batches are not supported";
+            rc = SQLITE_ERROR;
+            break;
+        }
+        batch.body = file.data + body;
+        batch.bodyLength = position - body;
+        batch.nodes = recordBatch.buf + nodesStart;
+        batch.buffers = recordBatch.buf + buffersStart;
+        batch.length = flatGetInt(&recordBatch, 0, 8, 0);
+        for (sqlite3_int64 i = 0; valid && i < numBuffers; i++)
+        {
+            sqlite3_int64 offset = (sqlite3_int64)flatRead(batch.buffers + 16 * i, 8);
+            sqlite3_int64 length = (sqlite3_int64)flatRead(batch.buffers + 16 * i + 8, 8);
+            valid = offset >= 0 && length >= 0 && offset <= batch.bodyLength && length <= batch.bodyLength - offset;
+        }
+        for (sqlite3_int64 i = 0; valid && i < numColumns; i++)
+            valid = columns[i].parameter == 0 || arrowSourceLoad(&columns[i], &batch);
+        if (!valid || batch.length < 0)
+        {
+            error = "GPKG_ImportArrow() error: the file has a record batch that is not valid";
+            rc = SQLITE_ERROR;
+            break;
+        }
+
+        for (sqlite3_int64 row = 0; row < batch.length && rc == SQLITE_OK; row++)
+        {
+            geom.numParts = 0;
+            for (sqlite3_int64 i = 0; i < numColumns && rc == SQLITE_OK; i++)
+            {
+                if (columns[i].parameter != 0)
+                    rc = arrowSourceBind(&columns[i], row, stmt, (int)i == geometrySource ? &geom : &other, &p_blob, &maxBytes);
+            }
+            if (rc == SQLITE_CORRUPT)
+                error = "GPKG_ImportArrow() error: the file has a geometry or a value that is not valid";
+            if (rc != SQLITE_OK)
+                break;
+            rc = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            if (rc != SQLITE_DONE)
+                break;
+            rc = SQLITE_OK;
+            numRows++;
+
+            // Box of the geometry for the spatial index
+            if (rtreeColumns > 0 && geom.numParts > 0)
+            {
+                double minZ = HUGE_VAL, maxZ = -HUGE_VAL;
+                rtreeCell *cell;
+                if (numCells == maxCells)
+                {
+                    rtreeCell *p = (rtreeCell *)sqlite3_realloc64(cells, sizeof(rtreeCell) * (maxCells * 2 + 1024));
+                    if (p == NULL)
+                    {
+                        rc = SQLITE_NOMEM;
+                        break;
+                    }
+                    cells = p;
+                    maxCells = maxCells * 2 + 1024;
+                }
+                for (int j = 0; geom.hasZ && j < geom.numPoints; j++)
+                {
+                    double z = geom.coords[j * geom.dimension + 2];
+                    if (z < minZ) minZ = z;
+                    if (z > maxZ) maxZ = z;
+                }
+                if (minZ > maxZ)
+                    minZ = maxZ = 0; // Like rtreeZValues
+                cell = &cells[numCells++];
+                cell->id = sqlite3_last_insert_rowid(db);
+                cell->box[0] = rtreeValueDown(geom.env[0]);
+                cell->box[1] = rtreeValueUp(geom.env[2]);
+                cell->box[2] = rtreeValueDown(geom.env[1]);
+                cell->box[3] = rtreeValueUp(geom.env[3]);
+                cell->box[4] = rtreeValueDown(minZ);
+                cell->box[5] = rtreeValueUp(maxZ);
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+
+    // Populate the spatial index and create its triggers again
+    if (rc == SQLITE_OK && rtreeColumns > 0)
+    {
+        rc = rtreeBulkLoad(db, table, gcolumn, rtreeColumns > 5, cells, numCells);
+        if (rc == SQLITE_OK)
+            rc = sqlite3_exec(db, triggers, NULL, NULL, NULL);
+    }
+    if (error != NULL)
+        sqlite3_exec(db, "ROLLBACK TO gpkg_bulk; RELEASE gpkg_bulk", NULL, NULL, NULL);
+    else
+    {
+        endBulkSavepoint(context, db, rc, "GPKG_ImportArrow");
+        if (rc == SQLITE_OK)
+            sqlite3_result_int64(context, numRows);
+        rc = SQLITE_OK;
+    }
+
+end:
+    for (sqlite3_int64 i = 0; columns != NULL && i < numColumns; i++)
+        sqlite3_free(columns[i].name);
+    sqlite3_free(columns);
+    sqlite3_free(gcolumn);
+    sqlite3_free(triggers);
+    sqlite3_free(cells);
+    sqlite3_free(p_blob);
+    freeGPKGGeometry(&geom);
+    freeGPKGGeometry(&other);
+    unmapFile(&file);
+    if (error != NULL)
+        sqlite3_result_error(context, error, -1);
+    else if (rc == SQLITE_NOMEM)
+        sqlite3_result_error_nomem(context);
+    else if (rc != SQLITE_OK)
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+}
+
+// Returns the SQL expression that computes the Hilbert key of a Point of the point index
+// It's allocated with sqlite3_mprintf so it can be consumed with the %z format
+// prefix -> Prefix of the geometry column ("NEW." or "OLD." inside the triggers, "" when populating the point index)
+// gcolumn -> Column that contains the geometry
+// ext -> Extent of the point index (minX, minY, maxX, maxY)
+static char *pointIndexKeySQL(const char *prefix, const char *gcolumn, const double *ext)
+{
+    return sqlite3_mprintf("GPKG_HilbertKey(ST_X(%s\"%w\"), ST_Y(%s\"%w\"), %!.17g, %!.17g, %!.17g, %!.17g)",
+        prefix, gcolumn, prefix, gcolumn, ext[0], ext[1], ext[2], ext[3]);
+}
+
+// Reads the extent of a point index from gpkgext_point_index
+// db -> sqlite3
+// table -> Name of the table
+// gcolumn -> Column that contains the geometry
+// ext <- Extent of the point index (minX, minY, maxX, maxY)
+// Returns SQLITE_OK if it's correct, SQLITE_NOTFOUND if the point index doesn't exist or an SQLite error code
+static int readPointIndexExtent(sqlite3 *db, const char *table, const char *gcolumn, double *ext)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    rc = sqlite3_prepare_v2(db, "SELECT min_x, min_y, max_x, max_y FROM gpkgext_point_index WHERE LOWER(table_name) = LOWER(?1) AND LOWER(column_name) = LOWER(?2)", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+        return rc;
+    sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, gcolumn, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW)
+    {
+        for (int i = 0; i < 4; i++)
+            ext[i] = sqlite3_column_double(stmt, i);
+        rc = SQLITE_OK;
+    }
+    else if (rc == SQLITE_DONE)
+        rc = SQLITE_NOTFOUND;
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Gets the extent of the Hilbert grid of a point index or a point overview from the arguments or from the Points of the table
+// context -> sqlite3_context of the SQL function, receives the error
+// db -> sqlite3
+// table -> Name of the table
+// gcolumn -> Column that contains the geometry
+// argc, argv -> Arguments of the SQL function. If there are 4 arguments from first they are the extent (minX, minY, maxX, maxY)
+// first -> Index of the first argument of the extent
+// name -> Name of the SQL function for the error messages
+// ext <- Extent of the grid. An empty width or height is widened to 1
+// Returns SQLITE_OK if it's correct or an SQLite error code (the error is the result of the context)
+static int readHilbertGridExtent(sqlite3_context *context, sqlite3 *db, const char *table, const char *gcolumn, int argc, sqlite3_value **argv, int first, const char *name, double *ext)
+{
+    sqlite3_stmt *stmt;
+    char *sql;
+    int rc;
+
+    if (argc == first + 4)
+    {
+        for (int i = 0; i < 4; i++)
+            ext[i] = sqlite3_value_double(argv[first + i]);
+        if (!(ext[2] >= ext[0]) || !(ext[3] >= ext[1]))
+        {
+            sql = sqlite3_mprintf("%s() error: arguments %d to %d [minX, minY, maxX, maxY] are not a valid extent", name, first + 1, first + 4);
+            sqlite3_result_error(context, sql, -1);
+            sqlite3_free(sql);
+            return SQLITE_ERROR;
+        }
+    }
+    else
+    {
+        sql = sqlite3_mprintf("SELECT MIN(ST_X(\"%w\")), MIN(ST_Y(\"%w\")), MAX(ST_X(\"%w\")), MAX(ST_Y(\"%w\")) FROM \"%w\"",
+            gcolumn, gcolumn, gcolumn, gcolumn, table);
+        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+        sqlite3_free(sql);
+        if (rc != SQLITE_OK)
+        {
+            sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+            return rc;
+        }
+        rc = sqlite3_step(stmt);
+        if (rc != SQLITE_ROW || sqlite3_column_type(stmt, 0) == SQLITE_NULL)
+        {
+            sqlite3_finalize(stmt);
+            sql = sqlite3_mprintf("%s() error: the table has no Points, the extent must be specified", name);
+            sqlite3_result_error(context, sql, -1);
+            sqlite3_free(sql);
+            return SQLITE_ERROR;
+        }
+        for (int i = 0; i < 4; i++)
+            ext[i] = sqlite3_column_double(stmt, i);
+        sqlite3_finalize(stmt);
+    }
+    // The grid can't have an empty extent
+    if (ext[2] == ext[0])
+    {
+        ext[0] -= 0.5;
+        ext[2] += 0.5;
+    }
+    if (ext[3] == ext[1])
+    {
+        ext[1] -= 0.5;
+        ext[3] += 0.5;
+    }
+    return SQLITE_OK;
+}
+
+// SQL function: GPKG_AddPointIndex(tableName, geometryColumn, idColumn, minX, minY, maxX, maxY); 
+// Creates a point index of a POINT table and the corresponding triggers to maintain the integrity between the point index and the table
+// The point index is a table sorted by the Hilbert key of the Points that stores the coordinates once (an rtree stores them twice, as min and max)
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// idColumn -> Column that is the PrimaryKey of the table
+// minX, minY, maxX, maxY -> optional parameters. Extent of the Hilbert grid. If not specified assumes the extent of the Points of the table.
+//                           Points outside the extent are indexed in the border cells of the grid
+// The point index created is called pointidx_tableName_geometryColumn and its extent is stored in gpkgext_point_index
+// The triggers are called pointidx_tableName_geometryColumn_insert, pointidx_tableName_geometryColumn_update, pointidx_tableName_geometryColumn_delete
+// Populates the point index
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGAddPointIndex(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    const char *icolumn;
+    double ext[4];
+    sqlite3 *db;
+    char *sql, *errsql;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    icolumn = (const char *)sqlite3_value_text(argv[2]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Get the extent of the Hilbert grid
+    if (readHilbertGridExtent(context, db, table, gcolumn, argc, argv, 3, "GPKG_AddPointIndex", ext) != SQLITE_OK)
+        return;
+
+    // Create the metadata table of the point indexes
+    sql = sqlite3_mprintf("CREATE TABLE IF NOT EXISTS gpkgext_point_index(\n   table_name TEXT NOT NULL,\n   column_name TEXT NOT NULL,\n   min_x DOUBLE NOT NULL,\n   min_y DOUBLE NOT NULL,\n   max_x DOUBLE NOT NULL,\n   max_y DOUBLE NOT NULL,\n   CONSTRAINT pk_gpi PRIMARY KEY(table_name, column_name)\n)");
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Create the point index. The primary key keeps it sorted by the Hilbert key and covers the queries
+    sql = sqlite3_mprintf("CREATE TABLE \"pointidx_%w_%w\"(\n   hkey INTEGER NOT NULL,\n   id INTEGER NOT NULL,\n   x DOUBLE NOT NULL,\n   y DOUBLE NOT NULL,\n   PRIMARY KEY(hkey, id)\n) WITHOUT ROWID",
+        table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Conditions: Insertion of a non-empty Point
+    //    Actions: Insert record into the point index
+    sql = sqlite3_mprintf("CREATE TRIGGER \"pointidx_%w_%w_insert\" AFTER INSERT ON \"%w\" WHEN ST_X(NEW.\"%w\") NOT NULL\nBEGIN\n   INSERT OR REPLACE INTO \"pointidx_%w_%w\" VALUES (%z, NEW.\"%w\", ST_X(NEW.\"%w\"), ST_Y(NEW.\"%w\"));\nEND;",
+        table, gcolumn, table, gcolumn, table, gcolumn, pointIndexKeySQL("NEW.", gcolumn, ext), icolumn, gcolumn, gcolumn);
+    errsql = sqlite3_mprintf("DROP TABLE \"pointidx_%w_%w\"",
+        table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Update of the geometry column or the row ID
+    //    Actions: Remove record from the point index for the old Point
+    //             Insert record into the point index for the new Point if it is not empty
+    sql = sqlite3_mprintf("CREATE TRIGGER \"pointidx_%w_%w_update\" AFTER UPDATE OF \"%w\", \"%w\" ON \"%w\"\nBEGIN\n   DELETE FROM \"pointidx_%w_%w\" WHERE hkey = %z AND id = OLD.\"%w\";\n   INSERT OR REPLACE INTO \"pointidx_%w_%w\" SELECT %z, NEW.\"%w\", ST_X(NEW.\"%w\"), ST_Y(NEW.\"%w\") WHERE ST_X(NEW.\"%w\") NOT NULL;\nEND;",
+        table, gcolumn, gcolumn, icolumn, table, table, gcolumn, pointIndexKeySQL("OLD.", gcolumn, ext), icolumn, table, gcolumn, pointIndexKeySQL("NEW.", gcolumn, ext), icolumn, gcolumn, gcolumn, gcolumn);
+    errsql = sqlite3_mprintf("DROP TRIGGER \"pointidx_%w_%w_insert\"; DROP TABLE \"pointidx_%w_%w\"",
+        table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Row deleted
+    //    Actions: Remove record from the point index for the old Point
+    sql = sqlite3_mprintf("CREATE TRIGGER \"pointidx_%w_%w_delete\" AFTER DELETE ON \"%w\" WHEN ST_X(OLD.\"%w\") NOT NULL\nBEGIN\n   DELETE FROM \"pointidx_%w_%w\" WHERE hkey = %z AND id = OLD.\"%w\";\nEND;",
+        table, gcolumn, table, gcolumn, table, gcolumn, pointIndexKeySQL("OLD.", gcolumn, ext), icolumn);
+    errsql = sqlite3_mprintf("DROP TRIGGER \"pointidx_%w_%w_update\"; DROP TRIGGER \"pointidx_%w_%w_insert\"; DROP TABLE \"pointidx_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Register the extent
+    sql = sqlite3_mprintf("INSERT OR REPLACE INTO gpkgext_point_index(table_name, column_name, min_x, min_y, max_x, max_y) VALUES(%Q, %Q, %!.17g, %!.17g, %!.17g, %!.17g)",
+        table, gcolumn, ext[0], ext[1], ext[2], ext[3]);
+    errsql = sqlite3_mprintf("DROP TRIGGER \"pointidx_%w_%w_delete\"; DROP TRIGGER \"pointidx_%w_%w_update\"; DROP TRIGGER \"pointidx_%w_%w_insert\"; DROP TABLE \"pointidx_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Populate the point index in Hilbert order
+    sql = sqlite3_mprintf("INSERT OR REPLACE INTO \"pointidx_%w_%w\" SELECT %z, \"%w\", ST_X(\"%w\"), ST_Y(\"%w\") FROM \"%w\" WHERE ST_X(\"%w\") NOT NULL ORDER BY 1, 2",
+        table, gcolumn, pointIndexKeySQL("", gcolumn, ext), icolumn, gcolumn, gcolumn, table, gcolumn);
+    errsql = sqlite3_mprintf("DELETE FROM gpkgext_point_index WHERE table_name = %Q AND column_name = %Q; DROP TRIGGER \"pointidx_%w_%w_delete\"; DROP TRIGGER \"pointidx_%w_%w_update\"; DROP TRIGGER \"pointidx_%w_%w_insert\"; DROP TABLE \"pointidx_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+}
+
+// SQL function: GPKG_DropPointIndex(tableName, geometryColumn); 
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// Drops a point index of a table and the corresponding triggers to maintain the integrity between the point index and the table
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGDropPointIndex(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    sqlite3 *db;
+    char *sql;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Drop triggers and point index
+    sql = sqlite3_mprintf("DROP TRIGGER \"pointidx_%w_%w_delete\"; DROP TRIGGER \"pointidx_%w_%w_update\"; DROP TRIGGER \"pointidx_%w_%w_insert\"; DROP TABLE \"pointidx_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Remove the extent
+    sql = sqlite3_mprintf("DELETE FROM gpkgext_point_index WHERE LOWER(table_name) = LOWER(%Q) AND LOWER(column_name) = LOWER(%Q)",
+        table, gcolumn);
+    sqlite3_exec_free(context, db, sql, NULL);
+}
+
+// Returns the SQL that drops the tables of a point overview, allocated with sqlite3_mprintf
+// table -> Name of the table
+// gcolumn -> Column that contains the geometry
+// numZooms -> Number of tables to drop from zoom 0
+// triggers -> 1 to drop also the triggers
+static char *pointOverviewDropSQL(const char *table, const char *gcolumn, int numZooms, int triggers)
+{
+    char *sql;
+
+    if (triggers)
+        sql = sqlite3_mprintf("DROP TRIGGER \"pointov_%w_%w_delete\"; DROP TRIGGER \"pointov_%w_%w_update\"; DROP TRIGGER \"pointov_%w_%w_insert\";",
+            table, gcolumn, table, gcolumn, table, gcolumn);
+    else
+        sql = sqlite3_mprintf("");
+    for (int z = 0; z < numZooms && sql != NULL; z++)
+        sql = sqlite3_mprintf("%z DROP TABLE \"pointov_%w_%w_%d\";", sql, table, gcolumn, z);
+    return sql;
+}
+
+// SQL function: GPKG_CreatePointOverview(tableName, geometryColumn, maxZoom); GPKG_CreatePointOverview(tableName, geometryColumn, maxZoom, minX, minY, maxX, maxY); 
+// Creates the point overview of a POINT table: the number of Points and their centroid by cell of a grid for each zoom from 0 to maxZoom,
+// and the corresponding triggers to maintain it when the table changes
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// maxZoom -> Deepest zoom, between 0 and 16. The grid of zoom z has 2^z x 2^z cells
+// minX, minY, maxX, maxY -> optional parameters. Extent of the grid. If not specified assumes the extent of the Points of the table.
+//                           Points outside the extent are counted in the border cells of the grid
+// The tables created are called pointov_tableName_geometryColumn_z (cell, count, x, y) where cell is the Hilbert key of the cell at order z
+// (GPKG_HilbertKey(x, y, minX, minY, maxX, maxY) >> (2 * (16 - z))) and x, y the centroid of its Points. The point overview is registered in gpkgext_point_overview
+// The triggers pointov_tableName_geometryColumn_insert, pointov_tableName_geometryColumn_update, pointov_tableName_geometryColumn_delete
+// insert the old and new Points into GPKG_PointOverviewUpdate, that parses each Point once and updates its cell of every zoom
+// Populates the point overview grouping the Points in the deepest zoom and each zoom from the next one
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGCreatePointOverview(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    int maxZoom;
+    double ext[4];
+    sqlite3 *db;
+    char *sql, *errsql;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    maxZoom = sqlite3_value_int(argv[2]);
+    if (sqlite3_value_type(argv[2]) != SQLITE_INTEGER || maxZoom < 0 || maxZoom > HILBERT_ORDER)
+    {
+        sqlite3_result_error(context, "GPKG_CreatePointOverview() error: argument 3 [maxZoom] must be an integer between 0 and 16", -1);
+        return;
+    }
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Get the extent of the grid
+    if (readHilbertGridExtent(context, db, table, gcolumn, argc, argv, 3, "GPKG_CreatePointOverview", ext) != SQLITE_OK)
+        return;
+
+    // Create the metadata table of the point overviews
+    sql = sqlite3_mprintf("CREATE TABLE IF NOT EXISTS gpkgext_point_overview(\n   table_name TEXT NOT NULL,\n   column_name TEXT NOT NULL,\n   max_zoom INTEGER NOT NULL,\n   min_x DOUBLE NOT NULL,\n   min_y DOUBLE NOT NULL,\n   max_x DOUBLE NOT NULL,\n   max_y DOUBLE NOT NULL,\n   CONSTRAINT pk_gpo PRIMARY KEY(table_name, column_name)\n)");
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Create a table by zoom
+    for (int z = 0; z <= maxZoom; z++)
+    {
+        sql = sqlite3_mprintf("CREATE TABLE \"pointov_%w_%w_%d\"(\n   cell INTEGER PRIMARY KEY,\n   count INTEGER NOT NULL,\n   x DOUBLE NOT NULL,\n   y DOUBLE NOT NULL\n)",
+            table, gcolumn, z);
+        errsql = pointOverviewDropSQL(table, gcolumn, z, 0);
+        if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+            return;
+    }
+
+    // Populate the deepest zoom grouping the Points by cell and each zoom from the next one
+    sql = sqlite3_mprintf("INSERT INTO \"pointov_%w_%w_%d\" SELECT %z >> %d AS cell, COUNT(*), AVG(ST_X(\"%w\")), AVG(ST_Y(\"%w\")) FROM \"%w\" WHERE ST_X(\"%w\") NOT NULL GROUP BY cell",
+        table, gcolumn, maxZoom, pointIndexKeySQL("", gcolumn, ext), 2 * (HILBERT_ORDER - maxZoom), gcolumn, gcolumn, table, gcolumn);
+    errsql = pointOverviewDropSQL(table, gcolumn, maxZoom + 1, 0);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+    for (int z = maxZoom - 1; z >= 0; z--)
+    {
+        sql = sqlite3_mprintf("INSERT INTO \"pointov_%w_%w_%d\" SELECT cell >> 2 AS parent, SUM(count), SUM(x * count) / SUM(count), SUM(y * count) / SUM(count) FROM \"pointov_%w_%w_%d\" GROUP BY parent",
+            table, gcolumn, z, table, gcolumn, z + 1);
+        errsql = pointOverviewDropSQL(table, gcolumn, maxZoom + 1, 0);
+        if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+            return;
+    }
+
+    // Register the point overview
+    sql = sqlite3_mprintf("INSERT OR REPLACE INTO gpkgext_point_overview(table_name, column_name, max_zoom, min_x, min_y, max_x, max_y) VALUES(%Q, %Q, %d, %!.17g, %!.17g, %!.17g, %!.17g)",
+        table, gcolumn, maxZoom, ext[0], ext[1], ext[2], ext[3]);
+    errsql = pointOverviewDropSQL(table, gcolumn, maxZoom + 1, 0);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Insertion of a row
+    //    Actions: Add the new Point to its cells
+    sql = sqlite3_mprintf("CREATE TRIGGER \"pointov_%w_%w_insert\" AFTER INSERT ON \"%w\" WHEN NEW.\"%w\" NOT NULL\nBEGIN\n   INSERT INTO GPKG_PointOverviewUpdate VALUES(%Q, %Q, NULL, NEW.\"%w\");\nEND;",
+        table, gcolumn, table, gcolumn, table, gcolumn, gcolumn);
+    errsql = sqlite3_mprintf("DELETE FROM gpkgext_point_overview WHERE table_name = %Q AND column_name = %Q; %z",
+        table, gcolumn, pointOverviewDropSQL(table, gcolumn, maxZoom + 1, 0));
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Update of the geometry column
+    //    Actions: Remove the old Point from its cells and add the new Point to its cells
+    sql = sqlite3_mprintf("CREATE TRIGGER \"pointov_%w_%w_update\" AFTER UPDATE OF \"%w\" ON \"%w\"\nBEGIN\n   INSERT INTO GPKG_PointOverviewUpdate VALUES(%Q, %Q, OLD.\"%w\", NEW.\"%w\");\nEND;",
+        table, gcolumn, gcolumn, table, table, gcolumn, gcolumn, gcolumn);
+    errsql = sqlite3_mprintf("DELETE FROM gpkgext_point_overview WHERE table_name = %Q AND column_name = %Q; DROP TRIGGER \"pointov_%w_%w_insert\"; %z",
+        table, gcolumn, table, gcolumn, pointOverviewDropSQL(table, gcolumn, maxZoom + 1, 0));
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Row deleted
+    //    Actions: Remove the old Point from its cells
+    sql = sqlite3_mprintf("CREATE TRIGGER \"pointov_%w_%w_delete\" AFTER DELETE ON \"%w\" WHEN OLD.\"%w\" NOT NULL\nBEGIN\n   INSERT INTO GPKG_PointOverviewUpdate VALUES(%Q, %Q, OLD.\"%w\", NULL);\nEND;",
+        table, gcolumn, table, gcolumn, table, gcolumn, gcolumn);
+    errsql = sqlite3_mprintf("DELETE FROM gpkgext_point_overview WHERE table_name = %Q AND column_name = %Q; DROP TRIGGER \"pointov_%w_%w_update\"; DROP TRIGGER \"pointov_%w_%w_insert\"; %z",
+        table, gcolumn, table, gcolumn, table, gcolumn, pointOverviewDropSQL(table, gcolumn, maxZoom + 1, 0));
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+}
+
+// SQL function: GPKG_DropPointOverview(tableName, geometryColumn); 
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// Drops the point overview of a table and the corresponding triggers to maintain it
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGDropPointOverview(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    char *sql;
+    int maxZoom = -1;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Get the deepest zoom
+    if (sqlite3_prepare_v2(db, "SELECT max_zoom FROM gpkgext_point_overview WHERE LOWER(table_name) = LOWER(?) AND LOWER(column_name) = LOWER(?)", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, gcolumn, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            maxZoom = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if (maxZoom < 0 || maxZoom > HILBERT_ORDER)
+    {
+        sqlite3_result_error(context, "GPKG_DropPointOverview() error: argument 1 [tableName] has no point overview in the geometry column", -1);
+        return;
+    }
+
+    // Drop triggers and tables
+    sql = pointOverviewDropSQL(table, gcolumn, maxZoom + 1, 1);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Unregister the point overview
+    sql = sqlite3_mprintf("DELETE FROM gpkgext_point_overview WHERE LOWER(table_name) = LOWER(%Q) AND LOWER(column_name) = LOWER(%Q)",
+        table, gcolumn);
+    sqlite3_exec_free(context, db, sql, NULL);
+}
+
+// SQL function: GPKG_EnableDirtyTracking(tableName, geometryColumn); 
+// Starts logging the envelopes of the features of a table that are inserted, updated or deleted, to know which tiles of a cache must be rendered again
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry. Its SRS must be EPSG:4326 or EPSG:3857
+// The envelopes are logged in Web Mercator (EPSG:3857) into gpkgext_dirty_region (id, table_name, column_name, min_x, min_y, max_x, max_y).
+// An update logs the envelopes before and after the change (once if they are equal), an insert the new one and a delete the old one
+// The triggers dirty_tableName_geometryColumn_insert, dirty_tableName_geometryColumn_update, dirty_tableName_geometryColumn_delete
+// insert the old and new geometries into GPKG_DirtyRegionUpdate, that parses each geometry once
+// GPKG_DirtyTiles(zoom) returns the tiles of the envelopes logged. Delete the rows of gpkgext_dirty_region once the tiles are rendered
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGEnableDirtyTracking(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    int srs = 0;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    char *sql, *errsql;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Get the SRS of the geometry column
+    if (sqlite3_prepare_v2(db, "SELECT s.organization_coordsys_id FROM gpkg_geometry_columns g JOIN gpkg_spatial_ref_sys s ON s.srs_id = g.srs_id WHERE LOWER(g.table_name) = LOWER(?) AND LOWER(g.column_name) = LOWER(?) AND LOWER(s.organization) = 'epsg'", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, gcolumn, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            srs = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if (srs != 4326 && srs != 3857)
+    {
+        sqlite3_result_error(context, "GPKG_EnableDirtyTracking() error: the SRS of the geometry column must be EPSG:4326 or EPSG:3857", -1);
+        return;
+    }
+
+    // Create the log
+    sql = sqlite3_mprintf("CREATE TABLE IF NOT EXISTS gpkgext_dirty_region(\n   id INTEGER PRIMARY KEY AUTOINCREMENT,\n   table_name TEXT NOT NULL,\n   column_name TEXT NOT NULL,\n   min_x DOUBLE NOT NULL,\n   min_y DOUBLE NOT NULL,\n   max_x DOUBLE NOT NULL,\n   max_y DOUBLE NOT NULL\n)");
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Conditions: Insertion of a row
+    //    Actions: Log the envelope of the new geometry
+    sql = sqlite3_mprintf("CREATE TRIGGER \"dirty_%w_%w_insert\" AFTER INSERT ON \"%w\" WHEN NEW.\"%w\" NOT NULL\nBEGIN\n   INSERT INTO GPKG_DirtyRegionUpdate VALUES(%Q, %Q, %d, NULL, NEW.\"%w\");\nEND;",
+        table, gcolumn, table, gcolumn, table, gcolumn, srs, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Conditions: Update of a row
+    //    Actions: Log the envelopes of the old and new geometries
+    sql = sqlite3_mprintf("CREATE TRIGGER \"dirty_%w_%w_update\" AFTER UPDATE ON \"%w\"\nBEGIN\n   INSERT INTO GPKG_DirtyRegionUpdate VALUES(%Q, %Q, %d, OLD.\"%w\", NEW.\"%w\");\nEND;",
+        table, gcolumn, table, table, gcolumn, srs, gcolumn, gcolumn);
+    errsql = sqlite3_mprintf("DROP TRIGGER \"dirty_%w_%w_insert\"",
+        table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // Conditions: Row deleted
+    //    Actions: Log the envelope of the old geometry
+    sql = sqlite3_mprintf("CREATE TRIGGER \"dirty_%w_%w_delete\" AFTER DELETE ON \"%w\" WHEN OLD.\"%w\" NOT NULL\nBEGIN\n   INSERT INTO GPKG_DirtyRegionUpdate VALUES(%Q, %Q, %d, OLD.\"%w\", NULL);\nEND;",
+        table, gcolumn, table, gcolumn, table, gcolumn, srs, gcolumn);
+    errsql = sqlite3_mprintf("DROP TRIGGER \"dirty_%w_%w_update\"; DROP TRIGGER \"dirty_%w_%w_insert\"",
+        table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+}
+
+// SQL function: GPKG_DisableDirtyTracking(tableName, geometryColumn); 
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// Stops logging the changes of a table: drops the triggers and deletes its envelopes from gpkgext_dirty_region
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGDisableDirtyTracking(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    sqlite3 *db;
+    char *sql;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Drop triggers
+    sql = sqlite3_mprintf("DROP TRIGGER \"dirty_%w_%w_delete\"; DROP TRIGGER \"dirty_%w_%w_update\"; DROP TRIGGER \"dirty_%w_%w_insert\"",
+        table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Remove the envelopes logged
+    sql = sqlite3_mprintf("DELETE FROM gpkgext_dirty_region WHERE LOWER(table_name) = LOWER(%Q) AND LOWER(column_name) = LOWER(%Q)",
+        table, gcolumn);
+    sqlite3_exec_free(context, db, sql, NULL);
+}
+
+// SQL function: GPKG_EnableChangeLog(tableName); 
+// Starts logging the features of a table that are inserted, updated or deleted, to export or replicate only the changes
+// tableName -> Name of the table. Its features are identified by the row ID (the primary key of a GeoPackage feature table)
+// The changes are appended to changelog_tableName (seq, id, op, min_x, min_y, max_x, max_y): seq is an increasing sequence number
+// never reused, op is 1 (insert), 2 (update) or 3 (delete) and the envelope is the one of the geometry of the column registered in
+// gpkg_geometry_columns (after the change, or before it on delete). It's NULL if the table has no geometry column
+// The triggers changelog_tableName_insert, changelog_tableName_update, changelog_tableName_delete insert the changes into GPKG_ChangeLogUpdate,
+// that parses each geometry once
+// GPKG_ChangesSince(tableName, seq) returns the last change of each feature after seq. Delete the rows of changelog_tableName already processed
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGEnableChangeLog(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    char *gcolumn = NULL;
+    char *oldGeom, *newGeom;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    char *sql, *errsql;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Get the geometry column, if any
+    if (sqlite3_prepare_v2(db, "SELECT column_name FROM gpkg_geometry_columns WHERE LOWER(table_name) = LOWER(?)", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            gcolumn = sqlite3_mprintf("%s", (const char *)sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    oldGeom = gcolumn != NULL ? sqlite3_mprintf("OLD.\"%w\"", gcolumn) : sqlite3_mprintf("NULL");
+    newGeom = gcolumn != NULL ? sqlite3_mprintf("NEW.\"%w\"", gcolumn) : sqlite3_mprintf("NULL");
+    sqlite3_free(gcolumn);
+    if (oldGeom == NULL || newGeom == NULL)
+    {
+        sqlite3_free(oldGeom);
+        sqlite3_free(newGeom);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    // Create the change log
+    sql = sqlite3_mprintf("CREATE TABLE \"changelog_%w\"(\n   seq INTEGER PRIMARY KEY AUTOINCREMENT,\n   id INTEGER NOT NULL,\n   op INTEGER NOT NULL,\n   min_x DOUBLE,\n   min_y DOUBLE,\n   max_x DOUBLE,\n   max_y DOUBLE\n)",
+        table);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        goto end;
+
+    // Conditions: Insertion of a row
+    //    Actions: Log an insert of the new row ID
+    sql = sqlite3_mprintf("CREATE TRIGGER \"changelog_%w_insert\" AFTER INSERT ON \"%w\"\nBEGIN\n   INSERT INTO GPKG_ChangeLogUpdate VALUES(%Q, %d, NULL, NEW.rowid, NULL, %s);\nEND;",
+        table, table, table, CHANGELOG_INSERT, newGeom);
+    errsql = sqlite3_mprintf("DROP TABLE \"changelog_%w\"",
+        table);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        goto end;
+
+    // Conditions: Update of a row
+    //    Actions: Log an update, or a delete and an insert if the row ID changes
+    sql = sqlite3_mprintf("CREATE TRIGGER \"changelog_%w_update\" AFTER UPDATE ON \"%w\"\nBEGIN\n   INSERT INTO GPKG_ChangeLogUpdate VALUES(%Q, %d, OLD.rowid, NEW.rowid, %s, %s);\nEND;",
+        table, table, table, CHANGELOG_UPDATE, oldGeom, newGeom);
+    errsql = sqlite3_mprintf("DROP TRIGGER \"changelog_%w_insert\"; DROP TABLE \"changelog_%w\"",
+        table, table);
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        goto end;
+
+    // Conditions: Row deleted
+    //    Actions: Log a delete of the old row ID
+    sql = sqlite3_mprintf("CREATE TRIGGER \"changelog_%w_delete\" AFTER DELETE ON \"%w\"\nBEGIN\n   INSERT INTO GPKG_ChangeLogUpdate VALUES(%Q, %d, OLD.rowid, NULL, %s, NULL);\nEND;",
+        table, table, table, CHANGELOG_DELETE, oldGeom);
+    errsql = sqlite3_mprintf("DROP TRIGGER \"changelog_%w_update\"; DROP TRIGGER \"changelog_%w_insert\"; DROP TABLE \"changelog_%w\"",
+        table, table, table);
+    sqlite3_exec_free(context, db, sql, errsql);
+
+end:
+    sqlite3_free(oldGeom);
+    sqlite3_free(newGeom);
+}
+
+// SQL function: GPKG_DisableChangeLog(tableName); 
+// tableName -> Name of the table
+// Stops logging the changes of a table: drops the triggers and the change log
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGDisableChangeLog(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    sqlite3 *db;
+    char *sql;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Drop triggers and change log
+    sql = sqlite3_mprintf("DROP TRIGGER \"changelog_%w_delete\"; DROP TRIGGER \"changelog_%w_update\"; DROP TRIGGER \"changelog_%w_insert\"; DROP TABLE \"changelog_%w\"",
+        table, table, table, table);
+    sqlite3_exec_free(context, db, sql, NULL);
+}
+
+// SQL function: GPKG_AddSegmentIndex(tableName, geometryColumn, idColumn); GPKG_AddSegmentIndex(tableName, geometryColumn, idColumn, minVertices); 
+// Creates a segment index of a geometry column: a packed Hilbert R-tree of the segments of each Polygon or MultiPolygon with at least minVertices coordinates,
+// used by ST_Intersects(tableName, geometryColumn, id, geometry) and ST_Contains(tableName, geometryColumn, id, geometry)
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// idColumn -> Column that is the PrimaryKey of the table
+// minVertices -> optional parameter. Minimum number of coordinates of the indexed features. If not specified assumes SEGMENT_INDEX_MIN_VERTICES
+// The segment index created is called segidx_tableName_geometryColumn and is registered in gpkgext_segment_index
+// The triggers segidx_tableName_geometryColumn_update and segidx_tableName_geometryColumn_delete remove the tree of a feature when it changes
+// If the segment index already exists, builds the trees of the features that don't have one (inserted or updated after the last call)
+// On success returns the number of trees built. If there is an error throw an exception
+static void fnct_GPKGAddSegmentIndex(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    const char *icolumn;
+    int minVertices = SEGMENT_INDEX_MIN_VERTICES;
+    sqlite3 *db;
+    sqlite3_stmt *stmt, *insertStmt;
+    unsigned char header[1 + sizeof(sqlite3_int64)];
+    sqlite3_int64 built = 0;
+    char *sql, *errsql;
+    int exists;
+    int rc;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    icolumn = (const char *)sqlite3_value_text(argv[2]);
+    if (argc == 4)
+    {
+        if (sqlite3_value_type(argv[3]) != SQLITE_INTEGER || sqlite3_value_int(argv[3]) < 4)
+        {
+            sqlite3_result_error(context, "GPKG_AddSegmentIndex() error: argument 4 [minVertices] must be an integer greater than 3", -1);
+            return;
+        }
+        minVertices = sqlite3_value_int(argv[3]);
+    }
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Create the metadata table of the segment indexes
+    sql = sqlite3_mprintf("CREATE TABLE IF NOT EXISTS gpkgext_segment_index(\n   table_name TEXT NOT NULL,\n   column_name TEXT NOT NULL,\n   id_column TEXT NOT NULL,\n   min_vertices INTEGER NOT NULL,\n   CONSTRAINT pk_gsi PRIMARY KEY(table_name, column_name)\n)");
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Check if the segment index exists
+    rc = sqlite3_prepare_v2(db, "SELECT id_column, min_vertices FROM gpkgext_segment_index WHERE LOWER(table_name) = LOWER(?) AND LOWER(column_name) = LOWER(?)", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+    sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, gcolumn, -1, SQLITE_STATIC);
+    exists = sqlite3_step(stmt) == SQLITE_ROW;
+    if (exists)
+    {
+        sql = sqlite3_mprintf("SELECT \"%w\", \"%w\" FROM \"%w\" WHERE length(\"%w\") >= %d AND NOT EXISTS (SELECT 1 FROM \"segidx_%w_%w\" WHERE id = \"%w\".\"%w\" AND page = 0)",
+            (const char *)sqlite3_column_text(stmt, 0), gcolumn, table, gcolumn, 8 + 16 * sqlite3_column_int(stmt, 1), table, gcolumn, table, (const char *)sqlite3_column_text(stmt, 0));
+        minVertices = sqlite3_column_int(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+
+    if (!exists)
+    {
+        // Create the segment index
+        sql = sqlite3_mprintf("CREATE TABLE \"segidx_%w_%w\"(\n   id INTEGER NOT NULL,\n   page INTEGER NOT NULL,\n   data BLOB NOT NULL,\n   PRIMARY KEY(id, page)\n) WITHOUT ROWID",
+            table, gcolumn);
+        if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+            return;
+
+        // Conditions: Update of the geometry column or the row ID
+        //    Actions: Remove the tree of the old feature
+        sql = sqlite3_mprintf("CREATE TRIGGER \"segidx_%w_%w_update\" AFTER UPDATE OF \"%w\", \"%w\" ON \"%w\"\nBEGIN\n   DELETE FROM \"segidx_%w_%w\" WHERE id = OLD.\"%w\";\nEND;",
+            table, gcolumn, gcolumn, icolumn, table, table, gcolumn, icolumn);
+        errsql = sqlite3_mprintf("DROP TABLE \"segidx_%w_%w\"",
+            table, gcolumn);
+        if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+            return;
+
+        // Conditions: Row deleted
+        //    Actions: Remove the tree of the old feature
+        sql = sqlite3_mprintf("CREATE TRIGGER \"segidx_%w_%w_delete\" AFTER DELETE ON \"%w\"\nBEGIN\n   DELETE FROM \"segidx_%w_%w\" WHERE id = OLD.\"%w\";\nEND;",
+            table, gcolumn, table, table, gcolumn, icolumn);
+        errsql = sqlite3_mprintf("DROP TRIGGER \"segidx_%w_%w_update\"; DROP TABLE \"segidx_%w_%w\"",
+            table, gcolumn, table, gcolumn);
+        if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+            return;
+
+        // Register the segment index
+        sql = sqlite3_mprintf("INSERT INTO gpkgext_segment_index(table_name, column_name, id_column, min_vertices) VALUES(%Q, %Q, %Q, %d)",
+            table, gcolumn, icolumn, minVertices);
+        errsql = sqlite3_mprintf("DROP TRIGGER \"segidx_%w_%w_delete\"; DROP TRIGGER \"segidx_%w_%w_update\"; DROP TABLE \"segidx_%w_%w\"",
+            table, gcolumn, table, gcolumn, table, gcolumn);
+        if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+            return;
+
+        // A coordinate takes at least 16 bytes
+        sql = sqlite3_mprintf("SELECT \"%w\", \"%w\" FROM \"%w\" WHERE length(\"%w\") >= %d",
+            icolumn, gcolumn, table, gcolumn, 8 + 16 * minVertices);
+    }
+
+    // Build the trees of the features
+    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+    sql = sqlite3_mprintf("INSERT OR REPLACE INTO \"segidx_%w_%w\"(id, page, data) VALUES(?, ?, ?)", table, gcolumn);
+    rc = sqlite3_prepare_v2(db, sql, -1, &insertStmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_finalize(stmt);
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+    header[0] = endian();
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        gpkgGeometry geom;
+        double *tree = NULL;
+        sqlite3_int64 numSegments, levelStart[SEGMENT_INDEX_MAX_LEVELS + 1], numEntries;
+        if (sqlite3_column_type(stmt, 1) != SQLITE_BLOB)
+            continue;
+        memset(&geom, 0, sizeof(gpkgGeometry));
+        if (!readGPKGGeometry((unsigned char *)sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1), &geom) ||
+            (geom.geometryType != wkbPolygon && geom.geometryType != wkbMultiPolygon) || geom.numPoints < minVertices)
+        {
+            freeGPKGGeometry(&geom);
+            continue;
+        }
+        if (!buildSegmentIndex(&geom, &tree, &numSegments))
+        {
+            freeGPKGGeometry(&geom);
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        freeGPKGGeometry(&geom);
+        numEntries = levelStart[segmentIndexLevels(numSegments, levelStart)];
+
+        // Header and pages
+        memcpy(header + 1, &numSegments, sizeof(sqlite3_int64));
+        sqlite3_bind_value(insertStmt, 1, sqlite3_column_value(stmt, 0));
+        sqlite3_bind_int(insertStmt, 2, 0);
+        sqlite3_bind_blob(insertStmt, 3, header, sizeof(header), SQLITE_STATIC);
+        rc = sqlite3_step(insertStmt);
+        sqlite3_reset(insertStmt);
+        for (sqlite3_int64 first = 0; first < numEntries && rc == SQLITE_DONE; first += SEGMENT_INDEX_PAGE_SIZE)
+        {
+            sqlite3_int64 count = numEntries - first < SEGMENT_INDEX_PAGE_SIZE ? numEntries - first : SEGMENT_INDEX_PAGE_SIZE;
+            sqlite3_bind_int64(insertStmt, 2, first / SEGMENT_INDEX_PAGE_SIZE + 1);
+            sqlite3_bind_blob(insertStmt, 3, &tree[first * 4], (int)(sizeof(double) * 4 * count), SQLITE_STATIC);
+            rc = sqlite3_step(insertStmt);
+            sqlite3_reset(insertStmt);
+        }
+        sqlite3_free(tree);
+        if (rc != SQLITE_DONE)
+            break;
+        built++;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(insertStmt);
+    if (rc == SQLITE_NOMEM)
+        sqlite3_result_error_nomem(context);
+    else if (rc != SQLITE_DONE)
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+    else
+        sqlite3_result_int64(context, built);
+}
+
+// SQL function: GPKG_DropSegmentIndex(tableName, geometryColumn); 
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// Drops a segment index of a geometry column and the corresponding triggers
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGDropSegmentIndex(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    sqlite3 *db;
+    char *sql;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Drop triggers and segment index
+    sql = sqlite3_mprintf("DROP TRIGGER \"segidx_%w_%w_delete\"; DROP TRIGGER \"segidx_%w_%w_update\"; DROP TABLE \"segidx_%w_%w\"",
+        table, gcolumn, table, gcolumn, table, gcolumn);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Unregister it
+    sql = sqlite3_mprintf("DELETE FROM gpkgext_segment_index WHERE LOWER(table_name) = LOWER(%Q) AND LOWER(column_name) = LOWER(%Q)",
+        table, gcolumn);
+    sqlite3_exec_free(context, db, sql, NULL);
+}
+
+// Spatial histogram of a geometry column: number of features by the cell of the center of their envelope
+// in a grid of SPATIAL_HISTOGRAM_SIZE x SPATIAL_HISTOGRAM_SIZE cells over the extent of the features
+typedef struct spatialHistogram
+{
+    char *table;                 // Name of the table (to check the cached histogram of GPKG_EstimateCount)
+    char *gcolumn;               // Column that contains the geometry
+    double ext[4];               // Extent of the grid (minX, minY, maxX, maxY)
+    double avgWidth, avgHeight;  // Average size of the envelopes
+    sqlite3_int64 featureCount;  // Number of features
+    unsigned int cells[SPATIAL_HISTOGRAM_SIZE * SPATIAL_HISTOGRAM_SIZE]; // Number of features of each cell, by rows from minY
+} spatialHistogram;
+
+// Releases a spatial histogram
+static void freeSpatialHistogram(void *p)
+{
+    spatialHistogram *hist = (spatialHistogram *)p;
+
+    sqlite3_free(hist->table);
+    sqlite3_free(hist->gcolumn);
+    sqlite3_free(hist);
+}
+
+// Returns the cell of the spatial histogram that contains the coordinate
+// value -> Coordinate
+// min, max -> Range of the grid in that axis
+static int spatialHistogramCell(double value, double min, double max)
+{
+    int cell = max > min ? (int)((value - min) / (max - min) * SPATIAL_HISTOGRAM_SIZE) : 0;
+
+    return cell < 0 ? 0 : (cell >= SPATIAL_HISTOGRAM_SIZE ? SPATIAL_HISTOGRAM_SIZE - 1 : cell);
+}
+
+// SQL function: GPKG_AnalyzeSpatial(tableName, geometryColumn); 
+// Computes the spatial histogram of a geometry column used by GPKG_EstimateCount and stores it in gpkgext_spatial_statistics
+// The histogram has the number of features in each cell of a grid of SPATIAL_HISTOGRAM_SIZE x SPATIAL_HISTOGRAM_SIZE cells
+// (counted by the center of the envelope) and the average size of the envelopes
+// The envelopes are read from the spatial index if it exists, else from the geometries
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// On success returns the number of features analyzed. If there is an error throw an exception
+static void fnct_GPKGAnalyzeSpatial(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    spatialHistogram *hist;
+    unsigned char *blob;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    char *sql;
+    int rc;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // The envelopes of the spatial index are already computed
+    sql = sqlite3_mprintf("SELECT minx, miny, maxx, maxy FROM \"rtree_%w_%w\"", table, gcolumn);
+    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("SELECT ST_MinX(\"%w\"), ST_MinY(\"%w\"), ST_MaxX(\"%w\"), ST_MaxY(\"%w\") FROM \"%w\" WHERE \"%w\" NOT NULL AND NOT ST_IsEmpty(\"%w\")",
+            gcolumn, gcolumn, gcolumn, gcolumn, table, gcolumn, gcolumn);
+        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+        sqlite3_free(sql);
+        if (rc != SQLITE_OK)
+        {
+            sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+            return;
+        }
+    }
+
+    hist = (spatialHistogram *)sqlite3_malloc(sizeof(spatialHistogram));
+    if (hist == NULL)
+    {
+        sqlite3_finalize(stmt);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    memset(hist, 0, sizeof(spatialHistogram));
+    hist->ext[0] = hist->ext[1] = HUGE_VAL;
+    hist->ext[2] = hist->ext[3] = -HUGE_VAL;
+
+    // First pass: extent and average size. Second pass: count the features of each cell
+    for (int pass = 0; pass < 2 && rc != SQLITE_ERROR; pass++)
+    {
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            double minx = sqlite3_column_double(stmt, 0);
+            double miny = sqlite3_column_double(stmt, 1);
+            double maxx = sqlite3_column_double(stmt, 2);
+            double maxy = sqlite3_column_double(stmt, 3);
+            if (sqlite3_column_type(stmt, 0) == SQLITE_NULL)
+                continue;
+            if (pass == 0)
+            {
+                hist->ext[0] = fmin(hist->ext[0], minx);
+                hist->ext[1] = fmin(hist->ext[1], miny);
+                hist->ext[2] = fmax(hist->ext[2], maxx);
+                hist->ext[3] = fmax(hist->ext[3], maxy);
+                hist->avgWidth += maxx - minx;
+                hist->avgHeight += maxy - miny;
+                hist->featureCount++;
+            }
+            else
+                hist->cells[spatialHistogramCell((miny + maxy) / 2, hist->ext[1], hist->ext[3]) * SPATIAL_HISTOGRAM_SIZE +
+                            spatialHistogramCell((minx + maxx) / 2, hist->ext[0], hist->ext[2])]++;
+        }
+        if (rc == SQLITE_DONE)
+            rc = sqlite3_reset(stmt);
+        else
+            rc = SQLITE_ERROR;
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_free(hist);
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+    if (hist->featureCount > 0)
+    {
+        hist->avgWidth /= hist->featureCount;
+        hist->avgHeight /= hist->featureCount;
+    }
+    else
+        hist->ext[0] = hist->ext[1] = hist->ext[2] = hist->ext[3] = 0;
+
+    // The cells are stored as 4 byte little endian integers
+    blob = (unsigned char *)sqlite3_malloc(SPATIAL_HISTOGRAM_SIZE * SPATIAL_HISTOGRAM_SIZE * 4);
+    if (blob == NULL)
+    {
+        sqlite3_free(hist);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    for (int i = 0; i < SPATIAL_HISTOGRAM_SIZE * SPATIAL_HISTOGRAM_SIZE; i++)
+    {
+        blob[i * 4] = (unsigned char)hist->cells[i];
+        blob[i * 4 + 1] = (unsigned char)(hist->cells[i] >> 8);
+        blob[i * 4 + 2] = (unsigned char)(hist->cells[i] >> 16);
+        blob[i * 4 + 3] = (unsigned char)(hist->cells[i] >> 24);
+    }
+
+    // Create the table of the statistics
+    sql = sqlite3_mprintf("CREATE TABLE IF NOT EXISTS gpkgext_spatial_statistics(\n   table_name TEXT NOT NULL,\n   column_name TEXT NOT NULL,\n   min_x DOUBLE NOT NULL,\n   min_y DOUBLE NOT NULL,\n   max_x DOUBLE NOT NULL,\n   max_y DOUBLE NOT NULL,\n   feature_count INTEGER NOT NULL,\n   avg_width DOUBLE NOT NULL,\n   avg_height DOUBLE NOT NULL,\n   grid_size INTEGER NOT NULL,\n   histogram BLOB NOT NULL,\n   last_change DATETIME NOT NULL DEFAULT (strftime('%%Y-%%m-%%dT%%H:%%M:%%fZ','now')),\n   CONSTRAINT pk_gss PRIMARY KEY(table_name, column_name)\n)");
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+    {
+        sqlite3_free(blob);
+        sqlite3_free(hist);
+        return;
+    }
+    rc = sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO gpkgext_spatial_statistics(table_name, column_name, min_x, min_y, max_x, max_y, feature_count, avg_width, avg_height, grid_size, histogram) VALUES(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11)", -1, &stmt, NULL);
+    if (rc == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, gcolumn, -1, SQLITE_STATIC);
+        for (int i = 0; i < 4; i++)
+            sqlite3_bind_double(stmt, 3 + i, hist->ext[i]);
+        sqlite3_bind_int64(stmt, 7, hist->featureCount);
+        sqlite3_bind_double(stmt, 8, hist->avgWidth);
+        sqlite3_bind_double(stmt, 9, hist->avgHeight);
+        sqlite3_bind_int(stmt, 10, SPATIAL_HISTOGRAM_SIZE);
+        sqlite3_bind_blob(stmt, 11, blob, SPATIAL_HISTOGRAM_SIZE * SPATIAL_HISTOGRAM_SIZE * 4, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+    if (rc != SQLITE_OK && rc != SQLITE_DONE)
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+    else
+        sqlite3_result_int64(context, hist->featureCount);
+    sqlite3_free(blob);
+    sqlite3_free(hist);
+}
+
+// Reads the spatial histogram of a geometry column from gpkgext_spatial_statistics
+// db -> sqlite3
+// table -> Name of the table
+// gcolumn -> Column that contains the geometry
+// hist <- Spatial histogram allocated with sqlite3_malloc. Must be released with freeSpatialHistogram
+// Returns SQLITE_OK if it's correct, SQLITE_NOTFOUND if the column has not been analyzed or an SQLite error code
+static int readSpatialHistogram(sqlite3 *db, const char *table, const char *gcolumn, spatialHistogram **hist)
+{
+    sqlite3_stmt *stmt;
+    const unsigned char *blob;
+    int rc;
+
+    *hist = NULL;
+    rc = sqlite3_prepare_v2(db, "SELECT min_x, min_y, max_x, max_y, feature_count, avg_width, avg_height, grid_size, histogram FROM gpkgext_spatial_statistics WHERE LOWER(table_name) = LOWER(?1) AND LOWER(column_name) = LOWER(?2)", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+        return rc == SQLITE_ERROR ? SQLITE_NOTFOUND : rc; // The table of the statistics doesn't exist
+    sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, gcolumn, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE || (rc == SQLITE_ROW && (sqlite3_column_int(stmt, 7) != SPATIAL_HISTOGRAM_SIZE || sqlite3_column_bytes(stmt, 8) != SPATIAL_HISTOGRAM_SIZE * SPATIAL_HISTOGRAM_SIZE * 4)))
+        rc = SQLITE_NOTFOUND;
+    else if (rc == SQLITE_ROW)
+    {
+        *hist = (spatialHistogram *)sqlite3_malloc(sizeof(spatialHistogram));
+        if (*hist == NULL)
+            rc = SQLITE_NOMEM;
+        else
+        {
+            memset(*hist, 0, sizeof(spatialHistogram));
+            (*hist)->table = sqlite3_mprintf("%s", table);
+            (*hist)->gcolumn = sqlite3_mprintf("%s", gcolumn);
+            for (int i = 0; i < 4; i++)
+                (*hist)->ext[i] = sqlite3_column_double(stmt, i);
+            (*hist)->featureCount = sqlite3_column_int64(stmt, 4);
+            (*hist)->avgWidth = sqlite3_column_double(stmt, 5);
+            (*hist)->avgHeight = sqlite3_column_double(stmt, 6);
+            blob = (const unsigned char *)sqlite3_column_blob(stmt, 8);
+            for (int i = 0; i < SPATIAL_HISTOGRAM_SIZE * SPATIAL_HISTOGRAM_SIZE; i++)
+                (*hist)->cells[i] = blob[i * 4] | ((unsigned int)blob[i * 4 + 1] << 8) | ((unsigned int)blob[i * 4 + 2] << 16) | ((unsigned int)blob[i * 4 + 3] << 24);
+            rc = SQLITE_OK;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Returns the fraction of the range [min, max] that overlaps [qmin, qmax]. A range of length 0 overlaps completely or not at all
+static double rangeOverlap(double min, double max, double qmin, double qmax)
+{
+    if (qmax < min || qmin > max)
+        return 0;
+    if (max <= min)
+        return 1;
+    return (fmin(max, qmax) - fmax(min, qmin)) / (max - min);
+}
+
+// SQL function: GPKG_EstimateCount(tableName, geometryColumn, minX, minY, maxX, maxY); 
+// Estimates the number of features whose envelope intersects a window, using the spatial histogram computed with GPKG_AnalyzeSpatial
+// The window is enlarged by half the average size of the envelopes and the features of each cell are prorated by the part of the cell inside the window
+// The histogram is read once per statement when tableName and geometryColumn are constants
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// minX, minY, maxX, maxY -> Window
+// Returns the estimated number of features or NULL if the column has not been analyzed. If there is an error throw an exception
+static void fnct_GPKGEstimateCount(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const char *table;
+    const char *gcolumn;
+    spatialHistogram *hist;
+    double box[4];
+    double cellWidth, cellHeight;
+    double estimate = 0;
+    int rc;
+
+    // Get the parameters
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    for (int i = 0; i < 4; i++)
+    {
+        if (sqlite3_value_type(argv[2 + i]) != SQLITE_INTEGER && sqlite3_value_type(argv[2 + i]) != SQLITE_FLOAT)
+        {
+            sqlite3_result_error(context, "GPKG_EstimateCount() error: arguments 3 to 6 [minX, minY, maxX, maxY] must be numbers", -1);
+            return;
+        }
+        box[i] = sqlite3_value_double(argv[2 + i]);
+    }
+    if (table == NULL || gcolumn == NULL)
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+
+    // Use the histogram of the previous call if the parameters are constants
+    hist = (spatialHistogram *)sqlite3_get_auxdata(context, 1);
+    if (hist == NULL || hist->table == NULL || hist->gcolumn == NULL || strcmp(hist->table, table) != 0 || strcmp(hist->gcolumn, gcolumn) != 0)
+    {
+        rc = readSpatialHistogram(sqlite3_context_db_handle(context), table, gcolumn, &hist);
+        if (rc == SQLITE_NOTFOUND)
+        {
+            sqlite3_result_null(context);
+            return;
+        }
+        if (rc != SQLITE_OK)
+        {
+            sqlite3_result_error_code(context, rc);
+            return;
+        }
+        // SQLite releases the histogram when the statement ends or, if the parameters are not constants, when this call ends
+        sqlite3_set_auxdata(context, 1, hist, freeSpatialHistogram);
+        hist = (spatialHistogram *)sqlite3_get_auxdata(context, 1);
+        if (hist == NULL)
+        {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+    }
+
+    // A feature intersects the window if the center of its envelope is inside the window enlarged by half its size
+    box[0] -= hist->avgWidth / 2;
+    box[1] -= hist->avgHeight / 2;
+    box[2] += hist->avgWidth / 2;
+    box[3] += hist->avgHeight / 2;
+    if (hist->featureCount > 0 && box[2] >= hist->ext[0] && box[0] <= hist->ext[2] && box[3] >= hist->ext[1] && box[1] <= hist->ext[3])
+    {
+        int minCol = spatialHistogramCell(box[0], hist->ext[0], hist->ext[2]);
+        int maxCol = spatialHistogramCell(box[2], hist->ext[0], hist->ext[2]);
+        int minRow = spatialHistogramCell(box[1], hist->ext[1], hist->ext[3]);
+        int maxRow = spatialHistogramCell(box[3], hist->ext[1], hist->ext[3]);
+        cellWidth = (hist->ext[2] - hist->ext[0]) / SPATIAL_HISTOGRAM_SIZE;
+        cellHeight = (hist->ext[3] - hist->ext[1]) / SPATIAL_HISTOGRAM_SIZE;
+        for (int row = minRow; row <= maxRow; row++)
+        {
+            double fy = rangeOverlap(hist->ext[1] + row * cellHeight, hist->ext[1] + (row + 1) * cellHeight, box[1], box[3]);
+            for (int col = minCol; col <= maxCol; col++)
+            {
+                unsigned int count = hist->cells[row * SPATIAL_HISTOGRAM_SIZE + col];
+                if (count > 0)
+                    estimate += count * fy * rangeOverlap(hist->ext[0] + col * cellWidth, hist->ext[0] + (col + 1) * cellWidth, box[0], box[2]);
+            }
+        }
+    }
+    sqlite3_result_int64(context, (sqlite3_int64)(estimate + 0.5));
+}
+
+// Grid of GPKG_GridCount: number of geometries by the cell of the center of their envelope
+typedef struct gridCount
+{
+    double ext[4];        // Extent of the grid (minX, minY, maxX, maxY)
+    int columns, rows;    // Number of cells
+    unsigned int *cells;  // Number of geometries of each cell, by rows from minY. NULL until the first row
+} gridCount;
+
+// Aggregate function step: GPKG_GridCount(geometry, minX, minY, maxX, maxY, columns, rows); 
+// Counts a geometry in the cell of the grid that contains the center of its envelope. The geometries outside the extent are not counted
+// The extent and the size of the grid are read from the first row
+static void fnct_GPKGGridCountStep(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    gridCount *grid = (gridCount *)sqlite3_aggregate_context(context, sizeof(gridCount));
+    double env[4], x, y;
+    int column, row;
+
+    if (grid == NULL)
+    {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (grid->cells == NULL)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (sqlite3_value_type(argv[1 + i]) != SQLITE_INTEGER && sqlite3_value_type(argv[1 + i]) != SQLITE_FLOAT)
+            {
+                sqlite3_result_error(context, "GPKG_GridCount() error: arguments 2 to 5 [minX, minY, maxX, maxY] must be numbers", -1);
+                return;
+            }
+            grid->ext[i] = sqlite3_value_double(argv[1 + i]);
+        }
+        if (!(grid->ext[2] > grid->ext[0]) || !(grid->ext[3] > grid->ext[1]))
+        {
+            sqlite3_result_error(context, "GPKG_GridCount() error: arguments 2 to 5 [minX, minY, maxX, maxY] are not a valid extent", -1);
+            return;
+        }
+        if (sqlite3_value_type(argv[5]) != SQLITE_INTEGER || sqlite3_value_type(argv[6]) != SQLITE_INTEGER ||
+            sqlite3_value_int64(argv[5]) < 1 || sqlite3_value_int64(argv[6]) < 1 || sqlite3_value_int64(argv[5]) * sqlite3_value_int64(argv[6]) > GRID_COUNT_MAX_CELLS)
+        {
+            sqlite3_result_error(context, "GPKG_GridCount() error: arguments 6 and 7 [columns, rows] must be positive integers with at most 16777216 cells", -1);
+            return;
+        }
+        grid->columns = sqlite3_value_int(argv[5]);
+        grid->rows = sqlite3_value_int(argv[6]);
+        grid->cells = (unsigned int *)sqlite3_malloc64(sizeof(unsigned int) * grid->columns * grid->rows);
+        if (grid->cells == NULL)
+        {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        memset(grid->cells, 0, sizeof(unsigned int) * grid->columns * grid->rows);
+    }
+
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || !readGPKGEnvelope((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), env))
+        return;
+    x = (env[0] + env[2]) / 2;
+    y = (env[1] + env[3]) / 2;
+    if (!(x >= grid->ext[0] && x <= grid->ext[2] && y >= grid->ext[1] && y <= grid->ext[3]))
+        return;
+    column = (int)((x - grid->ext[0]) / (grid->ext[2] - grid->ext[0]) * grid->columns);
+    row = (int)((y - grid->ext[1]) / (grid->ext[3] - grid->ext[1]) * grid->rows);
+    // The maximum belongs to the last cell
+    if (column >= grid->columns)
+        column = grid->columns - 1;
+    if (row >= grid->rows)
+        row = grid->rows - 1;
+    grid->cells[row * grid->columns + column]++;
+}
+
+// Aggregate function final: GPKG_GridCount(geometry, minX, minY, maxX, maxY, columns, rows); 
+// Returns a BLOB with the grid, in the CPU ENDIANESS: 1 byte with the ENDIANESS (as WKB), the extent (4 doubles: minX, minY, maxX, maxY),
+// the number of columns and rows (2 uint32) and the number of geometries of each cell (columns * rows uint32, by rows from minY)
+// Returns NULL if there are no rows. If there is an error throw an exception
+static void fnct_GPKGGridCountFinal(sqlite3_context *context)
+{
+    gridCount *grid = (gridCount *)sqlite3_aggregate_context(context, 0);
+    unsigned char *blob;
+    int n, index = 0;
+
+    if (grid == NULL || grid->cells == NULL)
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+    n = 1 + 8 * 4 + 4 * 2 + 4 * grid->columns * grid->rows;
+    blob = (unsigned char *)sqlite3_malloc(n);
+    if (blob == NULL)
+    {
+        sqlite3_free(grid->cells);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    blob[index++] = endian();
+    for (int i = 0; i < 4; i++)
+        putDouble(blob, &index, grid->ext[i]);
+    putInt(blob, &index, grid->columns);
+    putInt(blob, &index, grid->rows);
+    memcpy(&blob[index], grid->cells, 4 * grid->columns * grid->rows);
+    sqlite3_free(grid->cells);
+    sqlite3_result_blob(context, blob, n, sqlite3_free);
+}
+
+// SQL function: GPKG_ExtVersion(); 
+// Returns an string showing the version of this extension
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGExtVersion(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    sqlite3_result_text(context, VERSION, -1, NULL);
+}
+
+// SQL function: GPKG_Version(); 
+// Returns an integer showing the GeoPackage version
+// Is the value stored as PRAGMA user_version
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGVersion(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    sqlite3 *db;
+    char *sql;
+    sqlite3_stmt *stmt;
+    int ret;
+    int version = 0;
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Query the version
+    sql = sqlite3_mprintf("PRAGMA user_version");
+    ret = sqlite3_prepare_v2(db, sql, (int)strlen(sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+    {
+        sqlite3_result_error(context, "GPKG_Version() error", -1);
+        return;
+    }
+    ret = sqlite3_step(stmt);
+    if (ret == SQLITE_ROW)
+        version = sqlite3_column_int(stmt, 0);
+    else
+    {
+        sqlite3_result_error(context, "GPKG_Version() version undefined", -1);
+        return;
+    }
+    sqlite3_finalize(stmt);
+
+    // Return the result
+    sqlite3_result_int(context, version);
+}
+
+// SQL function: GPKG_Initialize(version); 
+// Creates the base tables for an empty GeoPackage
+// version -> optional parameter must be 10200 or 10300. If not specified assumes 10300.
+// On success returns nothing. If there is an error throw an exception
+static void fnct_GPKGInitialize(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    sqlite3 *db;
+    char *sql, *errsql;
+    int userVersion = GPKG_VERSION_10300;
+
+    // Get the parameters
+    if (argc == 1)
+    {
+        userVersion = sqlite3_value_int(argv[0]);
+        if (userVersion != GPKG_VERSION_10200 && userVersion != GPKG_VERSION_10300)
+        {
+            sqlite3_result_error(context, "GPKG_Initialize() error: argument 1 [version] unsupported value. Must be 10200 or 10300.", -1);
+            return;
+        }
+    }
+
+    // Get DB handle
+    db = sqlite3_context_db_handle(context);
+
+    // Set Application ID (Clause 1.1.1.1.1 Req 2)
+    sql = sqlite3_mprintf("PRAGMA application_id = %d", GPKG_APPLICATION_ID);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Set User Version (Clause 1.1.1.1.1 Req 2)
+    sql = sqlite3_mprintf("PRAGMA user_version = %d", userVersion);
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // C.1. gpkg_spatial_ref_sys
+    sql = sqlite3_mprintf("CREATE TABLE gpkg_spatial_ref_sys(\n   srs_name TEXT NOT NULL,\n   srs_id INTEGER NOT NULL PRIMARY KEY,\n   organization TEXT NOT NULL,\n   organization_coordsys_id INTEGER NOT NULL,\n   definition TEXT NOT NULL,\n   description TEXT\n)");
+    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
+        return;
+
+    // Default gpkg_spatial_ref_sys minimum records
+    sql = sqlite3_mprintf("INSERT INTO gpkg_spatial_ref_sys(srs_name, srs_id, organization, organization_coordsys_id, definition, description) VALUES('Undefined cartesian SRS', -1, 'NONE', -1, 'undefined', 'undefined cartesian coordinate reference system')");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+    sql = sqlite3_mprintf("INSERT INTO gpkg_spatial_ref_sys(srs_name, srs_id, organization, organization_coordsys_id, definition, description) VALUES('Undefined geographic SRS ', 0, 'NONE', 0, 'undefined', 'undefined geographic coordinate reference system')");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+    sql = sqlite3_mprintf("INSERT INTO gpkg_spatial_ref_sys(srs_name, srs_id, organization, organization_coordsys_id, definition, description) VALUES('WGS84', 4326, 'epsg', 4326, 'GEOGCS[\"WGS 84\",DATUM[\"WGS_1984\",SPHEROID[\"WGS 84\",6378137,298.257223563,AUTHORITY[\"EPSG\",\"7030\"]],AUTHORITY[\"EPSG\",\"6326\"]],PRIMEM[\"Greenwich\",0,AUTHORITY[\"EPSG\",\"8901\"]],UNIT[\"degree\",0.0174532925199433,AUTHORITY[\"EPSG\",\"9122\"]],AUTHORITY[\"EPSG\",\"4326\"]]', 'longitude/latitude coordinates in decimal degrees on the WGS 84 spheroid')");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // C.2. gpkg_contents
+    sql = sqlite3_mprintf("CREATE TABLE gpkg_contents(\n   table_name TEXT NOT NULL PRIMARY KEY,\n   data_type TEXT NOT NULL,\n   identifier TEXT UNIQUE,\n   description TEXT DEFAULT '',\n   last_change DATETIME NOT NULL DEFAULT(strftime('%%Y-%%m-%%dT%%H:%%M:%%fZ', 'now')),\n   min_x DOUBLE,\n   min_y DOUBLE,\n   max_x DOUBLE,\n   max_y DOUBLE,\n   srs_id INTEGER,\n   CONSTRAINT fk_gc_r_srs_id FOREIGN KEY(srs_id) REFERENCES gpkg_spatial_ref_sys(srs_id)\n)");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // C.3. gpkg_geometry_columns
+    sql = sqlite3_mprintf("CREATE TABLE gpkg_geometry_columns(\n   table_name TEXT NOT NULL,\n   column_name TEXT NOT NULL,\n   geometry_type_name TEXT NOT NULL,\n   srs_id INTEGER NOT NULL,\n   z TINYINT NOT NULL,\n   m TINYINT NOT NULL,\n   CONSTRAINT pk_geom_cols PRIMARY KEY(table_name, column_name),\n   CONSTRAINT fk_gc_tn FOREIGN KEY(table_name) REFERENCES gpkg_contents(table_name),\n   CONSTRAINT fk_gc_srs FOREIGN KEY(srs_id) REFERENCES gpkg_spatial_ref_sys(srs_id)\n)");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // C.5. gpkg_tile_matrix_set
+    sql = sqlite3_mprintf("CREATE TABLE gpkg_tile_matrix_set(\n   table_name TEXT NOT NULL PRIMARY KEY,\n   srs_id INTEGER NOT NULL,\n   min_x DOUBLE NOT NULL,\n   min_y DOUBLE NOT NULL,\n   max_x DOUBLE NOT NULL,\n   max_y DOUBLE NOT NULL,\n   CONSTRAINT fk_gtms_table_name FOREIGN KEY(table_name) REFERENCES gpkg_contents(table_name),\n   CONSTRAINT fk_gtms_srs FOREIGN KEY(srs_id) REFERENCES gpkg_spatial_ref_sys(srs_id)\n)");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // C.6. gpkg_tile_matrix
+    sql = sqlite3_mprintf("CREATE TABLE gpkg_tile_matrix(\n   table_name TEXT NOT NULL,\n   zoom_level INTEGER NOT NULL,\n   matrix_width INTEGER NOT NULL,\n   matrix_height INTEGER NOT NULL,\n   tile_width INTEGER NOT NULL,\n   tile_height INTEGER NOT NULL,\n   pixel_x_size DOUBLE NOT NULL,\n   pixel_y_size DOUBLE NOT NULL,\n   CONSTRAINT pk_ttm PRIMARY KEY(table_name, zoom_level),\n   CONSTRAINT fk_tmm_table_name FOREIGN KEY(table_name) REFERENCES gpkg_contents(table_name)\n)");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // D.1. gpkg_tile_matrix triggers
+    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_zoom_level_insert' BEFORE INSERT ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'insert on table ''gpkg_tile_matrix'' violates constraint: zoom_level cannot be less than 0') WHERE (NEW.zoom_level < 0);\nEND;");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_zoom_level_update' BEFORE UPDATE of zoom_level ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'update on table ''gpkg_tile_matrix'' violates constraint: zoom_level cannot be less than 0') WHERE (NEW.zoom_level < 0);\nEND;");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_matrix_width_insert' BEFORE INSERT ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'insert on table ''gpkg_tile_matrix'' violates constraint: matrix_width cannot be less than 1') WHERE (NEW.matrix_width < 1);\nEND;");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_matrix_width_update' BEFORE UPDATE OF matrix_width ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'update on table ''gpkg_tile_matrix'' violates constraint: matrix_width cannot be less than 1') WHERE (NEW.matrix_width < 1);\nEND;");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_matrix_height_insert' BEFORE INSERT ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'insert on table ''gpkg_tile_matrix'' violates constraint: matrix_height cannot be less than 1') WHERE (NEW.matrix_height < 1);\nEND;");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_matrix_height_update' BEFORE UPDATE OF matrix_height ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'update on table ''gpkg_tile_matrix'' violates constraint: matrix_height cannot be less than 1') WHERE (NEW.matrix_height < 1);\nEND;");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_pixel_x_size_insert' BEFORE INSERT ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'insert on table ''gpkg_tile_matrix'' violates constraint: pixel_x_size must be greater than 0') WHERE NOT (NEW.pixel_x_size > 0);\nEND;");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_pixel_x_size_update' BEFORE UPDATE OF pixel_x_size ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'update on table ''gpkg_tile_matrix'' violates constraint: pixel_x_size must be greater than 0') WHERE NOT (NEW.pixel_x_size > 0);\nEND;");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_pixel_y_size_insert' BEFORE INSERT ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'insert on table ''gpkg_tile_matrix'' violates constraint: pixel_y_size must be greater than 0') WHERE NOT (NEW.pixel_y_size > 0);\nEND;");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_pixel_y_size_update' BEFORE UPDATE OF pixel_y_size ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'update on table ''gpkg_tile_matrix'' violates constraint: pixel_y_size must be greater than 0') WHERE NOT (NEW.pixel_y_size > 0);\nEND;");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+
+    // C.8. gpkg_extensions
+    sql = sqlite3_mprintf("CREATE TABLE gpkg_extensions(\n   table_name TEXT, column_name TEXT,\n   extension_name TEXT NOT NULL,\n   definition TEXT NOT NULL,\n   scope TEXT NOT NULL,\n   CONSTRAINT ge_tce UNIQUE(table_name, column_name, extension_name)\n)");
+    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
+    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
+        return;
+}
+
+// Virtual table of the table-valued functions that only need the database connection
+typedef struct tableFunctionVtab
+{
+    sqlite3_vtab base; // Base class. Must be first
+    sqlite3 *db;       // Database connection
+} tableFunctionVtab;
+
+// Connects a table-valued function declared with the schema passed as pAux
+static int tableFunctionConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr)
+{
+    tableFunctionVtab *vtab;
+    int rc;
+
+    rc = sqlite3_declare_vtab(db, (const char *)pAux);
+    if (rc != SQLITE_OK)
+        return rc;
+    vtab = (tableFunctionVtab *)sqlite3_malloc(sizeof(tableFunctionVtab));
+    if (vtab == NULL)
+        return SQLITE_NOMEM;
+    memset(vtab, 0, sizeof(tableFunctionVtab));
+    vtab->db = db;
+    *ppVtab = &vtab->base;
+    return SQLITE_OK;
+}
+
+// Disconnects a table-valued function
+static int tableFunctionDisconnect(sqlite3_vtab *vtab)
+{
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
+
+// xBestIndex of the table-valued functions whose parameters are hidden columns
+// The parameters are the equality constraints on the hidden columns, passed to xFilter in the order of the columns
+// idxNum gets a bit for each hidden column constrained
+// info -> sqlite3_index_info
+// firstParam, lastParam -> First and last hidden columns
+// required -> Bit mask of the hidden columns that are mandatory
+static int tableFunctionBestIndex(sqlite3_index_info *info, int firstParam, int lastParam, int required)
+{
+    int argvIndex[32];
+    int mask = 0;
+    int n = 0;
+
+    for (int column = firstParam; column <= lastParam; column++)
+        argvIndex[column] = -1;
+    for (int i = 0; i < info->nConstraint; i++)
+    {
+        int column = info->aConstraint[i].iColumn;
+        if (column < firstParam || column > lastParam || !info->aConstraint[i].usable || info->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ)
+            continue;
+        argvIndex[column] = i;
+        mask |= 1 << column;
+    }
+    for (int column = firstParam; column <= lastParam; column++)
+    {
+        if (argvIndex[column] >= 0)
+        {
+            info->aConstraintUsage[argvIndex[column]].argvIndex = ++n;
+            info->aConstraintUsage[argvIndex[column]].omit = 1;
+        }
+    }
+    info->idxNum = mask;
+    // Without the mandatory parameters the function can't be evaluated
+    if ((mask & required) != required)
+        info->estimatedCost = 1e99;
+    else
+        info->estimatedCost = 1000.0;
+    return SQLITE_OK;
+}
+
+// Table-valued function: GPKG_SpatialWindow(tableName, geometryColumn, minX, minY, maxX, maxY, minZ, maxZ)
+// Returns the id of the features whose envelope intersects the window, looking at the spatial index rtree_tableName_geometryColumn
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// minX, minY, maxX, maxY -> Window to query
+// minZ, maxZ -> optional parameters. Altitude range of the window. The spatial index must be 3D (see GPKG_AddSpatialIndex)
+// Usage: SELECT id FROM GPKG_SpatialWindow('buildings', 'geom', 0, 0, 100, 100, 10, 20)
+
+// Columns of GPKG_SpatialWindow
+#define SPATIALWINDOW_ID 0
+#define SPATIALWINDOW_TABLE 1
+#define SPATIALWINDOW_COLUMN 2
+#define SPATIALWINDOW_MINX 3
+#define SPATIALWINDOW_MINY 4
+#define SPATIALWINDOW_MAXX 5
+#define SPATIALWINDOW_MAXY 6
+#define SPATIALWINDOW_MINZ 7
+#define SPATIALWINDOW_MAXZ 8
+#define SPATIALWINDOW_SCHEMA "CREATE TABLE x(id, table_name HIDDEN, column_name HIDDEN, minx HIDDEN, miny HIDDEN, maxx HIDDEN, maxy HIDDEN, minz HIDDEN, maxz HIDDEN)"
+
+// Cursor of GPKG_SpatialWindow
+typedef struct spatialWindowCursor
+{
+    sqlite3_vtab_cursor base; // Base class. Must be first
+    sqlite3_stmt *stmt;       // Query on the rtree
+    int eof;                  // 1 when there are no more rows
+} spatialWindowCursor;
+
+// Opens a cursor on GPKG_SpatialWindow
+static int spatialWindowOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    spatialWindowCursor *cur;
+
+    cur = (spatialWindowCursor *)sqlite3_malloc(sizeof(spatialWindowCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(spatialWindowCursor));
+    cur->eof = 1;
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+// Closes a cursor on GPKG_SpatialWindow
+static int spatialWindowClose(sqlite3_vtab_cursor *cursor)
+{
+    spatialWindowCursor *cur = (spatialWindowCursor *)cursor;
+
+    sqlite3_finalize(cur->stmt);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+static int spatialWindowBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    return tableFunctionBestIndex(info, SPATIALWINDOW_TABLE, SPATIALWINDOW_MAXZ, 0x7E);
+}
+
+// Moves the cursor to the next row
+static int spatialWindowNext(sqlite3_vtab_cursor *cursor)
+{
+    spatialWindowCursor *cur = (spatialWindowCursor *)cursor;
+    int rc;
+
+    rc = sqlite3_step(cur->stmt);
+    if (rc == SQLITE_ROW)
+        return SQLITE_OK;
+    cur->eof = 1;
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+// Queries the rtree with the window passed as parameters
+static int spatialWindowFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
+{
+    spatialWindowCursor *cur = (spatialWindowCursor *)cursor;
+    sqlite3 *db;
+    char *sql;
+    int hasZ;
+    int rc;
+
+    sqlite3_finalize(cur->stmt);
+    cur->stmt = NULL;
+    cur->eof = 1;
+    if ((idxNum & 0x7E) != 0x7E)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_SpatialWindow() error: tableName, geometryColumn, minX, minY, maxX and maxY are mandatory");
+        return SQLITE_ERROR;
+    }
+    hasZ = (idxNum & 0x180) == 0x180;
+    if (!hasZ && (idxNum & 0x180) != 0)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_SpatialWindow() error: minZ and maxZ must be specified together");
+        return SQLITE_ERROR;
+    }
+
+    // Get DB handle
+    db = ((tableFunctionVtab *)cursor->pVtab)->db;
+
+    sql = sqlite3_mprintf("SELECT id FROM \"rtree_%w_%w\" WHERE minx <= ?5 AND maxx >= ?3 AND miny <= ?6 AND maxy >= ?4%s",
+        (const char *)sqlite3_value_text(argv[0]), (const char *)sqlite3_value_text(argv[1]), hasZ ? " AND minz <= ?8 AND maxz >= ?7" : "");
+    rc = sqlite3_prepare_v2(db, sql, -1, &cur->stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_SpatialWindow() error: %s", sqlite3_errmsg(db));
+        return rc;
+    }
+    for (int i = 2; i < argc; i++)
+        sqlite3_bind_value(cur->stmt, i + 1, argv[i]);
+    cur->eof = 0;
+    return spatialWindowNext(cursor);
+}
+
+// Returns 1 if there are no more rows
+static int spatialWindowEof(sqlite3_vtab_cursor *cursor)
+{
+    return ((spatialWindowCursor *)cursor)->eof;
+}
+
+// Returns the value of a column. Only the id is returned, the hidden columns are the parameters
+static int spatialWindowColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    spatialWindowCursor *cur = (spatialWindowCursor *)cursor;
+
+    if (column == SPATIALWINDOW_ID)
+        sqlite3_result_value(context, sqlite3_column_value(cur->stmt, 0));
+    return SQLITE_OK;
+}
+
+// The rowid is the id of the feature
+static int spatialWindowRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = sqlite3_column_int64(((spatialWindowCursor *)cursor)->stmt, 0);
+    return SQLITE_OK;
+}
+
+static sqlite3_module spatialWindowModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    tableFunctionConnect,    // xConnect
+    spatialWindowBestIndex,  // xBestIndex
+    tableFunctionDisconnect, // xDisconnect
+    0,                       // xDestroy
+    spatialWindowOpen,       // xOpen
+    spatialWindowClose,      // xClose
+    spatialWindowFilter,     // xFilter
+    spatialWindowNext,       // xNext
+    spatialWindowEof,        // xEof
+    spatialWindowColumn,     // xColumn
+    spatialWindowRowid,      // xRowid
+    0, 0, 0, 0, 0, 0, 0       // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Table-valued function: GPKG_PointWindow(tableName, geometryColumn, minX, minY, maxX, maxY)
+// Returns the id, x and y of the Points inside the window, looking at the point index pointidx_tableName_geometryColumn
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// minX, minY, maxX, maxY -> Window to query
+// The window is covered with at most 17 x 17 cells of the Hilbert grid, whose keys are merged in ranges of the point index
+// Usage: SELECT id, x, y FROM GPKG_PointWindow('addresses', 'geom', 0, 0, 100, 100)
+
+// Columns of GPKG_PointWindow
+#define POINTWINDOW_ID 0
+#define POINTWINDOW_X 1
+#define POINTWINDOW_Y 2
+#define POINTWINDOW_TABLE 3
+#define POINTWINDOW_COLUMN 4
+#define POINTWINDOW_MINX 5
+#define POINTWINDOW_MINY 6
+#define POINTWINDOW_MAXX 7
+#define POINTWINDOW_MAXY 8
+#define POINTWINDOW_SCHEMA "CREATE TABLE x(id, x, y, table_name HIDDEN, column_name HIDDEN, minx HIDDEN, miny HIDDEN, maxx HIDDEN, maxy HIDDEN)"
+
+// Maximum number of cells of the Hilbert grid per axis used to cover a window
+#define HILBERT_MAX_CELLS 16
+
+// Compares two ranges of Hilbert keys for qsort
+static int compareHilbertRanges(const void *a, const void *b)
+{
+    sqlite3_int64 ka = *(const sqlite3_int64 *)a;
+    sqlite3_int64 kb = *(const sqlite3_int64 *)b;
+
+    return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+// Computes the sorted ranges of Hilbert keys that cover a window
+// ext -> Extent of the point index (minX, minY, maxX, maxY)
+// box -> Window (minX, minY, maxX, maxY)
+// ranges <- Array of pairs (first key, last key). Must be freed with sqlite3_free
+// Returns the number of ranges or -1 if there is no memory
+static int hilbertRanges(const double *ext, const double *box, sqlite3_int64 **ranges)
+{
+    unsigned int x0, y0, x1, y1;
+    int shift = 0;
+    int n = 0;
+    sqlite3_int64 *r;
+
+    x0 = hilbertCell(box[0], ext[0], ext[2]);
+    y0 = hilbertCell(box[1], ext[1], ext[3]);
+    x1 = hilbertCell(box[2], ext[0], ext[2]);
+    y1 = hilbertCell(box[3], ext[1], ext[3]);
+    // Go up in the grid until the window is covered by a few cells
+    while ((x1 >> shift) - (x0 >> shift) > HILBERT_MAX_CELLS || (y1 >> shift) - (y0 >> shift) > HILBERT_MAX_CELLS)
+        shift++;
+    x0 >>= shift;
+    y0 >>= shift;
+    x1 >>= shift;
+    y1 >>= shift;
+    r = (sqlite3_int64 *)sqlite3_malloc64(sizeof(sqlite3_int64) * 2 * (x1 - x0 + 1) * (y1 - y0 + 1));
+    if (r == NULL)
+        return -1;
+    for (unsigned int x = x0; x <= x1; x++)
+    {
+        for (unsigned int y = y0; y <= y1; y++)
+        {
+            sqlite3_int64 key = hilbertKey(x, y, HILBERT_ORDER - shift);
+            r[n * 2] = key << (2 * shift);
+            r[n * 2 + 1] = ((key + 1) << (2 * shift)) - 1;
+            n++;
+        }
+    }
+    // Sort and merge the consecutive ranges
+    qsort(r, n, sizeof(sqlite3_int64) * 2, compareHilbertRanges);
+    int merged = 0;
+    for (int i = 1; i < n; i++)
+    {
+        if (r[i * 2] == r[merged * 2 + 1] + 1)
+            r[merged * 2 + 1] = r[i * 2 + 1];
+        else
+        {
+            merged++;
+            r[merged * 2] = r[i * 2];
+            r[merged * 2 + 1] = r[i * 2 + 1];
+        }
+    }
+    *ranges = r;
+    return merged + 1;
+}
+
+// Cursor of GPKG_PointWindow
+typedef struct pointWindowCursor
+{
+    sqlite3_vtab_cursor base; // Base class. Must be first
+    sqlite3_stmt *stmt;       // Query on a range of the point index
+    sqlite3_int64 *ranges;    // Ranges of Hilbert keys that cover the window
+    int numRanges;            // Number of ranges
+    int range;                // Range being queried
+    double box[4];            // Window
+    int eof;                  // 1 when there are no more rows
+} pointWindowCursor;
+
+// Opens a cursor on GPKG_PointWindow
+static int pointWindowOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    pointWindowCursor *cur;
+
+    cur = (pointWindowCursor *)sqlite3_malloc(sizeof(pointWindowCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(pointWindowCursor));
+    cur->eof = 1;
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+// Closes a cursor on GPKG_PointWindow
+static int pointWindowClose(sqlite3_vtab_cursor *cursor)
+{
+    pointWindowCursor *cur = (pointWindowCursor *)cursor;
+
+    sqlite3_finalize(cur->stmt);
+    sqlite3_free(cur->ranges);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+static int pointWindowBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    return tableFunctionBestIndex(info, POINTWINDOW_TABLE, POINTWINDOW_MAXY, 0x1F8);
+}
+
+// Moves the cursor to the next Point inside the window, going through the ranges of the point index
+static int pointWindowNext(sqlite3_vtab_cursor *cursor)
+{
+    pointWindowCursor *cur = (pointWindowCursor *)cursor;
+    double x, y;
+    int rc;
+
+    while (cur->range < cur->numRanges)
+    {
+        rc = sqlite3_step(cur->stmt);
+        if (rc == SQLITE_ROW)
+        {
+            x = sqlite3_column_double(cur->stmt, 1);
+            y = sqlite3_column_double(cur->stmt, 2);
+            if (x >= cur->box[0] && x <= cur->box[2] && y >= cur->box[1] && y <= cur->box[3])
+                return SQLITE_OK;
+            continue;
+        }
+        if (rc != SQLITE_DONE)
+            return rc;
+        // Next range
+        if (++cur->range < cur->numRanges)
+        {
+            sqlite3_reset(cur->stmt);
+            sqlite3_bind_int64(cur->stmt, 1, cur->ranges[cur->range * 2]);
+            sqlite3_bind_int64(cur->stmt, 2, cur->ranges[cur->range * 2 + 1]);
+        }
+    }
+    cur->eof = 1;
+    return SQLITE_OK;
+}
+
+// Computes the ranges of the point index that cover the window passed as parameter
+static int pointWindowFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
+{
+    pointWindowCursor *cur = (pointWindowCursor *)cursor;
+    const char *table;
+    const char *gcolumn;
+    double ext[4];
+    sqlite3 *db;
+    char *sql;
+    int rc;
+
+    sqlite3_finalize(cur->stmt);
+    cur->stmt = NULL;
+    sqlite3_free(cur->ranges);
+    cur->ranges = NULL;
+    cur->eof = 1;
+    if ((idxNum & 0x1F8) != 0x1F8)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_PointWindow() error: tableName, geometryColumn, minX, minY, maxX and maxY are mandatory");
+        return SQLITE_ERROR;
+    }
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    for (int i = 0; i < 4; i++)
+        cur->box[i] = sqlite3_value_double(argv[2 + i]);
+
+    // Get DB handle
+    db = ((tableFunctionVtab *)cursor->pVtab)->db;
+
+    rc = readPointIndexExtent(db, table, gcolumn, ext);
+    if (rc != SQLITE_OK)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_PointWindow() error: %s", rc == SQLITE_NOTFOUND ? "there is no point index" : sqlite3_errmsg(db));
+        return SQLITE_ERROR;
+    }
+    cur->numRanges = hilbertRanges(ext, cur->box, &cur->ranges);
+    if (cur->numRanges < 0)
+        return SQLITE_NOMEM;
+
+    sql = sqlite3_mprintf("SELECT id, x, y FROM \"pointidx_%w_%w\" WHERE hkey BETWEEN ?1 AND ?2",
+        table, gcolumn);
+    rc = sqlite3_prepare_v2(db, sql, -1, &cur->stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_PointWindow() error: %s", sqlite3_errmsg(db));
+        return rc;
+    }
+    cur->range = 0;
+    sqlite3_bind_int64(cur->stmt, 1, cur->ranges[0]);
+    sqlite3_bind_int64(cur->stmt, 2, cur->ranges[1]);
+    cur->eof = 0;
+    return pointWindowNext(cursor);
+}
+
+// Returns 1 if there are no more rows
+static int pointWindowEof(sqlite3_vtab_cursor *cursor)
+{
+    return ((pointWindowCursor *)cursor)->eof;
+}
+
+// Returns the value of a column. The hidden columns are the parameters
+static int pointWindowColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    pointWindowCursor *cur = (pointWindowCursor *)cursor;
+
+    if (column <= POINTWINDOW_Y)
+        sqlite3_result_value(context, sqlite3_column_value(cur->stmt, column));
+    return SQLITE_OK;
+}
+
+// The rowid is the id of the feature
+static int pointWindowRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = sqlite3_column_int64(((pointWindowCursor *)cursor)->stmt, 0);
+    return SQLITE_OK;
+}
+
+static sqlite3_module pointWindowModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    tableFunctionConnect,    // xConnect
+    pointWindowBestIndex,    // xBestIndex
+    tableFunctionDisconnect, // xDisconnect
+    0,                       // xDestroy
+    pointWindowOpen,         // xOpen
+    pointWindowClose,        // xClose
+    pointWindowFilter,       // xFilter
+    pointWindowNext,         // xNext
+    pointWindowEof,          // xEof
+    pointWindowColumn,       // xColumn
+    pointWindowRowid,        // xRowid
+    0, 0, 0, 0, 0, 0, 0       // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Table-valued function: GPKG_PointKNN(tableName, geometryColumn, x, y, k)
+// Returns the id, x, y and distance of the k Points nearest to (x, y) sorted by distance, looking at the point index pointidx_tableName_geometryColumn
+// tableName -> Name of the table
+// geometryColumn -> Column that contains the geometry
+// x, y -> Coordinate to query
+// k -> Number of Points to return
+// Queries windows of growing size around (x, y) until there are k Points at a distance not greater than half the size of the window
+// Usage: SELECT id, distance FROM GPKG_PointKNN('addresses', 'geom', 10, 10, 5)
+
+// Columns of GPKG_PointKNN
+#define POINTKNN_ID 0
+#define POINTKNN_X 1
+#define POINTKNN_Y 2
+#define POINTKNN_DISTANCE 3
+#define POINTKNN_TABLE 4
+#define POINTKNN_COLUMN 5
+#define POINTKNN_QUERYX 6
+#define POINTKNN_QUERYY 7
+#define POINTKNN_K 8
+#define POINTKNN_SCHEMA "CREATE TABLE x(id, x, y, distance, table_name HIDDEN, column_name HIDDEN, query_x HIDDEN, query_y HIDDEN, k HIDDEN)"
+
+// Point found by GPKG_PointKNN
+typedef struct pointKNNItem
+{
+    sqlite3_int64 id;
+    double x;
+    double y;
+    double distance;
+} pointKNNItem;
+
+// Cursor of GPKG_PointKNN
+typedef struct pointKNNCursor
+{
+    sqlite3_vtab_cursor base; // Base class. Must be first
+    pointKNNItem *items;      // Points found sorted by distance
+    int numItems;             // Number of Points found
+    int maxItems;             // Allocated Points
+    int item;                 // Current Point
+} pointKNNCursor;
+
+// Compares two Points by distance for qsort
+static int comparePointKNNItems(const void *a, const void *b)
+{
+    double da = ((const pointKNNItem *)a)->distance;
+    double db = ((const pointKNNItem *)b)->distance;
+
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+// Opens a cursor on GPKG_PointKNN
+static int pointKNNOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    pointKNNCursor *cur;
+
+    cur = (pointKNNCursor *)sqlite3_malloc(sizeof(pointKNNCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(pointKNNCursor));
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+// Closes a cursor on GPKG_PointKNN
+static int pointKNNClose(sqlite3_vtab_cursor *cursor)
+{
+    pointKNNCursor *cur = (pointKNNCursor *)cursor;
+
+    sqlite3_free(cur->items);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+static int pointKNNBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    int rc = tableFunctionBestIndex(info, POINTKNN_TABLE, POINTKNN_K, 0x1F0);
+
+    // The rows are returned sorted by distance
+    if (info->nOrderBy == 1 && info->aOrderBy[0].iColumn == POINTKNN_DISTANCE && !info->aOrderBy[0].desc)
+        info->orderByConsumed = 1;
+    return rc;
+}
+
+// Collects the Points of the point index inside a window
+// cur -> Cursor where the Points are collected
+// stmt -> Query on a range of the point index
+// ext -> Extent of the point index
+// box -> Window (minX, minY, maxX, maxY). NULL to collect all the Points
+// qx, qy -> Coordinate to query, to compute the distances
+// Returns SQLITE_OK or an SQLite error code
+static int pointKNNCollect(pointKNNCursor *cur, sqlite3_stmt *stmt, const double *ext, const double *box, double qx, double qy)
+{
+    static const double world[4] = { -HUGE_VAL, -HUGE_VAL, HUGE_VAL, HUGE_VAL };
+    sqlite3_int64 *ranges;
+    int numRanges;
+    int rc = SQLITE_OK;
+
+    if (box == NULL)
+        box = world;
+    numRanges = hilbertRanges(ext, box, &ranges);
+    if (numRanges < 0)
+        return SQLITE_NOMEM;
+    cur->numItems = 0;
+    for (int i = 0; i < numRanges && rc == SQLITE_OK; i++)
+    {
+        sqlite3_reset(stmt);
+        sqlite3_bind_int64(stmt, 1, ranges[i * 2]);
+        sqlite3_bind_int64(stmt, 2, ranges[i * 2 + 1]);
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            double x = sqlite3_column_double(stmt, 1);
+            double y = sqlite3_column_double(stmt, 2);
+            if (x < box[0] || x > box[2] || y < box[1] || y > box[3])
+                continue;
+            if (cur->numItems == cur->maxItems)
+            {
+                int maxItems = cur->maxItems ? cur->maxItems * 2 : 64;
+                pointKNNItem *items = (pointKNNItem *)sqlite3_realloc64(cur->items, sizeof(pointKNNItem) * maxItems);
+                if (items == NULL)
+                {
+                    sqlite3_free(ranges);
+                    return SQLITE_NOMEM;
+                }
+                cur->items = items;
+                cur->maxItems = maxItems;
+            }
+            cur->items[cur->numItems].id = sqlite3_column_int64(stmt, 0);
+            cur->items[cur->numItems].x = x;
+            cur->items[cur->numItems].y = y;
+            cur->items[cur->numItems].distance = sqrt((x - qx) * (x - qx) + (y - qy) * (y - qy));
+            cur->numItems++;
+        }
+        if (rc == SQLITE_DONE)
+            rc = SQLITE_OK;
+    }
+    sqlite3_free(ranges);
+    return rc;
+}
+
+// Searches the k nearest Points
+static int pointKNNFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
+{
+    pointKNNCursor *cur = (pointKNNCursor *)cursor;
+    const char *table;
+    const char *gcolumn;
+    double qx, qy, radius;
+    double ext[4];
+    double box[4];
+    int k, found;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    char *sql;
+    int rc;
+
+    cur->numItems = 0;
+    cur->item = 0;
+    if ((idxNum & 0x1F0) != 0x1F0)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_PointKNN() error: tableName, geometryColumn, x, y and k are mandatory");
+        return SQLITE_ERROR;
+    }
+    table = (const char *)sqlite3_value_text(argv[0]);
+    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+    qx = sqlite3_value_double(argv[2]);
+    qy = sqlite3_value_double(argv[3]);
+    k = sqlite3_value_int(argv[4]);
+    if (k <= 0)
+        return SQLITE_OK;
+
+    // Get DB handle
+    db = ((tableFunctionVtab *)cursor->pVtab)->db;
+
+    rc = readPointIndexExtent(db, table, gcolumn, ext);
+    if (rc != SQLITE_OK)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_PointKNN() error: %s", rc == SQLITE_NOTFOUND ? "there is no point index" : sqlite3_errmsg(db));
+        return SQLITE_ERROR;
+    }
+    sql = sqlite3_mprintf("SELECT id, x, y FROM \"pointidx_%w_%w\" WHERE hkey BETWEEN ?1 AND ?2",
+        table, gcolumn);
+    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_PointKNN() error: %s", sqlite3_errmsg(db));
+        return rc;
+    }
+
+    // Start with a window of a few cells of the grid and double it
+    radius = (ext[2] - ext[0] > ext[3] - ext[1] ? ext[2] - ext[0] : ext[3] - ext[1]) / (1 << HILBERT_ORDER) * 4;
+    for (;;)
+    {
+        box[0] = qx - radius;
+        box[1] = qy - radius;
+        box[2] = qx + radius;
+        box[3] = qy + radius;
+        if (box[0] <= ext[0] && box[1] <= ext[1] && box[2] >= ext[2] && box[3] >= ext[3])
+        {
+            // The window covers the whole grid: the Points outside the extent may be further
+            rc = pointKNNCollect(cur, stmt, ext, NULL, qx, qy);
+            break;
+        }
+        rc = pointKNNCollect(cur, stmt, ext, box, qx, qy);
+        if (rc != SQLITE_OK)
+            break;
+        found = 0;
+        for (int i = 0; i < cur->numItems; i++)
+        {
+            if (cur->items[i].distance <= radius)
+                found++;
+        }
+        if (found >= k)
+            break;
+        radius *= 2;
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_OK)
+        return rc;
+    qsort(cur->items, cur->numItems, sizeof(pointKNNItem), comparePointKNNItems);
+    if (cur->numItems > k)
+        cur->numItems = k;
+    return SQLITE_OK;
+}
+
+// Moves the cursor to the next Point
+static int pointKNNNext(sqlite3_vtab_cursor *cursor)
+{
+    ((pointKNNCursor *)cursor)->item++;
+    return SQLITE_OK;
+}
+
+// Returns 1 if there are no more rows
+static int pointKNNEof(sqlite3_vtab_cursor *cursor)
+{
+    pointKNNCursor *cur = (pointKNNCursor *)cursor;
+
+    return cur->item >= cur->numItems;
+}
+
+// Returns the value of a column. The hidden columns are the parameters
+static int pointKNNColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    pointKNNCursor *cur = (pointKNNCursor *)cursor;
+    pointKNNItem *item = &cur->items[cur->item];
+
+    switch (column)
+    {
+    case POINTKNN_ID: sqlite3_result_int64(context, item->id); break;
+    case POINTKNN_X: sqlite3_result_double(context, item->x); break;
+    case POINTKNN_Y: sqlite3_result_double(context, item->y); break;
+    case POINTKNN_DISTANCE: sqlite3_result_double(context, item->distance); break;
+    default: break;
+    }
+    return SQLITE_OK;
+}
+
+// The rowid is the rank of the Point
+static int pointKNNRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = ((pointKNNCursor *)cursor)->item + 1;
+    return SQLITE_OK;
+}
+
+static sqlite3_module pointKNNModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    tableFunctionConnect,    // xConnect
+    pointKNNBestIndex,       // xBestIndex
+    tableFunctionDisconnect, // xDisconnect
+    0,                       // xDestroy
+    pointKNNOpen,            // xOpen
+    pointKNNClose,           // xClose
+    pointKNNFilter,          // xFilter
+    pointKNNNext,            // xNext
+    pointKNNEof,             // xEof
+    pointKNNColumn,          // xColumn
+    pointKNNRowid,           // xRowid
+    0, 0, 0, 0, 0, 0, 0       // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Node of an rtree read from its shadow table rtree_tableName_geometryColumn_node
+typedef struct rtreeNode
+{
+    int numCells;          // Number of cells of the node
+    int maxCells;          // Allocated cells
+    sqlite3_int64 *ids;    // Id of the feature (leaf nodes) or number of the child node (internal nodes) of each cell
+    double *boxes;         // Envelope (minX, minY, maxX, maxY) of each cell
+} rtreeNode;
+
+// Reader of the nodes of an rtree
+typedef struct rtreeReader
+{
+    sqlite3_stmt *stmt; // Query on the shadow table of the nodes
+    int dimension;      // Number of dimensions of the rtree (2 or 3)
+    int depth;          // Depth of the rtree. The leaves are at level 0 and the root at level depth
+} rtreeReader;
+
+// Reads a 4 byte big endian float from a node of an rtree
+static double getRtreeCoord(const unsigned char *p)
+{
+    unsigned int i = ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+    float f;
+
+    memcpy(&f, &i, 4);
+    return f;
+}
+
+// Reads a node of an rtree. The format of the node is the one of the SQLite rtree module:
+// 2 bytes with the depth of the tree (only meaningful in the root), 2 bytes with the number of cells and the cells.
+// Each cell has the 8 bytes of the id and 2 big endian floats (min and max) for each dimension, all in big endian
+// reader -> Reader of the rtree
+// nodeNo -> Number of the node. The root is the node 1
+// node <- Node read. Its buffers are reused
+// Returns SQLITE_OK or an SQLite error code
+static int readRtreeNode(rtreeReader *reader, sqlite3_int64 nodeNo, rtreeNode *node)
+{
+    const unsigned char *p;
+    int n_bytes;
+    int cellSize = 8 + reader->dimension * 8;
+    int rc;
+
+    node->numCells = 0;
+    sqlite3_reset(reader->stmt);
+    sqlite3_bind_int64(reader->stmt, 1, nodeNo);
+    rc = sqlite3_step(reader->stmt);
+    if (rc != SQLITE_ROW)
+        return rc == SQLITE_DONE ? SQLITE_CORRUPT : rc;
+    p = (const unsigned char *)sqlite3_column_blob(reader->stmt, 0);
+    n_bytes = sqlite3_column_bytes(reader->stmt, 0);
+    if (n_bytes < 4)
+        return SQLITE_CORRUPT;
+    if (nodeNo == 1)
+        reader->depth = (p[0] << 8) | p[1];
+    node->numCells = (p[2] << 8) | p[3];
+    if (4 + node->numCells * cellSize > n_bytes)
+        return SQLITE_CORRUPT;
+    if (node->numCells > node->maxCells)
+    {
+        sqlite3_int64 *ids = (sqlite3_int64 *)sqlite3_realloc64(node->ids, sizeof(sqlite3_int64) * node->numCells);
+        double *boxes;
+        if (ids == NULL)
+            return SQLITE_NOMEM;
+        node->ids = ids;
+        boxes = (double *)sqlite3_realloc64(node->boxes, sizeof(double) * 4 * node->numCells);
+        if (boxes == NULL)
+            return SQLITE_NOMEM;
+        node->boxes = boxes;
+        node->maxCells = node->numCells;
+    }
+    for (int i = 0; i < node->numCells; i++)
+    {
+        const unsigned char *cell = p + 4 + i * cellSize;
+        sqlite3_uint64 id = 0;
+        for (int j = 0; j < 8; j++)
+            id = (id << 8) | cell[j];
+        node->ids[i] = (sqlite3_int64)id;
+        node->boxes[i * 4] = getRtreeCoord(cell + 8);      // minX
+        node->boxes[i * 4 + 2] = getRtreeCoord(cell + 12); // maxX
+        node->boxes[i * 4 + 1] = getRtreeCoord(cell + 16); // minY
+        node->boxes[i * 4 + 3] = getRtreeCoord(cell + 20); // maxY
+    }
+    return SQLITE_OK;
+}
+
+// Releases the buffers of a node of an rtree
+static void freeRtreeNode(rtreeNode *node)
+{
+    sqlite3_free(node->ids);
+    sqlite3_free(node->boxes);
+    memset(node, 0, sizeof(rtreeNode));
+}
+
+// Opens a reader of the nodes of the spatial index of a table and reads the depth of the rtree
+// db -> sqlite3
+// table -> Name of the table
+// gcolumn -> Column that contains the geometry
+// reader <- Reader of the rtree
+// Returns SQLITE_OK or an SQLite error code
+static int openRtreeReader(sqlite3 *db, const char *table, const char *gcolumn, rtreeReader *reader)
+{
+    rtreeNode root;
+    char *sql;
+    int rc;
+
+    memset(reader, 0, sizeof(rtreeReader));
+    // The number of dimensions is given by the columns of the rtree
+    sql = sqlite3_mprintf("SELECT * FROM \"rtree_%w_%w\" LIMIT 0", table, gcolumn);
+    rc = sqlite3_prepare_v2(db, sql, -1, &reader->stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+        return rc;
+    reader->dimension = (sqlite3_column_count(reader->stmt) - 1) / 2;
+    sqlite3_finalize(reader->stmt);
+    sql = sqlite3_mprintf("SELECT data FROM \"rtree_%w_%w_node\" WHERE nodeno = ?1", table, gcolumn);
+    rc = sqlite3_prepare_v2(db, sql, -1, &reader->stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+        return rc;
+    memset(&root, 0, sizeof(rtreeNode));
+    rc = readRtreeNode(reader, 1, &root);
+    freeRtreeNode(&root);
+    return rc;
+}
+
+// Closes a reader of the nodes of an rtree
+static void closeRtreeReader(rtreeReader *reader)
+{
+    sqlite3_finalize(reader->stmt);
+    reader->stmt = NULL;
+}
+
+
+// Worker threads of GPKG_SpatialJoin and GPKG_PointsInPolygons. A connection can't be used by several threads at the same time,
+// so each worker opens its own read only connection to the database file
+typedef struct workerThread
+{
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    void (*run)(void *arg); // Function run by the thread
+    void *arg;              // Argument of the function
+    int started;            // 1 if the thread was started and has to be joined
+} workerThread;
+
+// Maximum number of worker threads of a query
+#define MAX_WORKER_THREADS 64
+
+#ifdef _WIN32
+static DWORD WINAPI workerThreadMain(LPVOID p)
+{
+    workerThread *thread = (workerThread *)p;
+
+    thread->run(thread->arg);
+    return 0;
+}
+#else
+static void *workerThreadMain(void *p)
+{
+    workerThread *thread = (workerThread *)p;
+
+    thread->run(thread->arg);
+    return NULL;
+}
+#endif
+
+// Starts a worker thread. If the thread can't be created the function is run in the calling thread
+static void startWorkerThread(workerThread *thread, void (*run)(void *arg), void *arg)
+{
+    thread->run = run;
+    thread->arg = arg;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, workerThreadMain, thread, 0, NULL);
+    thread->started = thread->handle != NULL;
+#else
+    thread->started = pthread_create(&thread->handle, NULL, workerThreadMain, thread) == 0;
+#endif
+    if (!thread->started)
+        run(arg);
+}
+
+// Waits until a worker thread ends
+static void joinWorkerThread(workerThread *thread)
+{
+    if (!thread->started)
+        return;
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    thread->started = 0;
+}
+
+// Returns the number of worker threads of a query
+// value -> Parameter threads: NULL for 1, 0 for one thread per processor
+// Returns the number of threads (1 means no worker threads) or -1 if the parameter is not valid
+static int workerThreadCount(sqlite3_value *value)
+{
+    int threads;
+
+    if (value == NULL || sqlite3_value_type(value) == SQLITE_NULL)
+        return 1;
+    if (sqlite3_value_type(value) != SQLITE_INTEGER || sqlite3_value_int64(value) < 0)
+        return -1;
+    threads = sqlite3_value_int64(value) > MAX_WORKER_THREADS ? MAX_WORKER_THREADS : sqlite3_value_int(value);
+    if (threads == 0)
+    {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        threads = (int)info.dwNumberOfProcessors;
+#else
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        threads = threads < 1 ? 1 : (threads > MAX_WORKER_THREADS ? MAX_WORKER_THREADS : threads);
+    }
+    return threads;
+}
+
+// Opens the read only connection of a worker to the main database of a connection
+// The workers only see the committed data, so there are no workers if the connection is in a transaction,
+// if the database is in memory or temporary or if SQLite is not thread safe
+// db -> Connection of the query
+// workerDb <- Connection of the worker. It must be closed with sqlite3_close
+// Returns SQLITE_OK or an SQLite error code
+static int openWorkerConnection(sqlite3 *db, sqlite3 **workerDb)
+{
+    const char *filename = sqlite3_db_filename(db, "main");
+    int rc;
+
+    *workerDb = NULL;
+    if (filename == NULL || filename[0] == '\0' || !sqlite3_threadsafe() || !sqlite3_get_autocommit(db))
+        return SQLITE_MISUSE;
+    rc = sqlite3_open_v2(filename, workerDb, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_close(*workerDb);
+        *workerDb = NULL;
+        return rc;
+    }
+    sqlite3_busy_timeout(*workerDb, 5000);
+    return SQLITE_OK;
+}
+
+// Table-valued function: GPKG_SpatialJoin(tableA, geometryColumnA, tableB, geometryColumnB, predicate, threads)
+// Returns the pairs of ids (id_a, id_b) of the features of tableA and tableB whose envelopes intersect
+// traversing synchronously the spatial indexes of both tables, instead of probing the rtree of tableB for each feature of tableA
+// tableA, tableB -> Name of the tables. Both need a spatial index (see GPKG_AddSpatialIndex)
+// geometryColumnA, geometryColumnB -> Columns that contain the geometries
+// predicate -> optional parameter. 'intersects', 'contains' (a contains b) or 'within' (a within b) to refine the pairs with the exact predicate.
+//              If not specified or 'envelope' returns all the candidate pairs
+// threads -> optional parameter. Number of worker threads, 0 for one per processor. By default 1, the traversal is done by the calling thread.
+//            The first levels of the rtrees are split in pairs of nodes that are traversed and refined by the workers, each one with its own
+//            read only connection to the database file. The pairs are returned in a different order. Without a database file or inside
+//            a transaction the workers wouldn't see the same data, so the traversal is done by the calling thread
+// Usage: SELECT id_a, id_b FROM GPKG_SpatialJoin('parcels', 'geom', 'flood_zones', 'geom', 'intersects', 0)
+
+// Columns of GPKG_SpatialJoin
+#define SPATIALJOIN_IDA 0
+#define SPATIALJOIN_IDB 1
+#define SPATIALJOIN_TABLEA 2
+#define SPATIALJOIN_COLUMNA 3
+#define SPATIALJOIN_TABLEB 4
+#define SPATIALJOIN_COLUMNB 5
+#define SPATIALJOIN_PREDICATE 6
+#define SPATIALJOIN_THREADS 7
+#define SPATIALJOIN_SCHEMA "CREATE TABLE x(id_a, id_b, table_a HIDDEN, column_a HIDDEN, table_b HIDDEN, column_b HIDDEN, predicate HIDDEN, threads HIDDEN)"
+
+// Pairs of nodes per worker thread in which the first levels of the rtrees are split
+#define SPATIALJOIN_SPLIT_PAIRS 64
+// Pairs of nodes given to each worker thread at a time. The pairs found are kept in memory until the cursor returns them
+#define SPATIALJOIN_ROUND_PAIRS 4
+
+// Pair of nodes of the rtrees pending to be traversed
+typedef struct spatialJoinPair
+{
+    sqlite3_int64 nodeA;
+    int levelA;
+    sqlite3_int64 nodeB;
+    int levelB;
+} spatialJoinPair;
+
+// Cell of a node sorted by its minimum X for the plane sweep
+typedef struct spatialJoinCell
+{
+    double minx;
+    int cell;
+} spatialJoinCell;
+
+// Traversal of the rtrees of both tables. Each worker thread has its own one on its own connection
+typedef struct spatialJoinTraversal
+{
+    rtreeReader readerA, readerB;   // Readers of the rtrees
+    rtreeNode nodeA, nodeB;         // Nodes being traversed
+    spatialJoinCell *sortA, *sortB; // Cells of the nodes sorted by minimum X
+    int maxSortA, maxSortB;
+    spatialJoinPair *stack;         // Pairs of nodes pending to be traversed
+    int numStack, maxStack;
+    sqlite3_int64 *candidates;      // Pairs of ids whose envelopes intersect
+    int numCandidates, maxCandidates, candidate;
+    int predicate;                  // Exact predicate to refine the candidates
+    sqlite3_stmt *stmtA, *stmtB;    // Queries of the geometries to refine the candidates
+    gpkgGeometry geomA, geomB;      // Geometries to refine the candidates
+    sqlite3_int64 idGeomA;          // Id of geomA, that is kept while the candidates have the same id_a
+    int geomAOk;                    // 1 if geomA was read correctly
+} spatialJoinTraversal;
+
+// Worker thread of GPKG_SpatialJoin
+typedef struct spatialJoinWorker
+{
+    workerThread thread;
+    sqlite3 *db;               // Read only connection of the worker
+    spatialJoinTraversal join; // Traversal of the pairs of nodes given to the worker
+    sqlite3_int64 *pairs;      // Pairs of ids found by the worker
+    int numPairs, maxPairs, pair;
+    int rc;                    // Result of the traversal
+} spatialJoinWorker;
+
+// Cursor of GPKG_SpatialJoin
+typedef struct spatialJoinCursor
+{
+    sqlite3_vtab_cursor base;    // Base class. Must be first
+    spatialJoinTraversal join;   // Traversal of the rtrees. With worker threads it only splits the first levels in pairs of nodes
+    spatialJoinWorker *workers;  // Worker threads or NULL
+    int numWorkers;
+    int worker;                  // Worker whose pairs are being returned
+    sqlite3_int64 idA, idB;      // Current pair
+    sqlite3_int64 rowid;         // Number of the current pair
+    int eof;                     // 1 when there are no more rows
+} spatialJoinCursor;
+
+// Compares two cells by minimum X for qsort
+static int compareSpatialJoinCells(const void *a, const void *b)
+{
+    double da = ((const spatialJoinCell *)a)->minx;
+    double db = ((const spatialJoinCell *)b)->minx;
+
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+// Opens the rtrees of both tables and the queries of the geometries
+// db -> Connection used by the traversal
+// predicate -> Exact predicate to refine the candidates
+// t <- Traversal. Must be zeroed or closed
+// Returns SQLITE_OK or an SQLite error code
+static int spatialJoinOpenTraversal(sqlite3 *db, const char *tableA, const char *gcolumnA, const char *tableB, const char *gcolumnB, int predicate, spatialJoinTraversal *t)
+{
+    char *sql;
+    int rc;
+
+    t->predicate = predicate;
+    t->idGeomA = -1;
+    rc = openRtreeReader(db, tableA, gcolumnA, &t->readerA);
+    if (rc == SQLITE_OK)
+        rc = openRtreeReader(db, tableB, gcolumnB, &t->readerB);
+    if (rc == SQLITE_OK && predicate != PREDICATE_ENVELOPE)
+    {
+        sql = sqlite3_mprintf("SELECT \"%w\" FROM \"%w\" WHERE rowid = ?1", gcolumnA, tableA);
+        rc = sqlite3_prepare_v2(db, sql, -1, &t->stmtA, NULL);
+        sqlite3_free(sql);
+        if (rc == SQLITE_OK)
+        {
+            sql = sqlite3_mprintf("SELECT \"%w\" FROM \"%w\" WHERE rowid = ?1", gcolumnB, tableB);
+            rc = sqlite3_prepare_v2(db, sql, -1, &t->stmtB, NULL);
+            sqlite3_free(sql);
+        }
+    }
+    return rc;
+}
+
+// Releases the statements of a traversal. Its buffers are kept
+static void spatialJoinCloseTraversal(spatialJoinTraversal *t)
+{
+    closeRtreeReader(&t->readerA);
+    closeRtreeReader(&t->readerB);
+    sqlite3_finalize(t->stmtA);
+    sqlite3_finalize(t->stmtB);
+    t->stmtA = t->stmtB = NULL;
+    t->numStack = t->numCandidates = t->candidate = 0;
+    t->idGeomA = -1;
+    t->geomAOk = 0;
+}
+
+// Releases the statements and the buffers of a traversal
+static void spatialJoinFreeTraversal(spatialJoinTraversal *t)
+{
+    spatialJoinCloseTraversal(t);
+    freeRtreeNode(&t->nodeA);
+    freeRtreeNode(&t->nodeB);
+    freeGPKGGeometry(&t->geomA);
+    freeGPKGGeometry(&t->geomB);
+    sqlite3_free(t->sortA);
+    sqlite3_free(t->sortB);
+    sqlite3_free(t->stack);
+    sqlite3_free(t->candidates);
+    memset(t, 0, sizeof(spatialJoinTraversal));
+}
+
+// Opens a cursor on GPKG_SpatialJoin
+static int spatialJoinOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    spatialJoinCursor *cur;
+
+    cur = (spatialJoinCursor *)sqlite3_malloc(sizeof(spatialJoinCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(spatialJoinCursor));
+    cur->eof = 1;
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+// Releases the statements and the worker threads of a cursor on GPKG_SpatialJoin
+static void spatialJoinReset(spatialJoinCursor *cur)
+{
+    spatialJoinCloseTraversal(&cur->join);
+    for (int i = 0; i < cur->numWorkers; i++)
+    {
+        spatialJoinFreeTraversal(&cur->workers[i].join);
+        sqlite3_close(cur->workers[i].db);
+        sqlite3_free(cur->workers[i].pairs);
+    }
+    sqlite3_free(cur->workers);
+    cur->workers = NULL;
+    cur->numWorkers = cur->worker = 0;
+    cur->rowid = 0;
+    cur->eof = 1;
+}
+
+// Closes a cursor on GPKG_SpatialJoin
+static int spatialJoinClose(sqlite3_vtab_cursor *cursor)
+{
+    spatialJoinCursor *cur = (spatialJoinCursor *)cursor;
+
+    spatialJoinReset(cur);
+    spatialJoinFreeTraversal(&cur->join);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+static int spatialJoinBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    return tableFunctionBestIndex(info, SPATIALJOIN_TABLEA, SPATIALJOIN_THREADS, 0x3C);
+}
+
+// Adds a pair of nodes pending to be traversed or a pair of candidate ids
+// t -> Traversal
+// idA, idB -> Nodes or ids
+// levelA, levelB -> Levels of the nodes. -1 for a pair of candidate ids
+// Returns 0 if there is no memory or 1 if it's correct
+static int spatialJoinPush(spatialJoinTraversal *t, sqlite3_int64 idA, int levelA, sqlite3_int64 idB, int levelB)
+{
+    if (levelA < 0)
+    {
+        if (t->numCandidates == t->maxCandidates)
+        {
+            int maxCandidates = t->maxCandidates ? t->maxCandidates * 2 : 1024;
+            sqlite3_int64 *candidates = (sqlite3_int64 *)sqlite3_realloc64(t->candidates, sizeof(sqlite3_int64) * 2 * maxCandidates);
+            if (candidates == NULL)
+                return 0;
+            t->candidates = candidates;
+            t->maxCandidates = maxCandidates;
+        }
+        t->candidates[t->numCandidates * 2] = idA;
+        t->candidates[t->numCandidates * 2 + 1] = idB;
+        t->numCandidates++;
+        return 1;
+    }
+    if (t->numStack == t->maxStack)
+    {
+        int maxStack = t->maxStack ? t->maxStack * 2 : 256;
+        spatialJoinPair *stack = (spatialJoinPair *)sqlite3_realloc64(t->stack, sizeof(spatialJoinPair) * maxStack);
+        if (stack == NULL)
+            return 0;
+        t->stack = stack;
+        t->maxStack = maxStack;
+    }
+    t->stack[t->numStack].nodeA = idA;
+    t->stack[t->numStack].levelA = levelA;
+    t->stack[t->numStack].nodeB = idB;
+    t->stack[t->numStack].levelB = levelB;
+    t->numStack++;
+    return 1;
+}
+
+// Sorts the cells of a node by minimum X
+// Returns 0 if there is no memory or 1 if it's correct
+static int spatialJoinSort(const rtreeNode *node, spatialJoinCell **sorted, int *maxSorted)
+{
+    if (node->numCells > *maxSorted)
+    {
+        spatialJoinCell *s = (spatialJoinCell *)sqlite3_realloc64(*sorted, sizeof(spatialJoinCell) * node->numCells);
+        if (s == NULL)
+            return 0;
+        *sorted = s;
+        *maxSorted = node->numCells;
+    }
+    for (int i = 0; i < node->numCells; i++)
+    {
+        (*sorted)[i].minx = node->boxes[i * 4];
+        (*sorted)[i].cell = i;
+    }
+    qsort(*sorted, node->numCells, sizeof(spatialJoinCell), compareSpatialJoinCells);
+    return 1;
+}
+
+// Traverses a pair of nodes: pushes the pairs of children (or candidate ids) whose envelopes intersect
+// The pairs are found with a plane sweep along X of the cells of both nodes
+// When only one of the nodes is a leaf, the other one is descended alone
+// Returns SQLITE_OK or an SQLite error code
+static int spatialJoinExpand(spatialJoinTraversal *t, const spatialJoinPair *pair)
+{
+    rtreeNode *a = &t->nodeA;
+    rtreeNode *b = &t->nodeB;
+    int descendA, descendB;
+    int i = 0, j = 0;
+    int rc;
+
+    rc = readRtreeNode(&t->readerA, pair->nodeA, a);
+    if (rc != SQLITE_OK)
+        return rc;
+    rc = readRtreeNode(&t->readerB, pair->nodeB, b);
+    if (rc != SQLITE_OK)
+        return rc;
+    descendA = pair->levelA > 0 && (pair->levelB == 0 || pair->levelA >= pair->levelB);
+    descendB = pair->levelB > 0 && (pair->levelA == 0 || pair->levelB >= pair->levelA);
+
+    if (descendA != descendB)
+    {
+        // Descend one node filtering its children with the envelope of the other node
+        rtreeNode *node = descendA ? a : b;
+        rtreeNode *other = descendA ? b : a;
+        double env[4] = { HUGE_VAL, HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+        for (int k = 0; k < other->numCells; k++)
+        {
+            env[0] = fmin(env[0], other->boxes[k * 4]);
+            env[1] = fmin(env[1], other->boxes[k * 4 + 1]);
+            env[2] = fmax(env[2], other->boxes[k * 4 + 2]);
+            env[3] = fmax(env[3], other->boxes[k * 4 + 3]);
+        }
+        for (int k = 0; k < node->numCells; k++)
+        {
+            double *box = &node->boxes[k * 4];
+            if (box[0] > env[2] || box[2] < env[0] || box[1] > env[3] || box[3] < env[1])
+                continue;
+            if (descendA ? !spatialJoinPush(t, node->ids[k], pair->levelA - 1, pair->nodeB, pair->levelB)
+                         : !spatialJoinPush(t, pair->nodeA, pair->levelA, node->ids[k], pair->levelB - 1))
+                return SQLITE_NOMEM;
+        }
+        return SQLITE_OK;
+    }
+
+    // Plane sweep of both nodes
+    if (!spatialJoinSort(a, &t->sortA, &t->maxSortA) || !spatialJoinSort(b, &t->sortB, &t->maxSortB))
+        return SQLITE_NOMEM;
+    while (i < a->numCells && j < b->numCells)
+    {
+        int first = t->sortA[i].minx <= t->sortB[j].minx;
+        int cell = first ? t->sortA[i].cell : t->sortB[j].cell;
+        rtreeNode *node = first ? a : b;
+        rtreeNode *other = first ? b : a;
+        spatialJoinCell *sorted = first ? t->sortB : t->sortA;
+        int numSorted = first ? b->numCells : a->numCells;
+        double *box = &node->boxes[cell * 4];
+        for (int k = first ? j : i; k < numSorted && sorted[k].minx <= box[2]; k++)
+        {
+            double *box2 = &other->boxes[sorted[k].cell * 4];
+            int cellA, cellB;
+            if (box2[1] > box[3] || box2[3] < box[1])
+                continue;
+            cellA = first ? cell : sorted[k].cell;
+            cellB = first ? sorted[k].cell : cell;
+            if (!spatialJoinPush(t, a->ids[cellA], descendA ? pair->levelA - 1 : -1, b->ids[cellB], descendB ? pair->levelB - 1 : -1))
+                return SQLITE_NOMEM;
+        }
+        if (first)
+            i++;
+        else
+            j++;
+    }
+    return SQLITE_OK;
+}
+
+// Splits the first levels of the rtrees: expands level by level the pending pairs of nodes until there are numPairs of them
+// or only pairs of leaves are left. The pairs of leaves are expanded by the traversal
+// Returns SQLITE_OK or an SQLite error code
+static int spatialJoinSplit(spatialJoinTraversal *t, int numPairs)
+{
+    spatialJoinPair *pairs = NULL;
+    int expanded = 1;
+    int rc = SQLITE_OK;
+
+    while (rc == SQLITE_OK && expanded && t->numStack < numPairs)
+    {
+        int n = t->numStack;
+        spatialJoinPair *p = (spatialJoinPair *)sqlite3_realloc64(pairs, sizeof(spatialJoinPair) * n);
+        if (p == NULL)
+        {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        pairs = p;
+        memcpy(pairs, t->stack, sizeof(spatialJoinPair) * n);
+        t->numStack = 0;
+        expanded = 0;
+        for (int i = 0; i < n && rc == SQLITE_OK; i++)
+        {
+            if (pairs[i].levelA == 0 && pairs[i].levelB == 0)
+            {
+                if (!spatialJoinPush(t, pairs[i].nodeA, 0, pairs[i].nodeB, 0))
+                    rc = SQLITE_NOMEM;
+            }
+            else
+            {
+                rc = spatialJoinExpand(t, &pairs[i]);
+                expanded = 1;
+            }
+        }
+    }
+    sqlite3_free(pairs);
+    return rc;
+}
+
+// Reads the geometry of a feature to refine the candidates
+// Returns 1 if the geometry was read correctly or 0 if it is NULL, it's not correct or there is an error
+static int spatialJoinReadGeometry(sqlite3_stmt *stmt, sqlite3_int64 id, gpkgGeometry *geom)
+{
+    int ok = 0;
+
+    sqlite3_reset(stmt);
+    sqlite3_bind_int64(stmt, 1, id);
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) == SQLITE_BLOB)
+        ok = readGPKGGeometry((unsigned char *)sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0), geom);
+    sqlite3_reset(stmt);
+    return ok;
+}
+
+// Moves a traversal to the next pair of ids that satisfies the predicate
+// idA, idB <- Pair of ids
+// Returns SQLITE_ROW if there is a pair, SQLITE_DONE at the end of the traversal or an SQLite error code
+static int spatialJoinStep(spatialJoinTraversal *t, sqlite3_int64 *idA, sqlite3_int64 *idB)
+{
+    spatialJoinPair pair;
+    int rc;
+
+    for (;;)
+    {
+        while (t->candidate < t->numCandidates)
+        {
+            *idA = t->candidates[t->candidate * 2];
+            *idB = t->candidates[t->candidate * 2 + 1];
+            t->candidate++;
+            if (t->predicate == PREDICATE_ENVELOPE)
+                return SQLITE_ROW;
+            if (*idA != t->idGeomA)
+            {
+                t->idGeomA = *idA;
+                t->geomAOk = spatialJoinReadGeometry(t->stmtA, *idA, &t->geomA);
+            }
+            if (!t->geomAOk || !spatialJoinReadGeometry(t->stmtB, *idB, &t->geomB))
+                continue;
+            if ((t->predicate == PREDICATE_INTERSECTS && geometryIntersects(&t->geomA, &t->geomB)) ||
+                (t->predicate == PREDICATE_CONTAINS && geometryContains(&t->geomA, &t->geomB)) ||
+                (t->predicate == PREDICATE_WITHIN && geometryContains(&t->geomB, &t->geomA)))
+                return SQLITE_ROW;
+        }
+        if (t->numStack == 0)
+            return SQLITE_DONE;
+        pair = t->stack[--t->numStack];
+        t->numCandidates = 0;
+        t->candidate = 0;
+        rc = spatialJoinExpand(t, &pair);
+        if (rc != SQLITE_OK)
+            return rc;
+    }
+}
+
+// Runs a worker thread: traverses the pairs of nodes given to the worker and keeps the pairs of ids found
+static void spatialJoinWork(void *arg)
+{
+    spatialJoinWorker *worker = (spatialJoinWorker *)arg;
+    sqlite3_int64 idA, idB;
+
+    worker->numPairs = worker->pair = 0;
+    while ((worker->rc = spatialJoinStep(&worker->join, &idA, &idB)) == SQLITE_ROW)
+    {
+        if (worker->numPairs == worker->maxPairs)
+        {
+            int maxPairs = worker->maxPairs ? worker->maxPairs * 2 : 1024;
+            sqlite3_int64 *pairs = (sqlite3_int64 *)sqlite3_realloc64(worker->pairs, sizeof(sqlite3_int64) * 2 * maxPairs);
+            if (pairs == NULL)
+            {
+                worker->rc = SQLITE_NOMEM;
+                return;
+            }
+            worker->pairs = pairs;
+            worker->maxPairs = maxPairs;
+        }
+        worker->pairs[worker->numPairs * 2] = idA;
+        worker->pairs[worker->numPairs * 2 + 1] = idB;
+        worker->numPairs++;
+    }
+    if (worker->rc == SQLITE_DONE)
+        worker->rc = SQLITE_OK;
+}
+
+// Opens the connections and the traversals of the worker threads
+// Returns SQLITE_OK or an SQLite error code. If there is an error there are no worker threads
+static int spatialJoinOpenWorkers(spatialJoinCursor *cur, sqlite3 *db, const char *tableA, const char *gcolumnA, const char *tableB, const char *gcolumnB, int numWorkers)
+{
+    int rc = SQLITE_OK;
+
+    cur->workers = (spatialJoinWorker *)sqlite3_malloc64(sizeof(spatialJoinWorker) * numWorkers);
+    if (cur->workers == NULL)
+        return SQLITE_NOMEM;
+    memset(cur->workers, 0, sizeof(spatialJoinWorker) * numWorkers);
+    cur->numWorkers = numWorkers;
+    for (int i = 0; i < numWorkers && rc == SQLITE_OK; i++)
+    {
+        rc = openWorkerConnection(db, &cur->workers[i].db);
+        if (rc == SQLITE_OK)
+            rc = spatialJoinOpenTraversal(cur->workers[i].db, tableA, gcolumnA, tableB, gcolumnB, cur->join.predicate, &cur->workers[i].join);
+    }
+    if (rc != SQLITE_OK)
+    {
+        for (int i = 0; i < numWorkers; i++)
+        {
+            spatialJoinFreeTraversal(&cur->workers[i].join);
+            sqlite3_close(cur->workers[i].db);
+        }
+        sqlite3_free(cur->workers);
+        cur->workers = NULL;
+        cur->numWorkers = 0;
+    }
+    return rc;
+}
+
+// Gives the next pending pairs of nodes to the worker threads and waits until they are traversed
+// Returns SQLITE_OK or an SQLite error code
+static int spatialJoinRound(spatialJoinCursor *cur)
+{
+    int n = cur->numWorkers * SPATIALJOIN_ROUND_PAIRS;
+    int rc = SQLITE_OK;
+
+    if (n > cur->join.numStack)
+        n = cur->join.numStack;
+    for (int i = 0; i < n; i++)
+    {
+        spatialJoinPair *pair = &cur->join.stack[--cur->join.numStack];
+        if (!spatialJoinPush(&cur->workers[i % cur->numWorkers].join, pair->nodeA, pair->levelA, pair->nodeB, pair->levelB))
+            return SQLITE_NOMEM;
+    }
+    for (int i = 0; i < cur->numWorkers; i++)
+        startWorkerThread(&cur->workers[i].thread, spatialJoinWork, &cur->workers[i]);
+    for (int i = 0; i < cur->numWorkers; i++)
+    {
+        joinWorkerThread(&cur->workers[i].thread);
+        if (rc == SQLITE_OK && cur->workers[i].rc != SQLITE_OK)
+        {
+            rc = cur->workers[i].rc;
+            cur->base.pVtab->zErrMsg = sqlite3_mprintf("GPKG_SpatialJoin() error: %s", sqlite3_errmsg(cur->workers[i].db));
+        }
+    }
+    cur->worker = 0;
+    return rc;
+}
+
+// Moves the cursor to the next pair of ids that satisfies the predicate
+static int spatialJoinNext(sqlite3_vtab_cursor *cursor)
+{
+    spatialJoinCursor *cur = (spatialJoinCursor *)cursor;
+    int rc;
+
+    if (cur->workers == NULL)
+    {
+        rc = spatialJoinStep(&cur->join, &cur->idA, &cur->idB);
+        if (rc == SQLITE_ROW)
+        {
+            cur->rowid++;
+            return SQLITE_OK;
+        }
+        if (rc == SQLITE_DONE)
+            cur->eof = 1;
+        return rc == SQLITE_DONE ? SQLITE_OK : rc;
+    }
+
+    // Return the pairs found by the worker threads in the last round
+    for (;;)
+    {
+        while (cur->worker < cur->numWorkers)
+        {
+            spatialJoinWorker *worker = &cur->workers[cur->worker];
+            if (worker->pair < worker->numPairs)
+            {
+                cur->idA = worker->pairs[worker->pair * 2];
+                cur->idB = worker->pairs[worker->pair * 2 + 1];
+                worker->pair++;
+                cur->rowid++;
+                return SQLITE_OK;
+            }
+            cur->worker++;
+        }
+        if (cur->join.numStack == 0)
+        {
+            cur->eof = 1;
+            return SQLITE_OK;
+        }
+        rc = spatialJoinRound(cur);
+        if (rc != SQLITE_OK)
+            return rc;
+    }
+}
+
+// Opens the rtrees of both tables and starts the traversal from their roots
+static int spatialJoinFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
+{
+    spatialJoinCursor *cur = (spatialJoinCursor *)cursor;
+    const char *tableA, *gcolumnA, *tableB, *gcolumnB;
+    const char *predicate = NULL;
+    int threads = 1;
+    int arg = 4;
+    sqlite3 *db;
+    int rc;
+
+    spatialJoinReset(cur);
+    if ((idxNum & 0x3C) != 0x3C)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_SpatialJoin() error: tableA, geometryColumnA, tableB and geometryColumnB are mandatory");
+        return SQLITE_ERROR;
+    }
+    tableA = (const char *)sqlite3_value_text(argv[0]);
+    gcolumnA = (const char *)sqlite3_value_text(argv[1]);
+    tableB = (const char *)sqlite3_value_text(argv[2]);
+    gcolumnB = (const char *)sqlite3_value_text(argv[3]);
+    if (idxNum & (1 << SPATIALJOIN_PREDICATE))
+        predicate = (const char *)sqlite3_value_text(argv[arg++]);
+    if (idxNum & (1 << SPATIALJOIN_THREADS))
+        threads = workerThreadCount(argv[arg]);
+    if (predicate == NULL || _stricmp(predicate, "envelope") == 0)
+        cur->join.predicate = PREDICATE_ENVELOPE;
+    else if (_stricmp(predicate, "intersects") == 0)
+        cur->join.predicate = PREDICATE_INTERSECTS;
+    else if (_stricmp(predicate, "contains") == 0)
+        cur->join.predicate = PREDICATE_CONTAINS;
+    else if (_stricmp(predicate, "within") == 0)
+        cur->join.predicate = PREDICATE_WITHIN;
+    else
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_SpatialJoin() error: argument 5 [predicate] must be 'envelope', 'intersects', 'contains' or 'within'");
+        return SQLITE_ERROR;
+    }
+    if (threads < 0)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_SpatialJoin() error: argument 6 [threads] must be an integer greater or equal than 0");
+        return SQLITE_ERROR;
+    }
+
+    // Get DB handle
+    db = ((tableFunctionVtab *)cursor->pVtab)->db;
+
+    rc = spatialJoinOpenTraversal(db, tableA, gcolumnA, tableB, gcolumnB, cur->join.predicate, &cur->join);
+    if (rc != SQLITE_OK)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_SpatialJoin() error: %s", sqlite3_errmsg(db));
+        return rc;
+    }
+    if (!spatialJoinPush(&cur->join, 1, cur->join.readerA.depth, 1, cur->join.readerB.depth))
+        return SQLITE_NOMEM;
+    // Without worker threads the traversal is done by the calling thread
+    if (threads > 1 && spatialJoinOpenWorkers(cur, db, tableA, gcolumnA, tableB, gcolumnB, threads) == SQLITE_OK)
+    {
+        rc = spatialJoinSplit(&cur->join, threads * SPATIALJOIN_SPLIT_PAIRS);
+        if (rc != SQLITE_OK)
+        {
+            cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_SpatialJoin() error: %s", sqlite3_errmsg(db));
+            return rc;
+        }
+    }
+    cur->eof = 0;
+    return spatialJoinNext(cursor);
+}
+
+// Returns 1 if there are no more rows
+static int spatialJoinEof(sqlite3_vtab_cursor *cursor)
+{
+    return ((spatialJoinCursor *)cursor)->eof;
+}
+
+// Returns the value of a column. The hidden columns are the parameters
+static int spatialJoinColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    spatialJoinCursor *cur = (spatialJoinCursor *)cursor;
+
+    if (column == SPATIALJOIN_IDA)
+        sqlite3_result_int64(context, cur->idA);
+    else if (column == SPATIALJOIN_IDB)
+        sqlite3_result_int64(context, cur->idB);
+    return SQLITE_OK;
+}
+
+// The rowid is the number of the pair
+static int spatialJoinRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = ((spatialJoinCursor *)cursor)->rowid;
+    return SQLITE_OK;
+}
+
+static sqlite3_module spatialJoinModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    tableFunctionConnect,    // xConnect
+    spatialJoinBestIndex,    // xBestIndex
+    tableFunctionDisconnect, // xDisconnect
+    0,                       // xDestroy
+    spatialJoinOpen,         // xOpen
+    spatialJoinClose,        // xClose
+    spatialJoinFilter,       // xFilter
+    spatialJoinNext,         // xNext
+    spatialJoinEof,          // xEof
+    spatialJoinColumn,       // xColumn
+    spatialJoinRowid,        // xRowid
+    0, 0, 0, 0, 0, 0, 0       // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Table-valued function: GPKG_PointsInPolygons(pointTable, pointColumn, polygonTable, polygonColumn, valueColumn, threads)
+// Returns for each Polygon of polygonTable the number of Points of pointTable inside it (or on its boundary) and the sum of their values
+// Each Polygon is prepared once for the point-in-polygon tests, and the Points are probed with the spatial index of pointTable
+// pointTable -> Name of the table of Points. Needs a spatial index (see GPKG_AddSpatialIndex)
+// pointColumn -> Column that contains the Points
+// polygonTable -> Name of the table of Polygons
+// polygonColumn -> Column that contains the Polygons
+// valueColumn -> optional parameter. Column of pointTable to sum
+// threads -> optional parameter. Number of worker threads, 0 for one per processor. By default 1, the Polygons are counted by the calling thread.
+//            The Polygons are read in blocks and counted by the workers, each one with its own read only connection to the database file.
+//            Without a database file or inside a transaction the workers wouldn't see the same data, so the Polygons are counted by the calling thread
+// Usage: SELECT id, count, sum FROM GPKG_PointsInPolygons('addresses', 'geom', 'districts', 'geom', 'population', 0)
+
+// Columns of GPKG_PointsInPolygons
+#define POINTSINPOLYGONS_ID 0
+#define POINTSINPOLYGONS_COUNT 1
+#define POINTSINPOLYGONS_SUM 2
+#define POINTSINPOLYGONS_POINTTABLE 3
+#define POINTSINPOLYGONS_POINTCOLUMN 4
+#define POINTSINPOLYGONS_POLYGONTABLE 5
+#define POINTSINPOLYGONS_POLYGONCOLUMN 6
+#define POINTSINPOLYGONS_VALUECOLUMN 7
+#define POINTSINPOLYGONS_THREADS 8
+#define POINTSINPOLYGONS_SCHEMA "CREATE TABLE x(id, count, sum, point_table HIDDEN, point_column HIDDEN, polygon_table HIDDEN, polygon_column HIDDEN, value_column HIDDEN, threads HIDDEN)"
+
+// Polygons per worker thread in each block
+#define POINTSINPOLYGONS_BLOCK_POLYGONS 64
+
+// Points inside a Polygon
+typedef struct pointsInPolygonsResult
+{
+    sqlite3_int64 id;            // Id of the Polygon
+    sqlite3_int64 count;         // Number of Points inside the Polygon
+    sqlite3_int64 sumInt;        // Sum of the integer values
+    double sumReal;              // Sum of the values if any of them is not an integer
+    int sumType;                 // SQLITE_NULL if there are no values, SQLITE_INTEGER or SQLITE_FLOAT
+} pointsInPolygonsResult;
+
+// Worker thread of GPKG_PointsInPolygons
+typedef struct pointsInPolygonsWorker
+{
+    workerThread thread;
+    sqlite3 *db;                     // Read only connection of the worker
+    sqlite3_stmt *stmtPolygon;       // Query on a Polygon by id
+    sqlite3_stmt *stmtPoints;        // Query on the Points inside an envelope
+    gpkgGeometry polygon;            // Current Polygon
+    preparedPolygon prep;            // Current Polygon prepared for the point-in-polygon tests
+    pointsInPolygonsResult *results; // Polygons of the block. The worker counts one of every step Polygons
+    int numResults, step;
+    int rc;                          // Result of the count
+} pointsInPolygonsWorker;
+
+// Cursor of GPKG_PointsInPolygons
+typedef struct pointsInPolygonsCursor
+{
+    sqlite3_vtab_cursor base;         // Base class. Must be first
+    sqlite3_stmt *stmtPolygons;       // Query on the Polygons. With worker threads only their ids
+    sqlite3_stmt *stmtPoints;         // Query on the Points inside an envelope
+    gpkgGeometry polygon;             // Current Polygon
+    preparedPolygon prep;             // Current Polygon prepared for the point-in-polygon tests
+    pointsInPolygonsResult row;       // Points inside the current Polygon
+    pointsInPolygonsWorker *workers;  // Worker threads or NULL
+    int numWorkers;
+    pointsInPolygonsResult *results;  // Block of Polygons counted by the worker threads
+    int numResults, result;
+    int polygonsDone;                 // 1 when all the Polygons were read
+    int eof;                          // 1 when there are no more rows
+} pointsInPolygonsCursor;
+
+// Opens a cursor on GPKG_PointsInPolygons
+static int pointsInPolygonsOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    pointsInPolygonsCursor *cur;
+
+    cur = (pointsInPolygonsCursor *)sqlite3_malloc(sizeof(pointsInPolygonsCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(pointsInPolygonsCursor));
+    cur->eof = 1;
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+// Releases the statements and the worker threads of a cursor on GPKG_PointsInPolygons
+static void pointsInPolygonsReset(pointsInPolygonsCursor *cur)
+{
+    sqlite3_finalize(cur->stmtPolygons);
+    sqlite3_finalize(cur->stmtPoints);
+    cur->stmtPolygons = cur->stmtPoints = NULL;
+    for (int i = 0; i < cur->numWorkers; i++)
+    {
+        sqlite3_finalize(cur->workers[i].stmtPolygon);
+        sqlite3_finalize(cur->workers[i].stmtPoints);
+        sqlite3_close(cur->workers[i].db);
+        freeGPKGGeometry(&cur->workers[i].polygon);
+        freePreparedPolygon(&cur->workers[i].prep);
+    }
+    sqlite3_free(cur->workers);
+    cur->workers = NULL;
+    cur->numWorkers = 0;
+    cur->numResults = cur->result = 0;
+    cur->polygonsDone = 0;
+    cur->eof = 1;
+}
+
+// Closes a cursor on GPKG_PointsInPolygons
+static int pointsInPolygonsClose(sqlite3_vtab_cursor *cursor)
+{
+    pointsInPolygonsCursor *cur = (pointsInPolygonsCursor *)cursor;
+
+    pointsInPolygonsReset(cur);
+    freeGPKGGeometry(&cur->polygon);
+    freePreparedPolygon(&cur->prep);
+    sqlite3_free(cur->results);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+static int pointsInPolygonsBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    return tableFunctionBestIndex(info, POINTSINPOLYGONS_POINTTABLE, POINTSINPOLYGONS_THREADS, 0x78);
+}
+
+// Prepares the query on the Points inside an envelope (?1 minX, ?2 minY, ?3 maxX, ?4 maxY)
+// valueColumn -> Column to sum or NULL
+// Returns SQLITE_OK or an SQLite error code
+static int pointsInPolygonsPreparePoints(sqlite3 *db, const char *pointTable, const char *pointColumn, const char *valueColumn, sqlite3_stmt **stmt)
+{
+    char *sql;
+    int rc;
+
+    if (valueColumn != NULL)
+        sql = sqlite3_mprintf("SELECT p.\"%w\", p.\"%w\" FROM \"rtree_%w_%w\" r JOIN \"%w\" p ON p.rowid = r.id WHERE r.minx <= ?3 AND r.maxx >= ?1 AND r.miny <= ?4 AND r.maxy >= ?2",
+                              pointColumn, valueColumn, pointTable, pointColumn, pointTable);
+    else
+        sql = sqlite3_mprintf("SELECT p.\"%w\" FROM \"rtree_%w_%w\" r JOIN \"%w\" p ON p.rowid = r.id WHERE r.minx <= ?3 AND r.maxx >= ?1 AND r.miny <= ?4 AND r.maxy >= ?2",
+                              pointColumn, pointTable, pointColumn, pointTable);
+    rc = sqlite3_prepare_v2(db, sql, -1, stmt, NULL);
+    sqlite3_free(sql);
+    return rc;
+}
+
+// Counts the Points inside a Polygon and sums their values
+// stmtPoints -> Query on the Points inside an envelope
+// blob, n_bytes -> Polygon. NULL, empty or incorrect geometries contain no Points
+// polygon, prep -> Buffers for the Polygon
+// result <- Number of Points and sum of their values. The id is not modified
+// Returns SQLITE_OK or an SQLite error code
+static int pointsInPolygonsCount(sqlite3_stmt *stmtPoints, const unsigned char *blob, int n_bytes, gpkgGeometry *polygon, preparedPolygon *prep, pointsInPolygonsResult *result)
+{
+    int rc;
+
+    result->count = 0;
+    result->sumInt = 0;
+    result->sumReal = 0;
+    result->sumType = SQLITE_NULL;
+    if (blob == NULL || !readGPKGGeometry((unsigned char *)blob, n_bytes, polygon) || polygon->numParts == 0)
+        return SQLITE_OK;
+    if (!prepareGPKGPolygon(polygon, prep))
+        return SQLITE_NOMEM;
+
+    // Probe the spatial index of the Points with the envelope of the Polygon
+    sqlite3_bind_double(stmtPoints, 1, prep->env[0]);
+    sqlite3_bind_double(stmtPoints, 2, prep->env[1]);
+    sqlite3_bind_double(stmtPoints, 3, prep->env[2]);
+    sqlite3_bind_double(stmtPoints, 4, prep->env[3]);
+    while ((rc = sqlite3_step(stmtPoints)) == SQLITE_ROW)
+    {
+        double x, y;
+        if (sqlite3_column_type(stmtPoints, 0) != SQLITE_BLOB ||
+            !readGPKGPointXY((unsigned char *)sqlite3_column_blob(stmtPoints, 0), sqlite3_column_bytes(stmtPoints, 0), &x, &y))
+            continue;
+        if (pointInPreparedPolygon(prep, x, y) == 0)
+            continue;
+        result->count++;
+        if (sqlite3_column_count(stmtPoints) > 1)
+        {
+            switch (sqlite3_column_type(stmtPoints, 1))
+            {
+            case SQLITE_NULL:
+                break;
+            case SQLITE_INTEGER:
+                result->sumInt += sqlite3_column_int64(stmtPoints, 1);
+                if (result->sumType == SQLITE_NULL)
+                    result->sumType = SQLITE_INTEGER;
+                break;
+            default:
+                result->sumReal += sqlite3_column_double(stmtPoints, 1);
+                result->sumType = SQLITE_FLOAT;
+                break;
+            }
+        }
+    }
+    sqlite3_reset(stmtPoints);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+// Runs a worker thread: counts its Polygons of the block
+static void pointsInPolygonsWork(void *arg)
+{
+    pointsInPolygonsWorker *worker = (pointsInPolygonsWorker *)arg;
+
+    worker->rc = SQLITE_OK;
+    for (int i = 0; i < worker->numResults && worker->rc == SQLITE_OK; i += worker->step)
+    {
+        pointsInPolygonsResult *result = &worker->results[i];
+        const unsigned char *blob = NULL;
+        int n_bytes = 0;
+        sqlite3_bind_int64(worker->stmtPolygon, 1, result->id);
+        worker->rc = sqlite3_step(worker->stmtPolygon);
+        if (worker->rc == SQLITE_ROW && sqlite3_column_type(worker->stmtPolygon, 0) == SQLITE_BLOB)
+        {
+            blob = (const unsigned char *)sqlite3_column_blob(worker->stmtPolygon, 0);
+            n_bytes = sqlite3_column_bytes(worker->stmtPolygon, 0);
+        }
+        // A Polygon deleted after its id was read contains no Points
+        if (worker->rc == SQLITE_ROW || worker->rc == SQLITE_DONE)
+            worker->rc = pointsInPolygonsCount(worker->stmtPoints, blob, n_bytes, &worker->polygon, &worker->prep, result);
+        sqlite3_reset(worker->stmtPolygon);
+    }
+}
+
+// Opens the connections and the queries of the worker threads
+// Returns SQLITE_OK or an SQLite error code. If there is an error there are no worker threads
+static int pointsInPolygonsOpenWorkers(pointsInPolygonsCursor *cur, sqlite3 *db, const char *pointTable, const char *pointColumn, const char *polygonTable,
+                                       const char *polygonColumn, const char *valueColumn, int numWorkers)
+{
+    pointsInPolygonsResult *results;
+    char *sql;
+    int rc = SQLITE_OK;
+
+    results = (pointsInPolygonsResult *)sqlite3_realloc64(cur->results, sizeof(pointsInPolygonsResult) * numWorkers * POINTSINPOLYGONS_BLOCK_POLYGONS);
+    if (results == NULL)
+        return SQLITE_NOMEM;
+    cur->results = results;
+    cur->workers = (pointsInPolygonsWorker *)sqlite3_malloc64(sizeof(pointsInPolygonsWorker) * numWorkers);
+    if (cur->workers == NULL)
+        return SQLITE_NOMEM;
+    memset(cur->workers, 0, sizeof(pointsInPolygonsWorker) * numWorkers);
+    cur->numWorkers = numWorkers;
+    sql = sqlite3_mprintf("SELECT \"%w\" FROM \"%w\" WHERE rowid = ?1", polygonColumn, polygonTable);
+    for (int i = 0; i < numWorkers && rc == SQLITE_OK; i++)
+    {
+        rc = sql == NULL ? SQLITE_NOMEM : openWorkerConnection(db, &cur->workers[i].db);
+        if (rc == SQLITE_OK)
+            rc = sqlite3_prepare_v2(cur->workers[i].db, sql, -1, &cur->workers[i].stmtPolygon, NULL);
+        if (rc == SQLITE_OK)
+            rc = pointsInPolygonsPreparePoints(cur->workers[i].db, pointTable, pointColumn, valueColumn, &cur->workers[i].stmtPoints);
+    }
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+    {
+        for (int i = 0; i < numWorkers; i++)
+        {
+            sqlite3_finalize(cur->workers[i].stmtPolygon);
+            sqlite3_finalize(cur->workers[i].stmtPoints);
+            sqlite3_close(cur->workers[i].db);
+        }
+        sqlite3_free(cur->workers);
+        cur->workers = NULL;
+        cur->numWorkers = 0;
+    }
+    return rc;
+}
+
+// Reads the ids of the next block of Polygons and counts them with the worker threads
+// Returns SQLITE_OK or an SQLite error code
+static int pointsInPolygonsBlock(pointsInPolygonsCursor *cur)
+{
+    int rc = SQLITE_OK;
+
+    cur->numResults = cur->result = 0;
+    while (!cur->polygonsDone && cur->numResults < cur->numWorkers * POINTSINPOLYGONS_BLOCK_POLYGONS)
+    {
+        rc = sqlite3_step(cur->stmtPolygons);
+        if (rc != SQLITE_ROW)
+        {
+            cur->polygonsDone = 1;
+            if (rc != SQLITE_DONE)
+                return rc;
+            break;
+        }
+        cur->results[cur->numResults++].id = sqlite3_column_int64(cur->stmtPolygons, 0);
+    }
+    rc = SQLITE_OK;
+    if (cur->numResults == 0)
+        return rc;
+    for (int i = 0; i < cur->numWorkers; i++)
+    {
+        cur->workers[i].results = cur->results + i;
+        cur->workers[i].numResults = cur->numResults - i;
+        cur->workers[i].step = cur->numWorkers;
+        startWorkerThread(&cur->workers[i].thread, pointsInPolygonsWork, &cur->workers[i]);
+    }
+    for (int i = 0; i < cur->numWorkers; i++)
+    {
+        joinWorkerThread(&cur->workers[i].thread);
+        if (rc == SQLITE_OK && cur->workers[i].rc != SQLITE_OK)
+        {
+            rc = cur->workers[i].rc;
+            cur->base.pVtab->zErrMsg = sqlite3_mprintf("GPKG_PointsInPolygons() error: %s", sqlite3_errmsg(cur->workers[i].db));
+        }
+    }
+    return rc;
+}
+
+// Moves the cursor to the next Polygon and counts the Points inside it
+static int pointsInPolygonsNext(sqlite3_vtab_cursor *cursor)
+{
+    pointsInPolygonsCursor *cur = (pointsInPolygonsCursor *)cursor;
+    const unsigned char *blob = NULL;
+    int rc;
+
+    if (cur->workers != NULL)
+    {
+        // Return the Polygons counted by the worker threads in the last block
+        if (cur->result == cur->numResults)
+        {
+            rc = pointsInPolygonsBlock(cur);
+            if (rc != SQLITE_OK || cur->numResults == 0)
+            {
+                cur->eof = 1;
+                return rc;
+            }
+        }
+        cur->row = cur->results[cur->result++];
+        return SQLITE_OK;
+    }
+
+    rc = sqlite3_step(cur->stmtPolygons);
+    if (rc != SQLITE_ROW)
+    {
+        cur->eof = 1;
+        return rc == SQLITE_DONE ? SQLITE_OK : rc;
+    }
+    cur->row.id = sqlite3_column_int64(cur->stmtPolygons, 0);
+    if (sqlite3_column_type(cur->stmtPolygons, 1) == SQLITE_BLOB)
+        blob = (const unsigned char *)sqlite3_column_blob(cur->stmtPolygons, 1);
+    return pointsInPolygonsCount(cur->stmtPoints, blob, sqlite3_column_bytes(cur->stmtPolygons, 1), &cur->polygon, &cur->prep, &cur->row);
+}
+
+// Prepares the queries on the Polygons and on the Points
+static int pointsInPolygonsFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
+{
+    pointsInPolygonsCursor *cur = (pointsInPolygonsCursor *)cursor;
+    const char *pointTable, *pointColumn, *polygonTable, *polygonColumn;
+    const char *valueColumn = NULL;
+    int threads = 1;
+    int arg = 4;
+    sqlite3 *db;
+    char *sql;
+    int rc;
+
+    pointsInPolygonsReset(cur);
+    if ((idxNum & 0x78) != 0x78)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_PointsInPolygons() error: pointTable, pointColumn, polygonTable and polygonColumn are mandatory");
+        return SQLITE_ERROR;
+    }
+    pointTable = (const char *)sqlite3_value_text(argv[0]);
+    pointColumn = (const char *)sqlite3_value_text(argv[1]);
+    polygonTable = (const char *)sqlite3_value_text(argv[2]);
+    polygonColumn = (const char *)sqlite3_value_text(argv[3]);
+    if (idxNum & (1 << POINTSINPOLYGONS_VALUECOLUMN))
+        valueColumn = (const char *)sqlite3_value_text(argv[arg++]);
+    if (idxNum & (1 << POINTSINPOLYGONS_THREADS))
+        threads = workerThreadCount(argv[arg]);
+    if (threads < 0)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_PointsInPolygons() error: argument 6 [threads] must be an integer greater or equal than 0");
+        return SQLITE_ERROR;
+    }
+
+    // Get DB handle
+    db = ((tableFunctionVtab *)cursor->pVtab)->db;
+
+    rc = pointsInPolygonsPreparePoints(db, pointTable, pointColumn, valueColumn, &cur->stmtPoints);
+    if (rc == SQLITE_OK)
+    {
+        // Without worker threads the Polygons are counted by the calling thread
+        if (threads > 1 && pointsInPolygonsOpenWorkers(cur, db, pointTable, pointColumn, polygonTable, polygonColumn, valueColumn, threads) == SQLITE_OK)
+            sql = sqlite3_mprintf("SELECT rowid FROM \"%w\"", polygonTable);
+        else
+            sql = sqlite3_mprintf("SELECT rowid, \"%w\" FROM \"%w\"", polygonColumn, polygonTable);
+        rc = sqlite3_prepare_v2(db, sql, -1, &cur->stmtPolygons, NULL);
+        sqlite3_free(sql);
+    }
+    if (rc != SQLITE_OK)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_PointsInPolygons() error: %s", sqlite3_errmsg(db));
+        return rc;
+    }
+    cur->eof = 0;
+    return pointsInPolygonsNext(cursor);
+}
+
+// Returns 1 if there are no more rows
+static int pointsInPolygonsEof(sqlite3_vtab_cursor *cursor)
+{
+    return ((pointsInPolygonsCursor *)cursor)->eof;
+}
+
+// Returns the value of a column. The hidden columns are the parameters
+static int pointsInPolygonsColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    pointsInPolygonsCursor *cur = (pointsInPolygonsCursor *)cursor;
+
+    switch (column)
+    {
+    case POINTSINPOLYGONS_ID:
+        sqlite3_result_int64(context, cur->row.id);
+        break;
+    case POINTSINPOLYGONS_COUNT:
+        sqlite3_result_int64(context, cur->row.count);
+        break;
+    case POINTSINPOLYGONS_SUM:
+        if (cur->row.sumType == SQLITE_INTEGER)
+            sqlite3_result_int64(context, cur->row.sumInt);
+        else if (cur->row.sumType == SQLITE_FLOAT)
+            sqlite3_result_double(context, cur->row.sumReal + (double)cur->row.sumInt);
+        break;
+    }
+    return SQLITE_OK;
+}
+
+// The rowid is the id of the Polygon
+static int pointsInPolygonsRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = ((pointsInPolygonsCursor *)cursor)->row.id;
+    return SQLITE_OK;
+}
+
+static sqlite3_module pointsInPolygonsModule = {
+    0,                         // iVersion
+    0,                         // xCreate (eponymous only)
+    tableFunctionConnect,      // xConnect
+    pointsInPolygonsBestIndex, // xBestIndex
+    tableFunctionDisconnect,   // xDisconnect
+    0,                         // xDestroy
+    pointsInPolygonsOpen,      // xOpen
+    pointsInPolygonsClose,     // xClose
+    pointsInPolygonsFilter,    // xFilter
+    pointsInPolygonsNext,      // xNext
+    pointsInPolygonsEof,       // xEof
+    pointsInPolygonsColumn,    // xColumn
+    pointsInPolygonsRowid,     // xRowid
+    0, 0, 0, 0, 0, 0, 0         // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Table-valued function: GPKG_NearestJoin(tableA, geometryColumnA, tableB, geometryColumnB, k, maxDistance)
+// Returns for each feature of tableA its k nearest features of tableB, sorted by distance
+// The nearest features are searched best-first in the rtree of tableB: the nodes are visited in order of the distance to their envelope
+// and the exact distance to a feature is computed only when its envelope is the nearest pending entry
+// tableA -> Name of the table whose features are searched
+// geometryColumnA -> Column that contains the geometries of tableA
+// tableB -> Name of the table where the nearest features are searched. Needs a spatial index (see GPKG_AddSpatialIndex)
+// geometryColumnB -> Column that contains the geometries of tableB
+// k -> Number of nearest features of tableB for each feature of tableA
+// maxDistance -> optional parameter. Maximum distance of the features of tableB
+// Usage: SELECT id_a, id_b, distance FROM GPKG_NearestJoin('addresses', 'geom', 'roads', 'geom', 1, 50)
+
+// Columns of GPKG_NearestJoin
+#define NEARESTJOIN_IDA 0
+#define NEARESTJOIN_IDB 1
+#define NEARESTJOIN_DISTANCE 2
+#define NEARESTJOIN_TABLEA 3
+#define NEARESTJOIN_COLUMNA 4
+#define NEARESTJOIN_TABLEB 5
+#define NEARESTJOIN_COLUMNB 6
+#define NEARESTJOIN_K 7
+#define NEARESTJOIN_MAXDISTANCE 8
+#define NEARESTJOIN_SCHEMA "CREATE TABLE x(id_a, id_b, distance, table_a HIDDEN, column_a HIDDEN, table_b HIDDEN, column_b HIDDEN, k HIDDEN, max_distance HIDDEN)"
+
+// Levels of the entries of the queue of GPKG_NearestJoin that are features instead of nodes
+#define NEARESTJOIN_ENVELOPE -1 // Feature with the distance to its envelope
+#define NEARESTJOIN_FEATURE -2  // Feature with its exact distance
+
+// Entry of the priority queue of GPKG_NearestJoin
+typedef struct nearestJoinEntry
+{
+    double distance;  // Distance to the envelope of the node or to the feature
+    sqlite3_int64 id; // Number of the node or id of the feature
+    int level;        // Level of the node, NEARESTJOIN_ENVELOPE or NEARESTJOIN_FEATURE
+} nearestJoinEntry;
+
+// Cursor of GPKG_NearestJoin
+typedef struct nearestJoinCursor
+{
+    sqlite3_vtab_cursor base;  // Base class. Must be first
+    sqlite3_stmt *stmtA;       // Query on the features of tableA
+    sqlite3_stmt *stmtB;       // Query of a geometry of tableB
+    rtreeReader reader;        // Reader of the rtree of tableB
+    rtreeNode node;            // Node being visited
+    gpkgGeometry geomA, geomB; // Geometries to compute the distances
+    nearestJoinEntry *queue;   // Priority queue (binary heap) shared by all the features of tableA
+    int numQueue, maxQueue;
+    nearestJoinEntry *results; // Nearest features of the current feature of tableA
+    int numResults, result;
+    int k;
+    double maxDistance;
+    sqlite3_int64 idA;         // Id of the current feature of tableA
+    sqlite3_int64 rowid;       // Number of the current row
+    int eof;                   // 1 when there are no more rows
+} nearestJoinCursor;
+
+// Opens a cursor on GPKG_NearestJoin
+static int nearestJoinOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    nearestJoinCursor *cur;
+
+    cur = (nearestJoinCursor *)sqlite3_malloc(sizeof(nearestJoinCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(nearestJoinCursor));
+    cur->eof = 1;
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+// Releases the statements of a cursor on GPKG_NearestJoin
+static void nearestJoinReset(nearestJoinCursor *cur)
+{
+    sqlite3_finalize(cur->stmtA);
+    sqlite3_finalize(cur->stmtB);
+    cur->stmtA = cur->stmtB = NULL;
+    closeRtreeReader(&cur->reader);
+    cur->numQueue = cur->numResults = cur->result = 0;
+    cur->rowid = 0;
+    cur->eof = 1;
+}
+
+// Closes a cursor on GPKG_NearestJoin
+static int nearestJoinClose(sqlite3_vtab_cursor *cursor)
+{
+    nearestJoinCursor *cur = (nearestJoinCursor *)cursor;
+
+    nearestJoinReset(cur);
+    freeRtreeNode(&cur->node);
+    freeGPKGGeometry(&cur->geomA);
+    freeGPKGGeometry(&cur->geomB);
+    sqlite3_free(cur->queue);
+    sqlite3_free(cur->results);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+static int nearestJoinBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    return tableFunctionBestIndex(info, NEARESTJOIN_TABLEA, NEARESTJOIN_MAXDISTANCE, 0xF8);
+}
+
+// Adds an entry to the priority queue
+// Returns 0 if there is no memory or 1 if it's correct
+static int nearestJoinPush(nearestJoinCursor *cur, double distance, sqlite3_int64 id, int level)
+{
+    int i;
+
+    if (cur->numQueue == cur->maxQueue)
+    {
+        int maxQueue = cur->maxQueue ? cur->maxQueue * 2 : 256;
+        nearestJoinEntry *queue = (nearestJoinEntry *)sqlite3_realloc64(cur->queue, sizeof(nearestJoinEntry) * maxQueue);
+        if (queue == NULL)
+            return 0;
+        cur->queue = queue;
+        cur->maxQueue = maxQueue;
+    }
+    // Sift up
+    for (i = cur->numQueue++; i > 0 && cur->queue[(i - 1) / 2].distance > distance; i = (i - 1) / 2)
+        cur->queue[i] = cur->queue[(i - 1) / 2];
+    cur->queue[i].distance = distance;
+    cur->queue[i].id = id;
+    cur->queue[i].level = level;
+    return 1;
+}
+
+// Removes the nearest entry of the priority queue
+static nearestJoinEntry nearestJoinPop(nearestJoinCursor *cur)
+{
+    nearestJoinEntry top = cur->queue[0];
+    nearestJoinEntry last = cur->queue[--cur->numQueue];
+    int i = 0;
+
+    // Sift down
+    for (;;)
+    {
+        int child = i * 2 + 1;
+        if (child >= cur->numQueue)
+            break;
+        if (child + 1 < cur->numQueue && cur->queue[child + 1].distance < cur->queue[child].distance)
+            child++;
+        if (cur->queue[child].distance >= last.distance)
+            break;
+        cur->queue[i] = cur->queue[child];
+        i = child;
+    }
+    if (cur->numQueue > 0)
+        cur->queue[i] = last;
+    return top;
+}
+
+// Returns the distance from the envelope of a geometry to a box (minX, minY, maxX, maxY)
+static double envelopeDistance(const double *env, const double *box)
+{
+    double dx = fmax(0, fmax(box[0] - env[2], env[0] - box[2]));
+    double dy = fmax(0, fmax(box[1] - env[3], env[1] - box[3]));
+
+    return hypot(dx, dy);
+}
+
+// Searches the k nearest features of tableB to geomA
+// Returns SQLITE_OK or an SQLite error code
+static int nearestJoinSearch(nearestJoinCursor *cur)
+{
+    int rc;
+
+    cur->numQueue = cur->numResults = cur->result = 0;
+    if (!nearestJoinPush(cur, 0, 1, cur->reader.depth))
+        return SQLITE_NOMEM;
+    while (cur->numQueue > 0 && cur->numResults < cur->k)
+    {
+        nearestJoinEntry entry = nearestJoinPop(cur);
+        if (entry.distance > cur->maxDistance)
+            break;
+        if (entry.level == NEARESTJOIN_FEATURE)
+        {
+            // No pending entry can be nearer
+            cur->results[cur->numResults++] = entry;
+        }
+        else if (entry.level == NEARESTJOIN_ENVELOPE)
+        {
+            double distance = -1;
+            sqlite3_reset(cur->stmtB);
+            sqlite3_bind_int64(cur->stmtB, 1, entry.id);
+            if (sqlite3_step(cur->stmtB) == SQLITE_ROW && sqlite3_column_type(cur->stmtB, 0) == SQLITE_BLOB &&
+                readGPKGGeometry((unsigned char *)sqlite3_column_blob(cur->stmtB, 0), sqlite3_column_bytes(cur->stmtB, 0), &cur->geomB))
+                distance = geometryDistance(&cur->geomA, &cur->geomB);
+            sqlite3_reset(cur->stmtB);
+            if (distance >= 0 && distance <= cur->maxDistance && !nearestJoinPush(cur, distance, entry.id, NEARESTJOIN_FEATURE))
+                return SQLITE_NOMEM;
+        }
+        else
+        {
+            rc = readRtreeNode(&cur->reader, entry.id, &cur->node);
+            if (rc != SQLITE_OK)
+                return rc;
+            for (int i = 0; i < cur->node.numCells; i++)
+            {
+                double distance = envelopeDistance(cur->geomA.env, &cur->node.boxes[i * 4]);
+                if (distance <= cur->maxDistance &&
+                    !nearestJoinPush(cur, distance, cur->node.ids[i], entry.level > 0 ? entry.level - 1 : NEARESTJOIN_ENVELOPE))
+                    return SQLITE_NOMEM;
+            }
+        }
+    }
+    return SQLITE_OK;
+}
+
+// Moves the cursor to the next nearest feature, searching the nearest features of the next feature of tableA when needed
+static int nearestJoinNext(sqlite3_vtab_cursor *cursor)
+{
+    nearestJoinCursor *cur = (nearestJoinCursor *)cursor;
+    int rc;
+
+    cur->result++;
+    while (cur->result >= cur->numResults)
+    {
+        rc = sqlite3_step(cur->stmtA);
+        if (rc != SQLITE_ROW)
+        {
+            cur->eof = 1;
+            return rc == SQLITE_DONE ? SQLITE_OK : rc;
+        }
+        cur->numResults = cur->result = 0;
+        if (sqlite3_column_type(cur->stmtA, 1) != SQLITE_BLOB ||
+            !readGPKGGeometry((unsigned char *)sqlite3_column_blob(cur->stmtA, 1), sqlite3_column_bytes(cur->stmtA, 1), &cur->geomA) ||
+            cur->geomA.numParts == 0)
+            continue; // NULL, empty or incorrect geometries have no nearest features
+        cur->idA = sqlite3_column_int64(cur->stmtA, 0);
+        rc = nearestJoinSearch(cur);
+        if (rc != SQLITE_OK)
+            return rc;
+    }
+    cur->rowid++;
+    return SQLITE_OK;
+}
+
+// Opens the rtree of tableB and starts the search with the first feature of tableA
+static int nearestJoinFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
+{
+    nearestJoinCursor *cur = (nearestJoinCursor *)cursor;
+    const char *tableA, *gcolumnA, *tableB, *gcolumnB;
+    sqlite3 *db;
+    char *sql;
+    int rc;
+
+    nearestJoinReset(cur);
+    if ((idxNum & 0xF8) != 0xF8)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_NearestJoin() error: tableA, geometryColumnA, tableB, geometryColumnB and k are mandatory");
+        return SQLITE_ERROR;
+    }
+    tableA = (const char *)sqlite3_value_text(argv[0]);
+    gcolumnA = (const char *)sqlite3_value_text(argv[1]);
+    tableB = (const char *)sqlite3_value_text(argv[2]);
+    gcolumnB = (const char *)sqlite3_value_text(argv[3]);
+    if (sqlite3_value_type(argv[4]) != SQLITE_INTEGER || sqlite3_value_int(argv[4]) < 1)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_NearestJoin() error: argument 5 [k] must be a positive integer");
+        return SQLITE_ERROR;
+    }
+    cur->k = sqlite3_value_int(argv[4]);
+    cur->maxDistance = HUGE_VAL;
+    if (argc == 6)
+    {
+        if (sqlite3_value_type(argv[5]) != SQLITE_INTEGER && sqlite3_value_type(argv[5]) != SQLITE_FLOAT)
+        {
+            cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_NearestJoin() error: argument 6 [maxDistance] must be a number");
+            return SQLITE_ERROR;
+        }
+        cur->maxDistance = sqlite3_value_double(argv[5]);
+    }
+    sqlite3_free(cur->results);
+    cur->results = (nearestJoinEntry *)sqlite3_malloc64(sizeof(nearestJoinEntry) * cur->k);
+    if (cur->results == NULL)
+        return SQLITE_NOMEM;
+
+    // Get DB handle
+    db = ((tableFunctionVtab *)cursor->pVtab)->db;
+
+    rc = openRtreeReader(db, tableB, gcolumnB, &cur->reader);
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("SELECT rowid, \"%w\" FROM \"%w\"", gcolumnA, tableA);
+        rc = sqlite3_prepare_v2(db, sql, -1, &cur->stmtA, NULL);
+        sqlite3_free(sql);
+    }
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("SELECT \"%w\" FROM \"%w\" WHERE rowid = ?1", gcolumnB, tableB);
+        rc = sqlite3_prepare_v2(db, sql, -1, &cur->stmtB, NULL);
+        sqlite3_free(sql);
+    }
+    if (rc != SQLITE_OK)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_NearestJoin() error: %s", sqlite3_errmsg(db));
+        return rc;
+    }
+    cur->eof = 0;
+    cur->result = -1;
+    return nearestJoinNext(cursor);
+}
+
+// Returns 1 if there are no more rows
+static int nearestJoinEof(sqlite3_vtab_cursor *cursor)
+{
+    return ((nearestJoinCursor *)cursor)->eof;
+}
+
+// Returns the value of a column. The hidden columns are the parameters
+static int nearestJoinColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    nearestJoinCursor *cur = (nearestJoinCursor *)cursor;
+
+    switch (column)
+    {
+    case NEARESTJOIN_IDA:
+        sqlite3_result_int64(context, cur->idA);
+        break;
+    case NEARESTJOIN_IDB:
+        sqlite3_result_int64(context, cur->results[cur->result].id);
+        break;
+    case NEARESTJOIN_DISTANCE:
+        sqlite3_result_double(context, cur->results[cur->result].distance);
+        break;
+    }
+    return SQLITE_OK;
+}
+
+// The rowid is the number of the row
+static int nearestJoinRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = ((nearestJoinCursor *)cursor)->rowid;
+    return SQLITE_OK;
+}
+
+static sqlite3_module nearestJoinModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    tableFunctionConnect,    // xConnect
+    nearestJoinBestIndex,    // xBestIndex
+    tableFunctionDisconnect, // xDisconnect
+    0,                       // xDestroy
+    nearestJoinOpen,         // xOpen
+    nearestJoinClose,        // xClose
+    nearestJoinFilter,       // xFilter
+    nearestJoinNext,         // xNext
+    nearestJoinEof,          // xEof
+    nearestJoinColumn,       // xColumn
+    nearestJoinRowid,        // xRowid
+    0, 0, 0, 0, 0, 0, 0       // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Virtual table: CREATE VIRTUAL TABLE name USING GPKG_Layer(tableName, geometryColumn, exact)
+// Exposes a feature table with the hidden columns minx, miny, maxx, maxy (envelope of the geometry)
+// The constraints on the hidden columns are pushed down to the spatial index, so a query like
+//   SELECT * FROM name WHERE maxx >= 10 AND minx <= 20 AND maxy >= 40 AND miny <= 50
+// reads the rows through the rtree instead of scanning the table
+// tableName -> Name of the table. It's queried through its spatial index if it has one (see GPKG_AddSpatialIndex)
+// geometryColumn -> Column that contains the geometry
+// exact -> optional parameter. If 1 and the constraints are a window (maxx >= minX AND minx <= maxX AND maxy >= minY AND miny <= maxY)
+//          only the rows whose geometry intersects the window are returned, not all the rows whose envelope intersects it
+// The virtual table is read only
+
+// Hidden columns of GPKG_Layer after the columns of the table
+#define LAYER_MINX 0
+#define LAYER_MINY 1
+#define LAYER_MAXX 2
+#define LAYER_MAXY 3
+
+// Bit of idxNum of GPKG_Layer when the rowid is constrained
+#define LAYER_ROWID 0x01
+// Bit of idxNum of GPKG_Layer when the spatial index is used. idxStr has the constraints on the hidden columns
+#define LAYER_RTREE 0x02
+
+// Virtual table of GPKG_Layer
+typedef struct layerVtab
+{
+    sqlite3_vtab base;    // Base class. Must be first
+    sqlite3 *db;          // Database connection
+    char *table;          // Name of the table
+    char *gcolumn;        // Column that contains the geometry
+    int numColumns;       // Number of columns of the table
+    int geometryIndex;    // Index of the geometry column
+    int hasRtree;         // 1 if the table has a spatial index
+    int exact;            // 1 to check the geometries against the window
+    double featureCount;  // Number of features for the costs of xBestIndex
+} layerVtab;
+
+// Cursor of GPKG_Layer
+typedef struct layerCursor
+{
+    sqlite3_vtab_cursor base; // Base class. Must be first
+    sqlite3_stmt *stmt;       // Query on the table. The first column is the rowid
+    gpkgGeometry geom;        // Geometry of the current row
+    int geomRead;             // 1 if geom has the geometry of the current row, -1 if it's NULL or empty
+    int window;               // 1 if the rows are checked against the window
+    gpkgGeometry windowGeom;  // Window as a Polygon
+    int eof;                  // 1 when there are no more rows
+} layerCursor;
+
+// Removes the quotes of an argument of CREATE VIRTUAL TABLE
+// Returns a copy allocated with sqlite3_malloc
+static char *layerDequote(const char *arg)
+{
+    int n = (int)strlen(arg);
+    char *res;
+    int j = 0;
+
+    if (n < 2 || (arg[0] != '\'' && arg[0] != '"' && arg[0] != '[' && arg[0] != '`'))
+        return sqlite3_mprintf("%s", arg);
+    res = sqlite3_mprintf("%s", arg + 1);
+    if (res == NULL)
+        return NULL;
+    for (int i = 0; i < n - 2; i++)
+    {
+        res[j++] = res[i];
+        if (arg[0] != '[' && res[i] == arg[0] && res[i + 1] == arg[0])
+            i++; // Doubled quote
+    }
+    res[j] = 0;
+    return res;
+}
+
+// Disconnects a GPKG_Layer virtual table
+static int layerDisconnect(sqlite3_vtab *vtab)
+{
+    layerVtab *layer = (layerVtab *)vtab;
+
+    sqlite3_free(layer->table);
+    sqlite3_free(layer->gcolumn);
+    sqlite3_free(layer);
+    return SQLITE_OK;
+}
+
+// Creates or connects a GPKG_Layer virtual table: declares the columns of the table plus the hidden columns of the envelope
+// and counts the features for the costs of xBestIndex
+static int layerConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr)
+{
+    layerVtab *layer;
+    sqlite3_stmt *stmt;
+    char *sql, *schema;
+    int rc;
+
+    if (argc < 5 || argc > 6)
+    {
+        *pzErr = sqlite3_mprintf("GPKG_Layer() error: the parameters are tableName, geometryColumn and optionally exact");
+        return SQLITE_ERROR;
+    }
+    layer = (layerVtab *)sqlite3_malloc(sizeof(layerVtab));
+    if (layer == NULL)
+        return SQLITE_NOMEM;
+    memset(layer, 0, sizeof(layerVtab));
+    layer->db = db;
+    layer->geometryIndex = -1;
+    layer->table = layerDequote(argv[3]);
+    layer->gcolumn = layerDequote(argv[4]);
+    if (argc == 6)
+        layer->exact = atoi(argv[5]) != 0;
+    if (layer->table == NULL || layer->gcolumn == NULL)
+    {
+        layerDisconnect(&layer->base);
+        return SQLITE_NOMEM;
+    }
+
+    // Declare the columns of the table with their types
+    sql = sqlite3_mprintf("SELECT * FROM \"%w\" LIMIT 0", layer->table);
+    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+    {
+        *pzErr = sqlite3_mprintf("GPKG_Layer() error: %s", sqlite3_errmsg(db));
+        layerDisconnect(&layer->base);
+        return rc;
+    }
+    layer->numColumns = sqlite3_column_count(stmt);
+    schema = sqlite3_mprintf("CREATE TABLE x(");
+    for (int i = 0; i < layer->numColumns && schema != NULL; i++)
+    {
+        const char *type = sqlite3_column_decltype(stmt, i);
+        schema = sqlite3_mprintf("%z\"%w\" %s, ", schema, sqlite3_column_name(stmt, i), type != NULL ? type : "");
+        if (_stricmp(sqlite3_column_name(stmt, i), layer->gcolumn) == 0)
+            layer->geometryIndex = i;
+    }
+    sqlite3_finalize(stmt);
+    if (schema == NULL)
+    {
+        layerDisconnect(&layer->base);
+        return SQLITE_NOMEM;
+    }
+    if (layer->geometryIndex < 0)
+    {
+        sqlite3_free(schema);
+        *pzErr = sqlite3_mprintf("GPKG_Layer() error: the table %s has no column %s", layer->table, layer->gcolumn);
+        layerDisconnect(&layer->base);
+        return SQLITE_ERROR;
+    }
+    schema = sqlite3_mprintf("%zminx HIDDEN, miny HIDDEN, maxx HIDDEN, maxy HIDDEN)", schema);
+    rc = schema != NULL ? sqlite3_declare_vtab(db, schema) : SQLITE_NOMEM;
+    sqlite3_free(schema);
+    if (rc != SQLITE_OK)
+    {
+        layerDisconnect(&layer->base);
+        return rc;
+    }
+
+    // Number of features: from the spatial histogram (see GPKG_AnalyzeSpatial), else from the spatial index, else assume a big table
+    layer->featureCount = 1e6;
+    sql = sqlite3_mprintf("SELECT count(*) FROM \"rtree_%w_%w_rowid\"", layer->table, layer->gcolumn);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        layer->hasRtree = 1;
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            layer->featureCount = (double)sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_free(sql);
+    if (sqlite3_prepare_v2(db, "SELECT feature_count FROM gpkgext_spatial_statistics WHERE LOWER(table_name) = LOWER(?1) AND LOWER(column_name) = LOWER(?2)", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, layer->table, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, layer->gcolumn, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            layer->featureCount = (double)sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (layer->featureCount < 1)
+        layer->featureCount = 1;
+    *ppVtab = &layer->base;
+    return SQLITE_OK;
+}
+
+// Chooses between the rowid, the spatial index and a full scan
+// The constraints on the hidden columns used by the spatial index are encoded in idxStr as pairs of characters:
+// the hidden column ('0' minx, '1' miny, '2' maxx, '3' maxy) and the operator ('<', 'l' <=, '>', 'g' >=)
+// They are not omitted: SQLite checks them again with the exact envelope because the rtree stores the envelopes rounded to floats
+static int layerBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    layerVtab *layer = (layerVtab *)vtab;
+    char ops[64];
+    int numOps = 0;
+    int n = 0;
+
+    for (int i = 0; i < info->nConstraint; i++)
+    {
+        // The rowid gives a single row
+        if (info->aConstraint[i].usable && info->aConstraint[i].iColumn == -1 && info->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_EQ)
+        {
+            info->aConstraintUsage[i].argvIndex = 1;
+            info->aConstraintUsage[i].omit = 1;
+            info->idxNum = LAYER_ROWID;
+            info->estimatedCost = 10;
+            info->estimatedRows = 1;
+            info->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+            return SQLITE_OK;
+        }
+    }
+    if (layer->hasRtree)
+    {
+        for (int i = 0; i < info->nConstraint && numOps < 30; i++)
+        {
+            int column = info->aConstraint[i].iColumn - layer->numColumns;
+            char op;
+            if (!info->aConstraint[i].usable || column < LAYER_MINX || column > LAYER_MAXY)
+                continue;
+            // The rtree rounds minx and miny down and maxx and maxy up, so only upper bounds of minx and miny
+            // and lower bounds of maxx and maxy can be checked on the rtree without missing rows
+            switch (info->aConstraint[i].op)
+            {
+            case SQLITE_INDEX_CONSTRAINT_LT: op = '<'; break;
+            case SQLITE_INDEX_CONSTRAINT_LE: op = 'l'; break;
+            case SQLITE_INDEX_CONSTRAINT_GT: op = '>'; break;
+            case SQLITE_INDEX_CONSTRAINT_GE: op = 'g'; break;
+            default: continue;
+            }
+            if ((column == LAYER_MINX || column == LAYER_MINY) != (op == '<' || op == 'l'))
+                continue;
+            ops[numOps * 2] = (char)('0' + column);
+            ops[numOps * 2 + 1] = op;
+            numOps++;
+            info->aConstraintUsage[i].argvIndex = ++n;
+        }
+    }
+    if (numOps == 0)
+    {
+        info->idxNum = 0;
+        info->estimatedCost = layer->featureCount;
+        info->estimatedRows = (sqlite3_int64)layer->featureCount;
+        return SQLITE_OK;
+    }
+    ops[numOps * 2] = 0;
+    info->idxNum = LAYER_RTREE;
+    info->idxStr = sqlite3_mprintf("%s", ops);
+    info->needToFreeIdxStr = 1;
+    // Each bound constrained halves the features. Every row is fetched from the table by rowid
+    info->estimatedRows = (sqlite3_int64)fmax(1, layer->featureCount / pow(2, numOps));
+    info->estimatedCost = log2(layer->featureCount + 1) + info->estimatedRows * 2.0;
+    return SQLITE_OK;
+}
+
+// Opens a cursor on GPKG_Layer
+static int layerOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    layerCursor *cur;
+
+    cur = (layerCursor *)sqlite3_malloc(sizeof(layerCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(layerCursor));
+    cur->eof = 1;
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+// Closes a cursor on GPKG_Layer
+static int layerClose(sqlite3_vtab_cursor *cursor)
+{
+    layerCursor *cur = (layerCursor *)cursor;
+
+    sqlite3_finalize(cur->stmt);
+    freeGPKGGeometry(&cur->geom);
+    freeGPKGGeometry(&cur->windowGeom);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+// Reads the geometry of the current row
+// Returns 1 if the geometry was read and is not empty
+static int layerReadGeometry(layerCursor *cur)
+{
+    int index = ((layerVtab *)cur->base.pVtab)->geometryIndex + 1;
+
+    if (cur->geomRead == 0)
+    {
+        cur->geomRead = -1;
+        if (sqlite3_column_type(cur->stmt, index) == SQLITE_BLOB &&
+            readGPKGGeometry((unsigned char *)sqlite3_column_blob(cur->stmt, index), sqlite3_column_bytes(cur->stmt, index), &cur->geom) &&
+            cur->geom.numParts > 0)
+            cur->geomRead = 1;
+    }
+    return cur->geomRead == 1;
+}
+
+// Moves the cursor to the next row. If exact refinement is active skips the rows whose geometry doesn't intersect the window
+static int layerNext(sqlite3_vtab_cursor *cursor)
+{
+    layerCursor *cur = (layerCursor *)cursor;
+    int rc;
+
+    for (;;)
+    {
+        cur->geomRead = 0;
+        rc = sqlite3_step(cur->stmt);
+        if (rc != SQLITE_ROW)
+        {
+            cur->eof = 1;
+            return rc == SQLITE_DONE ? SQLITE_OK : rc;
+        }
+        if (!cur->window || (layerReadGeometry(cur) && geometryIntersects(&cur->geom, &cur->windowGeom)))
+            return SQLITE_OK;
+    }
+}
+
+// Builds the window of the exact refinement as a Polygon
+// Returns 0 if there is no memory or 1 if it's correct
+static int layerWindow(layerCursor *cur, const double *box)
+{
+    gpkgGeometry *geom = &cur->windowGeom;
+    const double x[5] = { box[0], box[2], box[2], box[0], box[0] };
+    const double y[5] = { box[1], box[1], box[3], box[3], box[1] };
+
+    geom->geometryType = wkbPolygon;
+    geom->hasZ = geom->hasM = 0;
+    geom->dimension = 2;
+    geom->numParts = geom->numRings = geom->numPoints = 0;
+    if (!growGPKGGeometry(geom, 1, 1, 5))
+        return 0;
+    geom->parts[0].geometryType = wkbPolygon;
+    geom->parts[0].firstRing = 0;
+    geom->parts[0].numRings = 1;
+    geom->rings[0].firstPoint = 0;
+    geom->rings[0].numPoints = 5;
+    for (int i = 0; i < 5; i++)
+    {
+        geom->coords[i * 2] = x[i];
+        geom->coords[i * 2 + 1] = y[i];
+    }
+    geom->numParts = geom->numRings = 1;
+    geom->numPoints = 5;
+    memcpy(geom->env, box, sizeof(geom->env));
+    return 1;
+}
+
+// Prepares the query on the table for the plan chosen by xBestIndex
+static int layerFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
+{
+    layerCursor *cur = (layerCursor *)cursor;
+    layerVtab *layer = (layerVtab *)cursor->pVtab;
+    // Window of the exact refinement: the lower bounds come from maxx/maxy and the upper bounds from minx/miny
+    double box[4] = { -HUGE_VAL, -HUGE_VAL, HUGE_VAL, HUGE_VAL };
+    int boxMask = 0;
+    char *sql;
+    int rc;
+
+    sqlite3_finalize(cur->stmt);
+    cur->stmt = NULL;
+    cur->window = 0;
+    cur->eof = 1;
+    if (idxNum & LAYER_ROWID)
+        sql = sqlite3_mprintf("SELECT rowid, * FROM \"%w\" WHERE rowid = ?1", layer->table);
+    else if (idxNum & LAYER_RTREE)
+    {
+        // The hidden columns are in the order of GPKG (minx, miny, maxx, maxy), the columns of the rtree are minx, maxx, miny, maxy
+        static const char *const rtreeColumns[4] = { "minx", "miny", "maxx", "maxy" };
+        sql = sqlite3_mprintf("SELECT t.rowid, t.* FROM \"rtree_%w_%w\" r CROSS JOIN \"%w\" t ON t.rowid = r.id WHERE 1", layer->table, layer->gcolumn, layer->table);
+        for (int i = 0; idxStr[i * 2] != 0 && sql != NULL; i++)
+        {
+            int column = idxStr[i * 2] - '0';
+            char op = idxStr[i * 2 + 1];
+            const char *sqlOp = op == '<' ? "<" : op == 'l' ? "<=" : op == '>' ? ">" : ">=";
+            double value;
+            // Constraints of a window for the exact refinement
+            if (sqlite3_value_type(argv[i]) == SQLITE_INTEGER || sqlite3_value_type(argv[i]) == SQLITE_FLOAT)
+            {
+                value = sqlite3_value_double(argv[i]);
+                if (column == LAYER_MAXX || column == LAYER_MAXY)
+                {
+                    box[column - 2] = fmax(box[column - 2], value);
+                    boxMask |= 1 << (column - 2);
+                }
+                else
+                {
+                    box[column + 2] = fmin(box[column + 2], value);
+                    boxMask |= 1 << (column + 2);
+                }
+            }
+            sql = sqlite3_mprintf("%z AND r.%s %s ?%d", sql, rtreeColumns[column], sqlOp, i + 1);
+        }
+    }
+    else
+        sql = sqlite3_mprintf("SELECT rowid, * FROM \"%w\"", layer->table);
+    if (sql == NULL)
+        return SQLITE_NOMEM;
+    rc = sqlite3_prepare_v2(layer->db, sql, -1, &cur->stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_Layer() error: %s", sqlite3_errmsg(layer->db));
+        return rc;
+    }
+    for (int i = 0; i < argc; i++)
+        sqlite3_bind_value(cur->stmt, i + 1, argv[i]);
+    if (layer->exact && boxMask == 0x0F)
+    {
+        if (!layerWindow(cur, box))
+            return SQLITE_NOMEM;
+        cur->window = 1;
+    }
+    cur->eof = 0;
+    return layerNext(cursor);
+}
+
+// Returns 1 if there are no more rows
+static int layerEof(sqlite3_vtab_cursor *cursor)
+{
+    return ((layerCursor *)cursor)->eof;
+}
+
+// Returns the value of a column of the table or of the envelope of the geometry
+static int layerColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    layerCursor *cur = (layerCursor *)cursor;
+    int numColumns = ((layerVtab *)cursor->pVtab)->numColumns;
+
+    if (column < numColumns)
+        sqlite3_result_value(context, sqlite3_column_value(cur->stmt, column + 1));
+    else if (layerReadGeometry(cur))
+        sqlite3_result_double(context, cur->geom.env[column - numColumns]);
+    return SQLITE_OK;
+}
+
+// The rowid is the one of the table
+static int layerRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = sqlite3_column_int64(((layerCursor *)cursor)->stmt, 0);
+    return SQLITE_OK;
+}
+
+static sqlite3_module layerModule = {
+    0,               // iVersion
+    layerConnect,    // xCreate
+    layerConnect,    // xConnect
+    layerBestIndex,  // xBestIndex
+    layerDisconnect, // xDisconnect
+    layerDisconnect, // xDestroy
+    layerOpen,       // xOpen
+    layerClose,      // xClose
+    layerFilter,     // xFilter
+    layerNext,       // xNext
+    layerEof,        // xEof
+    layerColumn,     // xColumn
+    layerRowid,      // xRowid
+    0, 0, 0, 0, 0, 0, 0 // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Virtual table: CREATE VIRTUAL TABLE name USING GPKG_FlatGeobuf(path)
+// Exposes a FlatGeobuf file with its columns, the column geom and the hidden columns minx, miny, maxx, maxy (envelope of the geometry)
+// The file is memory mapped and nothing is imported. The constraints on the hidden columns are pushed down to the packed
+// Hilbert R-tree of the file, so a query like
+//   SELECT * FROM name WHERE maxx >= 10 AND minx <= 20 AND maxy >= 40 AND miny <= 50
+// only reads the features whose envelope intersects the window. The geometry of a feature is converted to GPKG format only when geom is read
+// path -> Path of the FlatGeobuf file
+// The rowid is the position of the feature in the file, from 0. The virtual table is read only
+// The hidden columns and the bits of idxNum are the ones of GPKG_Layer (LAYER_MINX ... LAYER_MAXY, LAYER_ROWID, LAYER_RTREE)
+
+// Bytes of a node item of the packed R-tree: minX, minY, maxX, maxY and the offset of the feature or the first child node item
+#define FGB_NODE_ITEM_SIZE 40
+// Maximum number of levels of the packed R-tree
+#define FGB_MAX_LEVELS 64
+
+// Types of the columns of FlatGeobuf
+#define FGB_BYTE 0
+#define FGB_UBYTE 1
+#define FGB_BOOL 2
+#define FGB_SHORT 3
+#define FGB_USHORT 4
+#define FGB_INT 5
+#define FGB_UINT 6
+#define FGB_LONG 7
+#define FGB_ULONG 8
+#define FGB_FLOAT 9
+#define FGB_DOUBLE 10
+#define FGB_STRING 11
+#define FGB_JSON 12
+#define FGB_DATETIME 13
+#define FGB_BINARY 14
+
+// Virtual table of GPKG_FlatGeobuf
+typedef struct fgbVtab
+{
+    sqlite3_vtab base;          // Base class. Must be first
+    mappedFile file;            // FlatGeobuf file
+    int geometryType;           // Geometry type of the header: wkbGeometry (Unknown) ... wkbGeometryCollection, or another FlatGeobuf type
+    int hasZ, hasM;             // Ordinates of the coordinates
+    int srsId;                  // EPSG code of the CRS, or 0
+    int numColumns;             // Number of columns of the header
+    unsigned char *columnTypes; // FGB_BYTE ... FGB_BINARY of each column
+    sqlite3_int64 numFeatures;  // Number of features of the header, or 0 if it's unknown
+    int nodeSize;               // Items of each node of the packed R-tree, or 0 if there is no index
+    sqlite3_int64 indexStart;   // Position of the packed R-tree in the file
+    int numLevels;              // Levels of the packed R-tree
+    sqlite3_int64 levelStart[FGB_MAX_LEVELS]; // First node item of each level, from the leaves (0) to the root
+    sqlite3_int64 levelEnd[FGB_MAX_LEVELS];   // Last node item + 1 of each level
+    sqlite3_int64 featuresStart; // Position of the first feature in the file
+} fgbVtab;
+
+// Cursor of GPKG_FlatGeobuf
+typedef struct fgbCursor
+{
+    sqlite3_vtab_cursor base;   // Base class. Must be first
+    int idxNum;                 // 0 (scan of the features), LAYER_ROWID or LAYER_RTREE
+    sqlite3_int64 rowid;        // Position of the current feature
+    sqlite3_int64 next;         // Position in the file of the next feature of the scan
+    const unsigned char *item;  // Leaf node item of the current feature, or NULL in a scan
+    flatTable feature;          // Feature table of the current row
+    sqlite3_int64 *properties;  // Position of the value of each column in the properties of the current feature, or -1 if it's NULL
+    int propertiesRead;         // 1 if properties has the values of the current feature
+    gpkgGeometry geom;          // Geometry of the current feature
+    int geomRead;               // 1 if geom has the geometry of the current feature, -1 if it's NULL or not valid
+    // Constraints on the hidden columns of LAYER_RTREE
+    int numOps;
+    int opColumns[30];
+    char ops[30];
+    double opValues[30];
+    // Search of the packed R-tree: node items still to check of each level, from the root
+    int depth;
+    sqlite3_int64 searchPos[FGB_MAX_LEVELS];
+    sqlite3_int64 searchEnd[FGB_MAX_LEVELS];
+    int searchLevel[FGB_MAX_LEVELS];
+    int eof;                    // 1 when there are no more rows
+} fgbCursor;
+
+// Reads a little endian double of a FlatGeobuf file
+static double fgbDouble(const unsigned char *p)
+{
+    sqlite3_uint64 bits = flatRead(p, 8);
+    double value;
+
+    memcpy(&value, &bits, 8);
+    return value;
+}
+
+// Disconnects a GPKG_FlatGeobuf virtual table
+static int fgbDisconnect(sqlite3_vtab *vtab)
+{
+    fgbVtab *fgb = (fgbVtab *)vtab;
+
+    unmapFile(&fgb->file);
+    sqlite3_free(fgb->columnTypes);
+    sqlite3_free(fgb);
+    return SQLITE_OK;
+}
+
+// Returns the SQL type of a column of FlatGeobuf
+static const char *fgbColumnType(int type)
+{
+    switch (type)
+    {
+    case FGB_BOOL: return "BOOLEAN";
+    case FGB_FLOAT: case FGB_DOUBLE: return "DOUBLE";
+    case FGB_STRING: case FGB_JSON: return "TEXT";
+    case FGB_DATETIME: return "DATETIME";
+    case FGB_BINARY: return "BLOB";
+    }
+    return "INTEGER";
+}
+
+// Creates or connects a GPKG_FlatGeobuf virtual table: maps the file, reads its header and the levels of its packed R-tree
+// and declares the columns of the header, geom and the hidden columns of the envelope
+static int fgbConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr)
+{
+    fgbVtab *fgb;
+    flatTable header, crs, column;
+    const unsigned char *data;
+    sqlite3_int64 headerSize, start, num, numNodes, levelItems[FGB_MAX_LEVELS];
+    const char *s;
+    char *path, *schema, *name;
+    int n, rc;
+
+    if (argc != 4)
+    {
+        *pzErr = sqlite3_mprintf("GPKG_FlatGeobuf() error: the parameter is the path of the file");
+        return SQLITE_ERROR;
+    }
+    fgb = (fgbVtab *)sqlite3_malloc(sizeof(fgbVtab));
+    path = layerDequote(argv[3]);
+    if (fgb == NULL || path == NULL)
+    {
+        sqlite3_free(fgb);
+        sqlite3_free(path);
+        return SQLITE_NOMEM;
+    }
+    memset(fgb, 0, sizeof(fgbVtab));
+    if (!mapFile(path, &fgb->file))
+    {
+        *pzErr = sqlite3_mprintf("GPKG_FlatGeobuf() error: can't open the file %s", path);
+        sqlite3_free(path);
+        fgbDisconnect(&fgb->base);
+        return SQLITE_ERROR;
+    }
+
+    // Magic bytes (version 3) and header
+    data = fgb->file.data;
+    if (fgb->file.size < 12 || memcmp(data, "fgb\x03" "fgb", 7) != 0 ||
+        (headerSize = (sqlite3_int64)flatRead(data + 8, 4)) < 4 || headerSize > fgb->file.size - 12 ||
+        !flatTableAt(data + 12, headerSize, (sqlite3_int64)flatRead(data + 12, 4), &header))
+    {
+        *pzErr = sqlite3_mprintf("GPKG_FlatGeobuf() error: %s is not a FlatGeobuf file", path);
+        sqlite3_free(path);
+        fgbDisconnect(&fgb->base);
+        return SQLITE_ERROR;
+    }
+    fgb->geometryType = (int)flatGetInt(&header, 2, 1, 0) & 0xff;
+    fgb->hasZ = flatGetInt(&header, 3, 1, 0) != 0;
+    fgb->hasM = flatGetInt(&header, 4, 1, 0) != 0;
+    fgb->numFeatures = flatGetInt(&header, 8, 8, 0);
+    fgb->nodeSize = (int)flatGetInt(&header, 9, 2, 16) & 0xffff;
+    if (fgb->numFeatures <= 0)
+    {
+        fgb->numFeatures = 0;
+        fgb->nodeSize = 0; // Without the number of features there is no index
+    }
+    if (flatGetTable(&header, 10, &crs))
+    {
+        // The organization of the code is EPSG by default
+        if (!flatGetString(&crs, 0, &s, &n) || (n == 4 && sqlite3_strnicmp(s, "EPSG", 4) == 0))
+            fgb->srsId = (int)flatGetInt(&crs, 1, 4, 0);
+    }
+
+    // Levels of the packed R-tree: the nodes are stored from the root to the leaves, and each level after the one above it
+    fgb->indexStart = 12 + headerSize;
+    fgb->featuresStart = fgb->indexStart;
+    if (fgb->nodeSize > 0)
+    {
+        numNodes = -1;
+        if (fgb->nodeSize >= 2 && fgb->numFeatures <= (fgb->file.size - fgb->indexStart) / FGB_NODE_ITEM_SIZE)
+        {
+            n = 1;
+            levelItems[0] = numNodes = fgb->numFeatures;
+            do
+            {
+                levelItems[n] = (levelItems[n - 1] + fgb->nodeSize - 1) / fgb->nodeSize;
+                numNodes += levelItems[n++];
+            } while (levelItems[n - 1] != 1 && n < FGB_MAX_LEVELS);
+            fgb->numLevels = n;
+            for (int level = 0; level < n; level++)
+            {
+                fgb->levelEnd[level] = level == 0 ? numNodes : fgb->levelStart[level - 1];
+                fgb->levelStart[level] = fgb->levelEnd[level] - levelItems[level];
+            }
+        }
+        if (numNodes < 0 || numNodes > (fgb->file.size - fgb->indexStart) / FGB_NODE_ITEM_SIZE)
+        {
+            *pzErr = sqlite3_mprintf("GPKG_FlatGeobuf() error: the index of %s is not valid", path);
+            sqlite3_free(path);
+            fgbDisconnect(&fgb->base);
+            return SQLITE_CORRUPT;
+        }
+        fgb->featuresStart += numNodes * FGB_NODE_ITEM_SIZE;
+    }
+
+    // Declare the columns of the header with their types
+    schema = sqlite3_mprintf("CREATE TABLE x(");
+    if (flatGetVector(&header, 7, 4, &start, &num) && num > 0)
+    {
+        fgb->columnTypes = (unsigned char *)sqlite3_malloc((int)num);
+        if (fgb->columnTypes == NULL)
+        {
+            sqlite3_free(schema);
+            schema = NULL;
+        }
+        for (int i = 0; i < num && schema != NULL; i++)
+        {
+            int type;
+            if (!flatVectorTable(&header, start, i, &column) || !flatGetString(&column, 0, &s, &n) ||
+                (type = (int)flatGetInt(&column, 1, 1, 0) & 0xff) > FGB_BINARY)
+            {
+                *pzErr = sqlite3_mprintf("GPKG_FlatGeobuf() error: the columns of %s are not valid", path);
+                sqlite3_free(path);
+                sqlite3_free(schema);
+                fgbDisconnect(&fgb->base);
+                return SQLITE_CORRUPT;
+            }
+            fgb->columnTypes[fgb->numColumns++] = (unsigned char)type;
+            name = sqlite3_mprintf("%.*s", n, s);
+            schema = name != NULL ? sqlite3_mprintf("%z\"%w\" %s, ", schema, name, fgbColumnType(type)) : NULL;
+            sqlite3_free(name);
+        }
+    }
+    sqlite3_free(path);
+    if (schema != NULL)
+        schema = sqlite3_mprintf("%zgeom %s, minx HIDDEN, miny HIDDEN, maxx HIDDEN, maxy HIDDEN)", schema,
+                                 fgb->geometryType <= wkbGeometryCollection ? wktGeomtryTypes[fgb->geometryType] : "GEOMETRY");
+    rc = schema != NULL ? sqlite3_declare_vtab(db, schema) : SQLITE_NOMEM;
+    sqlite3_free(schema);
+    if (rc != SQLITE_OK)
+    {
+        fgbDisconnect(&fgb->base);
+        return rc;
+    }
+    *ppVtab = &fgb->base;
+    return SQLITE_OK;
+}
+
+// Chooses between the rowid, the packed R-tree and a scan of the features
+// The constraints on the hidden columns are encoded in idxStr as in GPKG_Layer, with '=' for equality. They are not omitted:
+// SQLite checks them again, which also handles the values that are not numbers
+static int fgbBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    fgbVtab *fgb = (fgbVtab *)vtab;
+    double numFeatures = fgb->numFeatures > 0 ? (double)fgb->numFeatures : 1e6;
+    char ops[64];
+    int numOps = 0;
+    int n = 0;
+
+    if (fgb->nodeSize > 0)
+    {
+        for (int i = 0; i < info->nConstraint; i++)
+        {
+            // The rowid gives a single row through the leaves of the packed R-tree
+            if (info->aConstraint[i].usable && info->aConstraint[i].iColumn == -1 && info->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_EQ)
+            {
+                info->aConstraintUsage[i].argvIndex = 1;
+                info->aConstraintUsage[i].omit = 1;
+                info->idxNum = LAYER_ROWID;
+                info->estimatedCost = 10;
+                info->estimatedRows = 1;
+                info->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+                return SQLITE_OK;
+            }
+        }
+        for (int i = 0; i < info->nConstraint && numOps < 30; i++)
+        {
+            int column = info->aConstraint[i].iColumn - fgb->numColumns - 1;
+            char op;
+            if (!info->aConstraint[i].usable || column < LAYER_MINX || column > LAYER_MAXY)
+                continue;
+            // The envelopes of the packed R-tree are doubles, so all the bounds can be checked on it
+            switch (info->aConstraint[i].op)
+            {
+            case SQLITE_INDEX_CONSTRAINT_EQ: op = '='; break;
+            case SQLITE_INDEX_CONSTRAINT_LT: op = '<'; break;
+            case SQLITE_INDEX_CONSTRAINT_LE: op = 'l'; break;
+            case SQLITE_INDEX_CONSTRAINT_GT: op = '>'; break;
+            case SQLITE_INDEX_CONSTRAINT_GE: op = 'g'; break;
+            default: continue;
+            }
+            ops[numOps * 2] = (char)('0' + column);
+            ops[numOps * 2 + 1] = op;
+            numOps++;
+            info->aConstraintUsage[i].argvIndex = ++n;
+        }
+    }
+    if (numOps == 0)
+    {
+        info->idxNum = 0;
+        info->estimatedCost = numFeatures;
+        info->estimatedRows = (sqlite3_int64)numFeatures;
+        return SQLITE_OK;
+    }
+    ops[numOps * 2] = 0;
+    info->idxNum = LAYER_RTREE;
+    info->idxStr = sqlite3_mprintf("%s", ops);
+    info->needToFreeIdxStr = 1;
+    // Each bound constrained halves the features
+    info->estimatedRows = (sqlite3_int64)fmax(1, numFeatures / pow(2, numOps));
+    info->estimatedCost = log2(numFeatures + 1) + info->estimatedRows;
+    return SQLITE_OK;
+}
+
+// Opens a cursor on GPKG_FlatGeobuf
+static int fgbOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    fgbVtab *fgb = (fgbVtab *)vtab;
+    fgbCursor *cur;
+
+    cur = (fgbCursor *)sqlite3_malloc(sizeof(fgbCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(fgbCursor));
+    cur->properties = (sqlite3_int64 *)sqlite3_malloc64(sizeof(sqlite3_int64) * (fgb->numColumns + 1));
+    if (cur->properties == NULL)
+    {
+        sqlite3_free(cur);
+        return SQLITE_NOMEM;
+    }
+    cur->eof = 1;
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+// Closes a cursor on GPKG_FlatGeobuf
+static int fgbClose(sqlite3_vtab_cursor *cursor)
+{
+    fgbCursor *cur = (fgbCursor *)cursor;
+
+    freeGPKGGeometry(&cur->geom);
+    sqlite3_free(cur->properties);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+// Reads the feature at an offset from the first feature: the size of the feature and the feature table
+// Returns the size of the feature with its prefix, or 0 if it's not valid
+static sqlite3_int64 fgbFeature(const fgbVtab *fgb, sqlite3_uint64 offset, flatTable *feature)
+{
+    sqlite3_int64 pos, length;
+
+    if (offset > (sqlite3_uint64)(fgb->file.size - fgb->featuresStart))
+        return 0;
+    pos = fgb->featuresStart + (sqlite3_int64)offset;
+    if (pos + 4 > fgb->file.size)
+        return 0;
+    length = (sqlite3_int64)flatRead(fgb->file.data + pos, 4);
+    if (length < 4 || length > fgb->file.size - pos - 4 ||
+        !flatTableAt(fgb->file.data + pos + 4, length, (sqlite3_int64)flatRead(fgb->file.data + pos + 4, 4), feature))
+        return 0;
+    return 4 + length;
+}
+
+// Checks a node item of the packed R-tree against the constraints on the hidden columns
+// The minx and maxx of the features below an inner node are between its minX and maxX, and the same for Y
+static int fgbItemMatches(const fgbCursor *cur, const unsigned char *item, int leaf)
+{
+    for (int i = 0; i < cur->numOps; i++)
+    {
+        int column = cur->opColumns[i];
+        double value = cur->opValues[i];
+        // Axis of the column: minx and maxx are X, miny and maxy are Y
+        double lo = fgbDouble(item + 8 * (leaf ? column : column & 1));
+        double hi = fgbDouble(item + 8 * (leaf ? column : (column & 1) + 2));
+        int match;
+        switch (cur->ops[i])
+        {
+        case '<': match = lo < value; break;
+        case 'l': match = lo <= value; break;
+        case '>': match = hi > value; break;
+        case 'g': match = hi >= value; break;
+        default: match = lo <= value && hi >= value; break;
+        }
+        if (!match)
+            return 0;
+    }
+    return 1;
+}
+
+// Moves the cursor to the next feature: the next one of the file, or the next leaf of the packed R-tree that matches the constraints
+static int fgbNext(sqlite3_vtab_cursor *cursor)
+{
+    fgbCursor *cur = (fgbCursor *)cursor;
+    fgbVtab *fgb = (fgbVtab *)cursor->pVtab;
+    sqlite3_int64 length;
+
+    cur->propertiesRead = 0;
+    cur->geomRead = 0;
+    if (cur->idxNum == 0)
+    {
+        if (cur->next >= fgb->file.size || (fgb->numFeatures > 0 && cur->rowid + 1 >= fgb->numFeatures))
+        {
+            cur->eof = 1;
+            return SQLITE_OK;
+        }
+        length = fgbFeature(fgb, (sqlite3_uint64)(cur->next - fgb->featuresStart), &cur->feature);
+        if (length == 0)
+        {
+            cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_FlatGeobuf() error: the feature %lld is not valid", cur->rowid + 1);
+            return SQLITE_CORRUPT;
+        }
+        cur->next += length;
+        cur->rowid++;
+        return SQLITE_OK;
+    }
+    if (cur->idxNum == LAYER_ROWID)
+    {
+        cur->eof = 1;
+        return SQLITE_OK;
+    }
+
+    // Depth first search of the packed R-tree, so the features are returned in the order of the file
+    while (cur->depth > 0)
+    {
+        int d = cur->depth - 1;
+        int level = cur->searchLevel[d];
+        sqlite3_int64 pos = cur->searchPos[d]++;
+        const unsigned char *item;
+        sqlite3_uint64 child;
+        if (pos >= cur->searchEnd[d])
+        {
+            cur->depth--;
+            continue;
+        }
+        item = fgb->file.data + fgb->indexStart + pos * FGB_NODE_ITEM_SIZE;
+        if (!fgbItemMatches(cur, item, level == 0))
+            continue;
+        child = flatRead(item + 32, 8);
+        if (level == 0)
+        {
+            cur->item = item;
+            cur->rowid = pos - fgb->levelStart[0];
+            if (fgbFeature(fgb, child, &cur->feature) == 0)
+            {
+                cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_FlatGeobuf() error: the feature %lld is not valid", cur->rowid);
+                return SQLITE_CORRUPT;
+            }
+            return SQLITE_OK;
+        }
+        // The offset of an inner node item is its first child node item
+        if (child < (sqlite3_uint64)fgb->levelStart[level - 1] || child >= (sqlite3_uint64)fgb->levelEnd[level - 1] || cur->depth == FGB_MAX_LEVELS)
+        {
+            cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_FlatGeobuf() error: the index is not valid");
+            return SQLITE_CORRUPT;
+        }
+        cur->searchPos[cur->depth] = (sqlite3_int64)child;
+        cur->searchEnd[cur->depth] = (sqlite3_int64)child + fgb->nodeSize;
+        if (cur->searchEnd[cur->depth] > fgb->levelEnd[level - 1])
+            cur->searchEnd[cur->depth] = fgb->levelEnd[level - 1];
+        cur->searchLevel[cur->depth] = level - 1;
+        cur->depth++;
+    }
+    cur->eof = 1;
+    return SQLITE_OK;
+}
+
+// Starts a scan of the features, the search of the packed R-tree with the constraints on the hidden columns, or the feature of a rowid
+static int fgbFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
+{
+    fgbCursor *cur = (fgbCursor *)cursor;
+    fgbVtab *fgb = (fgbVtab *)cursor->pVtab;
+    int root = fgb->numLevels - 1;
+
+    cur->idxNum = idxNum;
+    cur->item = NULL;
+    cur->numOps = 0;
+    cur->depth = 0;
+    cur->eof = 1;
+    cur->propertiesRead = 0;
+    cur->geomRead = 0;
+    if (idxNum == LAYER_ROWID)
+    {
+        // Leaf node item of the feature
+        if (sqlite3_value_type(argv[0]) != SQLITE_INTEGER)
+            return SQLITE_OK;
+        cur->rowid = sqlite3_value_int64(argv[0]);
+        if (cur->rowid < 0 || cur->rowid >= fgb->numFeatures)
+            return SQLITE_OK;
+        cur->item = fgb->file.data + fgb->indexStart + (fgb->levelStart[0] + cur->rowid) * FGB_NODE_ITEM_SIZE;
+        if (fgbFeature(fgb, flatRead(cur->item + 32, 8), &cur->feature) == 0)
+        {
+            cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_FlatGeobuf() error: the feature %lld is not valid", cur->rowid);
+            return SQLITE_CORRUPT;
+        }
+        cur->eof = 0;
+        return SQLITE_OK;
+    }
+    cur->eof = 0;
+    if (idxNum == 0)
+    {
+        cur->rowid = -1;
+        cur->next = fgb->featuresStart;
+        return fgbNext(cursor);
+    }
+
+    // The constraints whose values are not numbers are left to SQLite
+    for (int i = 0; i < argc && idxStr[i * 2] != 0; i++)
+    {
+        if (sqlite3_value_type(argv[i]) != SQLITE_INTEGER && sqlite3_value_type(argv[i]) != SQLITE_FLOAT)
+            continue;
+        cur->opColumns[cur->numOps] = idxStr[i * 2] - '0';
+        cur->ops[cur->numOps] = idxStr[i * 2 + 1];
+        cur->opValues[cur->numOps] = sqlite3_value_double(argv[i]);
+        cur->numOps++;
+    }
+    cur->searchPos[0] = fgb->levelStart[root];
+    cur->searchEnd[0] = fgb->levelEnd[root];
+    cur->searchLevel[0] = root;
+    cur->depth = 1;
+    return fgbNext(cursor);
+}
+
+// Returns 1 if there are no more rows
+static int fgbEof(sqlite3_vtab_cursor *cursor)
+{
+    return ((fgbCursor *)cursor)->eof;
+}
+
+// Adds the coordinates [start, end) of a FlatGeobuf geometry as a ring of the last part of a geometry parsed in memory
+// xy, z, m -> Positions of the vectors of coordinates. z and m are used if the geometry has them
+static int fgbRing(const unsigned char *buf, sqlite3_int64 xy, sqlite3_int64 z, sqlite3_int64 m, sqlite3_int64 start, sqlite3_int64 end, gpkgGeometry *geom)
+{
+    int numPoints = (int)(end - start);
+    double *coord;
+
+    if (!growGPKGGeometry(geom, 0, 1, numPoints))
+        return 0;
+    geom->rings[geom->numRings].firstPoint = geom->numPoints;
+    geom->rings[geom->numRings].numPoints = numPoints;
+    geom->numRings++;
+    geom->parts[geom->numParts - 1].numRings++;
+    coord = &geom->coords[geom->numPoints * geom->dimension];
+    for (sqlite3_int64 i = start; i < end; i++)
+    {
+        *coord++ = fgbDouble(buf + xy + i * 16);
+        *coord++ = fgbDouble(buf + xy + i * 16 + 8);
+        if (geom->hasZ)
+            *coord++ = fgbDouble(buf + z + i * 8);
+        if (geom->hasM)
+            *coord++ = fgbDouble(buf + m + i * 8);
+    }
+    geom->numPoints += numPoints;
+    return 1;
+}
+
+// Reads a FlatGeobuf geometry into a geometry parsed in memory. The parts of MultiPolygons and GeometryCollections are read recursively
+// The empty parts are not added, as in GPKG_ImportArrow
+// g -> Geometry table
+// geometryType -> Type of the geometry if the table doesn't have it (the type of the header, or Polygon for the parts of a MultiPolygon)
+// Returns SQLITE_OK, SQLITE_NOMEM or SQLITE_CORRUPT if the geometry is not valid or its type is not supported (curves, surfaces)
+static int fgbGeometry(const flatTable *g, int geometryType, int depth, gpkgGeometry *geom)
+{
+    sqlite3_int64 xy, z = 0, m = 0, ends, start, num, numPoints, numEnds = 0, end = 0;
+    int type = (int)flatGetInt(g, 6, 1, 0) & 0xff;
+    flatTable part;
+    int rc;
+
+    if (type == wkbGeometry)
+        type = geometryType;
+    if (type < wkbPoint || type > wkbGeometryCollection || depth > 32)
+        return SQLITE_CORRUPT;
+    if (type == wkbMultiPolygon || type == wkbGeometryCollection)
+    {
+        if (!flatGetVector(g, 7, 4, &start, &num))
+            return SQLITE_OK; // Empty
+        for (sqlite3_int64 i = 0; i < num; i++)
+        {
+            if (!flatVectorTable(g, start, i, &part))
+                return SQLITE_CORRUPT;
+            rc = fgbGeometry(&part, type == wkbMultiPolygon ? wkbPolygon : wkbGeometry, depth + 1, geom);
+            if (rc != SQLITE_OK)
+                return rc;
+        }
+        return SQLITE_OK;
+    }
+
+    // Coordinates: XY interleaved, and Z and M in their own vectors
+    if (!flatGetVector(g, 1, 8, &xy, &numPoints))
+        return SQLITE_OK; // Empty
+    numPoints /= 2;
+    if (numPoints > 0x7fffffff / 4 ||
+        (geom->hasZ && (!flatGetVector(g, 2, 8, &z, &num) || num < numPoints)) ||
+        (geom->hasM && (!flatGetVector(g, 3, 8, &m, &num) || num < numPoints)))
+        return SQLITE_CORRUPT;
+    if (numPoints == 0 || (type == wkbPoint && isnan(fgbDouble(g->buf + xy)) && isnan(fgbDouble(g->buf + xy + 8))))
+        return SQLITE_OK; // Empty
+    // Ends of the rings of a Polygon or of the LineStrings of a MultiLineString. Without them there is only one
+    if ((type == wkbPolygon || type == wkbMultiLineString) && !flatGetVector(g, 0, 4, &ends, &numEnds))
+        numEnds = 0;
+    switch (type)
+    {
+    case wkbPoint:
+        return arrowSourcePart(geom, wkbPoint) && fgbRing(g->buf, xy, z, m, 0, 1, geom) ? SQLITE_OK : SQLITE_NOMEM;
+    case wkbLineString:
+        return arrowSourcePart(geom, wkbLineString) && fgbRing(g->buf, xy, z, m, 0, numPoints, geom) ? SQLITE_OK : SQLITE_NOMEM;
+    case wkbMultiPoint:
+        for (sqlite3_int64 i = 0; i < numPoints; i++)
+        {
+            if (!arrowSourcePart(geom, wkbPoint) || !fgbRing(g->buf, xy, z, m, i, i + 1, geom))
+                return SQLITE_NOMEM;
+        }
+        return SQLITE_OK;
+    }
+    if (type == wkbPolygon && !arrowSourcePart(geom, wkbPolygon))
+        return SQLITE_NOMEM;
+    for (sqlite3_int64 i = 0; i < (numEnds > 0 ? numEnds : 1); i++)
+    {
+        start = end;
+        end = numEnds > 0 ? (sqlite3_int64)flatRead(g->buf + ends + 4 * i, 4) : numPoints;
+        if (end < start || end > numPoints)
+            return SQLITE_CORRUPT;
+        if (type == wkbMultiLineString && start == end)
+            continue;
+        if ((type == wkbMultiLineString && !arrowSourcePart(geom, wkbLineString)) || !fgbRing(g->buf, xy, z, m, start, end, geom))
+            return SQLITE_NOMEM;
+    }
+    return SQLITE_OK;
+}
+
+// Reads the geometry of the current feature
+// Returns 1 if the geometry was read, -1 if it's NULL or not valid, or 0 if there is no memory
+static int fgbReadGeometry(fgbCursor *cur)
+{
+    fgbVtab *fgb = (fgbVtab *)cur->base.pVtab;
+    gpkgGeometry *geom = &cur->geom;
+    flatTable g;
+    int rc;
+
+    if (cur->geomRead != 0)
+        return cur->geomRead;
+    cur->geomRead = -1;
+    if (!flatGetTable(&cur->feature, 0, &g))
+        return -1;
+    // The type of the geometry, or of the header, so the empty geometries keep it
+    geom->geometryType = (int)flatGetInt(&g, 6, 1, 0) & 0xff;
+    if (geom->geometryType == wkbGeometry)
+        geom->geometryType = fgb->geometryType;
+    if (geom->geometryType > wkbGeometryCollection)
+        geom->geometryType = wkbGeometry;
+    geom->srsId = fgb->srsId;
+    geom->hasZ = fgb->hasZ;
+    geom->hasM = fgb->hasM;
+    geom->dimension = 2 + fgb->hasZ + fgb->hasM;
+    geom->numParts = geom->numRings = geom->numPoints = 0;
+    rc = fgbGeometry(&g, fgb->geometryType, 0, geom);
+    if (rc == SQLITE_NOMEM)
+    {
+        cur->geomRead = 0;
+        return 0;
+    }
+    if (rc == SQLITE_OK)
+    {
+        computeGPKGEnvelope(geom);
+        cur->geomRead = 1;
+    }
+    return cur->geomRead;
+}
+
+// Finds the values of the columns in the properties of the current feature: pairs of column index (uint16) and value
+static void fgbReadProperties(fgbCursor *cur)
+{
+    fgbVtab *fgb = (fgbVtab *)cur->base.pVtab;
+    const unsigned char *buf = cur->feature.buf;
+    sqlite3_int64 start, num, pos, end, size;
+
+    if (cur->propertiesRead)
+        return;
+    cur->propertiesRead = 1;
+    for (int i = 0; i < fgb->numColumns; i++)
+        cur->properties[i] = -1;
+    if (!flatGetVector(&cur->feature, 1, 1, &start, &num))
+        return;
+    end = start + num;
+    for (pos = start; pos + 2 <= end; pos += size)
+    {
+        int i = (int)flatRead(buf + pos, 2);
+        if (i >= fgb->numColumns)
+            return; // Not valid: the other values can't be found
+        pos += 2;
+        switch (fgb->columnTypes[i])
+        {
+        case FGB_BYTE: case FGB_UBYTE: case FGB_BOOL: size = 1; break;
+        case FGB_SHORT: case FGB_USHORT: size = 2; break;
+        case FGB_INT: case FGB_UINT: case FGB_FLOAT: size = 4; break;
+        case FGB_LONG: case FGB_ULONG: case FGB_DOUBLE: size = 8; break;
+        default: // Length and bytes
+            if (pos + 4 > end)
+                return;
+            size = 4 + (sqlite3_int64)flatRead(buf + pos, 4);
+            break;
+        }
+        if (size > end - pos)
+            return;
+        cur->properties[i] = pos;
+    }
+}
+
+// Returns the value of a column of the current feature, its geometry in GPKG format or its envelope
+static int fgbColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    fgbCursor *cur = (fgbCursor *)cursor;
+    fgbVtab *fgb = (fgbVtab *)cursor->pVtab;
+    const unsigned char *p;
+    sqlite3_uint64 value;
+    unsigned int bits;
+    unsigned char *blob;
+    float f;
+    int n;
+
+    if (column < fgb->numColumns)
+    {
+        fgbReadProperties(cur);
+        if (cur->properties[column] < 0)
+            return SQLITE_OK;
+        p = cur->feature.buf + cur->properties[column];
+        switch (fgb->columnTypes[column])
+        {
+        case FGB_BYTE: sqlite3_result_int(context, (signed char)p[0]); break;
+        case FGB_UBYTE: sqlite3_result_int(context, p[0]); break;
+        case FGB_BOOL: sqlite3_result_int(context, p[0] != 0); break;
+        case FGB_SHORT: sqlite3_result_int(context, (short)flatRead(p, 2)); break;
+        case FGB_USHORT: sqlite3_result_int(context, (int)flatRead(p, 2)); break;
+        case FGB_INT: sqlite3_result_int(context, (int)flatRead(p, 4)); break;
+        case FGB_UINT: sqlite3_result_int64(context, (sqlite3_int64)flatRead(p, 4)); break;
+        case FGB_LONG: sqlite3_result_int64(context, (sqlite3_int64)flatRead(p, 8)); break;
+        case FGB_ULONG:
+            // The values that don't fit in a signed integer are returned as doubles
+            value = flatRead(p, 8);
+            if (value > (sqlite3_uint64)0x7fffffffffffffff)
+                sqlite3_result_double(context, (double)value);
+            else
+                sqlite3_result_int64(context, (sqlite3_int64)value);
+            break;
+        case FGB_FLOAT:
+            bits = (unsigned int)flatRead(p, 4);
+            memcpy(&f, &bits, 4);
+            sqlite3_result_double(context, f);
+            break;
+        case FGB_DOUBLE: sqlite3_result_double(context, fgbDouble(p)); break;
+        case FGB_BINARY: sqlite3_result_blob(context, p + 4, (int)flatRead(p, 4), SQLITE_TRANSIENT); break;
+        default: sqlite3_result_text(context, (const char *)p + 4, (int)flatRead(p, 4), SQLITE_TRANSIENT); break;
+        }
+    }
+    else if (column == fgb->numColumns)
+    {
+        n = fgbReadGeometry(cur);
+        if (n == 0)
+            return SQLITE_NOMEM;
+        if (n == 1)
+        {
+            if (!writeGPKGGeometry(&cur->geom, 1, &blob, &n))
+                return SQLITE_NOMEM;
+            sqlite3_result_blob(context, blob, n, sqlite3_free);
+        }
+    }
+    else if (cur->item != NULL)
+        sqlite3_result_double(context, fgbDouble(cur->item + 8 * (column - fgb->numColumns - 1))); // Envelope of the packed R-tree
+    else
+    {
+        n = fgbReadGeometry(cur);
+        if (n == 0)
+            return SQLITE_NOMEM;
+        if (n == 1 && cur->geom.numParts > 0)
+            sqlite3_result_double(context, cur->geom.env[column - fgb->numColumns - 1]);
+    }
+    return SQLITE_OK;
+}
+
+// The rowid is the position of the feature in the file
+static int fgbRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = ((fgbCursor *)cursor)->rowid;
+    return SQLITE_OK;
+}
+
+static sqlite3_module fgbModule = {
+    0,             // iVersion
+    fgbConnect,    // xCreate
+    fgbConnect,    // xConnect
+    fgbBestIndex,  // xBestIndex
+    fgbDisconnect, // xDisconnect
+    fgbDisconnect, // xDestroy
+    fgbOpen,       // xOpen
+    fgbClose,      // xClose
+    fgbFilter,     // xFilter
+    fgbNext,       // xNext
+    fgbEof,        // xEof
+    fgbColumn,     // xColumn
+    fgbRowid,      // xRowid
+    0, 0, 0, 0, 0, 0, 0 // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Table-valued function: ST_Subdivide(geometry, maxVertices)
+// Splits a geometry in pieces of at most maxVertices coordinates. The geometry is cut recursively in two halves
+// along the longest side of its envelope, so the pieces have small envelopes and an rtree on them is selective.
+// Each LineString and Polygon of a collection is split on its own (the Points are kept together), so overlapping parts
+// don't multiply the pieces. A piece that can't be cut in two halves with fewer coordinates is returned as it is,
+// so a few pieces can have more than maxVertices coordinates
+// geometry -> Geometry in GPKG format
+// maxVertices -> Maximum number of coordinates of each piece (at least 5)
+// Usage: INSERT INTO countries_subdivided(country_id, geom) SELECT c.fid, s.geom FROM countries c, ST_Subdivide(c.geom, 256) s
+
+// Columns of ST_Subdivide
+#define SUBDIVIDE_GEOM 0
+#define SUBDIVIDE_GEOMETRY 1
+#define SUBDIVIDE_MAXVERTICES 2
+#define SUBDIVIDE_SCHEMA "CREATE TABLE x(geom, geometry HIDDEN, max_vertices HIDDEN)"
+
+// Maximum depth of the recursion of ST_Subdivide. Each part gives at most 2^SUBDIVIDE_MAX_DEPTH pieces
+#define SUBDIVIDE_MAX_DEPTH 16
+
+// Cursor of ST_Subdivide
+typedef struct subdivideCursor
+{
+    sqlite3_vtab_cursor base; // Base class. Must be first
+    unsigned char **pieces;   // Pieces in GPKG format
+    int *sizes;               // Length in bytes of each piece
+    int numPieces, maxPieces;
+    int piece;                // Current piece
+    int envelope;             // Envelope contents indicator of the geometry, kept in the pieces
+    gpkgGeometry scratch;     // Buffers for clipping the Polygons
+} subdivideCursor;
+
+// Opens a cursor on ST_Subdivide
+static int subdivideOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    subdivideCursor *cur;
+
+    cur = (subdivideCursor *)sqlite3_malloc(sizeof(subdivideCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(subdivideCursor));
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+// Releases the pieces of a cursor on ST_Subdivide
+static void subdivideReset(subdivideCursor *cur)
+{
+    for (int i = 0; i < cur->numPieces; i++)
+        sqlite3_free(cur->pieces[i]);
+    cur->numPieces = cur->piece = 0;
+}
+
+// Closes a cursor on ST_Subdivide
+static int subdivideClose(sqlite3_vtab_cursor *cursor)
+{
+    subdivideCursor *cur = (subdivideCursor *)cursor;
+
+    subdivideReset(cur);
+    sqlite3_free(cur->pieces);
+    sqlite3_free(cur->sizes);
+    freeGPKGGeometry(&cur->scratch);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+static int subdivideBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    return tableFunctionBestIndex(info, SUBDIVIDE_GEOMETRY, SUBDIVIDE_MAXVERTICES, 0x06);
+}
+
+// Adds a piece to a cursor on ST_Subdivide
+// Returns 0 if there is no memory or 1 if it's correct
+static int subdivideAddPiece(subdivideCursor *cur, const gpkgGeometry *geom)
+{
+    if (cur->numPieces == cur->maxPieces)
+    {
+        int maxPieces = cur->maxPieces ? cur->maxPieces * 2 : 16;
+        unsigned char **pieces = (unsigned char **)sqlite3_realloc64(cur->pieces, sizeof(unsigned char *) * maxPieces);
+        int *sizes;
+        if (pieces == NULL)
+            return 0;
+        cur->pieces = pieces;
+        sizes = (int *)sqlite3_realloc64(cur->sizes, sizeof(int) * maxPieces);
+        if (sizes == NULL)
+            return 0;
+        cur->sizes = sizes;
+        cur->maxPieces = maxPieces;
+    }
+    if (!writeGPKGGeometry(geom, cur->envelope, &cur->pieces[cur->numPieces], &cur->sizes[cur->numPieces]))
+        return 0;
+    cur->numPieces++;
+    return 1;
+}
+
+// Compares two doubles for qsort
+static int compareSubdivideValues(const void *a, const void *b)
+{
+    double va = *(const double *)a;
+    double vb = *(const double *)b;
+
+    return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+// Cuts a geometry in two halves with an axis-parallel line
+// Returns -1 if there is no memory, 0 if one of the halves has as many coordinates as the geometry or 1 if it's correct
+static int subdivideCut(subdivideCursor *cur, const gpkgGeometry *geom, int axis, double value, gpkgGeometry *lower, gpkgGeometry *upper)
+{
+    if (!clipGPKGGeometry(geom, axis, value, 0, lower, &cur->scratch) || !clipGPKGGeometry(geom, axis, value, 1, upper, &cur->scratch))
+        return -1;
+    return lower->numPoints < geom->numPoints && upper->numPoints < geom->numPoints;
+}
+
+// Splits a geometry until its pieces have at most maxVertices coordinates and adds them to the cursor
+// The geometry is cut in the middle of the longest side of its envelope. If a half doesn't get fewer coordinates
+// (a notch or a spike of a Polygon), it's cut at the median of the coordinates instead, and if that doesn't help either
+// the geometry is a piece as it is
+// Returns 0 if there is no memory or 1 if it's correct
+static int subdivideGeometry(subdivideCursor *cur, const gpkgGeometry *geom, int maxVertices, int depth)
+{
+    gpkgGeometry lower, upper;
+    int axis;
+    int cut;
+    int ok = 1;
+
+    if (geom->numParts == 0)
+        return 1;
+    if (geom->numPoints <= maxVertices || depth >= SUBDIVIDE_MAX_DEPTH || (geom->env[0] == geom->env[2] && geom->env[1] == geom->env[3]))
+        return subdivideAddPiece(cur, geom);
+
+    // Cut along the longest side of the envelope
+    axis = geom->env[2] - geom->env[0] >= geom->env[3] - geom->env[1] ? X : Y;
+    memset(&lower, 0, sizeof(gpkgGeometry));
+    memset(&upper, 0, sizeof(gpkgGeometry));
+    cut = subdivideCut(cur, geom, axis, (geom->env[axis] + geom->env[axis + 2]) / 2, &lower, &upper);
+    if (cut == 0)
+    {
+        double *values = (double *)sqlite3_malloc64(sizeof(double) * geom->numPoints);
+        if (values == NULL)
+            cut = -1;
+        else
+        {
+            double median;
+            for (int i = 0; i < geom->numPoints; i++)
+                values[i] = geom->coords[i * geom->dimension + axis];
+            qsort(values, geom->numPoints, sizeof(double), compareSubdivideValues);
+            median = values[geom->numPoints / 2];
+            if (median == geom->env[axis]) // The line must leave coordinates at both sides
+                median = values[geom->numPoints - 1];
+            sqlite3_free(values);
+            if (median > geom->env[axis] && median < geom->env[axis + 2])
+                cut = subdivideCut(cur, geom, axis, median, &lower, &upper);
+        }
+    }
+    if (cut < 0)
+        ok = 0;
+    else if (cut == 0)
+        ok = subdivideAddPiece(cur, geom);
+    else
+        ok = subdivideGeometry(cur, &lower, maxVertices, depth + 1) && subdivideGeometry(cur, &upper, maxVertices, depth + 1);
+    freeGPKGGeometry(&lower);
+    freeGPKGGeometry(&upper);
+    return ok;
+}
+
+// Splits each LineString and Polygon of a geometry on its own, and the Points together
+// Returns 0 if there is no memory or 1 if it's correct
+static int subdivideParts(subdivideCursor *cur, const gpkgGeometry *geom, int maxVertices)
+{
+    gpkgGeometry part;
+    int ok = 1;
+
+    if (geom->numPoints <= maxVertices || geom->numParts <= 1)
+        return subdivideGeometry(cur, geom, maxVertices, 0);
+    memset(&part, 0, sizeof(gpkgGeometry));
+    part.srsId = geom->srsId;
+    part.hasZ = geom->hasZ;
+    part.hasM = geom->hasM;
+    part.dimension = geom->dimension;
+    for (int i = -1; i < geom->numParts && ok; i++)
+    {
+        // First the Points, then each other part
+        part.geometryType = i < 0 ? wkbMultiPoint : geom->parts[i].geometryType;
+        part.numParts = part.numRings = part.numPoints = 0;
+        for (int j = i < 0 ? 0 : i; j < (i < 0 ? geom->numParts : i + 1) && ok; j++)
+        {
+            const gpkgPart *src = &geom->parts[j];
+            int numPoints = 0;
+            if ((i < 0) != (src->geometryType == wkbPoint))
+                continue;
+            for (int r = src->firstRing; r < src->firstRing + src->numRings; r++)
+                numPoints += geom->rings[r].numPoints;
+            ok = growGPKGGeometry(&part, 1, src->numRings, numPoints);
+            if (!ok)
+                break;
+            part.parts[part.numParts].geometryType = src->geometryType;
+            part.parts[part.numParts].firstRing = part.numRings;
+            part.parts[part.numParts++].numRings = src->numRings;
+            for (int r = src->firstRing; r < src->firstRing + src->numRings; r++)
+            {
+                const gpkgRing *ring = &geom->rings[r];
+                memcpy(&part.coords[part.numPoints * part.dimension], &geom->coords[ring->firstPoint * geom->dimension], sizeof(double) * ring->numPoints * geom->dimension);
+                part.rings[part.numRings].firstPoint = part.numPoints;
+                part.rings[part.numRings++].numPoints = ring->numPoints;
+                part.numPoints += ring->numPoints;
+            }
+        }
+        if (ok && part.numParts > 0)
+        {
+            computeGPKGEnvelope(&part);
+            ok = subdivideGeometry(cur, &part, maxVertices, 0);
+        }
+    }
+    freeGPKGGeometry(&part);
+    return ok;
+}
+
+// Splits the geometry in pieces
+static int subdivideFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
+{
+    subdivideCursor *cur = (subdivideCursor *)cursor;
+    gpkgGeometry geom;
+    int maxVertices;
+    int ok;
+
+    subdivideReset(cur);
+    if ((idxNum & 0x06) != 0x06)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("ST_Subdivide() error: geometry and maxVertices are mandatory");
+        return SQLITE_ERROR;
+    }
+    if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER || sqlite3_value_int(argv[1]) < 5)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("ST_Subdivide() error: argument 2 [maxVertices] must be an integer greater than 4");
+        return SQLITE_ERROR;
+    }
+    maxVertices = sqlite3_value_int(argv[1]);
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB)
+        return SQLITE_OK; // A NULL geometry has no pieces
+
+    memset(&geom, 0, sizeof(gpkgGeometry));
+    if (!readGPKGGeometry((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), &geom))
+    {
+        freeGPKGGeometry(&geom);
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("ST_Subdivide() error: argument 1 [geometry] is not a valid GPKG geometry");
+        return SQLITE_ERROR;
+    }
+    cur->envelope = readGPKGEnvelopeType((unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]));
+    ok = subdivideParts(cur, &geom, maxVertices);
+    freeGPKGGeometry(&geom);
+    return ok ? SQLITE_OK : SQLITE_NOMEM;
+}
+
+// Moves the cursor to the next piece
+static int subdivideNext(sqlite3_vtab_cursor *cursor)
+{
+    ((subdivideCursor *)cursor)->piece++;
+    return SQLITE_OK;
+}
+
+// Returns 1 if there are no more pieces
+static int subdivideEof(sqlite3_vtab_cursor *cursor)
+{
+    subdivideCursor *cur = (subdivideCursor *)cursor;
+
+    return cur->piece >= cur->numPieces;
+}
+
+// Returns the piece. The hidden columns are the parameters
+static int subdivideColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    subdivideCursor *cur = (subdivideCursor *)cursor;
+
+    if (column == SUBDIVIDE_GEOM)
+        sqlite3_result_blob(context, cur->pieces[cur->piece], cur->sizes[cur->piece], SQLITE_TRANSIENT);
+    return SQLITE_OK;
+}
+
+// The rowid is the number of the piece
+static int subdivideRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = ((subdivideCursor *)cursor)->piece + 1;
+    return SQLITE_OK;
+}
+
+static sqlite3_module subdivideModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    tableFunctionConnect,    // xConnect
+    subdivideBestIndex,      // xBestIndex
+    tableFunctionDisconnect, // xDisconnect
+    0,                       // xDestroy
+    subdivideOpen,           // xOpen
+    subdivideClose,          // xClose
+    subdivideFilter,         // xFilter
+    subdivideNext,           // xNext
+    subdivideEof,            // xEof
+    subdivideColumn,         // xColumn
+    subdivideRowid,          // xRowid
+    0, 0, 0, 0, 0, 0, 0       // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// The write-only tables of the trigger hooks have no rows, a full scan is the only plan
+static int hookTableBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    info->estimatedCost = 1;
+    info->estimatedRows = 0;
+    return SQLITE_OK;
+}
+
+static int hookTableOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    sqlite3_vtab_cursor *cur;
+
+    cur = (sqlite3_vtab_cursor *)sqlite3_malloc(sizeof(sqlite3_vtab_cursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(sqlite3_vtab_cursor));
+    *ppCursor = cur;
+    return SQLITE_OK;
+}
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
-    {
-        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
-        n_bytes = sqlite3_value_bytes(argv[0]);
-        if (n_bytes >= 29) // Not enough bytes (A point without SRID and with 2 dimensions occupies 21 bytes + 8 minimum GPKG header)
-        {
-            if (readGPKGGeometryEnv(p_blob, n_bytes, &index, endian(), M, MAX, wkbGeometry, &res))
-            {
-                sqlite3_result_double(context, res);
-                return;
-            }
-        }
-    }
-    sqlite3_result_null(context);
+static int hookTableClose(sqlite3_vtab_cursor *cursor)
+{
+    sqlite3_free(cursor);
+    return SQLITE_OK;
 }
 
-// SQL function: SQL function: ST_IsEmpty(GEOMETRY); 
-// Returns 1 if the geometry is empty, 0 if it is not empty, -1 if there is an error (therefore ISEMPTY (GEOM) is evaluated to TRUE)
-static void fnct_STIsEmpty(sqlite3_context *context, int argc, sqlite3_value **argv)
+static int hookTableFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
 {
-    unsigned char *p_blob;
-    int n_bytes;
-    int index = 0;
-    int res = -1;
+    return SQLITE_OK;
+}
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) // Must be a BLOB
-    {
-        p_blob = (unsigned char *)sqlite3_value_blob(argv[0]);
-        n_bytes = sqlite3_value_bytes(argv[0]);
-        if (n_bytes >= 13) // Not enough bytes (at least 1 for Endianess and 4 for TypeInt + 8 minimum GPKG header)
-            res = isEmptyGPKGGeometry(p_blob, n_bytes, &index, endian(), wkbGeometry);
-    }
-    sqlite3_result_int(context, res);
+static int hookTableNext(sqlite3_vtab_cursor *cursor)
+{
+    return SQLITE_OK;
 }
 
-// SQL function: GPKG_AddGeometryColumn(identifier, tableName, geometryColumn, geometryType, srsId, zFlag, mFlag); 
-// identifier -> Identifier of the geometry (gpkg_contents)
-// tableName -> Name of the table
-// geometryColumn -> Column that contains the geometry
-// geometryType -> WKT geometry name : "GEOMETRY", "POINT", "LINESTRING", "POLYGON", "MULTIPOINT", "MULTILINESTRING", "MULTIPOLYGON", "GEOMCOLLECTION"
-// srsId -> SRS ID of the geometries
-// zFlag -> 0: z values prohibited; 1: z values mandatory; 2: z values optional
-// mflag -> 0: m values prohibited; 1: m values mandatory; 2: m values optional
-// Populates the gpkg_contents table (if not already present)
-// Populates the gpkg_geometry_columns table
-// On success returns nothing. If there is an error throw an exception
-static void fnct_GPKGAddGeometryColumn(sqlite3_context *context, int argc, sqlite3_value **argv)
+static int hookTableEof(sqlite3_vtab_cursor *cursor)
 {
-    const char *identifier;
-    const char *table;
-    const char *gcolumn;
-    const char *gtype;
-    int igtype;
-    int srsid;
-    int zflag;
-    int mflag;
+    return 1;
+}
+
+static int hookTableColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    return SQLITE_OK;
+}
+
+static int hookTableRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = 0;
+    return SQLITE_OK;
+}
+
+// Write-only table: GPKG_PointOverviewUpdate(table_name, column_name, old_geom, new_geom)
+// Trigger hook of the point overviews (GPKG_CreatePointOverview): each row inserted removes old_geom from the cells of every zoom
+// of the point overview of the table and adds new_geom to them. The table has no rows
+// table_name -> Name of the table
+// column_name -> Column that contains the geometry
+// old_geom -> Point removed (NULL on insert)
+// new_geom -> Point added (NULL on delete)
+// Each Point is parsed once and its Hilbert key of the deepest grid gives the cells of all the zooms. If the Point stays in
+// the same cell only its centroid is moved. The statements that update the cells are cached by the connection, not by statement
+// like the auxiliary data of a function, that is released after each row of a trigger
+// Usage: INSERT INTO GPKG_PointOverviewUpdate VALUES('addresses', 'geom', OLD.geom, NEW.geom)
+
+// Columns of GPKG_PointOverviewUpdate
+#define POINTOVERVIEW_TABLE 0
+#define POINTOVERVIEW_COLUMN 1
+#define POINTOVERVIEW_OLD 2
+#define POINTOVERVIEW_NEW 3
+#define POINTOVERVIEW_SCHEMA "CREATE TABLE x(table_name, column_name, old_geom, new_geom)"
+
+// Statements of each zoom of a point overview
+#define POINTOVERVIEW_ADD_CELL 0
+#define POINTOVERVIEW_ADD_POINT 1
+#define POINTOVERVIEW_REMOVE_POINT 2
+#define POINTOVERVIEW_REMOVE_CELL 3
+#define POINTOVERVIEW_MOVE_POINT 4
+#define POINTOVERVIEW_STATEMENTS 5
+
+// Point overview of a table: for each zoom z from 0 to maxZoom the table pointov_tableName_geometryColumn_z has the number of Points
+// and their centroid by cell of a grid of 2^z x 2^z cells over the extent. The cell is the Hilbert key at order z, that's the Hilbert key
+// of GPKG_HilbertKey shifted 2 * (16 - z) bits to the right
+typedef struct pointOverview
+{
+    char *table;   // Name of the table
+    char *gcolumn; // Column that contains the geometry
+    int maxZoom;   // Deepest zoom
+    double ext[4]; // Extent of the grid (minX, minY, maxX, maxY)
+    sqlite3_stmt *stmts[(HILBERT_ORDER + 1) * POINTOVERVIEW_STATEMENTS]; // Statements of each zoom
+    struct pointOverview *next; // Next cached point overview
+} pointOverview;
+
+typedef struct pointOverviewVtab
+{
+    sqlite3_vtab base;
     sqlite3 *db;
+    sqlite3_stmt *metadataStmt; // Reads the deepest zoom and the extent from gpkgext_point_overview
+    pointOverview *overviews;   // Cached point overviews
+} pointOverviewVtab;
+
+// Releases a cached point overview
+static void freePointOverview(pointOverview *overview)
+{
+    for (int i = 0; i < (HILBERT_ORDER + 1) * POINTOVERVIEW_STATEMENTS; i++)
+        sqlite3_finalize(overview->stmts[i]);
+    sqlite3_free(overview->table);
+    sqlite3_free(overview->gcolumn);
+    sqlite3_free(overview);
+}
+
+// Gets the point overview of a table from the cache, prepares its statements if it isn't cached or has been created again
+// vtab -> GPKG_PointOverviewUpdate
+// table -> Name of the table
+// gcolumn -> Column that contains the geometry
+// Returns the point overview or NULL if there is an error (the error message is set in the vtab)
+static pointOverview *getPointOverview(pointOverviewVtab *vtab, const char *table, const char *gcolumn)
+{
+    static const char *stmtSQL[POINTOVERVIEW_STATEMENTS] = {
+        "INSERT OR IGNORE INTO \"pointov_%w_%w_%d\" VALUES(?1, 0, ?2, ?3)",
+        "UPDATE \"pointov_%w_%w_%d\" SET x = x + (?2 - x) / (count + 1), y = y + (?3 - y) / (count + 1), count = count + 1 WHERE cell = ?1",
+        "UPDATE \"pointov_%w_%w_%d\" SET x = CASE WHEN count > 1 THEN x + (x - ?2) / (count - 1) ELSE x END, y = CASE WHEN count > 1 THEN y + (y - ?3) / (count - 1) ELSE y END, count = count - 1 WHERE cell = ?1",
+        "DELETE FROM \"pointov_%w_%w_%d\" WHERE cell = ?1 AND count <= 0",
+        "UPDATE \"pointov_%w_%w_%d\" SET x = x + (?2 - ?4) / count, y = y + (?3 - ?5) / count WHERE cell = ?1"
+    };
+    pointOverview *overview, **prev;
+    int maxZoom;
+    double ext[4];
     char *sql;
+    int rc;
 
-    // Get the parameters
-    identifier = (const char *)sqlite3_value_text(argv[0]);
-    table = (const char *)sqlite3_value_text(argv[1]);
-    gcolumn = (const char *)sqlite3_value_text(argv[2]);
-    gtype = (const char *)sqlite3_value_text(argv[3]);
-    srsid = sqlite3_value_int(argv[4]);
-    zflag = sqlite3_value_int(argv[5]);
-    mflag = sqlite3_value_int(argv[6]);
+    // Get the deepest zoom and the extent of the point overview
+    rc = SQLITE_OK;
+    if (vtab->metadataStmt == NULL)
+        rc = sqlite3_prepare_v2(vtab->db, "SELECT max_zoom, min_x, min_y, max_x, max_y FROM gpkgext_point_overview WHERE LOWER(table_name) = LOWER(?) AND LOWER(column_name) = LOWER(?)", -1, &vtab->metadataStmt, NULL);
+    if (rc == SQLITE_OK)
+    {
+        sqlite3_bind_text(vtab->metadataStmt, 1, table, -1, SQLITE_STATIC);
+        sqlite3_bind_text(vtab->metadataStmt, 2, gcolumn, -1, SQLITE_STATIC);
+        rc = sqlite3_step(vtab->metadataStmt);
+    }
+    if (rc != SQLITE_ROW || sqlite3_column_int(vtab->metadataStmt, 0) < 0 || sqlite3_column_int(vtab->metadataStmt, 0) > HILBERT_ORDER)
+    {
+        if (vtab->metadataStmt != NULL)
+            sqlite3_reset(vtab->metadataStmt);
+        sqlite3_free(vtab->base.zErrMsg);
+        vtab->base.zErrMsg = sqlite3_mprintf("GPKG_PointOverviewUpdate error: the table %s has no point overview in the column %s", table, gcolumn);
+        return NULL;
+    }
+    maxZoom = sqlite3_column_int(vtab->metadataStmt, 0);
+    for (int i = 0; i < 4; i++)
+        ext[i] = sqlite3_column_double(vtab->metadataStmt, 1 + i);
+    sqlite3_reset(vtab->metadataStmt);
 
-    // Check parmeters
-    for (igtype = 0; wktGeomtryTypes[igtype] != NULL; igtype++)
+    // Look for it in the cache
+    for (prev = &vtab->overviews; *prev != NULL; prev = &(*prev)->next)
     {
-        if (_stricmp(gtype, wktGeomtryTypes[igtype]) == 0)
+        overview = *prev;
+        if (strcmp(overview->table, table) == 0 && strcmp(overview->gcolumn, gcolumn) == 0)
+        {
+            if (overview->maxZoom == maxZoom && memcmp(overview->ext, ext, sizeof(ext)) == 0)
+                return overview;
+            *prev = overview->next;
+            freePointOverview(overview);
             break;
+        }
     }
-    if (wktGeomtryTypes[igtype] == NULL)
+
+    // Prepare the statements
+    overview = (pointOverview *)sqlite3_malloc(sizeof(pointOverview));
+    if (overview == NULL)
+        return NULL;
+    memset(overview, 0, sizeof(pointOverview));
+    overview->maxZoom = maxZoom;
+    memcpy(overview->ext, ext, sizeof(ext));
+    overview->table = sqlite3_mprintf("%s", table);
+    overview->gcolumn = sqlite3_mprintf("%s", gcolumn);
+    rc = overview->table == NULL || overview->gcolumn == NULL ? SQLITE_NOMEM : SQLITE_OK;
+    for (int z = 0; z <= maxZoom && rc == SQLITE_OK; z++)
     {
-        sqlite3_result_error(context, "GPKG_AddGeometryColumn() error: argument 3 [geometryType] unrecognised geometry type", -1);
-        return;
+        for (int i = 0; i < POINTOVERVIEW_STATEMENTS && rc == SQLITE_OK; i++)
+        {
+            sql = sqlite3_mprintf(stmtSQL[i], table, gcolumn, z);
+            rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(vtab->db, sql, -1, &overview->stmts[z * POINTOVERVIEW_STATEMENTS + i], NULL);
+            sqlite3_free(sql);
+        }
     }
-    // HACK! Convert "GEOMETRYCOLLECTION" to "GEOMCOLLECTION"
-    if (igtype == 8)
-        igtype = 7;
-    if (zflag != 0 && zflag != 1 && zflag != 2)
+    if (rc != SQLITE_OK)
     {
-        sqlite3_result_error(context, "GPKG_AddGeometryColumn() error: argument 5 [zFlag] must be 0, 1 or 2", -1);
-        return;
+        sqlite3_free(vtab->base.zErrMsg);
+        vtab->base.zErrMsg = sqlite3_mprintf("GPKG_PointOverviewUpdate error: %s", sqlite3_errmsg(vtab->db));
+        freePointOverview(overview);
+        return NULL;
     }
-    if (mflag != 0 && mflag != 1 && mflag != 2)
+    overview->next = vtab->overviews;
+    vtab->overviews = overview;
+    return overview;
+}
+
+// Executes a statement of a point overview on a cell
+// stmt -> Statement to execute
+// cell -> Cell of the zoom of the statement
+// x, y -> Point added or removed, or new position of the moved Point
+// oldX, oldY -> Old position of the moved Point
+// Returns SQLITE_OK if it's correct or an SQLite error code
+static int updatePointOverviewCell(sqlite3_stmt *stmt, sqlite3_int64 cell, double x, double y, double oldX, double oldY)
+{
+    int rc;
+
+    sqlite3_bind_int64(stmt, 1, cell);
+    sqlite3_bind_double(stmt, 2, x);
+    sqlite3_bind_double(stmt, 3, y);
+    if (sqlite3_bind_parameter_count(stmt) == 5)
     {
-        sqlite3_result_error(context, "GPKG_AddGeometryColumn() error: argument 6 [mFlag] must be 0, 1 or 2", -1);
-        return;
+        sqlite3_bind_double(stmt, 4, oldX);
+        sqlite3_bind_double(stmt, 5, oldY);
     }
+    rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
 
-    // Get DB handle
-    db = sqlite3_context_db_handle(context);
+static int pointOverviewConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr)
+{
+    pointOverviewVtab *vtab;
+    int rc;
+
+    rc = sqlite3_declare_vtab(db, POINTOVERVIEW_SCHEMA);
+    if (rc != SQLITE_OK)
+        return rc;
+    vtab = (pointOverviewVtab *)sqlite3_malloc(sizeof(pointOverviewVtab));
+    if (vtab == NULL)
+        return SQLITE_NOMEM;
+    memset(vtab, 0, sizeof(pointOverviewVtab));
+    vtab->db = db;
+    *ppVtab = &vtab->base;
+    return SQLITE_OK;
+}
 
-    // Populate gpkg_contents
-    sql = sqlite3_mprintf("INSERT OR IGNORE INTO gpkg_contents(table_name, data_type, identifier, srs_id) VALUES(%Q, 'features', %Q, %i)",
-        table, identifier, srsid);
-    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
-        return;
+static int pointOverviewDisconnect(sqlite3_vtab *pVtab)
+{
+    pointOverviewVtab *vtab = (pointOverviewVtab *)pVtab;
+    pointOverview *overview;
 
-    // Populate gpkg_geometry_column
-    sql = sqlite3_mprintf("INSERT INTO gpkg_geometry_columns(table_name, column_name, geometry_type_name, srs_id, z, m) VALUES(%Q, %Q, '%s', %i, %i, %i)",
-        table, gcolumn, wktGeomtryTypes[igtype], srsid, zflag, mflag);
-    sqlite3_exec_free(context, db, sql, NULL);
+    while (vtab->overviews != NULL)
+    {
+        overview = vtab->overviews;
+        vtab->overviews = overview->next;
+        freePointOverview(overview);
+    }
+    sqlite3_finalize(vtab->metadataStmt);
+    sqlite3_free(vtab);
+    return SQLITE_OK;
 }
 
-// SQL function: GPKG_AddSpatialIndex(tableName, geometryColumn, idColumn); 
-// Creates a spatial index of a table and the corresponding triggers to maintain the integrity between the spatial index and the table
-// tableName -> Name of the table
-// geometryColumn -> Column that contains the geometry
-// idColumn -> Column that is the PrimaryKey of the table
-// The spatial index created is called rtree_tableName_geometryColumn
-// The triggers are called rtree_tableName_geometryColumn_insert, rtree_tableName_geometryColumn_update1, rtree_tableName_geometryColumn_update2, 
-//                         rtree_tableName_geometryColumn_update3, rtree_tableName_geometryColumn_update4, rtree_tableName_geometryColumn_delete
-// Registers the gpkg extension gpkg_rtree_index
-// Populates the spatial index
-// On success returns nothing. If there is an error throw an exception
-static void fnct_GPKGAddSpatialIndex(sqlite3_context *context, int argc, sqlite3_value **argv)
+// Inserting a row updates the cells of the old and new Points. Updates and deletes are not allowed
+static int pointOverviewUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite_int64 *rowid)
 {
-    const char *table;
-    const char *gcolumn;
-    const char *icolumn;
-    sqlite3 *db;
-    char *sql, *errsql;
-
-    // Get the parameters
-    table = (const char *)sqlite3_value_text(argv[0]);
-    gcolumn = (const char *)sqlite3_value_text(argv[1]);
-    icolumn = (const char *)sqlite3_value_text(argv[2]);
+    pointOverviewVtab *vtab = (pointOverviewVtab *)pVtab;
+    pointOverview *overview;
+    sqlite3_value **values = argv + 2;
+    double x[2], y[2];
+    int has[2];
+    sqlite3_int64 key[2];
+    sqlite3_int64 cell[2];
+    sqlite3_stmt **stmts;
+    int rc = SQLITE_OK;
 
-    // Get DB handle
-    db = sqlite3_context_db_handle(context);
+    if (argc == 1 || sqlite3_value_type(argv[0]) != SQLITE_NULL)
+        return SQLITE_READONLY;
+
+    // Read the Points
+    for (int i = 0; i < 2; i++)
+        has[i] = sqlite3_value_type(values[POINTOVERVIEW_OLD + i]) == SQLITE_BLOB &&
+            readGPKGPointXY((unsigned char *)sqlite3_value_blob(values[POINTOVERVIEW_OLD + i]), sqlite3_value_bytes(values[POINTOVERVIEW_OLD + i]), &x[i], &y[i]);
+    *rowid = 0;
+    if (!has[0] && !has[1])
+        return SQLITE_OK;
+    if (has[0] && has[1] && x[0] == x[1] && y[0] == y[1])
+        return SQLITE_OK;
+
+    overview = getPointOverview(vtab, (const char *)sqlite3_value_text(values[POINTOVERVIEW_TABLE]), (const char *)sqlite3_value_text(values[POINTOVERVIEW_COLUMN]));
+    if (overview == NULL)
+        return vtab->base.zErrMsg != NULL ? SQLITE_ERROR : SQLITE_NOMEM;
+
+    for (int i = 0; i < 2; i++)
+        if (has[i])
+            key[i] = hilbertKey(hilbertCell(x[i], overview->ext[0], overview->ext[2]), hilbertCell(y[i], overview->ext[1], overview->ext[3]), HILBERT_ORDER);
+
+    // Update the cells of every zoom
+    for (int z = 0; z <= overview->maxZoom && rc == SQLITE_OK; z++)
+    {
+        stmts = overview->stmts + z * POINTOVERVIEW_STATEMENTS;
+        for (int i = 0; i < 2; i++)
+            cell[i] = has[i] ? key[i] >> (2 * (HILBERT_ORDER - z)) : -1;
+        if (has[0] && has[1] && cell[0] == cell[1])
+        {
+            rc = updatePointOverviewCell(stmts[POINTOVERVIEW_MOVE_POINT], cell[1], x[1], y[1], x[0], y[0]);
+            continue;
+        }
+        if (has[0])
+        {
+            rc = updatePointOverviewCell(stmts[POINTOVERVIEW_REMOVE_POINT], cell[0], x[0], y[0], 0, 0);
+            if (rc == SQLITE_OK)
+                rc = updatePointOverviewCell(stmts[POINTOVERVIEW_REMOVE_CELL], cell[0], x[0], y[0], 0, 0);
+        }
+        if (has[1] && rc == SQLITE_OK)
+        {
+            rc = updatePointOverviewCell(stmts[POINTOVERVIEW_ADD_CELL], cell[1], x[1], y[1], 0, 0);
+            if (rc == SQLITE_OK)
+                rc = updatePointOverviewCell(stmts[POINTOVERVIEW_ADD_POINT], cell[1], x[1], y[1], 0, 0);
+        }
+    }
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_free(vtab->base.zErrMsg);
+        vtab->base.zErrMsg = sqlite3_mprintf("GPKG_PointOverviewUpdate error: %s", sqlite3_errmsg(vtab->db));
+    }
+    return rc;
+}
 
-    // Create rtree
-    sql = sqlite3_mprintf("CREATE VIRTUAL TABLE \"rtree_%w_%w\" USING rtree(id, minx, maxx, miny, maxy)",
-        table, gcolumn);
-    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
-        return;
+static sqlite3_module pointOverviewModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    pointOverviewConnect,    // xConnect
+    hookTableBestIndex,      // xBestIndex
+    pointOverviewDisconnect, // xDisconnect
+    0,                       // xDestroy
+    hookTableOpen,           // xOpen
+    hookTableClose,          // xClose
+    hookTableFilter,         // xFilter
+    hookTableNext,           // xNext
+    hookTableEof,            // xEof
+    hookTableColumn,         // xColumn
+    hookTableRowid,          // xRowid
+    pointOverviewUpdate,     // xUpdate
+    0, 0, 0, 0, 0, 0         // xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Converts a longitude and latitude to Web Mercator (EPSG:3857). Latitudes are clipped to the range of Web Mercator
+// lon, lat -> Coordinate in decimal degrees
+// x, y <- Coordinate in meters
+static void lonLatToWebMercator(double lon, double lat, double *x, double *y)
+{
+    lat = fmax(-WEB_MERCATOR_MAX_LATITUDE, fmin(WEB_MERCATOR_MAX_LATITUDE, lat));
+    *x = lon * WEB_MERCATOR_HALF_SIZE / 180;
+    *y = log(tan((90 + lat) * M_PI / 360)) * WEB_MERCATOR_HALF_SIZE / M_PI;
+}
 
-    // Conditions: Insertion of non-empty geometry
-    //    Actions: Insert record into rtree
-    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_insert\" AFTER INSERT ON \"%w\" WHEN (NEW.\"%w\" NOT NULL AND NOT ST_IsEmpty(NEW.\"%w\"))\nBEGIN\n   INSERT OR REPLACE INTO \"rtree_%w_%w\" VALUES (NEW.\"%w\", ST_MinX(NEW.\"%w\"), ST_MaxX(NEW.\"%w\"), ST_MinY(NEW.\"%w\"), ST_MaxY(NEW.\"%w\"));\nEND;",
-        table, gcolumn, table, gcolumn, gcolumn, table, gcolumn, icolumn, gcolumn, gcolumn, gcolumn, gcolumn);
-    errsql = sqlite3_mprintf("DROP TABLE \"rtree_%w_%w\"",
-        table, gcolumn);
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+// Write-only table: GPKG_DirtyRegionUpdate(table_name, column_name, srs, old_geom, new_geom)
+// Trigger hook of the dirty-region tracking (GPKG_EnableDirtyTracking): each row inserted logs the envelopes of old_geom and new_geom
+// in Web Mercator into gpkgext_dirty_region. If both envelopes are equal it's logged once. The table has no rows
+// table_name -> Name of the table
+// column_name -> Column that contains the geometry
+// srs -> 4326 if the coordinates are longitude and latitude or 3857 if they are Web Mercator
+// old_geom -> Geometry before the change (NULL on insert)
+// new_geom -> Geometry after the change (NULL on delete)
+// Each geometry is parsed once. The insert statement is cached by the connection
+// Usage: INSERT INTO GPKG_DirtyRegionUpdate VALUES('roads', 'geom', 4326, OLD.geom, NEW.geom)
+
+// Columns of GPKG_DirtyRegionUpdate
+#define DIRTYREGION_TABLE 0
+#define DIRTYREGION_COLUMN 1
+#define DIRTYREGION_SRS 2
+#define DIRTYREGION_OLD 3
+#define DIRTYREGION_NEW 4
+#define DIRTYREGION_SCHEMA "CREATE TABLE x(table_name, column_name, srs, old_geom, new_geom)"
+
+typedef struct dirtyRegionVtab
+{
+    sqlite3_vtab base;
+    sqlite3 *db;
+    sqlite3_stmt *insertStmt; // Inserts an envelope into gpkgext_dirty_region
+} dirtyRegionVtab;
 
-    // Conditions: Update of geometry column to non-empty geometry
-    //             No row ID change
-    //    Actions: Update record in rtree
-    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_update1\" AFTER UPDATE OF \"%w\" ON \"%w\" WHEN OLD.\"%w\" = NEW.\"%w\" AND (NEW.\"%w\" NOT NULL AND NOT ST_IsEmpty(NEW.\"%w\"))\nBEGIN\n   INSERT OR REPLACE INTO \"rtree_%w_%w\" VALUES (NEW.\"%w\", ST_MinX(NEW.\"%w\"), ST_MaxX(NEW.\"%w\"), ST_MinY(NEW.\"%w\"), ST_MaxY(NEW.\"%w\"));\nEND;",
-        table, gcolumn, gcolumn, table, icolumn, icolumn, gcolumn, gcolumn, table, gcolumn, icolumn, gcolumn, gcolumn, gcolumn, gcolumn);
-    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
-        table, gcolumn, table, gcolumn);
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+static int dirtyRegionConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr)
+{
+    dirtyRegionVtab *vtab;
+    int rc;
+
+    rc = sqlite3_declare_vtab(db, DIRTYREGION_SCHEMA);
+    if (rc != SQLITE_OK)
+        return rc;
+    vtab = (dirtyRegionVtab *)sqlite3_malloc(sizeof(dirtyRegionVtab));
+    if (vtab == NULL)
+        return SQLITE_NOMEM;
+    memset(vtab, 0, sizeof(dirtyRegionVtab));
+    vtab->db = db;
+    *ppVtab = &vtab->base;
+    return SQLITE_OK;
+}
 
-    // Conditions: Update of geometry column to empty geometry
-    //             No row ID change
-    //    Actions: Remove record from rtree
-    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_update2\" AFTER UPDATE OF \"%w\" ON \"%w\" WHEN OLD.\"%w\" = NEW.\"%w\" AND (NEW.\"%w\" IS NULL OR ST_IsEmpty(NEW.\"%w\"))\nBEGIN\n   DELETE FROM \"rtree_%w_%w\" WHERE id = OLD.\"%w\";\nEND;",
-        table, gcolumn, gcolumn, table, icolumn, icolumn, gcolumn, gcolumn, table, gcolumn, icolumn);
-    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
-        table, gcolumn, table, gcolumn, table, gcolumn);
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+static int dirtyRegionDisconnect(sqlite3_vtab *pVtab)
+{
+    dirtyRegionVtab *vtab = (dirtyRegionVtab *)pVtab;
 
-    // Conditions: Update of any column
-    //             Row ID change
-    //             Non-empty geometry
-    //    Actions: Remove record from rtree for old <i>
-    //             Insert record into rtree for new <i>
-    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_update3\" AFTER UPDATE ON \"%w\" WHEN OLD.\"%w\" != NEW.\"%w\" AND (NEW.\"%w\" NOT NULL AND NOT ST_IsEmpty(NEW.\"%w\"))\nBEGIN\n   DELETE FROM \"rtree_%w_%w\" WHERE id = OLD.\"%w\";\n   INSERT OR REPLACE INTO \"rtree_%w_%w\" VALUES (NEW.\"%w\", ST_MinX(NEW.\"%w\"), ST_MaxX(NEW.\"%w\"), ST_MinY(NEW.\"%w\"), ST_MaxY(NEW.\"%w\"));\nEND;",
-        table, gcolumn, table, icolumn, icolumn, gcolumn, gcolumn, table, gcolumn, icolumn, table, gcolumn, icolumn, gcolumn, gcolumn, gcolumn, gcolumn);
-    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
-        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+    sqlite3_finalize(vtab->insertStmt);
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
 
-    // Conditions: Update of any column
-    //             Row ID change
-    //             Empty geometry
-    //    Actions: Remove record from rtree for old and new <i>
-    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_update4\" AFTER UPDATE ON \"%w\" WHEN OLD.\"%w\" != NEW.\"%w\" AND (NEW.\"%w\" IS NULL OR ST_IsEmpty(NEW.\"%w\"))\nBEGIN\n   DELETE FROM \"rtree_%w_%w\" WHERE id IN (OLD.\"%w\", NEW.\"%w\");\nEND;\n",
-        table, gcolumn, table, icolumn, icolumn, gcolumn, gcolumn, table, gcolumn, icolumn, icolumn);
-    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_update3\"; DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
-        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+// Inserting a row logs the envelopes of the old and new geometries. Updates and deletes are not allowed
+static int dirtyRegionUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite_int64 *rowid)
+{
+    dirtyRegionVtab *vtab = (dirtyRegionVtab *)pVtab;
+    sqlite3_value **values = argv + 2;
+    double env[2][4];
+    int has[2];
+    int rc = SQLITE_OK;
 
-    // Conditions: Row deleted
-    //    Actions: Remove record from rtree for old <i>
-    sql = sqlite3_mprintf("CREATE TRIGGER \"rtree_%w_%w_delete\" AFTER DELETE ON \"%w\" WHEN old.\"%w\" NOT NULL\nBEGIN\n   DELETE FROM \"rtree_%w_%w\" WHERE id = OLD.\"%w\";\nEND;",
-        table, gcolumn, table, gcolumn, table, gcolumn, icolumn);
-    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_update4\"; DROP TRIGGER \"rtree_%w_%w_update3\"; DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
-        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+    if (argc == 1 || sqlite3_value_type(argv[0]) != SQLITE_NULL)
+        return SQLITE_READONLY;
 
-    // Register GPKG Extension
-    sql = sqlite3_mprintf("INSERT INTO gpkg_extensions(table_name, column_name, extension_name, definition, scope)  VALUES(%Q, %Q, 'gpkg_rtree_index', 'F.3 RTree Spatial Index', 'write-only')",
-        table, gcolumn);
-    errsql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_delete\"; DROP TRIGGER \"rtree_%w_%w_update4\"; DROP TRIGGER \"rtree_%w_%w_update3\"; DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
-        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+    // Read the envelopes
+    for (int i = 0; i < 2; i++)
+    {
+        has[i] = sqlite3_value_type(values[DIRTYREGION_OLD + i]) == SQLITE_BLOB &&
+            readGPKGEnvelope((unsigned char *)sqlite3_value_blob(values[DIRTYREGION_OLD + i]), sqlite3_value_bytes(values[DIRTYREGION_OLD + i]), env[i]);
+        if (has[i] && sqlite3_value_int(values[DIRTYREGION_SRS]) == 4326)
+        {
+            lonLatToWebMercator(env[i][0], env[i][1], &env[i][0], &env[i][1]);
+            lonLatToWebMercator(env[i][2], env[i][3], &env[i][2], &env[i][3]);
+        }
+    }
+    *rowid = 0;
+    if (has[0] && has[1] && memcmp(env[0], env[1], sizeof(env[0])) == 0)
+        has[0] = 0;
 
-    // Populate rtree
-    sql = sqlite3_mprintf("INSERT OR REPLACE INTO \"rtree_%w_%w\" SELECT \"%w\", ST_MinX(\"%w\"), ST_MaxX(\"%w\"), ST_MinY(\"%w\"), ST_MaxY(\"%w\") FROM \"%w\"",
-        table, gcolumn, icolumn, gcolumn, gcolumn, gcolumn, gcolumn, table);
-    errsql = sqlite3_mprintf("DELETE FROM gpkg_extensions where table_name = %Q AND column_name = %Q AND extension_name = 'gpkg_rtree_index'; DROP TRIGGER \"rtree_%w_%w_delete\"; DROP TRIGGER \"rtree_%w_%w_update4\"; DROP TRIGGER \"rtree_%w_%w_update3\"; DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
-        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+    // Log them
+    for (int i = 0; i < 2 && rc == SQLITE_OK; i++)
+    {
+        if (!has[i])
+            continue;
+        if (vtab->insertStmt == NULL)
+            rc = sqlite3_prepare_v2(vtab->db, "INSERT INTO gpkgext_dirty_region(table_name, column_name, min_x, min_y, max_x, max_y) VALUES(?, ?, ?, ?, ?, ?)", -1, &vtab->insertStmt, NULL);
+        if (rc != SQLITE_OK)
+            break;
+        sqlite3_bind_value(vtab->insertStmt, 1, values[DIRTYREGION_TABLE]);
+        sqlite3_bind_value(vtab->insertStmt, 2, values[DIRTYREGION_COLUMN]);
+        for (int j = 0; j < 4; j++)
+            sqlite3_bind_double(vtab->insertStmt, 3 + j, env[i][j]);
+        rc = sqlite3_step(vtab->insertStmt);
+        sqlite3_reset(vtab->insertStmt);
+        rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+    }
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_free(vtab->base.zErrMsg);
+        vtab->base.zErrMsg = sqlite3_mprintf("GPKG_DirtyRegionUpdate error: %s", sqlite3_errmsg(vtab->db));
+    }
+    return rc;
 }
 
-// SQL function: GPKG_DropSpatialIndex(table, geometryColumn, idColumn); 
-// tableName -> Name of the table
-// geometryColumn -> Column that contains the geometry
-// idColumn -> Column that is the PrimaryKey of the table
-// Drops a spatial index of a table and the corresponding triggers to maintain the integrity between the spatial index and the table
-// Unregisters the gpkg extension gpkg_rtree_index
-// On success returns nothing. If there is an error throw an exception
-static void fnct_GPKGDropSpatialIndex(sqlite3_context *context, int argc, sqlite3_value **argv)
+static sqlite3_module dirtyRegionModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    dirtyRegionConnect,      // xConnect
+    hookTableBestIndex,      // xBestIndex
+    dirtyRegionDisconnect,   // xDisconnect
+    0,                       // xDestroy
+    hookTableOpen,           // xOpen
+    hookTableClose,          // xClose
+    hookTableFilter,         // xFilter
+    hookTableNext,           // xNext
+    hookTableEof,            // xEof
+    hookTableColumn,         // xColumn
+    hookTableRowid,          // xRowid
+    dirtyRegionUpdate,       // xUpdate
+    0, 0, 0, 0, 0, 0         // xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Table-valued function: GPKG_DirtyTiles(zoom, tableName)
+// Returns the XYZ tiles (Web Mercator, y from the north) of a zoom level that intersect the envelopes logged in gpkgext_dirty_region,
+// without duplicates and sorted by x and y
+// zoom -> Zoom level, from 0 to QUADKEY_MAX_ZOOM
+// tableName -> optional parameter. Only the envelopes of this table. If not specified all the envelopes
+// At most DIRTY_TILES_MAX_TILES tiles are returned
+// Usage: SELECT x, y FROM GPKG_DirtyTiles(14)
+
+// Columns of GPKG_DirtyTiles
+#define DIRTYTILES_X 0
+#define DIRTYTILES_Y 1
+#define DIRTYTILES_ZOOM 2
+#define DIRTYTILES_TABLE 3
+#define DIRTYTILES_SCHEMA "CREATE TABLE x(x, y, zoom HIDDEN, table_name HIDDEN)"
+
+// Cursor of GPKG_DirtyTiles
+typedef struct dirtyTilesCursor
+{
+    sqlite3_vtab_cursor base; // Base class. Must be first
+    sqlite3_uint64 *tiles;    // Tiles (x in the high 32 bits and y in the low ones), sorted
+    int numTiles, maxTiles;
+    int tile;                 // Current tile
+} dirtyTilesCursor;
+
+// Compares two tiles for qsort
+static int compareTiles(const void *a, const void *b)
+{
+    sqlite3_uint64 ta = *(const sqlite3_uint64 *)a;
+    sqlite3_uint64 tb = *(const sqlite3_uint64 *)b;
+
+    return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+// Sorts the tiles of a cursor and removes the duplicates
+static void uniqueTiles(dirtyTilesCursor *cur)
 {
-    const char *table;
-    const char *gcolumn;
-    sqlite3 *db;
-    char *sql;
+    int n = 0;
+
+    if (cur->numTiles > 0)
+        qsort(cur->tiles, cur->numTiles, sizeof(sqlite3_uint64), compareTiles);
+    for (int i = 0; i < cur->numTiles; i++)
+        if (n == 0 || cur->tiles[i] != cur->tiles[n - 1])
+            cur->tiles[n++] = cur->tiles[i];
+    cur->numTiles = n;
+}
 
-    // Get the parameters
-    table = (const char *)sqlite3_value_text(argv[0]);
-    gcolumn = (const char *)sqlite3_value_text(argv[1]);
+// Returns the tile of a zoom level where a Web Mercator ordinate falls
+// value -> Ordinate in meters. Y grows to the south
+// n -> Number of tiles of each side of the zoom level
+static unsigned int webMercatorTile(double value, unsigned int n)
+{
+    double t = (value + WEB_MERCATOR_HALF_SIZE) / (2 * WEB_MERCATOR_HALF_SIZE);
 
-    // Get DB handle
-    db = sqlite3_context_db_handle(context);
+    return t <= 0 ? 0 : (t >= 1 ? n - 1 : (unsigned int)(t * n));
+}
 
-    // Drop triggers and RTree
-    sql = sqlite3_mprintf("DROP TRIGGER \"rtree_%w_%w_delete\"; DROP TRIGGER \"rtree_%w_%w_update4\"; DROP TRIGGER \"rtree_%w_%w_update3\"; DROP TRIGGER \"rtree_%w_%w_update2\"; DROP TRIGGER \"rtree_%w_%w_update1\"; DROP TRIGGER \"rtree_%w_%w_insert\"; DROP TABLE \"rtree_%w_%w\"",
-        table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn, table, gcolumn);
-    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
-        return;
+// Opens a cursor on GPKG_DirtyTiles
+static int dirtyTilesOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    dirtyTilesCursor *cur;
+
+    cur = (dirtyTilesCursor *)sqlite3_malloc(sizeof(dirtyTilesCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(dirtyTilesCursor));
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
 
-    // Remove GPKG Extension
-    sql = sqlite3_mprintf("DELETE FROM gpkg_extensions WHERE LOWER(table_name) = LOWER(%Q) AND LOWER(column_name) = LOWER(%Q) AND extension_name = 'gpkg_rtree_index'",
-        table, gcolumn);
-    sqlite3_exec_free(context, db, sql, NULL);
+// Closes a cursor on GPKG_DirtyTiles
+static int dirtyTilesClose(sqlite3_vtab_cursor *cursor)
+{
+    dirtyTilesCursor *cur = (dirtyTilesCursor *)cursor;
+
+    sqlite3_free(cur->tiles);
+    sqlite3_free(cur);
+    return SQLITE_OK;
 }
 
-// SQL function: GPKG_ExtVersion(); 
-// Returns an string showing the version of this extension
-// On success returns nothing. If there is an error throw an exception
-static void fnct_GPKGExtVersion(sqlite3_context *context, int argc, sqlite3_value **argv)
+static int dirtyTilesBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
 {
-    sqlite3_result_text(context, VERSION, -1, NULL);
+    return tableFunctionBestIndex(info, DIRTYTILES_ZOOM, DIRTYTILES_TABLE, 1 << DIRTYTILES_ZOOM);
 }
 
-// SQL function: GPKG_Version(); 
-// Returns an integer showing the GeoPackage version
-// Is the value stored as PRAGMA user_version
-// On success returns nothing. If there is an error throw an exception
-static void fnct_GPKGVersion(sqlite3_context *context, int argc, sqlite3_value **argv)
+// Computes the tiles of the envelopes logged. When the buffer is full the tiles are sorted and the duplicates removed
+// before growing it
+static int dirtyTilesFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
 {
-    sqlite3 *db;
-    char *sql;
+    dirtyTilesCursor *cur = (dirtyTilesCursor *)cursor;
+    sqlite3 *db = ((tableFunctionVtab *)cursor->pVtab)->db;
     sqlite3_stmt *stmt;
-    int ret;
-    int version = 0;
+    unsigned int n, x0, x1, y0, y1;
+    int rc;
 
-    // Get DB handle
-    db = sqlite3_context_db_handle(context);
+    cur->numTiles = cur->tile = 0;
+    if ((idxNum & (1 << DIRTYTILES_ZOOM)) == 0)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_DirtyTiles() error: zoom is mandatory");
+        return SQLITE_ERROR;
+    }
+    if (sqlite3_value_type(argv[0]) != SQLITE_INTEGER || sqlite3_value_int(argv[0]) < 0 || sqlite3_value_int(argv[0]) > QUADKEY_MAX_ZOOM)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_DirtyTiles() error: argument 1 [zoom] must be an integer between 0 and 23");
+        return SQLITE_ERROR;
+    }
+    n = 1u << sqlite3_value_int(argv[0]);
 
-    // Query the version
-    sql = sqlite3_mprintf("PRAGMA user_version");
-    ret = sqlite3_prepare_v2(db, sql, (int)strlen(sql), &stmt, NULL);
-    if (ret != SQLITE_OK)
+    if (idxNum & (1 << DIRTYTILES_TABLE))
     {
-        sqlite3_result_error(context, "GPKG_Version() error", -1);
-        return;
+        rc = sqlite3_prepare_v2(db, "SELECT min_x, min_y, max_x, max_y FROM gpkgext_dirty_region WHERE LOWER(table_name) = LOWER(?)", -1, &stmt, NULL);
+        if (rc == SQLITE_OK)
+            sqlite3_bind_value(stmt, 1, argv[1]);
     }
-    ret = sqlite3_step(stmt);
-    if (ret == SQLITE_ROW)
-        version = sqlite3_column_int(stmt, 0);
     else
+        rc = sqlite3_prepare_v2(db, "SELECT min_x, min_y, max_x, max_y FROM gpkgext_dirty_region", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
     {
-        sqlite3_result_error(context, "GPKG_Version() version undefined", -1);
-        return;
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_DirtyTiles() error: %s", sqlite3_errmsg(db));
+        return rc;
+    }
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        x0 = webMercatorTile(sqlite3_column_double(stmt, 0), n);
+        x1 = webMercatorTile(sqlite3_column_double(stmt, 2), n);
+        y0 = webMercatorTile(-sqlite3_column_double(stmt, 3), n);
+        y1 = webMercatorTile(-sqlite3_column_double(stmt, 1), n);
+        if ((sqlite3_uint64)(x1 - x0 + 1) * (y1 - y0 + 1) > DIRTY_TILES_MAX_TILES)
+        {
+            rc = SQLITE_TOOBIG;
+            break;
+        }
+        if (cur->numTiles + (sqlite3_int64)(x1 - x0 + 1) * (y1 - y0 + 1) > cur->maxTiles)
+        {
+            uniqueTiles(cur);
+            while (cur->numTiles + (sqlite3_int64)(x1 - x0 + 1) * (y1 - y0 + 1) > cur->maxTiles / 2)
+            {
+                sqlite3_uint64 *tiles;
+                if (cur->maxTiles > DIRTY_TILES_MAX_TILES)
+                {
+                    rc = SQLITE_TOOBIG;
+                    break;
+                }
+                tiles = (sqlite3_uint64 *)sqlite3_realloc64(cur->tiles, sizeof(sqlite3_uint64) * (cur->maxTiles * 2 + 1024));
+                if (tiles == NULL)
+                {
+                    rc = SQLITE_NOMEM;
+                    break;
+                }
+                cur->tiles = tiles;
+                cur->maxTiles = cur->maxTiles * 2 + 1024;
+            }
+            if (rc != SQLITE_ROW)
+                break;
+        }
+        for (sqlite3_uint64 x = x0; x <= x1; x++)
+            for (sqlite3_uint64 y = y0; y <= y1; y++)
+                cur->tiles[cur->numTiles++] = (x << 32) | y;
     }
     sqlite3_finalize(stmt);
+    if (rc == SQLITE_TOOBIG)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_DirtyTiles() error: more than %d tiles, use a lower zoom", DIRTY_TILES_MAX_TILES);
+        return SQLITE_ERROR;
+    }
+    if (rc != SQLITE_DONE)
+        return rc;
+    uniqueTiles(cur);
+    if (cur->numTiles > DIRTY_TILES_MAX_TILES)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_DirtyTiles() error: more than %d tiles, use a lower zoom", DIRTY_TILES_MAX_TILES);
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
 
-    // Return the result
-    sqlite3_result_int(context, version);
+// Moves the cursor to the next tile
+static int dirtyTilesNext(sqlite3_vtab_cursor *cursor)
+{
+    ((dirtyTilesCursor *)cursor)->tile++;
+    return SQLITE_OK;
 }
 
-// SQL function: GPKG_Initialize(version); 
-// Creates the base tables for an empty GeoPackage
-// version -> optional parameter must be 10200 or 10300. If not specified assumes 10300.
-// On success returns nothing. If there is an error throw an exception
-static void fnct_GPKGInitialize(sqlite3_context *context, int argc, sqlite3_value **argv)
+// Returns 1 if there are no more tiles
+static int dirtyTilesEof(sqlite3_vtab_cursor *cursor)
 {
-    sqlite3 *db;
-    char *sql, *errsql;
-    int userVersion = GPKG_VERSION_10300;
+    dirtyTilesCursor *cur = (dirtyTilesCursor *)cursor;
 
-    // Get the parameters
-    if (argc == 1)
-    {
-        userVersion = sqlite3_value_int(argv[0]);
-        if (userVersion != GPKG_VERSION_10200 && userVersion != GPKG_VERSION_10300)
-        {
-            sqlite3_result_error(context, "GPKG_Initialize() error: argument 1 [version] unsupported value. Must be 10200 or 10300.", -1);
-            return;
-        }
-    }
+    return cur->tile >= cur->numTiles;
+}
 
-    // Get DB handle
-    db = sqlite3_context_db_handle(context);
+// Returns the x or y of the tile. The hidden columns are the parameters
+static int dirtyTilesColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    dirtyTilesCursor *cur = (dirtyTilesCursor *)cursor;
 
-    // Set Application ID (Clause 1.1.1.1.1 Req 2)
-    sql = sqlite3_mprintf("PRAGMA application_id = %d", GPKG_APPLICATION_ID);
-    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
-        return;
+    if (column == DIRTYTILES_X)
+        sqlite3_result_int64(context, (sqlite3_int64)(cur->tiles[cur->tile] >> 32));
+    else if (column == DIRTYTILES_Y)
+        sqlite3_result_int64(context, (sqlite3_int64)(cur->tiles[cur->tile] & 0xffffffff));
+    return SQLITE_OK;
+}
 
-    // Set User Version (Clause 1.1.1.1.1 Req 2)
-    sql = sqlite3_mprintf("PRAGMA user_version = %d", userVersion);
-    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
-        return;
+// The rowid is the number of the tile
+static int dirtyTilesRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = ((dirtyTilesCursor *)cursor)->tile + 1;
+    return SQLITE_OK;
+}
 
-    // C.1. gpkg_spatial_ref_sys
-    sql = sqlite3_mprintf("CREATE TABLE gpkg_spatial_ref_sys(\n   srs_name TEXT NOT NULL,\n   srs_id INTEGER NOT NULL PRIMARY KEY,\n   organization TEXT NOT NULL,\n   organization_coordsys_id INTEGER NOT NULL,\n   definition TEXT NOT NULL,\n   description TEXT\n)");
-    if (sqlite3_exec_free(context, db, sql, NULL) != SQLITE_OK)
-        return;
+static sqlite3_module dirtyTilesModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    tableFunctionConnect,    // xConnect
+    dirtyTilesBestIndex,     // xBestIndex
+    tableFunctionDisconnect, // xDisconnect
+    0,                       // xDestroy
+    dirtyTilesOpen,          // xOpen
+    dirtyTilesClose,         // xClose
+    dirtyTilesFilter,        // xFilter
+    dirtyTilesNext,          // xNext
+    dirtyTilesEof,           // xEof
+    dirtyTilesColumn,        // xColumn
+    dirtyTilesRowid,         // xRowid
+    0, 0, 0, 0, 0, 0, 0       // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Write-only table: GPKG_ChangeLogUpdate(table_name, op, old_id, new_id, old_geom, new_geom)
+// Trigger hook of the change logs (GPKG_EnableChangeLog): each row inserted appends a change to changelog_tableName with the id,
+// the operation and the envelope of the feature. The table has no rows
+// table_name -> Name of the table
+// op -> CHANGELOG_INSERT, CHANGELOG_UPDATE or CHANGELOG_DELETE
+// old_id, new_id -> Row ID before and after the change (NULL on insert and on delete respectively)
+// old_geom, new_geom -> Geometry before and after the change. The envelope logged is the one of new_geom, or old_geom on delete
+// An update that changes the row ID is logged as a delete of the old id and an insert of the new one. Each geometry is parsed once
+// and the insert statements are cached by the connection
+// Usage: INSERT INTO GPKG_ChangeLogUpdate VALUES('parcels', 2, OLD.rowid, NEW.rowid, OLD.geom, NEW.geom)
+
+// Columns of GPKG_ChangeLogUpdate
+#define CHANGELOGUPDATE_TABLE 0
+#define CHANGELOGUPDATE_OP 1
+#define CHANGELOGUPDATE_OLDID 2
+#define CHANGELOGUPDATE_NEWID 3
+#define CHANGELOGUPDATE_OLDGEOM 4
+#define CHANGELOGUPDATE_NEWGEOM 5
+#define CHANGELOGUPDATE_SCHEMA "CREATE TABLE x(table_name, op, old_id, new_id, old_geom, new_geom)"
+
+// Insert statement of the change log of a table
+typedef struct changeLogStmt
+{
+    char *table;
+    sqlite3_stmt *stmt;
+    struct changeLogStmt *next; // Next cached statement
+} changeLogStmt;
 
-    // Default gpkg_spatial_ref_sys minimum records
-    sql = sqlite3_mprintf("INSERT INTO gpkg_spatial_ref_sys(srs_name, srs_id, organization, organization_coordsys_id, definition, description) VALUES('Undefined cartesian SRS', -1, 'NONE', -1, 'undefined', 'undefined cartesian coordinate reference system')");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
-    sql = sqlite3_mprintf("INSERT INTO gpkg_spatial_ref_sys(srs_name, srs_id, organization, organization_coordsys_id, definition, description) VALUES('Undefined geographic SRS ', 0, 'NONE', 0, 'undefined', 'undefined geographic coordinate reference system')");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
-    sql = sqlite3_mprintf("INSERT INTO gpkg_spatial_ref_sys(srs_name, srs_id, organization, organization_coordsys_id, definition, description) VALUES('WGS84', 4326, 'epsg', 4326, 'GEOGCS[\"WGS 84\",DATUM[\"WGS_1984\",SPHEROID[\"WGS 84\",6378137,298.257223563,AUTHORITY[\"EPSG\",\"7030\"]],AUTHORITY[\"EPSG\",\"6326\"]],PRIMEM[\"Greenwich\",0,AUTHORITY[\"EPSG\",\"8901\"]],UNIT[\"degree\",0.0174532925199433,AUTHORITY[\"EPSG\",\"9122\"]],AUTHORITY[\"EPSG\",\"4326\"]]', 'longitude/latitude coordinates in decimal degrees on the WGS 84 spheroid')");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+typedef struct changeLogVtab
+{
+    sqlite3_vtab base;
+    sqlite3 *db;
+    changeLogStmt *stmts; // Cached insert statements
+} changeLogVtab;
 
-    // C.2. gpkg_contents
-    sql = sqlite3_mprintf("CREATE TABLE gpkg_contents(\n   table_name TEXT NOT NULL PRIMARY KEY,\n   data_type TEXT NOT NULL,\n   identifier TEXT UNIQUE,\n   description TEXT DEFAULT '',\n   last_change DATETIME NOT NULL DEFAULT(strftime('%%Y-%%m-%%dT%%H:%%M:%%fZ', 'now')),\n   min_x DOUBLE,\n   min_y DOUBLE,\n   max_x DOUBLE,\n   max_y DOUBLE,\n   srs_id INTEGER,\n   CONSTRAINT fk_gc_r_srs_id FOREIGN KEY(srs_id) REFERENCES gpkg_spatial_ref_sys(srs_id)\n)");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+static int changeLogConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr)
+{
+    changeLogVtab *vtab;
+    int rc;
+
+    rc = sqlite3_declare_vtab(db, CHANGELOGUPDATE_SCHEMA);
+    if (rc != SQLITE_OK)
+        return rc;
+    vtab = (changeLogVtab *)sqlite3_malloc(sizeof(changeLogVtab));
+    if (vtab == NULL)
+        return SQLITE_NOMEM;
+    memset(vtab, 0, sizeof(changeLogVtab));
+    vtab->db = db;
+    *ppVtab = &vtab->base;
+    return SQLITE_OK;
+}
 
-    // C.3. gpkg_geometry_columns
-    sql = sqlite3_mprintf("CREATE TABLE gpkg_geometry_columns(\n   table_name TEXT NOT NULL,\n   column_name TEXT NOT NULL,\n   geometry_type_name TEXT NOT NULL,\n   srs_id INTEGER NOT NULL,\n   z TINYINT NOT NULL,\n   m TINYINT NOT NULL,\n   CONSTRAINT pk_geom_cols PRIMARY KEY(table_name, column_name),\n   CONSTRAINT fk_gc_tn FOREIGN KEY(table_name) REFERENCES gpkg_contents(table_name),\n   CONSTRAINT fk_gc_srs FOREIGN KEY(srs_id) REFERENCES gpkg_spatial_ref_sys(srs_id)\n)");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+static int changeLogDisconnect(sqlite3_vtab *pVtab)
+{
+    changeLogVtab *vtab = (changeLogVtab *)pVtab;
+    changeLogStmt *cached;
 
-    // C.5. gpkg_tile_matrix_set
-    sql = sqlite3_mprintf("CREATE TABLE gpkg_tile_matrix_set(\n   table_name TEXT NOT NULL PRIMARY KEY,\n   srs_id INTEGER NOT NULL,\n   min_x DOUBLE NOT NULL,\n   min_y DOUBLE NOT NULL,\n   max_x DOUBLE NOT NULL,\n   max_y DOUBLE NOT NULL,\n   CONSTRAINT fk_gtms_table_name FOREIGN KEY(table_name) REFERENCES gpkg_contents(table_name),\n   CONSTRAINT fk_gtms_srs FOREIGN KEY(srs_id) REFERENCES gpkg_spatial_ref_sys(srs_id)\n)");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+    while (vtab->stmts != NULL)
+    {
+        cached = vtab->stmts;
+        vtab->stmts = cached->next;
+        sqlite3_finalize(cached->stmt);
+        sqlite3_free(cached->table);
+        sqlite3_free(cached);
+    }
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
 
-    // C.6. gpkg_tile_matrix
-    sql = sqlite3_mprintf("CREATE TABLE gpkg_tile_matrix(\n   table_name TEXT NOT NULL,\n   zoom_level INTEGER NOT NULL,\n   matrix_width INTEGER NOT NULL,\n   matrix_height INTEGER NOT NULL,\n   tile_width INTEGER NOT NULL,\n   tile_height INTEGER NOT NULL,\n   pixel_x_size DOUBLE NOT NULL,\n   pixel_y_size DOUBLE NOT NULL,\n   CONSTRAINT pk_ttm PRIMARY KEY(table_name, zoom_level),\n   CONSTRAINT fk_tmm_table_name FOREIGN KEY(table_name) REFERENCES gpkg_contents(table_name)\n)");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+// Appends a change to the change log of a table
+// vtab -> GPKG_ChangeLogUpdate
+// table -> Name of the table
+// op -> Operation
+// id -> Row ID of the feature
+// geom -> Geometry whose envelope is logged (may be NULL)
+// Returns SQLITE_OK if it's correct or an SQLite error code
+static int appendChange(changeLogVtab *vtab, const char *table, int op, sqlite3_value *id, sqlite3_value *geom)
+{
+    changeLogStmt *cached;
+    double env[4];
+    char *sql;
+    int rc;
 
-    // D.1. gpkg_tile_matrix triggers
-    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_zoom_level_insert' BEFORE INSERT ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'insert on table ''gpkg_tile_matrix'' violates constraint: zoom_level cannot be less than 0') WHERE (NEW.zoom_level < 0);\nEND;");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+    for (cached = vtab->stmts; cached != NULL; cached = cached->next)
+        if (strcmp(cached->table, table) == 0)
+            break;
+    if (cached == NULL)
+    {
+        cached = (changeLogStmt *)sqlite3_malloc(sizeof(changeLogStmt));
+        if (cached == NULL)
+            return SQLITE_NOMEM;
+        memset(cached, 0, sizeof(changeLogStmt));
+        cached->table = sqlite3_mprintf("%s", table);
+        sql = sqlite3_mprintf("INSERT INTO \"changelog_%w\"(id, op, min_x, min_y, max_x, max_y) VALUES(?, ?, ?, ?, ?, ?)", table);
+        rc = cached->table == NULL || sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(vtab->db, sql, -1, &cached->stmt, NULL);
+        sqlite3_free(sql);
+        if (rc != SQLITE_OK)
+        {
+            sqlite3_free(cached->table);
+            sqlite3_free(cached);
+            return rc;
+        }
+        cached->next = vtab->stmts;
+        vtab->stmts = cached;
+    }
 
-    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_zoom_level_update' BEFORE UPDATE of zoom_level ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'update on table ''gpkg_tile_matrix'' violates constraint: zoom_level cannot be less than 0') WHERE (NEW.zoom_level < 0);\nEND;");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+    sqlite3_bind_value(cached->stmt, 1, id);
+    sqlite3_bind_int(cached->stmt, 2, op);
+    if (sqlite3_value_type(geom) == SQLITE_BLOB && readGPKGEnvelope((unsigned char *)sqlite3_value_blob(geom), sqlite3_value_bytes(geom), env))
+    {
+        for (int i = 0; i < 4; i++)
+            sqlite3_bind_double(cached->stmt, 3 + i, env[i]);
+    }
+    else
+    {
+        for (int i = 0; i < 4; i++)
+            sqlite3_bind_null(cached->stmt, 3 + i);
+    }
+    rc = sqlite3_step(cached->stmt);
+    sqlite3_reset(cached->stmt);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
 
-    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_matrix_width_insert' BEFORE INSERT ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'insert on table ''gpkg_tile_matrix'' violates constraint: matrix_width cannot be less than 1') WHERE (NEW.matrix_width < 1);\nEND;");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+// Inserting a row appends the change to the change log of the table. Updates and deletes are not allowed
+static int changeLogUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite_int64 *rowid)
+{
+    changeLogVtab *vtab = (changeLogVtab *)pVtab;
+    sqlite3_value **values = argv + 2;
+    const char *table;
+    int op;
+    int rc;
+
+    if (argc == 1 || sqlite3_value_type(argv[0]) != SQLITE_NULL)
+        return SQLITE_READONLY;
+    *rowid = 0;
+
+    table = (const char *)sqlite3_value_text(values[CHANGELOGUPDATE_TABLE]);
+    op = sqlite3_value_int(values[CHANGELOGUPDATE_OP]);
+    if (table == NULL)
+        return SQLITE_OK;
+    if (op == CHANGELOG_INSERT)
+        rc = appendChange(vtab, table, op, values[CHANGELOGUPDATE_NEWID], values[CHANGELOGUPDATE_NEWGEOM]);
+    else if (op == CHANGELOG_DELETE)
+        rc = appendChange(vtab, table, op, values[CHANGELOGUPDATE_OLDID], values[CHANGELOGUPDATE_OLDGEOM]);
+    else if (sqlite3_value_int64(values[CHANGELOGUPDATE_OLDID]) == sqlite3_value_int64(values[CHANGELOGUPDATE_NEWID]))
+        rc = appendChange(vtab, table, op, values[CHANGELOGUPDATE_NEWID], values[CHANGELOGUPDATE_NEWGEOM]);
+    else
+    {
+        rc = appendChange(vtab, table, CHANGELOG_DELETE, values[CHANGELOGUPDATE_OLDID], values[CHANGELOGUPDATE_OLDGEOM]);
+        if (rc == SQLITE_OK)
+            rc = appendChange(vtab, table, CHANGELOG_INSERT, values[CHANGELOGUPDATE_NEWID], values[CHANGELOGUPDATE_NEWGEOM]);
+    }
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_free(vtab->base.zErrMsg);
+        vtab->base.zErrMsg = sqlite3_mprintf("GPKG_ChangeLogUpdate error: %s", sqlite3_errmsg(vtab->db));
+    }
+    return rc;
+}
 
-    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_matrix_width_update' BEFORE UPDATE OF matrix_width ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'update on table ''gpkg_tile_matrix'' violates constraint: matrix_width cannot be less than 1') WHERE (NEW.matrix_width < 1);\nEND;");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+static sqlite3_module changeLogModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    changeLogConnect,        // xConnect
+    hookTableBestIndex,      // xBestIndex
+    changeLogDisconnect,     // xDisconnect
+    0,                       // xDestroy
+    hookTableOpen,           // xOpen
+    hookTableClose,          // xClose
+    hookTableFilter,         // xFilter
+    hookTableNext,           // xNext
+    hookTableEof,            // xEof
+    hookTableColumn,         // xColumn
+    hookTableRowid,          // xRowid
+    changeLogUpdate,         // xUpdate
+    0, 0, 0, 0, 0, 0         // xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
+// Table-valued function: GPKG_ChangesSince(tableName, sequence)
+// Returns the last change of each feature of a table logged after a sequence number, sorted by sequence number, reading changelog_tableName
+// (see GPKG_EnableChangeLog)
+// tableName -> Name of the table
+// sequence -> optional parameter. Sequence number of the last change already processed. If not specified assumes 0 (all the changes)
+// The columns are the sequence number, the id of the feature, the operation ('insert', 'update' or 'delete') and the envelope
+// Usage: SELECT seq, id, op FROM GPKG_ChangesSince('parcels', 1234)
+
+// Columns of GPKG_ChangesSince
+#define CHANGESSINCE_SEQ 0
+#define CHANGESSINCE_ID 1
+#define CHANGESSINCE_OP 2
+#define CHANGESSINCE_MINX 3
+#define CHANGESSINCE_MINY 4
+#define CHANGESSINCE_MAXX 5
+#define CHANGESSINCE_MAXY 6
+#define CHANGESSINCE_TABLE 7
+#define CHANGESSINCE_SINCE 8
+#define CHANGESSINCE_SCHEMA "CREATE TABLE x(seq, id, op, min_x, min_y, max_x, max_y, table_name HIDDEN, since HIDDEN)"
+
+// Cursor of GPKG_ChangesSince
+typedef struct changesSinceCursor
+{
+    sqlite3_vtab_cursor base; // Base class. Must be first
+    sqlite3_stmt *stmt;       // Reads the changes
+    int eof;
+} changesSinceCursor;
 
-    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_matrix_height_insert' BEFORE INSERT ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'insert on table ''gpkg_tile_matrix'' violates constraint: matrix_height cannot be less than 1') WHERE (NEW.matrix_height < 1);\nEND;");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+// Opens a cursor on GPKG_ChangesSince
+static int changesSinceOpen(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor)
+{
+    changesSinceCursor *cur;
+
+    cur = (changesSinceCursor *)sqlite3_malloc(sizeof(changesSinceCursor));
+    if (cur == NULL)
+        return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(changesSinceCursor));
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
 
-    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_matrix_height_update' BEFORE UPDATE OF matrix_height ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'update on table ''gpkg_tile_matrix'' violates constraint: matrix_height cannot be less than 1') WHERE (NEW.matrix_height < 1);\nEND;");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+// Closes a cursor on GPKG_ChangesSince
+static int changesSinceClose(sqlite3_vtab_cursor *cursor)
+{
+    changesSinceCursor *cur = (changesSinceCursor *)cursor;
 
-    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_pixel_x_size_insert' BEFORE INSERT ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'insert on table ''gpkg_tile_matrix'' violates constraint: pixel_x_size must be greater than 0') WHERE NOT (NEW.pixel_x_size > 0);\nEND;");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+    sqlite3_finalize(cur->stmt);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
 
-    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_pixel_x_size_update' BEFORE UPDATE OF pixel_x_size ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'update on table ''gpkg_tile_matrix'' violates constraint: pixel_x_size must be greater than 0') WHERE NOT (NEW.pixel_x_size > 0);\nEND;");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+static int changesSinceBestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    return tableFunctionBestIndex(info, CHANGESSINCE_TABLE, CHANGESSINCE_SINCE, 1 << CHANGESSINCE_TABLE);
+}
 
-    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_pixel_y_size_insert' BEFORE INSERT ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'insert on table ''gpkg_tile_matrix'' violates constraint: pixel_y_size must be greater than 0') WHERE NOT (NEW.pixel_y_size > 0);\nEND;");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+// Moves the cursor to the next change
+static int changesSinceNext(sqlite3_vtab_cursor *cursor)
+{
+    changesSinceCursor *cur = (changesSinceCursor *)cursor;
+    int rc;
 
-    sql = sqlite3_mprintf("CREATE TRIGGER 'gpkg_tile_matrix_pixel_y_size_update' BEFORE UPDATE OF pixel_y_size ON 'gpkg_tile_matrix' FOR EACH ROW BEGIN\n   SELECT RAISE(ABORT, 'update on table ''gpkg_tile_matrix'' violates constraint: pixel_y_size must be greater than 0') WHERE NOT (NEW.pixel_y_size > 0);\nEND;");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+    rc = sqlite3_step(cur->stmt);
+    cur->eof = rc != SQLITE_ROW;
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_ChangesSince() error: %s", sqlite3_errmsg(((tableFunctionVtab *)cursor->pVtab)->db));
+        return rc;
+    }
+    return SQLITE_OK;
+}
 
-    // C.8. gpkg_extensions
-    sql = sqlite3_mprintf("CREATE TABLE gpkg_extensions(\n   table_name TEXT, column_name TEXT,\n   extension_name TEXT NOT NULL,\n   definition TEXT NOT NULL,\n   scope TEXT NOT NULL,\n   CONSTRAINT ge_tce UNIQUE(table_name, column_name, extension_name)\n)");
-    errsql = sqlite3_mprintf("DROP TABLE gpkg_tile_matrix; DROP TABLE gpkg_tile_matrix_set; DROP TABLE gpkg_geometry_columns; DROP TABLE gpkg_contents; DROP TABLE gpkg_spatial_ref_sys");
-    if (sqlite3_exec_free(context, db, sql, errsql) != SQLITE_OK)
-        return;
+// Queries the last change of each feature after the sequence number. The bare columns of the aggregate come from the row with MAX(seq)
+static int changesSinceFilter(sqlite3_vtab_cursor *cursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
+{
+    changesSinceCursor *cur = (changesSinceCursor *)cursor;
+    sqlite3 *db = ((tableFunctionVtab *)cursor->pVtab)->db;
+    char *sql;
+    int rc;
+
+    sqlite3_finalize(cur->stmt);
+    cur->stmt = NULL;
+    cur->eof = 1;
+    if ((idxNum & (1 << CHANGESSINCE_TABLE)) == 0 || sqlite3_value_type(argv[0]) != SQLITE_TEXT)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_ChangesSince() error: tableName is mandatory");
+        return SQLITE_ERROR;
+    }
+    sql = sqlite3_mprintf("SELECT MAX(seq) AS last, id, op, min_x, min_y, max_x, max_y FROM \"changelog_%w\" WHERE seq > ? GROUP BY id ORDER BY last",
+        (const char *)sqlite3_value_text(argv[0]));
+    rc = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(db, sql, -1, &cur->stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
+    {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("GPKG_ChangesSince() error: argument 1 [tableName] has no change log (%s)", sqlite3_errmsg(db));
+        return SQLITE_ERROR;
+    }
+    sqlite3_bind_int64(cur->stmt, 1, (idxNum & (1 << CHANGESSINCE_SINCE)) ? sqlite3_value_int64(argv[1]) : 0);
+    return changesSinceNext(cursor);
+}
+
+// Returns 1 if there are no more changes
+static int changesSinceEof(sqlite3_vtab_cursor *cursor)
+{
+    return ((changesSinceCursor *)cursor)->eof;
+}
+
+// Returns a column of the change. The hidden columns are the parameters
+static int changesSinceColumn(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column)
+{
+    static const char *ops[] = { "insert", "update", "delete" };
+    changesSinceCursor *cur = (changesSinceCursor *)cursor;
+    int op;
+
+    if (column == CHANGESSINCE_OP)
+    {
+        op = sqlite3_column_int(cur->stmt, CHANGESSINCE_OP);
+        if (op >= CHANGELOG_INSERT && op <= CHANGELOG_DELETE)
+            sqlite3_result_text(context, ops[op - CHANGELOG_INSERT], -1, SQLITE_STATIC);
+    }
+    else if (column <= CHANGESSINCE_MAXY)
+        sqlite3_result_value(context, sqlite3_column_value(cur->stmt, column));
+    return SQLITE_OK;
+}
+
+// The rowid is the sequence number
+static int changesSinceRowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+    *rowid = sqlite3_column_int64(((changesSinceCursor *)cursor)->stmt, CHANGESSINCE_SEQ);
+    return SQLITE_OK;
 }
 
+static sqlite3_module changesSinceModule = {
+    0,                       // iVersion
+    0,                       // xCreate (eponymous only)
+    tableFunctionConnect,    // xConnect
+    changesSinceBestIndex,   // xBestIndex
+    tableFunctionDisconnect, // xDisconnect
+    0,                       // xDestroy
+    changesSinceOpen,        // xOpen
+    changesSinceClose,       // xClose
+    changesSinceFilter,      // xFilter
+    changesSinceNext,        // xNext
+    changesSinceEof,         // xEof
+    changesSinceColumn,      // xColumn
+    changesSinceRowid,       // xRowid
+    0, 0, 0, 0, 0, 0, 0       // xUpdate, xBegin, xSync, xCommit, xRollback, xFindFunction, xRename
+};
+
 #ifdef _WIN32
 __declspec(dllexport)
 #endif
@@ -1608,14 +15890,76 @@ int sqlite3_gpkg_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *
     sqlite3_create_function_v2(db, "ST_MaxZ", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STMaxZ, 0, 0, 0);
     sqlite3_create_function_v2(db, "ST_MaxM", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STMaxM, 0, 0, 0);
     sqlite3_create_function_v2(db, "ST_IsEmpty", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STIsEmpty, 0, 0, 0);
-
+    sqlite3_create_function_v2(db, "ST_Intersects", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STIntersects, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_Intersects", 4, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STIntersects, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_Contains", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STContains, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_Contains", 4, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STContains, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_Within", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STWithin, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_Distance", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STDistance, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_X", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STX, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_Y", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STY, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_GeoHash", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STGeoHash, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_GeoHash", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STGeoHash, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_QuadKey", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STQuadKey, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_Transform", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STTransform, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_ByteOrder", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STByteOrder, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_GeometryHash", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STGeometryHash, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_EqualsExact", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STEqualsExact, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_SnapToGrid", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STSnapToGrid, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_ReducePrecision", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STReducePrecision, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_Triangulate", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STTriangulate, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_Triangulate", 3, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STTriangulate, 0, 0, 0);
+    sqlite3_create_function_v2(db, "ST_AsCoordArray", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_STAsCoordArray, 0, 0, 0);
+
+    sqlite3_create_function_v2(db, "GPKG_AddSRS", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGAddSRS, 0, 0, 0);
     sqlite3_create_function_v2(db, "GPKG_AddGeometryColumn", 7, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGAddGeometryColumn, 0, 0, 0);
     sqlite3_create_function_v2(db, "GPKG_AddSpatialIndex", 3, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGAddSpatialIndex, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_AddSpatialIndex", 4, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGAddSpatialIndex, 0, 0, 0);
     sqlite3_create_function_v2(db, "GPKG_DropSpatialIndex", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGDropSpatialIndex, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_DeleteInBox", 6, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGDeleteInBox, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_TranslateInBox", 8, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGTranslateInBox, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_TransformInPlace", 8, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGTransformInPlace, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_NormalizeByteOrder", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGNormalizeByteOrder, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_ReducePrecision", 3, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGReducePrecision, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_ExportArrow", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGExportArrow, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_ExportArrow", 3, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGExportArrow, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_ImportArrow", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGImportArrow, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_AddPointIndex", 3, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGAddPointIndex, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_AddPointIndex", 7, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGAddPointIndex, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_DropPointIndex", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGDropPointIndex, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_CreatePointOverview", 3, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGCreatePointOverview, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_CreatePointOverview", 7, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGCreatePointOverview, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_DropPointOverview", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGDropPointOverview, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_EnableDirtyTracking", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGEnableDirtyTracking, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_DisableDirtyTracking", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGDisableDirtyTracking, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_EnableChangeLog", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGEnableChangeLog, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_DisableChangeLog", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGDisableChangeLog, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_AddSegmentIndex", 3, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGAddSegmentIndex, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_AddSegmentIndex", 4, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGAddSegmentIndex, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_DropSegmentIndex", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGDropSegmentIndex, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_AnalyzeSpatial", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGAnalyzeSpatial, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_EstimateCount", 6, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGEstimateCount, 0, 0, 0);
+    sqlite3_create_function_v2(db, "GPKG_GridCount", 7, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, 0, fnct_GPKGGridCountStep, fnct_GPKGGridCountFinal, 0);
+    sqlite3_create_function_v2(db, "GPKG_HilbertKey", 6, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGHilbertKey, 0, 0, 0);
     sqlite3_create_function_v2(db, "GPKG_ExtVersion", 0, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGExtVersion, 0, 0, 0);
     sqlite3_create_function_v2(db, "GPKG_Version", 0, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGVersion, 0, 0, 0);
     sqlite3_create_function_v2(db, "GPKG_Initialize", 0, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGInitialize, 0, 0, 0);
     sqlite3_create_function_v2(db, "GPKG_Initialize", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, fnct_GPKGInitialize, 0, 0, 0);
 
+    sqlite3_create_module(db, "GPKG_SpatialWindow", &spatialWindowModule, (void *)SPATIALWINDOW_SCHEMA);
+    sqlite3_create_module(db, "GPKG_PointWindow", &pointWindowModule, (void *)POINTWINDOW_SCHEMA);
+    sqlite3_create_module(db, "GPKG_PointKNN", &pointKNNModule, (void *)POINTKNN_SCHEMA);
+    sqlite3_create_module(db, "GPKG_SpatialJoin", &spatialJoinModule, (void *)SPATIALJOIN_SCHEMA);
+    sqlite3_create_module(db, "GPKG_PointsInPolygons", &pointsInPolygonsModule, (void *)POINTSINPOLYGONS_SCHEMA);
+    sqlite3_create_module(db, "GPKG_NearestJoin", &nearestJoinModule, (void *)NEARESTJOIN_SCHEMA);
+    sqlite3_create_module(db, "GPKG_Layer", &layerModule, NULL);
+    sqlite3_create_module(db, "GPKG_FlatGeobuf", &fgbModule, NULL);
+    sqlite3_create_module(db, "ST_Subdivide", &subdivideModule, (void *)SUBDIVIDE_SCHEMA);
+    sqlite3_create_module(db, "GPKG_PointOverviewUpdate", &pointOverviewModule, NULL);
+    sqlite3_create_module(db, "GPKG_DirtyRegionUpdate", &dirtyRegionModule, NULL);
+    sqlite3_create_module(db, "GPKG_DirtyTiles", &dirtyTilesModule, (void *)DIRTYTILES_SCHEMA);
+    sqlite3_create_module(db, "GPKG_ChangeLogUpdate", &changeLogModule, NULL);
+    sqlite3_create_module(db, "GPKG_ChangesSince", &changesSinceModule, (void *)CHANGESSINCE_SCHEMA);
+
     return rc;
 }
\ No newline at end of file